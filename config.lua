@@ -17,6 +17,7 @@ audio =
     music_volume = 0.9;
     use_effects = 1;
     listener_is_player = 0;
+    preload_samples = 1;                        -- decode level sound samples in background after loading
     stream_buffer_size = 128;
 }
 
@@ -30,6 +31,9 @@ render =
     antialias_samples = 4;                      -- Maximum depends and is limited by hardware capabilities.
     z_depth = 24;                               -- Maximum and recommended is 24.
     texture_border = 16;
+    static_batching = 1;                        -- merge static meshes of every room into one buffer
+    occlusion = 0;                              -- CPU occlusion culling of rooms, statics and entities (experimental)
+    transparency_mode = 1;                      -- 0 - per frame BSP, 1 - sorted meshes (console: r_transparency)
     fog_color = {r = 255, g = 255, b = 255};
 }
 
@@ -1,6 +1,7 @@
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_audio.h>
+#include <pthread.h>
 
 #include <math.h>
 
@@ -18,6 +19,7 @@ extern "C" {
 #include "../core/vmath.h"
 #include "../core/gl_text.h"
 #include "../core/console.h"
+#include "../core/jobs.h"
 #include "../script/script.h"
 #include "../render/camera.h"
 #include "../vt/vt_level.h"
@@ -121,13 +123,20 @@ private:
 };
 
 
+#define TR_AUDIO_STREAM_LOAD_NONE       (0)
+#define TR_AUDIO_STREAM_LOAD_PENDING    (1)     // decoding job is submitted
+#define TR_AUDIO_STREAM_LOAD_DONE       (2)
+#define TR_AUDIO_STREAM_LOAD_FAILED     (3)
+
+// Track is found in script on the main thread, but decoded by job thread; streaming thread waits for load_state.
 class StreamTrackBuffer
 {
 public:
     StreamTrackBuffer();
    ~StreamTrackBuffer();
 
-    bool Load(int track_index);
+    bool Prepare(int track_index);
+    bool Load();
 
 private:
     bool Load_Ogg(const char *path);                        // Ogg file loading routine.
@@ -137,6 +146,11 @@ private:
 
 public:
     int             track_index;
+    int             load_method;
+    int             load_state;
+    int             play_result;        // TR_AUDIO_STREAMPLAY_*: errors are set by streaming thread
+    job_t           load_job;
+    char            file_path[1024];
     uint32_t        buffer_size;
     uint32_t        buffer_part;
     uint8_t        *buffer;
@@ -155,6 +169,8 @@ bool Audio_FillALBuffer(ALuint buf_number, Uint8* buffer_data, Uint32 buffer_siz
 int  Audio_LoadALbufferFromWAV_Mem(ALuint buf_number, uint8_t *sample_pointer, uint32_t sample_size, uint32_t uncomp_sample_size = 0);
 int  Audio_LoadALbufferFromWAV_File(ALuint buf_number, const char *fname);
 void Audio_LoadOverridedSamples();
+static void Audio_LoadSample(uint32_t index);       // Fill AL buffer of the sample on first play.
+static void Audio_UpdateSamples();                  // Upload samples decoded in background.
 
 int  Audio_GetFreeSource();
 int  Audio_GetFreeStream();                         // Get free (stopped) stream.
@@ -173,6 +189,9 @@ int  Audio_IsTrackPlaying(uint32_t track_index);
 // ==== STREAMTRACK BUFFER CLASS IMPLEMENTATION =====
 StreamTrackBuffer::StreamTrackBuffer() :
     track_index(-1),
+    load_method(0),
+    load_state(TR_AUDIO_STREAM_LOAD_NONE),
+    play_result(TR_AUDIO_STREAMPLAY_IGNORED),
     buffer_size(0),
     buffer(NULL),
     stream_type(TR_AUDIO_STREAM_TYPE_ONESHOT),
@@ -194,36 +213,31 @@ StreamTrackBuffer::~StreamTrackBuffer()
 }
 
 
-bool StreamTrackBuffer::Load(int track_index)
+/// Gets track file info from script, main thread only.
+bool StreamTrackBuffer::Prepare(int track_index)
 {
-    if(this->track_index < 0)
-    {
-        this->track_index = track_index;
-        char file_path[1024];
-        int load_method = 0;
+    this->track_index = track_index;
+    return Script_GetSoundtrack(engine_lua, track_index, file_path, sizeof(file_path), &load_method, &stream_type);
+}
 
-        if(!Script_GetSoundtrack(engine_lua, track_index, file_path, sizeof(file_path), &load_method, &stream_type))
-        {
-            return false;
-        }
 
-        switch(load_method)
-        {
-            case TR_AUDIO_STREAM_METHOD_OGG:
-                return Load_Ogg(file_path);
+/// Decodes whole track, may be called from any thread.
+bool StreamTrackBuffer::Load()
+{
+    switch(load_method)
+    {
+        case TR_AUDIO_STREAM_METHOD_OGG:
+            return Load_Ogg(file_path);
 
-            case TR_AUDIO_STREAM_METHOD_WAD:
-                return Load_Wad(file_path, track_index);
+        case TR_AUDIO_STREAM_METHOD_WAD:
+            return Load_Wad(file_path, track_index);
 
-            case TR_AUDIO_STREAM_METHOD_WAV:
-                return Load_Wav(file_path);
+        case TR_AUDIO_STREAM_METHOD_WAV:
+            return Load_Wav(file_path);
 
-            default:
-                return false;
-        }
+        default:
+            return false;
     }
-
-    return (this->buffer != NULL);
 }
 
 ///@TODO: fix vorbis streaming! ov_bitrate may differ in differ section
@@ -232,13 +246,13 @@ bool StreamTrackBuffer::Load_Ogg(const char *path)
     int err = 0;
     stb_vorbis_alloc alloc;
     alloc.alloc_buffer_length_in_bytes = 256 * 1024;
-    alloc.alloc_buffer = (char*)Sys_GetTempMem(alloc.alloc_buffer_length_in_bytes);
+    alloc.alloc_buffer = (char*)malloc(alloc.alloc_buffer_length_in_bytes);
     stb_vorbis *ov = stb_vorbis_open_filename(path, &err, &alloc);
 
     if(!ov)
     {
         Sys_DebugLog(SYS_LOG_FILENAME, "OGG: Couldn't open file: %s.", path);
-        Sys_ReturnTempMem(alloc.alloc_buffer_length_in_bytes);
+        free(alloc.alloc_buffer);
         return false;
     }
 
@@ -261,13 +275,13 @@ bool StreamTrackBuffer::Load_Ogg(const char *path)
         }
         buffer_size *= 2;
         stb_vorbis_close(ov);
-        Sys_ReturnTempMem(alloc.alloc_buffer_length_in_bytes);
+        free(alloc.alloc_buffer);
 
         if(buffer_size > 0)
         {
             buffer = (uint8_t*)malloc(buffer_size);
             memcpy(buffer, temp_buff, buffer_size);
-            Con_Notify("file \"%s\" loaded with rate=%d, bitrate=%.1f", path, rate, ((float)info.sample_rate / 1000.0f));
+            Sys_DebugLog(SYS_LOG_FILENAME, "file \"%s\" loaded with rate=%d, bitrate=%.1f", path, rate, ((float)info.sample_rate / 1000.0f));
         }
         free(temp_buff);
     }
@@ -405,7 +419,37 @@ bool StreamTrackBuffer::Load_WavRW(SDL_RWops *file)
 
 // ========== GLOBALS ==============
 ALfloat                     listener_position[3];
-struct audio_settings_s     audio_settings = {0};
+struct audio_settings_s     audio_settings = {};
+
+// Stream tracks are refilled and faded by streaming thread; any access to stream tracks
+// or to stream buffers array must be done with locked audio_streams_mutex.
+#define TR_AUDIO_STREAM_UPDATE_INTERVAL  (10)      // ms
+
+static pthread_t            audio_stream_thread;
+static int                  audio_stream_thread_active = 0;
+static volatile int         audio_stream_thread_stop = 0;
+static pthread_mutex_t      audio_streams_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+#define TR_AUDIO_SAMPLE_STATE_EMPTY      (0)       // not decoded yet
+#define TR_AUDIO_SAMPLE_STATE_DECODING   (1)       // taken by a job thread
+#define TR_AUDIO_SAMPLE_STATE_DECODED    (2)       // wav_buffer is ready to be uploaded
+#define TR_AUDIO_SAMPLE_STATE_LOADED     (3)       // AL buffer is filled (or sample is broken)
+
+/*
+ * Level sample block entry. Samples are decoded and uploaded on first play, or before it by warm-up job
+ * for all samples referenced by level sound map; AL buffers are filled on the main thread only.
+ */
+typedef struct audio_sample_decode_s
+{
+    uint8_t        *data;
+    uint32_t        size;
+    uint32_t        uncomp_size;
+    int             state;
+    SDL_AudioSpec   spec;
+    Uint8          *wav_buffer;
+    Uint32          wav_length;
+} audio_sample_decode_t, *audio_sample_decode_p;
 
 
 struct audio_world_data_s
@@ -420,6 +464,11 @@ struct audio_world_data_s
 
     uint32_t                        audio_buffers_count;    // Amount of samples.
     ALuint                         *audio_buffers;          // Samples.
+    uint8_t                        *samples_data;           // Level sample block, kept until samples are loaded.
+    struct audio_sample_decode_s   *samples;                // Sample block index, AL buffer is filled on first play.
+    uint32_t                        samples_warmup_count;   // Samples referenced by sound map, decoded in background.
+    uint32_t                       *samples_warmup;
+    job_t                           samples_warmup_job;
     uint32_t                        audio_sources_count;    // Amount of runtime channels.
     AudioSource                    *audio_sources;          // Channels.
 
@@ -754,11 +803,8 @@ int Audio_StreamPlay(uint32_t track_index, const uint8_t mask)
         return TR_AUDIO_STREAMPLAY_IGNORED;
     }
 
-    // lua_GetSoundtrack returns stream type, file path and load method in last three
-    // provided arguments. That is, after calling this function we receive stream type
-    // in "stream_type" argument, file path into "file_path" argument and load method into
-    // "load_method" argument. Function itself returns false, if script wasn't found or
-    // request was broken; in this case, we quit.
+    // Track file info is taken from script here, but decoding is done in background;
+    // stream starts to play from streaming thread as soon as track buffer is ready.
     if(!audio_world_data.stream_buffers[track_index])
     {
         Audio_CacheTrack(track_index);
@@ -785,10 +831,20 @@ int Audio_StreamPlay(uint32_t track_index, const uint8_t mask)
         Audio_StopStreams(stb->stream_type);
     }
 
+    pthread_mutex_lock(&audio_streams_mutex);
+    if(stb->load_state == TR_AUDIO_STREAM_LOAD_FAILED)
+    {
+        stb->play_result = TR_AUDIO_STREAMPLAY_LOADERROR;
+        pthread_mutex_unlock(&audio_streams_mutex);
+        Con_AddLine("StreamPlay: CANCEL, track load error.", FONTSTYLE_CONSOLE_WARNING);
+        return TR_AUDIO_STREAMPLAY_LOADERROR;
+    }
+
     // Entry found, now process to actual track loading.
     target_stream = Audio_GetFreeStream();            // At first, we need to get free stream.
     if(target_stream == -1)
     {
+        pthread_mutex_unlock(&audio_streams_mutex);
         Con_AddLine("StreamPlay: CANCEL, no free stream.", FONTSTYLE_CONSOLE_WARNING);
         return TR_AUDIO_STREAMPLAY_NOFREESTREAM;  // No success, exit and don't play anything.
     }
@@ -797,11 +853,42 @@ int Audio_StreamPlay(uint32_t track_index, const uint8_t mask)
     s->track = stb->track_index;
     s->type = stb->stream_type;
     s->state = TR_AUDIO_STREAM_PLAYING;
+    s->linked_buffers = 0;
+    s->buffer_offset = 0;
     s->current_volume = (s->type == TR_AUDIO_STREAM_TYPE_BACKGROUND) ? (0.0f) : (audio_settings.sound_volume);
+
+    if(audio_settings.use_effects)
+    {
+        StreamTrack_SetEffects(s, s->type == TR_AUDIO_STREAM_TYPE_CHAT);
+    }
+    stb->play_result = TR_AUDIO_STREAMPLAY_PROCESSED;   // streaming thread replaces it on load or play error
+    pthread_mutex_unlock(&audio_streams_mutex);
+
+    return TR_AUDIO_STREAMPLAY_PROCESSED;   // Everything is OK!
+}
+
+
+int Audio_StreamPlayResult(const uint32_t track_index)
+{
+    int ret = TR_AUDIO_STREAMPLAY_WRONGTRACK;
+
+    pthread_mutex_lock(&audio_streams_mutex);
+    if((track_index < audio_world_data.stream_buffers_count) && audio_world_data.stream_buffers[track_index])
+    {
+        ret = audio_world_data.stream_buffers[track_index]->play_result;
+    }
+    pthread_mutex_unlock(&audio_streams_mutex);
+
+    return ret;
+}
+
+
+static void Audio_FillStream(stream_track_p s, StreamTrackBuffer *stb)
+{
     while(StreamTrack_IsNeedUpdateBuffer(s) && (s->buffer_offset < stb->buffer_size))
     {
         size_t bytes = stb->buffer_part;
-        if(bytes > stb->buffer_size - s->buffer_offset)
+        if(bytes + s->buffer_offset > stb->buffer_size)
         {
             bytes = stb->buffer_size - s->buffer_offset;
         }
@@ -811,66 +898,104 @@ int Audio_StreamPlay(uint32_t track_index, const uint8_t mask)
         }
     }
 
-    if(audio_settings.use_effects)
+    if((s->buffer_offset >= stb->buffer_size) && (s->type == TR_AUDIO_STREAM_TYPE_BACKGROUND))
     {
-        StreamTrack_SetEffects(s, s->type == TR_AUDIO_STREAM_TYPE_CHAT);
+        s->buffer_offset = 0;
     }
-
-    if(StreamTrack_Play(s) <= 0)
-    {
-        Con_AddLine("StreamPlay: CANCEL, stream play error.", FONTSTYLE_CONSOLE_WARNING);
-        return TR_AUDIO_STREAMPLAY_PLAYERROR;
-    }
-
-    return TR_AUDIO_STREAMPLAY_PROCESSED;   // Everything is OK!
 }
 
 
-// Update routine for all streams. Should be placed into main loop.
+// Update routine for all streams, called from streaming thread with locked audio_streams_mutex.
 void Audio_UpdateStreams(float time)
 {
     stream_track_p s = audio_world_data.stream_tracks;
     for(uint32_t i = 0; i < audio_world_data.stream_tracks_count; ++i, ++s)
     {
-        if(StreamTrack_UpdateState(s, time, audio_settings.sound_volume))
-        {
-            StreamTrackBuffer *stb = ((s->track >= 0) && (s->track < audio_world_data.stream_buffers_count)) ?
-                (audio_world_data.stream_buffers[s->track]) : (NULL);
+        StreamTrackBuffer *stb = ((s->track >= 0) && (s->track < audio_world_data.stream_buffers_count)) ?
+            (audio_world_data.stream_buffers[s->track]) : (NULL);
 
-            while(stb && StreamTrack_IsNeedUpdateBuffer(s) && (s->buffer_offset < stb->buffer_size))
+        if((s->state != TR_AUDIO_STREAM_STOPPED) && (s->linked_buffers == 0))
+        {
+            // New stream: wait for track decoding, then fill the queue and start.
+            if(!stb || (stb->load_state == TR_AUDIO_STREAM_LOAD_FAILED) || (s->state == TR_AUDIO_STREAM_STOPPING))
             {
-                size_t bytes = stb->buffer_part;
-                if(bytes + s->buffer_offset > stb->buffer_size)
+                if(stb && (stb->load_state == TR_AUDIO_STREAM_LOAD_FAILED))
                 {
-                    bytes = stb->buffer_size - s->buffer_offset;
+                    stb->play_result = TR_AUDIO_STREAMPLAY_LOADERROR;
                 }
-                if(StreamTrack_UpdateBuffer(s, stb->buffer + s->buffer_offset, bytes, stb->sample_bitsize, stb->channels, stb->rate) <= 0)
+                StreamTrack_Stop(s);
+            }
+            else if((stb->load_state == TR_AUDIO_STREAM_LOAD_DONE) && (s->state == TR_AUDIO_STREAM_PLAYING))
+            {
+                Audio_FillStream(s, stb);
+                if(StreamTrack_Play(s) <= 0)
                 {
-                    break;
+                    stb->play_result = TR_AUDIO_STREAMPLAY_PLAYERROR;
+                    StreamTrack_Stop(s);
+                    s->state = TR_AUDIO_STREAM_STOPPED;                 // Stop does nothing with broken source
                 }
             }
+            continue;
+        }
 
-            if((s->buffer_offset >= stb->buffer_size) && (s->type == TR_AUDIO_STREAM_TYPE_BACKGROUND))
-            {
-                s->buffer_offset = 0;
-            }
+        if(StreamTrack_UpdateState(s, time, audio_settings.sound_volume) && stb)
+        {
+            Audio_FillStream(s, stb);
         }
     }
 }
 
 
+static void *Audio_StreamThreadFunc(void *data)
+{
+    Uint32 last_ticks = SDL_GetTicks();
+
+    (void)data;
+    pthread_mutex_lock(&audio_streams_mutex);
+    while(!audio_stream_thread_stop)
+    {
+        Uint32 ticks = SDL_GetTicks();
+        Audio_UpdateStreams((float)(ticks - last_ticks) / 1000.0f);
+        last_ticks = ticks;
+
+        pthread_mutex_unlock(&audio_streams_mutex);
+        SDL_Delay(TR_AUDIO_STREAM_UPDATE_INTERVAL);
+        pthread_mutex_lock(&audio_streams_mutex);
+    }
+    pthread_mutex_unlock(&audio_streams_mutex);
+
+    return NULL;
+}
+
+
+static void Audio_StopStreamThread()
+{
+    if(audio_stream_thread_active)
+    {
+        audio_stream_thread_stop = 1;
+        pthread_join(audio_stream_thread, NULL);
+        audio_stream_thread_active = 0;
+    }
+}
+
+
 int  Audio_IsTrackPlaying(uint32_t track_index)
 {
+    int ret = 0;
     stream_track_p s = audio_world_data.stream_tracks;
+
+    pthread_mutex_lock(&audio_streams_mutex);
     for(uint32_t i = 0; i < audio_world_data.stream_tracks_count; ++i, ++s)
     {
         if(s->track == track_index)
         {
-            return s->state != TR_AUDIO_STREAM_STOPPED;
+            ret = (s->state != TR_AUDIO_STREAM_STOPPED);
+            break;
         }
     }
+    pthread_mutex_unlock(&audio_streams_mutex);
 
-    return 0;
+    return ret;
 }
 
 
@@ -910,6 +1035,7 @@ int  Audio_TrackAlreadyPlayed(uint32_t track_index, int8_t mask)
 }
 
 
+// Called with locked audio_streams_mutex.
 int Audio_GetFreeStream()
 {
     int ret = TR_AUDIO_STREAMPLAY_NOFREESTREAM;
@@ -935,6 +1061,7 @@ int  Audio_StopStreams(int stream_type)
 {
     int ret = 0;
     stream_track_p s = audio_world_data.stream_tracks;
+    pthread_mutex_lock(&audio_streams_mutex);
     for(uint32_t i = 0; i < audio_world_data.stream_tracks_count; ++i, ++s)
     {
         if((stream_type == -1) || (s->type == stream_type))
@@ -942,6 +1069,7 @@ int  Audio_StopStreams(int stream_type)
             ret += (StreamTrack_Stop(s) > 0);
         }
     }
+    pthread_mutex_unlock(&audio_streams_mutex);
 
     return ret;
 }
@@ -951,6 +1079,7 @@ int  Audio_EndStreams(int stream_type)
 {
     int ret = 0;
     stream_track_p s = audio_world_data.stream_tracks;
+    pthread_mutex_lock(&audio_streams_mutex);
     for(uint32_t i = 0; i < audio_world_data.stream_tracks_count; ++i, ++s)
     {
         if((stream_type == -1) || (s->type == stream_type))
@@ -962,6 +1091,7 @@ int  Audio_EndStreams(int stream_type)
             }
         }
     }
+    pthread_mutex_unlock(&audio_streams_mutex);
 
     return ret;
 }
@@ -972,6 +1102,7 @@ int  Audio_PauseStreams(int stream_type)
     int ret = 0;
 
     stream_track_p s = audio_world_data.stream_tracks;
+    pthread_mutex_lock(&audio_streams_mutex);
     for(uint32_t i = 0; i < audio_world_data.stream_tracks_count; ++i, ++s)
     {
         if((stream_type == -1) || (s->type == stream_type))
@@ -979,6 +1110,7 @@ int  Audio_PauseStreams(int stream_type)
             ret += (StreamTrack_Pause(s) > 0);
         }
     }
+    pthread_mutex_unlock(&audio_streams_mutex);
 
     return ret;
 }
@@ -989,6 +1121,7 @@ int  Audio_ResumeStreams(int stream_type)
     int ret = 0;
 
     stream_track_p s = audio_world_data.stream_tracks;
+    pthread_mutex_lock(&audio_streams_mutex);
     for(uint32_t i = 0; i < audio_world_data.stream_tracks_count; ++i, ++s)
     {
         if(((stream_type == -1) || (s->type == stream_type)) && (s->state == TR_AUDIO_STREAM_PAUSED))
@@ -996,6 +1129,7 @@ int  Audio_ResumeStreams(int stream_type)
             ret += (StreamTrack_Play(s) > 0);
         }
     }
+    pthread_mutex_unlock(&audio_streams_mutex);
 
     return ret;
 }
@@ -1232,6 +1366,7 @@ int Audio_Send(int effect_ID, int entity_type, int entity_ID)
 
         source = &audio_world_data.audio_sources[source_number];
 
+        Audio_LoadSample(buffer_index);
         source->SetBuffer(buffer_index);
 
         // Step 2. Check looped flag, and if so, set source type to looped.
@@ -1322,9 +1457,11 @@ void Audio_LoadOverridedSamples()
                     for(int j = 0; j < sample_count; j++, buffer_counter++)
                     {
                         snprintf(sample_name, sizeof(sample_name), sample_name_mask, (sample_index + j));
-                        if(Sys_FileFound(sample_name, 0))
+                        if(Sys_FileFound(sample_name, 0) &&
+                           (Audio_LoadALbufferFromWAV_File(audio_world_data.audio_buffers[buffer_counter], sample_name) == 0) &&
+                           audio_world_data.samples && ((uint32_t)buffer_counter < audio_world_data.audio_buffers_count))
                         {
-                            Audio_LoadALbufferFromWAV_File(audio_world_data.audio_buffers[buffer_counter], sample_name);
+                            audio_world_data.samples[buffer_counter].state = TR_AUDIO_SAMPLE_STATE_LOADED;
                         }
                     }
                 }
@@ -1344,11 +1481,16 @@ void Audio_InitGlobals()
     audio_settings.sound_volume = 0.8;
     audio_settings.use_effects  = true;
     audio_settings.listener_is_player = false;
+    audio_settings.preload_samples = true;
 
     audio_world_data.audio_sources = NULL;
     audio_world_data.audio_sources_count = 0;
     audio_world_data.audio_buffers = NULL;
     audio_world_data.audio_buffers_count = 0;
+    audio_world_data.samples_data = NULL;
+    audio_world_data.samples = NULL;
+    audio_world_data.samples_warmup = NULL;
+    audio_world_data.samples_warmup_count = 0;
     audio_world_data.audio_effects = NULL;
     audio_world_data.audio_effects_count = 0;
 
@@ -1379,17 +1521,38 @@ void Audio_Init(uint32_t num_Sources)
     {
         StreamTrack_Init(audio_world_data.stream_tracks + i);
     }
+
+    audio_stream_thread_stop = 0;
+    audio_stream_thread_active = (pthread_create(&audio_stream_thread, NULL, Audio_StreamThreadFunc, NULL) == 0);
 }
 
 
+static void Audio_LoadTrackJob(void *data, uint32_t index)
+{
+    StreamTrackBuffer *stb = (StreamTrackBuffer*)data;
+    bool loaded = stb->Load();
+
+    (void)index;
+    pthread_mutex_lock(&audio_streams_mutex);
+    stb->load_state = (loaded) ? (TR_AUDIO_STREAM_LOAD_DONE) : (TR_AUDIO_STREAM_LOAD_FAILED);
+    pthread_mutex_unlock(&audio_streams_mutex);
+}
+
+
+/// Track file is found on the main thread (script), but decoded in background.
 void Audio_CacheTrack(int id)
 {
     if((id >= 0) && (id < audio_world_data.stream_buffers_count) && !audio_world_data.stream_buffers[id])
     {
         StreamTrackBuffer *stb = new StreamTrackBuffer();
-        if(stb->Load(id))
+        if(stb->Prepare(id))
         {
+            stb->load_state = TR_AUDIO_STREAM_LOAD_PENDING;
+            pthread_mutex_lock(&audio_streams_mutex);
             audio_world_data.stream_buffers[id] = stb;
+            pthread_mutex_unlock(&audio_streams_mutex);
+            Job_Init(&stb->load_job, Audio_LoadTrackJob, stb, 1);
+            Job_Submit(&stb->load_job);
         }
         else
         {
@@ -1399,11 +1562,269 @@ void Audio_CacheTrack(int id)
 }
 
 
+static pthread_mutex_t audio_samples_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void Audio_SetSampleDecode(audio_sample_decode_p samples, uint32_t index, uint8_t *data, uint32_t size, uint32_t uncomp_size = 0)
+{
+    samples[index].data = data;
+    samples[index].size = size;
+    samples[index].uncomp_size = uncomp_size;
+}
+
+
+/// Returns offset of the next "RIFF" tag starting from "from", or size if there is no more.
+static uint32_t Audio_FindRIFF(const uint8_t *data, uint32_t size, uint32_t from)
+{
+    for(; from + 4 <= size; from++)
+    {
+        if(!memcmp(data + from, "RIFF", 4))
+        {
+            return from;
+        }
+    }
+    return size;
+}
+
+
+/// Next sample in TR2/TR3 block: skip chunk by its size field, byte search only if chunk is followed by garbage.
+static uint32_t Audio_NextRIFF(const uint8_t *data, uint32_t size, uint32_t ind)
+{
+    if(ind + 8 <= size)
+    {
+        uint32_t chunk_size;
+        memcpy(&chunk_size, data + ind + 4, sizeof(chunk_size));
+        uint32_t next = ind + 8 + SDL_SwapLE32(chunk_size);
+        if((next > ind) && (next + 4 <= size) && !memcmp(data + next, "RIFF", 4))
+        {
+            return next;
+        }
+    }
+    return Audio_FindRIFF(data, size, ind + 4);
+}
+
+
+/// Takes not decoded sample for decoding, returns 0 if it is already taken or loaded.
+static int Audio_TakeSample(audio_sample_decode_p s)
+{
+    int ret = 0;
+    pthread_mutex_lock(&audio_samples_mutex);
+    if(s->state == TR_AUDIO_SAMPLE_STATE_EMPTY)
+    {
+        s->state = TR_AUDIO_SAMPLE_STATE_DECODING;
+        ret = 1;
+    }
+    pthread_mutex_unlock(&audio_samples_mutex);
+    return ret;
+}
+
+
+static int Audio_GetSampleState(audio_sample_decode_p s)
+{
+    int ret;
+    pthread_mutex_lock(&audio_samples_mutex);
+    ret = s->state;
+    pthread_mutex_unlock(&audio_samples_mutex);
+    return ret;
+}
+
+
+static void Audio_DecodeSample(audio_sample_decode_p s)
+{
+    SDL_RWops *src;
+
+    s->wav_buffer = NULL;
+    s->wav_length = 0;
+    if(s->data && (src = SDL_RWFromMem(s->data, s->size)))
+    {
+        // SDL automatically defines file format (PCM/ADPCM).
+        if(SDL_LoadWAV_RW(src, 1, &s->spec, &s->wav_buffer, &s->wav_length) == NULL)
+        {
+            s->wav_buffer = NULL;
+        }
+    }
+
+    pthread_mutex_lock(&audio_samples_mutex);
+    s->state = TR_AUDIO_SAMPLE_STATE_DECODED;
+    pthread_mutex_unlock(&audio_samples_mutex);
+}
+
+
+static void Audio_WarmupSampleJob(void *data, uint32_t index)
+{
+    (void)data;
+    audio_sample_decode_p s = audio_world_data.samples + audio_world_data.samples_warmup[index];
+    if(Audio_TakeSample(s))
+    {
+        Audio_DecodeSample(s);
+    }
+}
+
+
+static void Audio_UploadSample(uint32_t index)
+{
+    audio_sample_decode_p s = audio_world_data.samples + index;
+
+    if(s->data)
+    {
+        if(s->wav_buffer)
+        {
+            // See Audio_LoadALbufferFromWAV_Mem() about uncomp_size.
+            uint32_t uncomp_size = ((s->uncomp_size == 0) || (s->wav_length < s->uncomp_size)) ? (s->wav_length) : (s->uncomp_size);
+            Audio_FillALBuffer(audio_world_data.audio_buffers[index], s->wav_buffer, uncomp_size, s->spec.format & SDL_AUDIO_MASK_BITSIZE, s->spec.channels, s->spec.freq);
+            SDL_FreeWAV(s->wav_buffer);
+            s->wav_buffer = NULL;
+        }
+        else
+        {
+            Sys_DebugLog(SYS_LOG_FILENAME, "Error: can't load sample #%03d from sample block!", index);
+        }
+    }
+
+    pthread_mutex_lock(&audio_samples_mutex);
+    s->state = TR_AUDIO_SAMPLE_STATE_LOADED;
+    pthread_mutex_unlock(&audio_samples_mutex);
+}
+
+
+/// Makes sure AL buffer of the sample is filled, called before buffer is assigned to source.
+static void Audio_LoadSample(uint32_t index)
+{
+    audio_sample_decode_p s;
+
+    if(!audio_world_data.samples || (index >= audio_world_data.audio_buffers_count))
+    {
+        return;
+    }
+
+    s = audio_world_data.samples + index;
+    if(Audio_TakeSample(s))
+    {
+        Audio_DecodeSample(s);
+    }
+    else
+    {
+        // Sample is being decoded by warm-up job: help it instead of idle waiting.
+        while((Audio_GetSampleState(s) == TR_AUDIO_SAMPLE_STATE_DECODING) &&
+              !Job_WaitStep(&audio_world_data.samples_warmup_job));
+    }
+
+    if(Audio_GetSampleState(s) == TR_AUDIO_SAMPLE_STATE_DECODED)
+    {
+        Audio_UploadSample(index);
+    }
+}
+
+
+static void Audio_ClearSamples()
+{
+    if(audio_world_data.samples_warmup)
+    {
+        Job_Wait(&audio_world_data.samples_warmup_job);
+        free(audio_world_data.samples_warmup);
+        audio_world_data.samples_warmup = NULL;
+    }
+    audio_world_data.samples_warmup_count = 0;
+
+    if(audio_world_data.samples)
+    {
+        for(uint32_t i = 0; i < audio_world_data.audio_buffers_count; i++)
+        {
+            if(audio_world_data.samples[i].wav_buffer)
+            {
+                SDL_FreeWAV(audio_world_data.samples[i].wav_buffer);
+            }
+        }
+        free(audio_world_data.samples);
+        audio_world_data.samples = NULL;
+    }
+
+    if(audio_world_data.samples_data)
+    {
+        free(audio_world_data.samples_data);
+        audio_world_data.samples_data = NULL;
+    }
+}
+
+
+/// Uploads samples decoded by warm-up job; when all of them are loaded, sample block is not needed anymore.
+static void Audio_UpdateSamples()
+{
+    if(audio_world_data.samples_warmup)
+    {
+        int done = Job_IsDone(&audio_world_data.samples_warmup_job);
+        for(uint32_t i = 0; i < audio_world_data.samples_warmup_count; i++)
+        {
+            uint32_t index = audio_world_data.samples_warmup[i];
+            if(Audio_GetSampleState(audio_world_data.samples + index) == TR_AUDIO_SAMPLE_STATE_DECODED)
+            {
+                Audio_UploadSample(index);
+            }
+        }
+
+        // Only samples referenced by sound map may be played.
+        if(done)
+        {
+            Audio_ClearSamples();
+        }
+    }
+}
+
+
+/// Starts background decoding of all samples that may be played in this level.
+void Audio_StartSamplesWarmup()
+{
+    uint8_t *used;
+    uint32_t count = 0;
+
+    if(!audio_world_data.samples || !audio_settings.preload_samples || audio_world_data.samples_warmup)
+    {
+        return;
+    }
+
+    used = (uint8_t*)calloc(audio_world_data.audio_buffers_count, sizeof(uint8_t));
+
+    for(uint32_t i = 0; i < audio_world_data.audio_map_count; i++)
+    {
+        int real_ID = audio_world_data.audio_map[i];
+        if((real_ID >= 0) && ((uint32_t)real_ID < audio_world_data.audio_effects_count))
+        {
+            audio_effect_p effect = audio_world_data.audio_effects + real_ID;
+            for(uint32_t j = 0; j < effect->sample_count; j++)
+            {
+                uint32_t index = effect->sample_index + j;
+                if((index < audio_world_data.audio_buffers_count) && !used[index] &&
+                   (audio_world_data.samples[index].state == TR_AUDIO_SAMPLE_STATE_EMPTY))
+                {
+                    used[index] = 1;
+                    count++;
+                }
+            }
+        }
+    }
+
+    audio_world_data.samples_warmup_count = count;
+    audio_world_data.samples_warmup = (uint32_t*)malloc((count + 1) * sizeof(uint32_t));
+    count = 0;
+    for(uint32_t i = 0; i < audio_world_data.audio_buffers_count; i++)
+    {
+        if(used[i])
+        {
+            audio_world_data.samples_warmup[count++] = i;
+        }
+    }
+    free(used);
+
+    Job_Init(&audio_world_data.samples_warmup_job, Audio_WarmupSampleJob, NULL, count);
+    Job_Submit(&audio_world_data.samples_warmup_job);
+}
+
+
 void Audio_GenSamples(class VT_Level *tr)
 {
+    audio_sample_decode_p samples;
     uint8_t      *pointer = tr->samples_data;
-    int8_t        flag;
-    uint32_t      ind1, ind2;
+    uint32_t      ind, next;
     uint32_t      comp_size, uncomp_size;
     uint32_t      i;
 
@@ -1444,7 +1865,7 @@ void Audio_GenSamples(class VT_Level *tr)
     audio_world_data.audio_map = tr->soundmap;
     tr->soundmap = NULL;                   /// without it VT destructor free(tr->soundmap)
 
-    // Cycle through raw samples block and parse them to OpenAL buffers.
+    // Index raw samples block, samples are decoded to OpenAL buffers on first play.
 
     // Different TR versions have different ways of storing samples.
     // TR1:     sample block size, sample block, num samples, sample offsets.
@@ -1455,6 +1876,7 @@ void Audio_GenSamples(class VT_Level *tr)
 
     if(pointer)
     {
+        samples = (audio_sample_decode_p)calloc(audio_world_data.audio_buffers_count, sizeof(audio_sample_decode_t));
         switch(tr->game_version)
         {
             case TR_I:
@@ -1462,53 +1884,29 @@ void Audio_GenSamples(class VT_Level *tr)
             case TR_I_UB:
                 audio_world_data.audio_map_count = TR_AUDIO_MAP_SIZE_TR1;
 
-                for(i = 0; i < audio_world_data.audio_buffers_count-1; i++)
+                for(i = 0; i + 1 < audio_world_data.audio_buffers_count; i++)
                 {
                     pointer = tr->samples_data + tr->sample_indices[i];
                     uint32_t size = tr->sample_indices[i + 1] - tr->sample_indices[i];
-                    Audio_LoadALbufferFromWAV_Mem(audio_world_data.audio_buffers[i], pointer, size);
+                    Audio_SetSampleDecode(samples, i, pointer, size);
+                }
+                if((i < audio_world_data.audio_buffers_count) && (tr->sample_indices[i] < tr->samples_data_size))
+                {
+                    Audio_SetSampleDecode(samples, i, tr->samples_data + tr->sample_indices[i], tr->samples_data_size - tr->sample_indices[i]);
                 }
-                i = audio_world_data.audio_buffers_count-1;
-                Audio_LoadALbufferFromWAV_Mem(audio_world_data.audio_buffers[i], pointer, (tr->samples_count - tr->sample_indices[i]));
                 break;
 
             case TR_II:
             case TR_II_DEMO:
             case TR_III:
                 audio_world_data.audio_map_count = (tr->game_version == TR_III) ? (TR_AUDIO_MAP_SIZE_TR3) : (TR_AUDIO_MAP_SIZE_TR2);
-                ind1 = 0;
-                ind2 = 0;
-                flag = 0;
-                i = 0;
-                while(pointer < tr->samples_data + tr->samples_data_size - 4)
-                {
-                    pointer = tr->samples_data + ind2;
-                    if(!memcmp(pointer, "RIFF", 4))
-                    {
-                        if(flag == 0x00)
-                        {
-                            ind1 = ind2;
-                            flag = 0x01;
-                        }
-                        else
-                        {
-                            uncomp_size = ind2 - ind1;
-                            Audio_LoadALbufferFromWAV_Mem(audio_world_data.audio_buffers[i], tr->samples_data + ind1, uncomp_size);
-                            i++;
-                            if(i > audio_world_data.audio_buffers_count - 1)
-                            {
-                                break;
-                            }
-                            ind1 = ind2;
-                        }
-                    }
-                    ind2++;
-                }
-                uncomp_size = tr->samples_data_size - ind1;
-                pointer = tr->samples_data + ind1;
-                if(i < audio_world_data.audio_buffers_count)
+                // One pass through RIFF chunks by their size fields.
+                ind = Audio_FindRIFF(tr->samples_data, tr->samples_data_size, 0);
+                for(i = 0; (i < audio_world_data.audio_buffers_count) && (ind < tr->samples_data_size); i++)
                 {
-                    Audio_LoadALbufferFromWAV_Mem(audio_world_data.audio_buffers[i], pointer, uncomp_size);
+                    next = Audio_NextRIFF(tr->samples_data, tr->samples_data_size, ind);
+                    Audio_SetSampleDecode(samples, i, tr->samples_data + ind, next - ind);
+                    ind = next;
                 }
                 break;
 
@@ -1526,8 +1924,7 @@ void Audio_GenSamples(class VT_Level *tr)
                     comp_size   = *((uint32_t*)pointer);
                     pointer += 4;
 
-                    // Load WAV sample into OpenAL buffer.
-                    Audio_LoadALbufferFromWAV_Mem(audio_world_data.audio_buffers[i], pointer, comp_size, uncomp_size);
+                    Audio_SetSampleDecode(samples, i, pointer, comp_size, uncomp_size);
 
                     // Now we can safely move pointer through current sample data.
                     pointer += comp_size;
@@ -1536,13 +1933,16 @@ void Audio_GenSamples(class VT_Level *tr)
 
             default:
                 audio_world_data.audio_map_count = TR_AUDIO_MAP_SIZE_NONE;
+                free(samples);
                 free(tr->samples_data);
                 tr->samples_data = NULL;
                 tr->samples_data_size = 0;
                 return;
         }
 
-        free(tr->samples_data);
+        // Sample block is owned by audio now.
+        audio_world_data.samples = samples;
+        audio_world_data.samples_data = tr->samples_data;
         tr->samples_data = NULL;
         tr->samples_data_size = 0;
     }
@@ -1669,6 +2069,7 @@ int Audio_DeInit()
 {
     Audio_StopAllSources();
     Audio_StopStreams();
+    Audio_StopStreamThread();
 
     if(audio_world_data.audio_sources)
     {
@@ -1702,6 +2103,8 @@ int Audio_DeInit()
         audio_world_data.stream_track_map = NULL;
     }
 
+    Audio_ClearSamples();
+
     ///@CRITICAL: You must to delete all sources before buffers deleting!!!
 
     if(audio_world_data.audio_buffers)
@@ -1734,6 +2137,10 @@ int Audio_DeInit()
         {
             if(audio_world_data.stream_buffers[i])
             {
+                if(audio_world_data.stream_buffers[i]->load_state != TR_AUDIO_STREAM_LOAD_NONE)
+                {
+                    Job_Wait(&audio_world_data.stream_buffers[i]->load_job);
+                }
                 delete audio_world_data.stream_buffers[i];
             }
             audio_world_data.stream_buffers[i] = NULL;
@@ -1977,8 +2384,8 @@ void Audio_UpdateListenerByEntity(struct entity_s *ent)
 
 void Audio_Update(float time)
 {
+    Audio_UpdateSamples();
     Audio_UpdateSources();
-    Audio_UpdateStreams(time);
     Audio_UpdateListenerByCamera(&engine_camera, time);
 }
 
@@ -146,6 +146,7 @@ typedef struct audio_settings_s
     float       sound_volume;
     uint32_t    use_effects : 1;
     uint32_t    listener_is_player : 1; // RESERVED FOR FUTURE USE
+    uint32_t    preload_samples : 1;    // Decode level samples in background, not only on first play.
 }audio_settings_t, *audio_settings_p;
 
 
@@ -159,6 +160,7 @@ void Audio_CoreInit();
 void Audio_CoreDeinit();
 void Audio_Init(uint32_t num_Sources = TR_AUDIO_MAX_CHANNELS);
 void Audio_GenSamples(class VT_Level *tr);
+void Audio_StartSamplesWarmup();         // after load jobs: job queue is FIFO, the warm-up must not delay them
 void Audio_CacheTrack(int id);
 int  Audio_DeInit();
 void Audio_Update(float time);
@@ -177,6 +179,9 @@ int  Audio_ResumeStreams(int stream_type = -1);     // Resume ALL streams.
 
 // Generally, you need only this function to trigger any track.
 int Audio_StreamPlay(const uint32_t track_index, const uint8_t mask = 0);
+// Track is decoded in background, so load and play errors come after Audio_StreamPlay returned:
+// poll this for the result of the last Audio_StreamPlay of the track.
+int Audio_StreamPlayResult(const uint32_t track_index);
 
 
 struct stream_track_s *Audio_GetStreamExternal();
@@ -233,24 +233,34 @@ void Character_UpdatePath(struct entity_s *ent, struct room_sector_s *target)
 {
     if(ent->character && ent->self->sector && ent->self->sector->box && target && target->box)
     {
-        const int buf_size = sizeof(room_box_p) * World_GetRoomBoxesCount();
-        room_box_p *path = (room_box_p*)Sys_GetTempMem(buf_size);
         box_validition_options_t op;
         op.zone = ent->character->ai_zone;
         op.zone_type = (ent->move_type == MOVE_FLY) ? (ZONE_TYPE_FLY) : (ent->character->ai_zone_type);
         op.zone_alt = ent->self->room->is_swapped;
         op.step_up = (ent->character->max_step_up_height > ent->character->max_climb_height) ? (ent->character->max_step_up_height) : (ent->character->max_climb_height);
         op.step_down = ent->character->fall_down_height;
-        int dist = Room_FindPath(path, World_GetRoomBoxesCount(), ent->self->sector, target, &op);
         const int max_dist = sizeof(ent->character->path) / sizeof(ent->character->path[0]);
-        ent->character->path_dist = (dist > max_dist) ? (max_dist) : dist;
+        entity_p player = World_GetPlayer();
 
-        for(int i = 0; i < ent->character->path_dist; ++i)
+        if(player && player->self->sector && (player->self->sector->box == target->box))
         {
-            ent->character->path[i] = path[dist - i - 1];
+            // all AI chasing the player with the same options share one flow field
+            ent->character->path_dist = Room_GetFlowPath(ent->character->path, max_dist, ent->self->sector->box, target->box, &op);
         }
+        else
+        {
+            const int buf_size = sizeof(room_box_p) * World_GetRoomBoxesCount();
+            room_box_p *path = (room_box_p*)Sys_GetTempMem(buf_size);
+            int dist = Room_FindPath(path, World_GetRoomBoxesCount(), ent->self->sector, target, &op);
+            ent->character->path_dist = (dist > max_dist) ? (max_dist) : dist;
+
+            for(int i = 0; i < ent->character->path_dist; ++i)
+            {
+                ent->character->path[i] = path[dist - i - 1];
+            }
 
-        Sys_ReturnTempMem(buf_size);
+            Sys_ReturnTempMem(buf_size);
+        }
     }
 }
 
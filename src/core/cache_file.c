@@ -0,0 +1,251 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_rwops.h>
+#include <zlib.h>
+
+#include "cache_file.h"
+
+#define CACHE_FILE_HEADER_SIZE      (3 * sizeof(uint32_t))      // magic, version, file size
+#define CACHE_FILE_INIT_CAPACITY    (1024 * 1024)
+#define CACHE_FILE_CRC_BUF_SIZE     (65536)
+
+
+static void CacheFile_Reset(cache_file_p cache, const char *name)
+{
+    cache->mode = CACHE_FILE_NONE;
+    cache->failed = 0;
+    cache->data = NULL;
+    cache->size = 0;
+    cache->capacity = 0;
+    cache->pos = 0;
+    strncpy(cache->name, name, sizeof(cache->name));
+    cache->name[sizeof(cache->name) - 1] = 0;
+}
+
+
+int CacheFile_OpenRead(cache_file_p cache, const char *name, uint32_t magic, uint32_t version)
+{
+    uint32_t header[3];
+    SDL_RWops *rw;
+    Sint64 file_size;
+
+    CacheFile_Reset(cache, name);
+    rw = SDL_RWFromFile(name, "rb");
+    if(rw == NULL)
+    {
+        return 0;
+    }
+
+    file_size = SDL_RWsize(rw);
+    if(file_size > (Sint64)CACHE_FILE_HEADER_SIZE)
+    {
+        cache->data = (uint8_t*)malloc(file_size);
+    }
+    if((cache->data == NULL) || (SDL_RWread(rw, cache->data, file_size, 1) != 1))
+    {
+        free(cache->data);
+        cache->data = NULL;
+        SDL_RWclose(rw);
+        return 0;
+    }
+    SDL_RWclose(rw);
+
+    cache->size = file_size;
+    cache->capacity = file_size;
+    cache->mode = CACHE_FILE_READ;
+    CacheFile_Read(cache, header, sizeof(header));
+    if((header[0] != magic) || (header[1] != version) || (header[2] != cache->size))
+    {
+        CacheFile_Close(cache);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+int CacheFile_OpenWrite(cache_file_p cache, const char *name, uint32_t magic, uint32_t version)
+{
+    uint32_t header[3] = {magic, version, 0};
+
+    CacheFile_Reset(cache, name);
+    cache->data = (uint8_t*)malloc(CACHE_FILE_INIT_CAPACITY);
+    if(cache->data == NULL)
+    {
+        return 0;
+    }
+    cache->capacity = CACHE_FILE_INIT_CAPACITY;
+    cache->mode = CACHE_FILE_WRITE;
+
+    return CacheFile_Write(cache, header, sizeof(header));
+}
+
+
+int CacheFile_Close(cache_file_p cache)
+{
+    int ret = !cache->failed;
+
+    if((cache->mode == CACHE_FILE_WRITE) && !cache->failed)
+    {
+        SDL_RWops *rw = SDL_RWFromFile(cache->name, "wb");
+        uint32_t size = cache->size;
+        memcpy(cache->data + 2 * sizeof(uint32_t), &size, sizeof(size));
+        ret = (rw != NULL) && (SDL_RWwrite(rw, cache->data, cache->size, 1) == 1);
+        if(rw != NULL)
+        {
+            SDL_RWclose(rw);
+        }
+        if(!ret)
+        {
+            remove(cache->name);
+        }
+    }
+
+    free(cache->data);
+    cache->data = NULL;
+    cache->size = 0;
+    cache->capacity = 0;
+    cache->pos = 0;
+    cache->mode = CACHE_FILE_NONE;
+
+    return ret;
+}
+
+
+void CacheFile_Discard(cache_file_p cache)
+{
+    cache->failed = 1;
+    CacheFile_Close(cache);
+    remove(cache->name);
+}
+
+
+int CacheFile_Read(cache_file_p cache, void *data, size_t size)
+{
+    if(cache->failed || (cache->mode != CACHE_FILE_READ) || (size > cache->size - cache->pos))
+    {
+        cache->failed = 1;
+        memset(data, 0, size);
+        return 0;
+    }
+
+    memcpy(data, cache->data + cache->pos, size);
+    cache->pos += size;
+    return 1;
+}
+
+
+void *CacheFile_ReadArray(cache_file_p cache, uint32_t count, size_t elem_size)
+{
+    void *ret = NULL;
+
+    if((count == 0) || cache->failed)
+    {
+        return NULL;
+    }
+
+    if((cache->mode != CACHE_FILE_READ) || (count > (cache->size - cache->pos) / elem_size) ||
+       ((ret = malloc(count * elem_size)) == NULL))
+    {
+        cache->failed = 1;
+        return NULL;
+    }
+
+    memcpy(ret, cache->data + cache->pos, count * elem_size);
+    cache->pos += count * elem_size;
+    return ret;
+}
+
+
+int CacheFile_Write(cache_file_p cache, const void *data, size_t size)
+{
+    if(cache->failed || (cache->mode != CACHE_FILE_WRITE))
+    {
+        cache->failed = 1;
+        return 0;
+    }
+
+    if(cache->size + size > cache->capacity)
+    {
+        size_t capacity = cache->capacity;
+        uint8_t *new_data;
+        while(cache->size + size > capacity)
+        {
+            capacity *= 2;
+        }
+        new_data = (uint8_t*)realloc(cache->data, capacity);
+        if(new_data == NULL)
+        {
+            cache->failed = 1;
+            return 0;
+        }
+        cache->data = new_data;
+        cache->capacity = capacity;
+    }
+
+    memcpy(cache->data + cache->size, data, size);
+    cache->size += size;
+    return 1;
+}
+
+
+int CacheFile_Rewrite(cache_file_p cache, size_t offset, const void *data, size_t size)
+{
+    SDL_RWops *rw;
+    int ret;
+
+    if((cache->mode != CACHE_FILE_READ) || (offset + size > cache->size))
+    {
+        return 0;
+    }
+
+    memcpy(cache->data + offset, data, size);
+    rw = SDL_RWFromFile(cache->name, "r+b");
+    if(rw == NULL)
+    {
+        return 0;
+    }
+    ret = (SDL_RWseek(rw, offset, RW_SEEK_SET) == (Sint64)offset) && (SDL_RWwrite(rw, data, size, 1) == 1);
+    SDL_RWclose(rw);
+
+    return ret;
+}
+
+
+size_t CacheFile_Tell(cache_file_p cache)
+{
+    return (cache->mode == CACHE_FILE_READ) ? (cache->pos) : (cache->size);
+}
+
+
+uint32_t CacheFile_GetLayout(uint32_t version, const uint32_t *sizes, uint32_t count)
+{
+    uint32_t crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, (const Bytef*)&version, sizeof(version));
+    return crc32(crc, (const Bytef*)sizes, count * sizeof(uint32_t));
+}
+
+
+uint32_t CacheFile_GetFileCRC(const char *name)
+{
+    SDL_RWops *rw = SDL_RWFromFile(name, "rb");
+    uint32_t crc = 0;
+
+    if(rw != NULL)
+    {
+        uint8_t *buf = (uint8_t*)malloc(CACHE_FILE_CRC_BUF_SIZE);
+        size_t readed;
+        crc = crc32(0L, Z_NULL, 0);
+        while(buf && ((readed = SDL_RWread(rw, buf, 1, CACHE_FILE_CRC_BUF_SIZE)) > 0))
+        {
+            crc = crc32(crc, buf, readed);
+        }
+        free(buf);
+        SDL_RWclose(rw);
+    }
+
+    return crc;
+}
@@ -0,0 +1,60 @@
+
+#ifndef CACHE_FILE_H
+#define CACHE_FILE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CACHE_FILE_NONE             (0)
+#define CACHE_FILE_READ             (1)
+#define CACHE_FILE_WRITE            (2)
+
+#define CACHE_FILE_NAME_MAX_LEN     (1024)
+
+/*
+ * Binary cache of generated data, native endian. Read file is kept in memory as a whole,
+ * written data is collected in memory and saved by CacheFile_Close() with one write, so
+ * a broken write leaves a file with wrong size in the header, that is never accepted.
+ * Reads past the end and failed allocations set failed flag, check it after a section.
+ */
+typedef struct cache_file_s
+{
+    uint16_t                mode;
+    uint16_t                failed;
+    char                    name[CACHE_FILE_NAME_MAX_LEN];
+    uint8_t                *data;
+    size_t                  size;
+    size_t                  capacity;
+    size_t                  pos;                    // read position
+} cache_file_t, *cache_file_p;
+
+int   CacheFile_OpenRead(cache_file_p cache, const char *name, uint32_t magic, uint32_t version);
+int   CacheFile_OpenWrite(cache_file_p cache, const char *name, uint32_t magic, uint32_t version);
+int   CacheFile_Close(cache_file_p cache);          // saves written data; returns 0 if anything failed
+void  CacheFile_Discard(cache_file_p cache);        // drops data and removes the file: it is stale or broken
+
+int   CacheFile_Read(cache_file_p cache, void *data, size_t size);
+void *CacheFile_ReadArray(cache_file_p cache, uint32_t count, size_t elem_size);   // malloc()'ed, NULL for count == 0
+int   CacheFile_Write(cache_file_p cache, const void *data, size_t size);
+int   CacheFile_Rewrite(cache_file_p cache, size_t offset, const void *data, size_t size);  // read mode: updates the file on disk
+size_t CacheFile_Tell(cache_file_p cache);
+
+uint32_t CacheFile_GetFileCRC(const char *name);    // crc32 of any file, 0 if it can not be read
+/*
+ * Layout signature of a module cache: crc32 of its format version and record sizes.
+ * Version must be bumped on any change of stored data or its meaning.
+ */
+uint32_t CacheFile_GetLayout(uint32_t version, const uint32_t *sizes, uint32_t count);
+
+#define CacheFile_ReadValue(cache, value) CacheFile_Read((cache), &(value), sizeof(value))
+#define CacheFile_WriteValue(cache, value) CacheFile_Write((cache), &(value), sizeof(value))
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
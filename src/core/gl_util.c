@@ -216,6 +216,7 @@ PFNGLGETATTRIBLOCATIONARBPROC           qglGetAttribLocationARB = NULL;
 PFNGLENABLEVERTEXATTRIBARRAYARBPROC     qglEnableVertexAttribArrayARB = NULL;
 PFNGLENABLEVERTEXATTRIBARRAYARBPROC     qglDisableVertexAttribArrayARB = NULL;
 PFNGLVERTEXATTRIBPOINTERARBPROC         qglVertexAttribPointerARB = NULL;
+PFNGLVERTEXATTRIB1FARBPROC              qglVertexAttrib1fARB = NULL;
 
 PFNGLACTIVETEXTUREARBPROC               qglActiveTextureARB = NULL;
 PFNGLCLIENTACTIVETEXTUREARBPROC         qglClientActiveTextureARB = NULL;
@@ -270,6 +271,7 @@ PFNGLGENVERTEXARRAYSPROC                qglGenVertexArrays = NULL;
 PFNGLISVERTEXARRAYPROC                  qglIsVertexArray = NULL;
 
 PFNGLGENERATEMIPMAPEXTPROC              qglGenerateMipmap = NULL;
+PFNGLMULTIDRAWELEMENTSPROC              qglMultiDrawElements = NULL;
 
 static char *engine_gl_ext_str = NULL;
 static GLuint whiteTexture = 0;
@@ -520,6 +522,7 @@ void InitGLExtFuncs()
         qglIsVertexArray = (PFNGLISVERTEXARRAYPROC)SDL_GL_GetProcAddress("glIsVertexArray");
 
         qglGenerateMipmap = (PFNGLGENERATEMIPMAPPROC)SDL_GL_GetProcAddress("glGenerateMipmap");
+        qglMultiDrawElements = (PFNGLMULTIDRAWELEMENTSPROC)SDL_GL_GetProcAddress("glMultiDrawElements");
     }
     else
     {
@@ -575,6 +578,7 @@ void InitGLExtFuncs()
         qglDisableVertexAttribArrayARB = (PFNGLDISABLEVERTEXATTRIBARRAYARBPROC)SDL_GL_GetProcAddress("glDisableVertexAttribArrayARB");
 
         qglVertexAttribPointerARB = (PFNGLVERTEXATTRIBPOINTERARBPROC)SDL_GL_GetProcAddress("glVertexAttribPointerARB");
+        qglVertexAttrib1fARB = (PFNGLVERTEXATTRIB1FARBPROC)SDL_GL_GetProcAddress("glVertexAttrib1fARB");
     }
     else
     {
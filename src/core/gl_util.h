@@ -371,6 +371,7 @@ extern PFNGLGETATTRIBLOCATIONARBPROC qglGetAttribLocationARB;
 extern PFNGLENABLEVERTEXATTRIBARRAYARBPROC qglEnableVertexAttribArrayARB;
 extern PFNGLENABLEVERTEXATTRIBARRAYARBPROC qglDisableVertexAttribArrayARB;
 extern PFNGLVERTEXATTRIBPOINTERARBPROC qglVertexAttribPointerARB;
+extern PFNGLVERTEXATTRIB1FARBPROC qglVertexAttrib1fARB;
 
 /*multitexture EXT*/
 extern PFNGLACTIVETEXTUREARBPROC qglActiveTextureARB;
@@ -427,6 +428,7 @@ extern PFNGLGENVERTEXARRAYSPROC qglGenVertexArrays;
 extern PFNGLISVERTEXARRAYPROC qglIsVertexArray;
 
 extern PFNGLGENERATEMIPMAPPROC qglGenerateMipmap;
+extern PFNGLMULTIDRAWELEMENTSPROC qglMultiDrawElements;
 
 void InitGLExtFuncs();
 int IsGLExtensionSupported(const char *ext);
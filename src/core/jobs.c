@@ -0,0 +1,270 @@
+
+#include <stdlib.h>
+#include <SDL2/SDL.h>
+#include <pthread.h>
+
+#include "system.h"
+#include "jobs.h"
+
+
+static pthread_t        jobs_threads[JOBS_MAX_THREADS];
+static int              jobs_threads_count = 0;
+static pthread_mutex_t  jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   jobs_cond = PTHREAD_COND_INITIALIZER;         // new items are ready
+static pthread_cond_t   jobs_done_cond = PTHREAD_COND_INITIALIZER;    // an item is finished
+static job_p            jobs_ready_first = NULL;
+static job_p            jobs_ready_last = NULL;
+static volatile int     jobs_stop = 0;
+
+static void Jobs_MakeReady(job_p job);
+
+/*
+ * All queue operations are done under jobs_mutex. Items are taken one by one from the
+ * head job, so fast threads simply take more items - no static split of the loop.
+ */
+static void Jobs_Complete(job_p job)
+{
+    job->state = JOB_STATE_DONE;
+    for(uint16_t i = 0; i < job->dependents_count; i++)
+    {
+        job_p dep = job->dependents[i];
+        if((--dep->deps_left == 0) && (dep->state == JOB_STATE_WAITING))
+        {
+            Jobs_MakeReady(dep);
+        }
+    }
+}
+
+
+static void Jobs_MakeReady(job_p job)
+{
+    if(job->count == 0)
+    {
+        Jobs_Complete(job);
+        return;
+    }
+
+    job->state = JOB_STATE_READY;
+    job->next = NULL;
+    if(jobs_ready_last)
+    {
+        jobs_ready_last->next = job;
+    }
+    else
+    {
+        jobs_ready_first = job;
+    }
+    jobs_ready_last = job;
+    pthread_cond_broadcast(&jobs_cond);
+    pthread_cond_broadcast(&jobs_done_cond);
+}
+
+
+/// Takes the next item from the ready queue, called with locked mutex.
+static job_p Jobs_TakeItem(uint32_t *index)
+{
+    job_p job = jobs_ready_first;
+    if(job)
+    {
+        *index = job->next_index++;
+        if(job->next_index >= job->count)
+        {
+            jobs_ready_first = job->next;
+            if(jobs_ready_first == NULL)
+            {
+                jobs_ready_last = NULL;
+            }
+            job->next = NULL;
+        }
+    }
+    return job;
+}
+
+
+/// Runs the item without the lock and accounts it, called with locked mutex.
+static void Jobs_RunItem(job_p job, uint32_t index)
+{
+    pthread_mutex_unlock(&jobs_mutex);
+    job->func(job->data, index);
+    pthread_mutex_lock(&jobs_mutex);
+
+    if(++job->done_count >= job->count)
+    {
+        Jobs_Complete(job);
+    }
+    pthread_cond_broadcast(&jobs_done_cond);
+}
+
+
+static void *Jobs_ThreadFunc(void *data)
+{
+    uint32_t index;
+    job_p job;
+
+    (void)data;
+    pthread_mutex_lock(&jobs_mutex);
+    while(!jobs_stop)
+    {
+        job = Jobs_TakeItem(&index);
+        if(job)
+        {
+            Jobs_RunItem(job, index);
+        }
+        else
+        {
+            pthread_cond_wait(&jobs_cond, &jobs_mutex);
+        }
+    }
+    pthread_mutex_unlock(&jobs_mutex);
+
+    return NULL;
+}
+
+
+void Jobs_Init(int threads_count)
+{
+    if(threads_count <= 0)
+    {
+        threads_count = SDL_GetCPUCount() - 1;
+    }
+    threads_count = (threads_count > JOBS_MAX_THREADS) ? (JOBS_MAX_THREADS) : (threads_count);
+
+    jobs_stop = 0;
+    jobs_threads_count = 0;
+    for(int i = 0; i < threads_count; i++)
+    {
+        if(pthread_create(jobs_threads + jobs_threads_count, NULL, Jobs_ThreadFunc, NULL) == 0)
+        {
+            jobs_threads_count++;
+        }
+    }
+}
+
+
+void Jobs_Destroy()
+{
+    pthread_mutex_lock(&jobs_mutex);
+    jobs_stop = 1;
+    pthread_cond_broadcast(&jobs_cond);
+    pthread_mutex_unlock(&jobs_mutex);
+
+    for(int i = 0; i < jobs_threads_count; i++)
+    {
+        pthread_join(jobs_threads[i], NULL);
+    }
+    jobs_threads_count = 0;
+    jobs_ready_first = NULL;
+    jobs_ready_last = NULL;
+}
+
+
+int Jobs_GetThreadsCount()
+{
+    return jobs_threads_count;
+}
+
+
+void Job_Init(job_p job, job_func_t func, void *data, uint32_t count)
+{
+    job->func = func;
+    job->data = data;
+    job->count = count;
+    job->next_index = 0;
+    job->done_count = 0;
+    job->state = JOB_STATE_NEW;
+    job->deps_left = 0;
+    job->dependents_count = 0;
+    job->next = NULL;
+}
+
+
+/// Must be called before job is submitted.
+void Job_AddDependency(job_p job, job_p dependency)
+{
+    pthread_mutex_lock(&jobs_mutex);
+    if(dependency->state != JOB_STATE_DONE)
+    {
+        if(dependency->dependents_count >= JOBS_MAX_DEPENDENTS)
+        {
+            pthread_mutex_unlock(&jobs_mutex);
+            Sys_extError("Job_AddDependency: too many dependents");
+        }
+        dependency->dependents[dependency->dependents_count++] = job;
+        job->deps_left++;
+    }
+    pthread_mutex_unlock(&jobs_mutex);
+}
+
+
+void Job_Submit(job_p job)
+{
+    pthread_mutex_lock(&jobs_mutex);
+    if(job->deps_left > 0)
+    {
+        job->state = JOB_STATE_WAITING;
+    }
+    else
+    {
+        Jobs_MakeReady(job);
+    }
+    pthread_mutex_unlock(&jobs_mutex);
+}
+
+
+int Job_IsDone(job_p job)
+{
+    int ret;
+    pthread_mutex_lock(&jobs_mutex);
+    ret = (job->state == JOB_STATE_DONE);
+    pthread_mutex_unlock(&jobs_mutex);
+    return ret;
+}
+
+
+float Job_GetProgress(job_p job)
+{
+    float ret;
+    pthread_mutex_lock(&jobs_mutex);
+    if(job->state == JOB_STATE_DONE)
+    {
+        ret = 1.0f;
+    }
+    else
+    {
+        ret = (job->count > 0) ? ((float)job->done_count / (float)job->count) : (0.0f);
+    }
+    pthread_mutex_unlock(&jobs_mutex);
+    return ret;
+}
+
+
+int Job_WaitStep(job_p job)
+{
+    uint32_t index;
+    job_p item_job;
+    int ret;
+
+    pthread_mutex_lock(&jobs_mutex);
+    if(job->state != JOB_STATE_DONE)
+    {
+        item_job = Jobs_TakeItem(&index);
+        if(item_job)
+        {
+            Jobs_RunItem(item_job, index);
+        }
+        else
+        {
+            pthread_cond_wait(&jobs_done_cond, &jobs_mutex);
+        }
+    }
+    ret = (job->state == JOB_STATE_DONE);
+    pthread_mutex_unlock(&jobs_mutex);
+
+    return ret;
+}
+
+
+void Job_Wait(job_p job)
+{
+    while(!Job_WaitStep(job));
+}
@@ -0,0 +1,59 @@
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define JOBS_MAX_THREADS            (16)
+#define JOBS_MAX_DEPENDENTS         (8)
+
+#define JOB_STATE_NEW               (0)
+#define JOB_STATE_WAITING           (1)
+#define JOB_STATE_READY             (2)
+#define JOB_STATE_DONE              (3)
+
+/*
+ * Job is a parallel loop over count independent items: func(data, index) is
+ * called exactly once for every index, from any worker or from the thread that waits on the job.
+ * Job starts only after all its dependencies are done. Job functions must not touch
+ * GL, AL, Lua or physics - that stays on the main thread.
+ */
+typedef void (*job_func_t)(void *data, uint32_t index);
+
+typedef struct job_s
+{
+    job_func_t              func;
+    void                   *data;
+    uint32_t                count;
+    uint32_t                next_index;         // next item to be taken by a thread
+    uint32_t                done_count;         // finished items
+    uint16_t                state;
+    uint16_t                deps_left;
+    uint16_t                dependents_count;
+    struct job_s           *dependents[JOBS_MAX_DEPENDENTS];
+    struct job_s           *next;               // ready queue link
+} job_t, *job_p;
+
+void Jobs_Init(int threads_count);              // threads_count <= 0: one per CPU, minus the main thread
+void Jobs_Destroy();
+int  Jobs_GetThreadsCount();
+
+void Job_Init(job_p job, job_func_t func, void *data, uint32_t count);
+void Job_AddDependency(job_p job, job_p dependency);
+void Job_Submit(job_p job);
+int  Job_IsDone(job_p job);
+float Job_GetProgress(job_p job);
+
+// Executes one ready item or sleeps until any item is finished; returns 1 when job is done.
+int  Job_WaitStep(job_p job);
+void Job_Wait(job_p job);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
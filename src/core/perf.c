@@ -0,0 +1,74 @@
+
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "perf.h"
+
+
+static perf_counter_t   perf_counters[PERF_MAX_COUNTERS];
+static uint32_t         perf_counters_count = 0;
+static int              perf_enabled = 0;
+
+
+void Perf_Enable(int enable)
+{
+    perf_enabled = enable;
+}
+
+
+void Perf_Reset()
+{
+    perf_counters_count = 0;
+}
+
+
+uint64_t Perf_Begin()
+{
+    return (perf_enabled) ? (SDL_GetPerformanceCounter()) : (0);
+}
+
+
+void Perf_End(const char *name, uint64_t begin)
+{
+    if(perf_enabled && begin)
+    {
+        uint64_t ticks = SDL_GetPerformanceCounter() - begin;
+        perf_counter_p c = perf_counters;
+        perf_counter_p end = perf_counters + perf_counters_count;
+
+        for(; c < end; ++c)
+        {
+            if((c->name == name) || (strcmp(c->name, name) == 0))
+            {
+                break;
+            }
+        }
+
+        if(c == end)
+        {
+            if(perf_counters_count >= PERF_MAX_COUNTERS)
+            {
+                return;
+            }
+            c->name = name;
+            c->ticks = 0;
+            c->calls = 0;
+            perf_counters_count++;
+        }
+        c->ticks += ticks;
+        c->calls++;
+    }
+}
+
+
+uint32_t Perf_GetCounters(perf_counter_p *counters)
+{
+    *counters = perf_counters;
+    return perf_counters_count;
+}
+
+
+double Perf_TicksToMs(uint64_t ticks)
+{
+    return 1000.0 * (double)ticks / (double)SDL_GetPerformanceFrequency();
+}
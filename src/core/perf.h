@@ -0,0 +1,37 @@
+
+#ifndef PERF_H
+#define PERF_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define PERF_MAX_COUNTERS           (64)
+
+/*
+ * Named phase timers for benchmarks. Disabled by default, then Perf_Begin() costs one branch.
+ * Main thread only; counter names must be static strings.
+ */
+typedef struct perf_counter_s
+{
+    const char             *name;
+    uint64_t                ticks;
+    uint32_t                calls;
+} perf_counter_t, *perf_counter_p;
+
+void     Perf_Enable(int enable);
+void     Perf_Reset();
+uint64_t Perf_Begin();
+void     Perf_End(const char *name, uint64_t begin);
+uint32_t Perf_GetCounters(perf_counter_p *counters);
+double   Perf_TicksToMs(uint64_t ticks);
+
+#define Perf_Call(name, call) {uint64_t perf_begin = Perf_Begin(); call; Perf_End(name, perf_begin);}
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
@@ -1,8 +1,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_platform.h>
 #include <SDL2/SDL_rwops.h>
@@ -27,6 +30,9 @@ static uint8_t         *engine_mem_buffer             = NULL;
 static size_t           engine_mem_buffer_size        = 0;
 static size_t           engine_mem_buffer_size_left   = 0;
 
+static pthread_once_t   sys_thread_log_once           = PTHREAD_ONCE_INIT;
+static pthread_key_t    sys_thread_log_key;
+
 // =======================================================================
 // General routines
 // =======================================================================
@@ -138,16 +144,82 @@ void Sys_Strtime(char *buf, size_t buf_size)
 SYS PRINT FUNCTIONS
 ===============================================================================
 */
+static void Sys_InitThreadLogKey()
+{
+    pthread_key_create(&sys_thread_log_key, NULL);
+}
+
+
+static sys_thread_log_p Sys_GetThreadLog()
+{
+    pthread_once(&sys_thread_log_once, Sys_InitThreadLogKey);
+    return (sys_thread_log_p)pthread_getspecific(sys_thread_log_key);
+}
+
+
+static void Sys_AddThreadLogMessage(sys_thread_log_p log, const char *file, const char *text)
+{
+    if(log->messages_count < SYS_THREAD_LOG_MESSAGES)
+    {
+        log->messages[log->messages_count].file = file;
+        strncpy(log->messages[log->messages_count].text, text, SYS_THREAD_LOG_TEXT_SIZE - 1);
+        log->messages[log->messages_count].text[SYS_THREAD_LOG_TEXT_SIZE - 1] = 0;
+        log->messages_count++;
+    }
+    else
+    {
+        log->lost_count++;
+    }
+}
+
+
+void Sys_SetThreadLog(sys_thread_log_p log)
+{
+    pthread_once(&sys_thread_log_once, Sys_InitThreadLogKey);
+    pthread_setspecific(sys_thread_log_key, log);
+}
+
+
+void Sys_ReportThreadLog(sys_thread_log_p log)
+{
+    for(uint16_t i = 0; i < log->messages_count; i++)
+    {
+        if(log->messages[i].file)
+        {
+            Sys_DebugLog(log->messages[i].file, "%s", log->messages[i].text);
+        }
+        else
+        {
+            Con_Warning("%s", log->messages[i].text);
+        }
+    }
+    if(log->lost_count)
+    {
+        Sys_DebugLog(SYS_LOG_FILENAME, "%d messages of background thread are lost", log->lost_count);
+    }
+    log->messages_count = 0;
+    log->lost_count = 0;
+    log->error = 0;
+}
+
+
 void Sys_Error(const char *error, ...)
 {
     va_list     argptr;
     char        string[4096];
+    sys_thread_log_p log = Sys_GetThreadLog();
 
     va_start (argptr,error);
     vsnprintf (string, 4096, error, argptr);
     va_end (argptr);
 
     Sys_DebugLog(SYS_LOG_FILENAME, "System error: %s", string);
+    if(log && log->error_jump)
+    {
+        // back to the thread function, its owner decides what to do
+        log->error = 1;
+        longjmp(*log->error_jump, 1);
+    }
     //Engine_Shutdown(1);
     exit(1);
 }
@@ -157,11 +229,19 @@ void Sys_Warn(const char *warning, ...)
 {
     va_list     argptr;
     char        string[4096];
+    sys_thread_log_p log = Sys_GetThreadLog();
 
     va_start (argptr, warning);
     vsnprintf (string, 4096, warning, argptr);
     va_end (argptr);
     Sys_DebugLog(SYS_LOG_FILENAME, "Warning: %s", string);
+    if(log)
+    {
+        char text[SYS_THREAD_LOG_TEXT_SIZE];
+        snprintf(text, sizeof(text), "Warning: %s", string);
+        Sys_AddThreadLogMessage(log, NULL, text);
+        return;
+    }
     Con_Warning("Warning: %s", string);
 }
 
@@ -171,6 +251,17 @@ void Sys_DebugLog(const char *file, const char *fmt, ...)
     va_list argptr;
     static char data[4096];
     int32_t written;
+    sys_thread_log_p log = Sys_GetThreadLog();
+
+    if(log)
+    {
+        char text[SYS_THREAD_LOG_TEXT_SIZE];
+        va_start(argptr, fmt);
+        vsnprintf(text, sizeof(text), fmt, argptr);
+        va_end(argptr);
+        Sys_AddThreadLogMessage(log, file, text);
+        return;
+    }
 
     va_start(argptr, fmt);
     written = vsnprintf(data, sizeof(data), fmt, argptr);
@@ -310,3 +401,17 @@ int Sys_FileFound(const char *name, int checkWrite)
     }
     return 0;
 }
+
+
+int Sys_FileStat(const char *name, uint64_t *size, int64_t *mtime)
+{
+    struct stat st;
+
+    if(stat(name, &st) != 0)
+    {
+        return 0;
+    }
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return 1;
+}
@@ -7,10 +7,13 @@ extern "C" {
 #endif
     
 #include <stdint.h>
+#include <setjmp.h>
 #include <SDL2/SDL_platform.h>
 #include <SDL2/SDL_opengl.h>
 
 #define SYS_LOG_FILENAME            "d_log.txt"
+#define SYS_THREAD_LOG_MESSAGES     (64)
+#define SYS_THREAD_LOG_TEXT_SIZE    (256)
 
     
 typedef struct screen_info_s
@@ -30,6 +33,25 @@ typedef struct screen_info_s
 
 extern screen_info_t screen_info;
 
+/*
+ * Messages of a background thread: log file and console belong to the main thread,
+ * so the owner of the thread reports them there with Sys_ReportThreadLog.
+ * Sys_Error in such a thread longjmps to error_jump: the thread function cleans up and
+ * returns an error code to the joining thread. Code between must not rely on destructors.
+ */
+typedef struct sys_thread_log_s
+{
+    uint16_t    messages_count;
+    uint16_t    lost_count;                     // messages that did not fit
+    int         error;                          // Sys_Error was called
+    jmp_buf    *error_jump;                     // Sys_Error returns here, set by the thread function
+    struct
+    {
+        const char *file;                       // log file name, NULL for console warning
+        char        text[SYS_THREAD_LOG_TEXT_SIZE];
+    } messages[SYS_THREAD_LOG_MESSAGES];
+} sys_thread_log_t, *sys_thread_log_p;
+
 void Sys_Init();
 void Sys_InitGlobals();
 void Sys_Destroy();
@@ -45,11 +67,14 @@ void Sys_Init(void);
 void Sys_Error(const char *error, ...);
 void Sys_Warn(const char *warning, ...);
 void Sys_DebugLog(const char *file, const char *fmt, ...);
+void Sys_SetThreadLog(sys_thread_log_p log);    // log == NULL: messages of calling thread go to log file and console
+void Sys_ReportThreadLog(sys_thread_log_p log); // main thread only, clears the log
 
 void Sys_WriteTGAfile(const char *filename, const uint8_t *data, const int width, const int height, int bpp, char invY);
 void Sys_TakeScreenShot();
 
 int Sys_FileFound(const char *name, int checkWrite);
+int Sys_FileStat(const char *name, uint64_t *size, int64_t *mtime);   // size and modification time, 0 if file is absent
 
 #define Sys_LogCurrPlace Sys_DebugLog(SYS_LOG_FILENAME, "\"%s\" str = %d\n", __FILE__, __LINE__);
 #define Sys_extError(...) {Sys_LogCurrPlace Sys_Error(__VA_ARGS__);}
@@ -21,6 +21,8 @@ extern "C" {
 #include "core/vmath.h"
 #include "core/polygon.h"
 #include "core/gl_text.h"
+#include "core/jobs.h"
+#include "core/perf.h"
 #include "render/camera.h"
 #include "render/render.h"
 #include "script/script.h"
@@ -59,6 +61,7 @@ static stream_codec_t           engine_video;
 
 static char                     base_path[1024] = {0};
 static volatile int             engine_done   = 0;
+static int                      engine_headless = 0;             // hidden window, no audio device, no autoexec
 static int                      engine_set_zero_time = 0;
 float time_scale = 1.0f;
 
@@ -158,12 +161,17 @@ void Engine_Start(int argc, char **argv)
             }
             ++i;
         }
+        else if(0 == strncmp(argv[i], "-headless", 9))
+        {
+            engine_headless = 1;
+        }
         else
         {
             puts("usage:");
             puts("-config \"path_to_config_file\"");
             puts("-autoexec \"path_to_autoexec_file\"");
             puts("-base_path \"path_to_base_folder_location (contains data, resource, save and script folders)\"");
+            puts("-headless (hidden window, no audio; for benchmarks)");
             exit(0);
         }
     }
@@ -176,7 +184,10 @@ void Engine_Start(int argc, char **argv)
     // Init generic SDL interfaces.
     Engine_InitSDLSubsystems();
     Engine_InitSDLVideo();
-    Audio_CoreInit();
+    if(!engine_headless)
+    {
+        Audio_CoreInit();
+    }
 
     // Additional OpenGL initialization.
     Engine_InitGL();
@@ -194,12 +205,15 @@ void Engine_Start(int argc, char **argv)
     // Clearing up memory for initial level loading.
     World_Prepare();
 
-    // Setting up mouse.
-    SDL_SetRelativeMouseMode(SDL_TRUE);
-    SDL_WarpMouseInWindow(sdl_window, screen_info.w / 2, screen_info.h / 2);
-    SDL_ShowCursor(0);
+    if(!engine_headless)
+    {
+        // Setting up mouse.
+        SDL_SetRelativeMouseMode(SDL_TRUE);
+        SDL_WarpMouseInWindow(sdl_window, screen_info.w / 2, screen_info.h / 2);
+        SDL_ShowCursor(0);
 
-    luaL_dofile(engine_lua, autoexec_name ? autoexec_name : "autoexec.lua");
+        luaL_dofile(engine_lua, autoexec_name ? autoexec_name : "autoexec.lua");
+    }
 }
 
 
@@ -210,6 +224,8 @@ void Engine_Shutdown(int val)
     World_Clear();
 
     stream_codec_clear(&engine_video);
+    World_PreloadLevel(NULL, 0);
+    Jobs_Destroy();
 
     if(engine_lua)
     {
@@ -286,6 +302,7 @@ void Engine_Init_Pre()
     stream_codec_init(&engine_video);
 
     Sys_Init();
+    Jobs_Init(0);
     glf_init();
     GLText_Init();
     Con_Init();
@@ -352,7 +369,11 @@ void Engine_InitSDLVideo()
     Uint32 video_flags = SDL_WINDOW_OPENGL | SDL_WINDOW_MOUSE_FOCUS | SDL_WINDOW_INPUT_FOCUS;
     PFNGLGETSTRINGPROC lglGetString = NULL;
 
-    if(screen_info.fullscreen)
+    if(engine_headless)
+    {
+        video_flags |= SDL_WINDOW_HIDDEN;
+    }
+    else if(screen_info.fullscreen)
     {
         video_flags |= SDL_WINDOW_FULLSCREEN;
     }
@@ -559,7 +580,7 @@ void Engine_Display(float time)
 
         if(screen_info.debug_view_state != debug_view_state_e::model_view)
         {
-            renderer.GenWorldList(&engine_camera);
+            Perf_Call("GenWorldList", renderer.GenWorldList(&engine_camera));
             renderer.DrawList();
         }
         else
@@ -1175,6 +1196,9 @@ void ShowDebugInfo()
                 {
                     GLText_OutTextXY(30.0f, y += dy, "cam_room = (id = %d)", engine_camera.current_room->id);
                 }
+                GLText_OutTextXY(30.0f, y += dy, "vis_cache: hits = %d, misses = %d, rooms = %d, depth = %d", renderer.GetVisibilityCacheHits(), renderer.GetVisibilityCacheMisses(), renderer.GetRoomsListCount(), renderer.GetVisibilityDepth());
+                GLText_OutTextXY(30.0f, y += dy, "transparency: %s, polygons = %d, draws = %d", (renderer.settings.transparency_mode == RENDER_TRANSPARENCY_BSP) ? ("bsp") : ("sorted"),
+                                 renderer.GetTransparencyPolygons(), renderer.GetTransparencyDraws());
                 if(ent && ent->self->room)
                 {
                     GLText_OutTextXY(30.0f, y += dy, "char_pos = (%.1f, %.1f, %.1f)", ent->transform.M4x4[12 + 0], ent->transform.M4x4[12 + 1], ent->transform.M4x4[12 + 2]);
@@ -1717,6 +1741,17 @@ extern "C" int Engine_ExecCmd(char *ch)
             renderer.r_flags ^= R_DRAW_DUMMY_STATICS;
             return 1;
         }
+        else if(!strcmp(token, "r_transparency"))
+        {
+            ch = SC_ParseToken(ch, token, sizeof(token));
+            if(NULL != ch)
+            {
+                renderer.settings.transparency_mode = (atoi(token) == RENDER_TRANSPARENCY_BSP) ? (RENDER_TRANSPARENCY_BSP) : (RENDER_TRANSPARENCY_SORTED);
+            }
+            Con_Notify("transparency = %s, polygons = %d, draws = %d", (renderer.settings.transparency_mode == RENDER_TRANSPARENCY_BSP) ? ("bsp") : ("sorted"),
+                       renderer.GetTransparencyPolygons(), renderer.GetTransparencyDraws());
+            return 1;
+        }
         else if(!strcmp(token, "r_skip_room"))
         {
             renderer.r_flags ^= R_SKIP_ROOM;
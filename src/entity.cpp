@@ -1152,6 +1152,17 @@ void Entity_MoveToSink(entity_p entity, struct static_camera_sink_s *sink)
 
 
 void Entity_Frame(entity_p entity, float time)
+{
+    if(Entity_FrameAnimations(entity, time))
+    {
+        SSBoneFrame_Update(entity->bf, time);
+    }
+}
+
+/*
+ * Pose is left to the caller, so many entities may be posed at once by SSBoneFrame_UpdateBatch.
+ */
+int  Entity_FrameAnimations(entity_p entity, float time)
 {
     if(entity && !(entity->type_flags & ENTITY_TYPE_DYNAMIC) && (entity->state_flags & ENTITY_STATE_ACTIVE)  && (entity->state_flags & ENTITY_STATE_ENABLED))
     {
@@ -1214,8 +1225,10 @@ void Entity_Frame(entity_p entity, float time)
             ss_anim = ss_anim->next;
         }
 
-        SSBoneFrame_Update(entity->bf, time);
+        return 1;
     }
+
+    return 0;
 }
 
 /**
@@ -181,6 +181,7 @@ void Entity_UpdateRoomPos(entity_p ent);
 void Entity_MoveToRoom(entity_p entity, struct room_s *new_room);
 
 void Entity_Frame(entity_p entity, float time);  // process frame + trying to change state
+int  Entity_FrameAnimations(entity_p entity, float time);  // Entity_Frame without bones pose; returns 1 if pose must be updated
 
 void Entity_RebuildBV(entity_p ent);
 void Entity_UpdateTransform(entity_p entity);
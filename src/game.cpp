@@ -13,6 +13,7 @@ extern "C" {
 #include "core/vmath.h"
 #include "core/polygon.h"
 #include "core/obb.h"
+#include "core/perf.h"
 #include "render/camera.h"
 #include "render/frustum.h"
 #include "render/render.h"
@@ -34,6 +35,15 @@ extern "C" {
 
 extern lua_State *engine_lua;
 
+/*
+ * Entities animated by Game_UpdateEntity; their poses are evaluated in one batch after all logic.
+ * Ids are queued, not pointers: scripts may delete any entity before the batch is done.
+ */
+static uint32_t         *game_frame_pose_ids = NULL;
+static ss_bone_frame_p  *game_frame_poses = NULL;
+static uint32_t          game_frame_pose_ids_count = 0;
+static uint32_t          game_frame_pose_ids_size = 0;
+
 int Save_Entity(entity_p ent, void *data);
 
 int lua_mlook(lua_State * lua)
@@ -569,7 +579,17 @@ int Game_UpdateEntity(entity_p ent, void *data)
             Entity_ProcessSector(ent);
             Script_LoopEntity(engine_lua, ent);
         }
-        Entity_Frame(ent, engine_frame_time);
+        if(Entity_FrameAnimations(ent, engine_frame_time))
+        {
+            if(game_frame_pose_ids_count >= game_frame_pose_ids_size)
+            {
+                game_frame_pose_ids_size += 64;
+                game_frame_pose_ids = (uint32_t*)realloc(game_frame_pose_ids, game_frame_pose_ids_size * sizeof(uint32_t));
+                game_frame_poses = (ss_bone_frame_p*)realloc(game_frame_poses, game_frame_pose_ids_size * sizeof(ss_bone_frame_p));
+            }
+            game_frame_pose_ids[game_frame_pose_ids_count++] = ent->id;
+        }
+        // Collision and room are updated in logic order, from the last evaluated pose.
         Entity_UpdateRigidBody(ent, ent->character != NULL);
         Entity_UpdateRoomPos(ent);
     }
@@ -578,6 +598,22 @@ int Game_UpdateEntity(entity_p ent, void *data)
 }
 
 
+static void Game_UpdateEntitiesPoses()
+{
+    uint32_t poses_count = 0;
+    for(uint32_t i = 0; i < game_frame_pose_ids_count; i++)
+    {
+        entity_p ent = World_GetEntityByID(game_frame_pose_ids[i]);             // deleted entities are skipped
+        if(ent && ent->bf)
+        {
+            game_frame_poses[poses_count++] = ent->bf;
+        }
+    }
+    SSBoneFrame_UpdateBatch(game_frame_poses, poses_count, engine_frame_time, 1);
+    game_frame_pose_ids_count = 0;
+}
+
+
 void Game_Frame(float time)
 {
     entity_p player = World_GetPlayer();
@@ -727,9 +763,10 @@ void Game_Frame(float time)
         }
     }
 
-    World_IterateAllEntities(Game_UpdateEntity, NULL);
+    Perf_Call("Game_UpdateEntities", World_IterateAllEntities(Game_UpdateEntity, NULL));
+    Perf_Call("Game_UpdatePoses", Game_UpdateEntitiesPoses());
 
-    Physics_StepSimulation(time);
+    Perf_Call("Physics_StepSimulation", Physics_StepSimulation(time));
 
     Controls_RefreshStates();
     renderer.UpdateAnimTextures();
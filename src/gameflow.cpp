@@ -6,9 +6,11 @@ extern "C" {
 
 #include "core/gl_text.h"
 #include "core/console.h"
+#include "core/system.h"
 #include "script/script.h"
 #include "gui/gui.h"
 #include "audio/audio.h"
+#include "vt/vt_level.h"
 #include "engine.h"
 #include "gameflow.h"
 #include "game.h"
@@ -51,6 +53,7 @@ typedef struct level_info_s
 bool Gameflow_GetLevelInfo(level_info_p info, int game_id, int level_id);
 bool Gameflow_GetFMVPath(level_info_p info, int fmv_id);
 bool Gameflow_SetGameInternal(int game_id, int level_id);
+void Gameflow_PreloadNextLevel();
 
 
 void Gameflow_Init()
@@ -146,7 +149,12 @@ bool Gameflow_SetMap(const char* filePath, int game_id, int level_id)
     global_gameflow.m_currentGameID = game_id;
     global_gameflow.m_currentLevelID = level_id;
 
-    return Engine_LoadMap(filePath);
+    if(Engine_LoadMap(filePath))
+    {
+        Gameflow_PreloadNextLevel();
+        return true;
+    }
+    return false;
 }
 
 
@@ -286,13 +294,43 @@ bool Gameflow_SetGameInternal(int game_id, int level_id)
         global_gameflow.m_currentLevelID = level_id;
         strncpy(global_gameflow.m_currentLevelName, info.name, LEVEL_NAME_MAX_LEN);
         strncpy(global_gameflow.m_currentLevelPath, info.path, MAX_ENGINE_PATH);
-        return Engine_LoadMap(info.path);
+        if(Engine_LoadMap(info.path))
+        {
+            Gameflow_PreloadNextLevel();
+            return true;
+        }
     }
 
     return false;
 }
 
 
+/*
+ * Starts background reading of the level that follows current one in gameflow script,
+ * so GF_OP_LEVELCOMPLETE only has to create GL / AL resources.
+ * Path is resolved here, because Lua state is not thread safe.
+ */
+void Gameflow_PreloadNextLevel()
+{
+    level_info_t info;
+    char path[MAX_ENGINE_PATH];
+    int trv = TR_UNKNOWN;
+
+    if(Gameflow_GetLevelInfo(&info, global_gameflow.m_currentGameID, global_gameflow.m_currentLevelID + 1))
+    {
+        strncpy(path, Engine_GetBasePath(), sizeof(path));
+        path[sizeof(path) - 1] = 0;
+        strncat(path, info.path, sizeof(path) - strlen(path) - 1);
+        if(Sys_FileFound(path, 0) && (VT_Level::get_level_format(path) == LEVEL_FORMAT_PC))
+        {
+            trv = VT_Level::get_PC_level_version(path);
+        }
+    }
+
+    World_PreloadLevel((trv != TR_UNKNOWN) ? (path) : (NULL), trv);
+}
+
+
 const char *Gameflow_GetCurrentLevelPathLocal()
 {
     return global_gameflow.m_currentLevelPath + strlen(Engine_GetBasePath());
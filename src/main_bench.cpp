@@ -0,0 +1,264 @@
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/system.h"
+#include "core/perf.h"
+#include "render/camera.h"
+#include "render/render.h"
+#include "engine.h"
+#include "controls.h"
+#include "game.h"
+#include "world.h"
+#include "entity.h"
+#include "skeletal_model.h"
+
+/*
+ * Headless benchmark: loads levels through the usual World_Open path, runs fixed step
+ * Game_Frame iterations with scripted inputs and prints per-phase timings as JSON to stdout.
+ * usage: opentomb_bench [-frames N] [-level path]... [engine options]
+ */
+
+#define BENCH_MAX_LEVELS            (32)
+#define BENCH_FRAME_TIME            (1.0f / 60.0f)
+#define BENCH_POSE_ACTORS           (100)
+
+static const char *bench_default_levels[] =
+{
+    "tests/heavy1/LEVEL1.PHD",
+    "tests/altroom1/LEVEL1.PHD",
+    "tests/altroom2/LEVEL1.PHD",
+    "tests/altroom3/LEVEL1.PHD",
+    "tests/altroom4/LEVEL1.PHD"
+};
+
+
+// Same input sequence for every run: walk, turn, jump, sprint, look around.
+static void Bench_SetInputs(int frame)
+{
+    int step = (frame / 60) % 8;
+
+    memset(&control_states, 0x00, sizeof(control_states));
+    switch(step)
+    {
+        case 0:
+        case 1:
+            control_states.move_forward = 1;
+            break;
+
+        case 2:
+            control_states.move_left = 1;
+            break;
+
+        case 3:
+            control_states.move_forward = 1;
+            control_states.state_sprint = 1;
+            break;
+
+        case 4:
+            control_states.do_jump = ((frame % 60) == 0);
+            control_states.move_forward = 1;
+            break;
+
+        case 5:
+            control_states.move_right = 1;
+            break;
+
+        case 6:
+            control_states.move_backward = 1;
+            control_states.state_walk = 1;
+            break;
+
+        case 7:
+            control_states.look = 1;
+            control_states.look_left = 1;
+            break;
+    }
+}
+
+
+static void Bench_PrintCounters(const char *section, int frames)
+{
+    perf_counter_p counters;
+    uint32_t count = Perf_GetCounters(&counters);
+
+    printf("      \"%s\": {", section);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        double ms = Perf_TicksToMs(counters[i].ticks);
+        printf("%s\n        \"%s\": {\"ms\": %.4f, \"calls\": %u", (i) ? (",") : (""), counters[i].name, ms, counters[i].calls);
+        if(frames > 0)
+        {
+            printf(", \"ms_per_frame\": %.4f", ms / (double)frames);
+        }
+        printf("}");
+    }
+    printf("%s}", (count) ? ("\n      ") : (""));
+}
+
+
+static void Bench_PrintAnimsSize()
+{
+    skeletal_model_p models;
+    uint32_t models_count;
+    size_t frames_size = 0;
+    size_t packed_size = 0;
+
+    World_GetSkeletalModelsInfo(&models, &models_count);
+    for(uint32_t i = 0; i < models_count; ++i)
+    {
+        SkeletalModel_GetAnimsSize(models + i, &frames_size, &packed_size);
+    }
+    printf("      \"anim_keys\": {\"frames_bytes\": %llu, \"packed_bytes\": %llu},\n", (unsigned long long)frames_size, (unsigned long long)packed_size);
+}
+
+
+/*
+ * Player model copies with different animations: per entity pose update vs one batch,
+ * on the main thread only and spread over the jobs.
+ */
+static void Bench_RunPoses(int frames)
+{
+    entity_p player = World_GetPlayer();
+    skeletal_model_p model = (player && player->bf) ? (player->bf->animations.model) : (NULL);
+    ss_bone_frame_t actors[BENCH_POSE_ACTORS];
+    ss_bone_frame_p actors_list[BENCH_POSE_ACTORS];
+
+    if(!model || (model->animation_count == 0))
+    {
+        return;
+    }
+
+    for(int i = 0; i < BENCH_POSE_ACTORS; ++i)
+    {
+        SSBoneFrame_CreateFromModel(actors + i, model);
+        Anim_SetAnimation(&actors[i].animations, i % model->animation_count, i);
+        actors_list[i] = actors + i;
+    }
+
+    for(int i = 0; i < frames; ++i)
+    {
+        Sys_ResetTempMem();
+        for(int j = 0; j < BENCH_POSE_ACTORS; ++j)
+        {
+            Anim_SetNextFrame(&actors[j].animations, BENCH_FRAME_TIME);
+        }
+        uint64_t begin = Perf_Begin();
+        for(int j = 0; j < BENCH_POSE_ACTORS; ++j)
+        {
+            SSBoneFrame_Update(actors + j, BENCH_FRAME_TIME);
+        }
+        Perf_End("Pose", begin);
+        Perf_Call("PoseBatch", SSBoneFrame_UpdateBatch(actors_list, BENCH_POSE_ACTORS, BENCH_FRAME_TIME, 0));
+        Perf_Call("PoseBatchJobs", SSBoneFrame_UpdateBatch(actors_list, BENCH_POSE_ACTORS, BENCH_FRAME_TIME, 1));
+    }
+
+    for(int i = 0; i < BENCH_POSE_ACTORS; ++i)
+    {
+        SSBoneFrame_Clear(actors + i);
+    }
+}
+
+
+static void Bench_RunLevel(const char *path, int frames, int first)
+{
+    uint64_t begin;
+    uint64_t visible_exact = 0;
+    uint64_t visible_batched = 0;
+    double load_ms;
+    int loaded;
+
+    Perf_Reset();
+    begin = SDL_GetPerformanceCounter();
+    loaded = Engine_LoadMap(path);
+    load_ms = Perf_TicksToMs(SDL_GetPerformanceCounter() - begin);
+
+    printf("%s    {\n      \"level\": \"%s\",\n      \"loaded\": %s,\n", (first) ? ("") : (",\n"), path, (loaded) ? ("true") : ("false"));
+    if(!loaded)
+    {
+        printf("      \"load_ms\": %.4f\n    }", load_ms);
+        return;
+    }
+    printf("      \"version\": %d,\n      \"load_ms\": %.4f,\n", World_GetVersion(), load_ms);
+    Bench_PrintAnimsSize();
+    Bench_PrintCounters("load", 0);
+    printf(",\n");
+
+    Perf_Reset();
+    begin = SDL_GetPerformanceCounter();
+    for(int i = 0; i < frames; ++i)
+    {
+        Sys_ResetTempMem();
+        Bench_SetInputs(i);
+        engine_frame_time = BENCH_FRAME_TIME;
+        Perf_Call("Game_Frame", Game_Frame(BENCH_FRAME_TIME));
+
+        Cam_Apply(&engine_camera);
+        Cam_RecalcClipPlanes(&engine_camera);
+        Perf_Call("GenWorldList", renderer.GenWorldList(&engine_camera));
+
+        // culling of the same rooms list: per object polygon test vs batched plane test and occlusion
+        Perf_Call("UpdateOcclusion", renderer.UpdateOcclusion());
+        Perf_Call("CullObjects", visible_exact += renderer.CountVisibleObjects(false));
+        Perf_Call("CullObjectsBatched", visible_batched += renderer.CountVisibleObjects(true));
+    }
+    printf("      \"frames_ms\": %.4f,\n", Perf_TicksToMs(SDL_GetPerformanceCounter() - begin));
+    Bench_RunPoses(frames);
+    printf("      \"visible_objects\": {\"exact\": %llu, \"batched\": %llu},\n", (unsigned long long)visible_exact, (unsigned long long)visible_batched);
+    Bench_PrintCounters("frame", frames);
+    printf("\n    }");
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *levels[BENCH_MAX_LEVELS];
+    char *engine_argv[64];
+    int levels_count = 0;
+    int engine_argc = 0;
+    int frames = 1000;
+
+    engine_argv[engine_argc++] = argv[0];
+    engine_argv[engine_argc++] = (char*)"-headless";
+    for(int i = 1; i < argc; ++i)
+    {
+        if((0 == strcmp(argv[i], "-frames")) && (i + 1 < argc))
+        {
+            frames = atoi(argv[++i]);
+        }
+        else if((0 == strcmp(argv[i], "-level")) && (i + 1 < argc))
+        {
+            ++i;
+            if(levels_count < BENCH_MAX_LEVELS)
+            {
+                levels[levels_count++] = argv[i];
+            }
+        }
+        else if(engine_argc < 64)
+        {
+            engine_argv[engine_argc++] = argv[i];
+        }
+    }
+
+    if(levels_count == 0)
+    {
+        levels_count = sizeof(bench_default_levels) / sizeof(bench_default_levels[0]);
+        memcpy(levels, bench_default_levels, sizeof(bench_default_levels));
+    }
+
+    Engine_Start(engine_argc, engine_argv);
+    Perf_Enable(1);
+
+    printf("{\n  \"frames\": %d,\n  \"frame_time\": %.6f,\n  \"levels\": [\n", frames, BENCH_FRAME_TIME);
+    for(int i = 0; i < levels_count; ++i)
+    {
+        Bench_RunLevel(levels[i], frames, (i == 0));
+    }
+    printf("\n  ]\n}\n");
+    fflush(stdout);
+
+    Engine_Shutdown(EXIT_SUCCESS);
+
+    return(EXIT_SUCCESS);
+}
@@ -0,0 +1,237 @@
+#include <SDL2/SDL.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/system.h"
+#include "core/jobs.h"
+#include "vt/tr_versions.h"
+#include "vt/vt_level.h"
+
+/*
+ * Texture conversion test: palette table / SSE2 kernels are compared byte by byte with
+ * plain per pixel conversion. TR1 pages are taken as prepare_level converted them in job
+ * threads, synthetic pages cover every 16 bit colour and palette index.
+ * usage: opentomb_test_textiles [level path]...
+ */
+
+static const char *test_default_levels[] =
+{
+    "tests/heavy1/LEVEL1.PHD",
+    "tests/altroom1/LEVEL1.PHD",
+    "tests/altroom2/LEVEL1.PHD",
+    "tests/altroom3/LEVEL1.PHD",
+    "tests/altroom4/LEVEL1.PHD"
+};
+
+
+// Only the level reader is linked, messages go to stderr.
+void Sys_Error(const char *error, ...)
+{
+    va_list argptr;
+
+    va_start(argptr, error);
+    fprintf(stderr, "System error: ");
+    vfprintf(stderr, error, argptr);
+    fprintf(stderr, "\n");
+    va_end(argptr);
+    exit(1);
+}
+
+
+void Sys_Warn(const char *warning, ...)
+{
+    va_list argptr;
+
+    va_start(argptr, warning);
+    fprintf(stderr, "Warning: ");
+    vfprintf(stderr, warning, argptr);
+    fprintf(stderr, "\n");
+    va_end(argptr);
+}
+
+
+void Sys_DebugLog(const char *file, const char *fmt, ...)
+{
+    (void)file;
+    (void)fmt;
+}
+
+
+static void Test_ConvertTextile8(const tr_textile8_t *tex, const tr2_palette_t *pal, tr4_textile32_t *dst)
+{
+    for(int y = 0; y < 256; y++)
+    {
+        for(int x = 0; x < 256; x++)
+        {
+            int col = tex->pixels[y][x];
+            if(col > 0)
+            {
+                dst->pixels[y][x] = ((uint32_t)pal->colour[col].r) | ((uint32_t)pal->colour[col].g << 8) | ((uint32_t)pal->colour[col].b << 16) | (0xffU << 24);
+            }
+            else
+            {
+                dst->pixels[y][x] = 0x00000000;
+            }
+        }
+    }
+}
+
+
+static void Test_ConvertTextile16(const tr2_textile16_t *tex, tr4_textile32_t *dst)
+{
+    for(int y = 0; y < 256; y++)
+    {
+        for(int x = 0; x < 256; x++)
+        {
+            uint32_t col = tex->pixels[y][x];
+            if(col & 0x8000)
+            {
+                dst->pixels[y][x] = ((col & 0x00007c00) >> 7) | (((col & 0x000003e0) >> 2) << 8) | (((col & 0x0000001f) << 3) << 16) | 0xff000000;
+            }
+            else
+            {
+                dst->pixels[y][x] = 0x00000000;
+            }
+        }
+    }
+}
+
+
+static int Test_ComparePage(const char *name, uint32_t page, const tr4_textile32_t *result, const tr4_textile32_t *expected)
+{
+    if(memcmp(result, expected, sizeof(tr4_textile32_t)) == 0)
+    {
+        return 1;
+    }
+
+    for(int y = 0; y < 256; y++)
+    {
+        for(int x = 0; x < 256; x++)
+        {
+            if(result->pixels[y][x] != expected->pixels[y][x])
+            {
+                printf("FAIL %s: page %u pixel (%d, %d): 0x%08X, expected 0x%08X\n", name, page, x, y, result->pixels[y][x], expected->pixels[y][x]);
+                return 0;
+            }
+        }
+    }
+    return 0;
+}
+
+
+static int Test_Synthetic(tr4_textile32_t *result, tr4_textile32_t *expected)
+{
+    tr_textile8_t *tex8 = (tr_textile8_t*)malloc(sizeof(tr_textile8_t));
+    tr2_textile16_t *tex16 = (tr2_textile16_t*)malloc(sizeof(tr2_textile16_t));
+    tr2_palette_t pal;
+    uint32_t lut[256];
+    int ret = 1;
+
+    // 256 x 256 page holds every 16 bit value exactly once
+    for(uint32_t i = 0; i < 256 * 256; i++)
+    {
+        tex16->pixels[i / 256][i % 256] = (uint16_t)(i * 40503);
+        tex8->pixels[i / 256][i % 256] = (uint8_t)((i * 7) ^ (i >> 8));
+    }
+    for(int i = 0; i < 256; i++)
+    {
+        pal.colour[i].r = (uint8_t)(i * 3);
+        pal.colour[i].g = (uint8_t)(255 - i);
+        pal.colour[i].b = (uint8_t)(i ^ 0x5A);
+    }
+
+    VT_ConvertTextile16(tex16, result);
+    Test_ConvertTextile16(tex16, expected);
+    ret &= Test_ComparePage("synthetic textile16", 0, result, expected);
+
+    VT_MakePaletteLUT(&pal, lut);
+    VT_ConvertTextile8(tex8, lut, result);
+    Test_ConvertTextile8(tex8, &pal, expected);
+    ret &= Test_ComparePage("synthetic textile8", 0, result, expected);
+
+    free(tex8);
+    free(tex16);
+    return ret;
+}
+
+
+static int Test_Level(const char *path, tr4_textile32_t *result, tr4_textile32_t *expected)
+{
+    int trv = VT_Level::get_PC_level_version(path);
+    VT_Level *tr;
+    uint32_t lut[256];
+    int ret = 1;
+
+    if(trv == TR_UNKNOWN)
+    {
+        printf("FAIL %s: unknown level version\n", path);
+        return 0;
+    }
+
+    tr = new VT_Level();
+    tr->game_version = trv;
+    tr->read_level(path, trv);
+    tr->prepare_level();
+
+    // TR1 pages are checked as prepare_level made them, other 8 bit palettes only by the kernel
+    VT_MakePaletteLUT(&tr->palette, lut);
+    for(uint32_t i = 0; ret && (i < tr->textile8_count); i++)
+    {
+        tr4_textile32_t *out = result;
+        if(trv < TR_II)
+        {
+            out = tr->textile32 + i;
+        }
+        else
+        {
+            VT_ConvertTextile8(tr->textile8 + i, lut, result);
+        }
+        Test_ConvertTextile8(tr->textile8 + i, &tr->palette, expected);
+        ret &= Test_ComparePage(path, i, out, expected);
+    }
+    for(uint32_t i = 0; ret && (i < tr->textile16_count); i++)
+    {
+        VT_ConvertTextile16(tr->textile16 + i, result);
+        Test_ConvertTextile16(tr->textile16 + i, expected);
+        ret &= Test_ComparePage(path, i, result, expected);
+    }
+
+    if(ret)
+    {
+        printf("OK %s: %u + %u pages\n", path, tr->textile8_count, tr->textile16_count);
+    }
+    delete tr;
+    return ret;
+}
+
+
+int main(int argc, char **argv)
+{
+    tr4_textile32_t *result = (tr4_textile32_t*)malloc(sizeof(tr4_textile32_t));
+    tr4_textile32_t *expected = (tr4_textile32_t*)malloc(sizeof(tr4_textile32_t));
+    int ret = 1;
+
+    Jobs_Init(0);
+    ret &= Test_Synthetic(result, expected);
+    if(argc > 1)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            ret &= Test_Level(argv[i], result, expected);
+        }
+    }
+    else
+    {
+        for(size_t i = 0; i < sizeof(test_default_levels) / sizeof(test_default_levels[0]); i++)
+        {
+            ret &= Test_Level(test_default_levels[i], result, expected);
+        }
+    }
+    Jobs_Destroy();
+
+    free(result);
+    free(expected);
+    return (ret) ? (0) : (1);
+}
@@ -4,10 +4,27 @@
 #include "core/gl_util.h"
 #include "core/vmath.h"
 #include "core/polygon.h"
+#include "core/cache_file.h"
 #include "mesh.h"
 
+#define BASE_MESH_CACHE_VERSION     (1)
+
+/*
+ * Cached polygon header, vertices follow it. Texture is stored as the atlas page
+ * index: GL texture names may differ in the next run.
+ */
+typedef struct mesh_cache_polygon_s
+{
+    uint32_t                page;
+    uint16_t                vertex_count;
+    uint16_t                anim_id;
+    uint16_t                frame_offset;
+    uint8_t                 transparency;
+    uint8_t                 double_side;
+    float                   plane[4];
+}mesh_cache_polygon_t;
+
 
-void BaseMesh_GenVBO(struct base_mesh_s *mesh);
 void BaseMesh_AddPolygonToFaces(base_mesh_p mesh, struct polygon_s *p);
 void BaseMesh_AddAnimatedPolygonToFaces(base_mesh_p mesh, uint32_t *vertex_index, struct polygon_s *p);
 
@@ -31,8 +48,40 @@ void BaseMesh_Clear(base_mesh_p mesh)
         mesh->vbo_animated_texcoord_array = 0;
     }
 
+    if(qglIsBufferARB(mesh->vbo_animated_frame_array))
+    {
+        qglDeleteBuffersARB(1, &mesh->vbo_animated_frame_array);
+        mesh->vbo_animated_frame_array = 0;
+    }
+
+    if(qglIsBufferARB(mesh->vbo_transparency_array))
+    {
+        qglDeleteBuffersARB(1, &mesh->vbo_transparency_array);
+        mesh->vbo_transparency_array = 0;
+    }
+
+    if(qglIsBufferARB(mesh->vbo_transparency_texcoord_array))
+    {
+        qglDeleteBuffersARB(1, &mesh->vbo_transparency_texcoord_array);
+        mesh->vbo_transparency_texcoord_array = 0;
+    }
+
+    if(mesh->transparency)
+    {
+        free(mesh->transparency);
+        mesh->transparency = NULL;
+        mesh->transparency_count = 0;
+    }
+
     mesh->transparency_polygons = NULL;
     mesh->animated_polygons = NULL;
+
+    if(mesh->occluders)
+    {
+        free(mesh->occluders);
+        mesh->occluders = NULL;
+        mesh->occluders_count = 0;
+    }
     
     if(mesh->polygons)
     {
@@ -149,6 +198,7 @@ void BaseMesh_GenVBO(struct base_mesh_s *mesh)
     mesh->vbo_vertex_array = 0;
     mesh->vbo_animated_vertex_array = 0;
     mesh->vbo_animated_texcoord_array = 0;
+    mesh->vbo_animated_frame_array = 0;
     
     /// now, begin VBO filling!
     qglGenBuffersARB(1, &mesh->vbo_vertex_array);
@@ -397,6 +447,130 @@ void BaseMesh_GenFaces(base_mesh_p mesh)
             BaseMesh_AddAnimatedPolygonToFaces(mesh, &vertex_index, p);
         }
     }
-    
-    BaseMesh_GenVBO(mesh);
+
+    BaseMesh_GenOccluders(mesh);
+}
+
+
+static float BaseMesh_PolygonArea(polygon_p p)
+{
+    float area = 0.0f;
+    float e1[3], e2[3], cross[3];
+
+    for(uint16_t i = 1; i + 1 < p->vertex_count; i++)
+    {
+        vec3_sub(e1, p->vertices[i].position, p->vertices[0].position);
+        vec3_sub(e2, p->vertices[i + 1].position, p->vertices[0].position);
+        vec3_cross(cross, e1, e2);
+        area += 0.5f * vec3_abs(cross);
+    }
+
+    return area;
+}
+
+
+void BaseMesh_GenOccluders(base_mesh_p mesh)
+{
+    polygon_p p = mesh->polygons;
+
+    mesh->occluders_count = 0;
+    mesh->occluders = NULL;
+    for(uint32_t i = 0; i < mesh->polygons_count; i++, p++)
+    {
+        // opaque only: alpha tested polygons (fences, leaves) must not hide anything
+        if((p->transparency == 0) && !Polygon_IsBroken(p) && (BaseMesh_PolygonArea(p) >= MESH_OCCLUDER_MIN_AREA))
+        {
+            if(mesh->occluders == NULL)
+            {
+                mesh->occluders = (uint32_t*)malloc(mesh->polygons_count * sizeof(uint32_t));
+            }
+            mesh->occluders[mesh->occluders_count++] = i;
+        }
+    }
+
+    if(mesh->occluders && (mesh->occluders_count < mesh->polygons_count))
+    {
+        mesh->occluders = (uint32_t*)realloc(mesh->occluders, mesh->occluders_count * sizeof(uint32_t));
+    }
+}
+
+
+uint32_t BaseMesh_GetCacheLayout()
+{
+    uint32_t sizes[2] = {sizeof(mesh_cache_polygon_t), sizeof(vertex_t)};
+    return CacheFile_GetLayout(BASE_MESH_CACHE_VERSION, sizes, 2);
+}
+
+
+void BaseMesh_Store(base_mesh_p mesh, struct cache_file_s *cache, const GLuint *textures, uint32_t textures_count)
+{
+    polygon_p p = mesh->polygons;
+
+    CacheFile_WriteValue(cache, mesh->id);
+    CacheFile_WriteValue(cache, mesh->polygons_count);
+    CacheFile_WriteValue(cache, mesh->centre);
+    CacheFile_WriteValue(cache, mesh->bb_min);
+    CacheFile_WriteValue(cache, mesh->bb_max);
+    CacheFile_WriteValue(cache, mesh->radius);
+    for(uint32_t i = 0; i < mesh->polygons_count; i++, p++)
+    {
+        mesh_cache_polygon_t record;
+        record.page = textures_count;
+        for(uint32_t j = 0; j < textures_count; j++)
+        {
+            if(textures[j] == p->texture_index)
+            {
+                record.page = j;
+                break;
+            }
+        }
+        record.vertex_count = p->vertex_count;
+        record.anim_id = p->anim_id;
+        record.frame_offset = p->frame_offset;
+        record.transparency = p->transparency;
+        record.double_side = p->double_side;
+        vec4_copy(record.plane, p->plane);
+        CacheFile_WriteValue(cache, record);
+        CacheFile_Write(cache, p->vertices, p->vertex_count * sizeof(vertex_t));
+    }
+}
+
+/*
+ * Restores polygons of the mesh made by TR_GenMesh / TR_GenRoomMesh, mesh must be zeroed.
+ * Faces are not stored: call BaseMesh_GenFaces after it, as after generation.
+ */
+int BaseMesh_Restore(base_mesh_p mesh, struct cache_file_s *cache, const GLuint *textures, uint32_t textures_count)
+{
+    uint32_t polygons_count = 0;
+    polygon_p p;
+
+    CacheFile_ReadValue(cache, mesh->id);
+    CacheFile_ReadValue(cache, polygons_count);
+    CacheFile_ReadValue(cache, mesh->centre);
+    CacheFile_ReadValue(cache, mesh->bb_min);
+    CacheFile_ReadValue(cache, mesh->bb_max);
+    CacheFile_ReadValue(cache, mesh->radius);
+    if(cache->failed || (polygons_count > (cache->size - cache->pos) / sizeof(mesh_cache_polygon_t)))
+    {
+        cache->failed = 1;
+        return 0;
+    }
+
+    mesh->polygons_count = polygons_count;
+    p = mesh->polygons = Polygon_CreateArray(mesh->polygons_count);
+    for(uint32_t i = 0; !cache->failed && (i < mesh->polygons_count); i++, p++)
+    {
+        mesh_cache_polygon_t record;
+        CacheFile_ReadValue(cache, record);
+        p->vertices = (vertex_p)CacheFile_ReadArray(cache, record.vertex_count, sizeof(vertex_t));
+        p->vertex_count = (p->vertices) ? (record.vertex_count) : (0);
+        p->texture_index = (record.page < textures_count) ? (textures[record.page]) : (0);
+        p->anim_id = record.anim_id;
+        p->frame_offset = record.frame_offset;
+        p->transparency = record.transparency;
+        p->double_side = record.double_side;
+        vec4_copy(p->plane, record.plane);
+    }
+
+    return !cache->failed;
 }
@@ -8,6 +8,7 @@ extern "C" {
 
 #define MESH_FULL_OPAQUE      0x00  // Fully opaque object (all polygons are opaque: all t.flags < 0x02)
 #define MESH_HAS_TRANSPARENCY 0x01  // Fully transparency or has transparency and opaque polygon / object
+#define MESH_OCCLUDER_MIN_AREA (256.0f * 1024.0f)   // one click high wall strip, smaller polygons are not used as occluders
 
 #include <SDL2/SDL_platform.h>
 #include <SDL2/SDL_opengl.h>
@@ -15,6 +16,7 @@ extern "C" {
 
 struct polygon_s;
 struct vertex_s;
+struct cache_file_s;
 
 typedef struct mesh_face_s
 {
@@ -23,6 +25,19 @@ typedef struct mesh_face_s
     GLuint                 *elements;    
 }mesh_face_t, *mesh_face_p;
 
+/*
+ * transparency polygon of the sorted transparency path, triangulated in vbo_transparency_array
+ */
+typedef struct mesh_transparency_s
+{
+    GLuint                  texture_index;
+    uint16_t                transparency;                                       // blending mode
+    uint16_t                elements_count;
+    GLuint                  first_element;
+    float                   centre[3];                                          // sort point, mesh coordinates
+    struct polygon_s       *anim_polygon;                                       // animated texture source, texcoords and page are taken per frame
+}mesh_transparency_t, *mesh_transparency_p;
+
 /*
  * base mesh, uses everywhere
  */
@@ -40,6 +55,15 @@ typedef struct base_mesh_s
 
     uint32_t                animated_faces_count;                               // faces with animated texture
     struct mesh_face_s     *animated_faces;
+
+    uint32_t                transparency_count;                                 // sorted transparency path data, generated by renderer
+    uint32_t                transparency_animated_first;                        // animated polygons are at the end
+    struct mesh_transparency_s *transparency;                                   // ordered by blending mode and texture
+    GLuint                  vbo_transparency_array;
+    GLuint                  vbo_transparency_texcoord_array;                    // per frame texcoords of the animated polygons
+
+    uint32_t                occluders_count;                                    // large opaque polygons for software occlusion
+    uint32_t               *occluders;                                          // indexes in polygons
     
     uint32_t                vertex_count;                                       // number of mesh's vertices
     uint32_t                animated_vertex_count;
@@ -54,6 +78,7 @@ typedef struct base_mesh_s
     GLuint                  vbo_vertex_array;
     GLuint                  vbo_animated_vertex_array;
     GLuint                  vbo_animated_texcoord_array;
+    GLuint                  vbo_animated_frame_array;                           // anim textures table slot per animated vertex, 0 - texcoords are mapped
 }base_mesh_t, *base_mesh_p;
 
 
@@ -110,7 +135,12 @@ void BaseMesh_FindBB(base_mesh_p mesh);
 
 uint32_t BaseMesh_AddVertex(base_mesh_p mesh, struct vertex_s *vertex);
 uint32_t BaseMesh_FindVertexIndex(base_mesh_p mesh, float v[3]);
-void     BaseMesh_GenFaces(base_mesh_p mesh);
+void     BaseMesh_GenFaces(base_mesh_p mesh);               // CPU only, may be called from job threads
+void     BaseMesh_GenOccluders(base_mesh_p mesh);           // CPU only, called by BaseMesh_GenFaces
+void     BaseMesh_GenVBO(base_mesh_p mesh);                 // GL upload, main thread only
+uint32_t BaseMesh_GetCacheLayout();
+void     BaseMesh_Store(base_mesh_p mesh, struct cache_file_s *cache, const GLuint *textures, uint32_t textures_count);
+int      BaseMesh_Restore(base_mesh_p mesh, struct cache_file_s *cache, const GLuint *textures, uint32_t textures_count);
 
 
 #ifdef	__cplusplus
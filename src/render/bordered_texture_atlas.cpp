@@ -15,6 +15,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../core/cache_file.h"
 #include "../core/gl_util.h"
 #include "../core/polygon.h"
 #include "bsp_tree_2d.h"
@@ -50,6 +51,30 @@ static __inline GLuint NextPowerOf2(GLuint in)
 #define ARRAY_CAPACITY_INCREASE_STEP (32)
 #define WHITE_TEXTURE_INDEX          (0x8000)
 
+#define ATLAS_CACHE_VERSION (1)
+
+/*!
+ * Layout records of the cache file, they have the same size on all targets.
+ */
+typedef struct atlas_cache_texture_s
+{
+    uint32_t canonical_texture_index;
+    uint8_t corner_locations[4];
+} atlas_cache_texture_t;
+
+typedef struct atlas_cache_canonical_s
+{
+    uint8_t width;
+    uint8_t height;
+    uint16_t original_page;
+    uint8_t original_x;
+    uint8_t original_y;
+    uint16_t unused;
+    uint32_t new_page;
+    uint32_t new_x_with_border;
+    uint32_t new_y_with_border;
+} atlas_cache_canonical_t;
+
 /*!
  * The bordered texture atlas used by the borderedTextureAtlas_CompareCanonicalTextureSizes function. Sadly, qsort does not allow passing this context through as a parameter, and the nonstandard extensions qsort_r/qsort_s which do are not supported on MinGW, so this has to be done as a global variable.
  */
@@ -183,11 +208,7 @@ number_canonical_object_textures(0),
 canonical_object_textures(NULL),
 textures_indexes(NULL)
 {
-    GLint max_texture_edge_length = 0;
-    qglGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_edge_length);
-    if (max_texture_edge_length > 4096)
-        max_texture_edge_length = 4096; // That is already 64 MB and covers up to 256 pages.
-    result_page_width = max_texture_edge_length;
+    result_page_width = getMaxPageWidth();
 
     size_t maxNumberCanonicalTextures = object_texture_count + sprite_texture_count + 1;
     canonical_object_textures = new canonical_object_texture[maxNumberCanonicalTextures];
@@ -215,6 +236,159 @@ textures_indexes(NULL)
     layOutTextures();
 }
 
+bordered_texture_atlas::bordered_texture_atlas(int border,
+                                               size_t page_count,
+                                               const tr4_textile32_t *pages,
+                                               struct cache_file_s *cache)
+: border_width(border),
+number_result_pages(0),
+result_page_width(0),
+result_page_height(NULL),
+number_original_pages(page_count),
+original_pages(pages),
+number_file_object_textures(0),
+file_object_textures(NULL),
+number_sprite_textures(0),
+canonical_textures_for_sprite_textures(NULL),
+number_canonical_object_textures(0),
+canonical_object_textures(NULL),
+textures_indexes(NULL)
+{
+    uint32_t counts[5];     // page width, result pages, file textures, sprite textures, canonical textures
+
+    CacheFile_ReadValue(cache, counts);
+    if(cache->failed || (counts[0] != getMaxPageWidth()) || (counts[1] == 0) || (counts[4] == 0))
+    {
+        cache->failed = 1;
+        return;
+    }
+
+    result_page_width = counts[0];
+    result_page_height = (unsigned *) CacheFile_ReadArray(cache, counts[1], sizeof(unsigned));
+    if (!result_page_height)
+    {
+        return;
+    }
+    number_result_pages = counts[1];
+
+    canonical_object_textures = new canonical_object_texture[counts[4]];
+    number_canonical_object_textures = counts[4];
+    for (unsigned long i = 0; i < number_canonical_object_textures; i++)
+    {
+        atlas_cache_canonical_t record;
+        canonical_object_texture &canonical = canonical_object_textures[i];
+        CacheFile_ReadValue(cache, record);
+        canonical.width = record.width;
+        canonical.height = record.height;
+        canonical.original_page = record.original_page;
+        canonical.original_x = record.original_x;
+        canonical.original_y = record.original_y;
+        canonical.new_page = record.new_page;
+        canonical.new_x_with_border = record.new_x_with_border;
+        canonical.new_y_with_border = record.new_y_with_border;
+        if ((canonical.new_page >= number_result_pages) ||
+            ((canonical.original_page != WHITE_TEXTURE_INDEX) && (canonical.original_page >= number_original_pages)))
+        {
+            cache->failed = 1;
+        }
+    }
+
+    file_object_textures = new file_object_texture[counts[2]];
+    number_file_object_textures = counts[2];
+    for (unsigned long i = 0; i < number_file_object_textures; i++)
+    {
+        atlas_cache_texture_t record;
+        CacheFile_ReadValue(cache, record);
+        file_object_textures[i].canonical_texture_index = record.canonical_texture_index;
+        for (int j = 0; j < 4; j++)
+        {
+            file_object_textures[i].corner_locations[j] = (corner_location) (record.corner_locations[j] & 0x03);
+        }
+        if (record.canonical_texture_index >= number_canonical_object_textures)
+        {
+            cache->failed = 1;
+        }
+    }
+
+    canonical_textures_for_sprite_textures = new unsigned long[counts[3]];
+    number_sprite_textures = counts[3];
+    for (unsigned long i = 0; i < number_sprite_textures; i++)
+    {
+        uint32_t index = 0;
+        CacheFile_ReadValue(cache, index);
+        canonical_textures_for_sprite_textures[i] = index;
+        if (index >= number_canonical_object_textures)
+        {
+            cache->failed = 1;
+        }
+    }
+
+    if (cache->failed)
+    {
+        number_result_pages = 0;
+        number_file_object_textures = 0;
+        number_sprite_textures = 0;
+        number_canonical_object_textures = 0;
+    }
+}
+
+void bordered_texture_atlas::storeLayout(struct cache_file_s *cache) const
+{
+    uint32_t counts[5] = {result_page_width, (uint32_t) number_result_pages, (uint32_t) number_file_object_textures,
+                          (uint32_t) number_sprite_textures, (uint32_t) number_canonical_object_textures};
+
+    CacheFile_WriteValue(cache, counts);
+    CacheFile_Write(cache, result_page_height, number_result_pages * sizeof(unsigned));
+
+    for (unsigned long i = 0; i < number_canonical_object_textures; i++)
+    {
+        const canonical_object_texture &canonical = canonical_object_textures[i];
+        atlas_cache_canonical_t record;
+        record.width = canonical.width;
+        record.height = canonical.height;
+        record.original_page = canonical.original_page;
+        record.original_x = canonical.original_x;
+        record.original_y = canonical.original_y;
+        record.unused = 0;
+        record.new_page = canonical.new_page;
+        record.new_x_with_border = canonical.new_x_with_border;
+        record.new_y_with_border = canonical.new_y_with_border;
+        CacheFile_WriteValue(cache, record);
+    }
+
+    for (unsigned long i = 0; i < number_file_object_textures; i++)
+    {
+        atlas_cache_texture_t record;
+        record.canonical_texture_index = file_object_textures[i].canonical_texture_index;
+        for (int j = 0; j < 4; j++)
+        {
+            record.corner_locations[j] = file_object_textures[i].corner_locations[j];
+        }
+        CacheFile_WriteValue(cache, record);
+    }
+
+    for (unsigned long i = 0; i < number_sprite_textures; i++)
+    {
+        uint32_t index = canonical_textures_for_sprite_textures[i];
+        CacheFile_WriteValue(cache, index);
+    }
+}
+
+uint32_t bordered_texture_atlas::getCacheLayout()
+{
+    uint32_t sizes[2] = {sizeof(atlas_cache_texture_t), sizeof(atlas_cache_canonical_t)};
+    return CacheFile_GetLayout(ATLAS_CACHE_VERSION, sizes, 2);
+}
+
+unsigned bordered_texture_atlas::getMaxPageWidth()
+{
+    GLint max_texture_edge_length = 0;
+    qglGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_edge_length);
+    if (max_texture_edge_length > 4096)
+        max_texture_edge_length = 4096; // That is already 64 MB and covers up to 256 pages.
+    return max_texture_edge_length;
+}
+
 bordered_texture_atlas::~bordered_texture_atlas()
 {
     delete [] file_object_textures;
@@ -32,6 +32,8 @@
 #include "../core/polygon.h"
 #include "../vt/tr_types.h"
 
+struct cache_file_s;
+
 class bordered_texture_atlas
 {
     /*!
@@ -127,6 +129,27 @@ public:
                            const tr4_object_texture_t *object_textures,
                            size_t sprite_texture_count,
                            const tr_sprite_texture_t *sprite_textures);
+
+    /*!
+     * Restores the layout saved by storeLayout(), so textures are neither matched nor packed again.
+     * The original pages must be the same. On failure cache->failed is set and the atlas is empty.
+     */
+    bordered_texture_atlas(int border,
+                           size_t page_count,
+                           const tr4_textile32_t *pages,
+                           struct cache_file_s *cache);
+
+    void storeLayout(struct cache_file_s *cache) const;
+
+    /*!
+     * Width of all result pages: GL maximum texture size, but not more than 4096.
+     */
+    static unsigned getMaxPageWidth();
+
+    /*!
+     * Layout signature of storeLayout() data, a part of the world cache key.
+     */
+    static uint32_t getCacheLayout();
     
     /*!
      * Destroy all contents of a bordered texture atlas. Using the atlas afterwards
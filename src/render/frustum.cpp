@@ -2,6 +2,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define FRUSTUM_USE_SSE     (1)
+#endif
 
 #include "../core/system.h"
 #include "../core/vmath.h"
@@ -688,6 +692,153 @@ bool Frustum_IsOBBVisibleInFrustumList(struct obb_s *obb, struct frustum_s *frus
     return false;
 }
 
+/*
+ * BATCHED CULLING
+ * Boxes are stored as 12 streams of stride floats: centre x, y, z, then three box axes
+ * scaled by extent. Box is out of plane n when dot(n, centre) + n[3] + sum(|dot(n, axis_i)|) < 0,
+ * four boxes are tested at once.
+ */
+#define FRUSTUM_BOX_STREAMS     (12)
+
+#ifdef FRUSTUM_USE_SSE
+static inline __m128 Frustum_BoxesOutOfPlane4(const __m128 *b, const float n[4])
+{
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    __m128 nx = _mm_set1_ps(n[0]);
+    __m128 ny = _mm_set1_ps(n[1]);
+    __m128 nz = _mm_set1_ps(n[2]);
+    __m128 d, r;
+
+    d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, b[0]), _mm_mul_ps(ny, b[1])), _mm_add_ps(_mm_mul_ps(nz, b[2]), _mm_set1_ps(n[3])));
+    r = _mm_andnot_ps(sign_mask, _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, b[3]), _mm_mul_ps(ny, b[4])), _mm_mul_ps(nz, b[5])));
+    r = _mm_add_ps(r, _mm_andnot_ps(sign_mask, _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, b[6]), _mm_mul_ps(ny, b[7])), _mm_mul_ps(nz, b[8]))));
+    r = _mm_add_ps(r, _mm_andnot_ps(sign_mask, _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, b[9]), _mm_mul_ps(ny, b[10])), _mm_mul_ps(nz, b[11]))));
+
+    return _mm_cmplt_ps(_mm_add_ps(d, r), _mm_set1_ps(-SPLIT_EPSILON));
+}
+
+
+/// Returns 4 bit visibility mask of boxes [0, 4) of the streams.
+static uint32_t Frustum_CullBoxes4(const float *boxes, uint32_t stride, struct frustum_s *frustum)
+{
+    __m128 b[FRUSTUM_BOX_STREAMS];
+    uint32_t visible = 0x00;
+
+    for(int i = 0; i < FRUSTUM_BOX_STREAMS; i++)
+    {
+        b[i] = _mm_loadu_ps(boxes + i * stride);
+    }
+
+    for(; frustum && (visible != 0x0F); frustum = frustum->next)
+    {
+        __m128 out = Frustum_BoxesOutOfPlane4(b, frustum->norm);
+        float *n = frustum->planes;
+        for(uint16_t i = 0; i < frustum->vertex_count; i++, n += 4)
+        {
+            out = _mm_or_ps(out, Frustum_BoxesOutOfPlane4(b, n));
+        }
+        visible |= ~((uint32_t)_mm_movemask_ps(out)) & 0x0F;
+    }
+
+    return visible;
+}
+#else
+static inline bool Frustum_BoxIsOutOfPlane(const float *box, uint32_t stride, const float n[4])
+{
+    float d = n[0] * box[0] + n[1] * box[stride] + n[2] * box[2 * stride] + n[3];
+    for(int i = 3; i < FRUSTUM_BOX_STREAMS; i += 3)
+    {
+        d += fabs(n[0] * box[i * stride] + n[1] * box[(i + 1) * stride] + n[2] * box[(i + 2) * stride]);
+    }
+    return d < -SPLIT_EPSILON;
+}
+
+
+static uint32_t Frustum_CullBoxes4(const float *boxes, uint32_t stride, struct frustum_s *frustum)
+{
+    uint32_t visible = 0x00;
+
+    for(; frustum && (visible != 0x0F); frustum = frustum->next)
+    {
+        for(uint32_t j = 0; j < 4; j++)
+        {
+            bool out = Frustum_BoxIsOutOfPlane(boxes + j, stride, frustum->norm);
+            float *n = frustum->planes;
+            for(uint16_t i = 0; !out && (i < frustum->vertex_count); i++, n += 4)
+            {
+                out = Frustum_BoxIsOutOfPlane(boxes + j, stride, n);
+            }
+            visible |= (out) ? (0x00) : (0x01 << j);
+        }
+    }
+
+    return visible;
+}
+#endif
+
+
+static void Frustum_CullBoxes(const float *boxes, uint32_t stride, uint32_t count, struct frustum_s *frustum, uint32_t *mask)
+{
+    memset(mask, 0x00, FRUSTUM_MASK_WORDS(count) * sizeof(uint32_t));
+    for(uint32_t i = 0; i < count; i += 4)
+    {
+        uint32_t visible = Frustum_CullBoxes4(boxes + i, stride, frustum);
+        if(count - i < 4)
+        {
+            visible &= (0x01 << (count - i)) - 1;
+        }
+        mask[i / 32] |= visible << (i % 32);
+    }
+}
+
+
+void Frustum_CullOBBs(struct obb_s **obbs, uint32_t count, struct frustum_s *frustum, uint32_t *mask)
+{
+    uint32_t stride = (count + 3) & ~0x03;
+    size_t size = FRUSTUM_BOX_STREAMS * stride * sizeof(float);
+    float *boxes = (float*)Sys_GetTempMem(size);
+
+    memset(boxes, 0x00, size);
+    for(uint32_t i = 0; i < count; i++)
+    {
+        obb_p obb = obbs[i];
+        float *tr = obb->transform;
+        boxes[i] = obb->centre[0];
+        boxes[stride + i] = obb->centre[1];
+        boxes[2 * stride + i] = obb->centre[2];
+        for(int k = 0; k < 3; k++)
+        {
+            for(int j = 0; j < 3; j++)
+            {
+                float axis = (tr) ? (tr[4 * k + j]) : ((k == j) ? (1.0f) : (0.0f));
+                boxes[(3 + 3 * k + j) * stride + i] = axis * obb->extent[k];
+            }
+        }
+    }
+    Frustum_CullBoxes(boxes, stride, count, frustum, mask);
+    Sys_ReturnTempMem(size);
+}
+
+
+void Frustum_CullAABBs(const float *bb, uint32_t count, struct frustum_s *frustum, uint32_t *mask)
+{
+    uint32_t stride = (count + 3) & ~0x03;
+    size_t size = FRUSTUM_BOX_STREAMS * stride * sizeof(float);
+    float *boxes = (float*)Sys_GetTempMem(size);
+
+    memset(boxes, 0x00, size);
+    for(uint32_t i = 0; i < count; i++, bb += 6)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            boxes[j * stride + i] = 0.5f * (bb[j] + bb[3 + j]);
+            boxes[(3 + 4 * j) * stride + i] = 0.5f * (bb[3 + j] - bb[j]);
+        }
+    }
+    Frustum_CullBoxes(boxes, stride, count, frustum, mask);
+    Sys_ReturnTempMem(size);
+}
+
 /*
  * PORTALS
  */
@@ -42,6 +42,10 @@ public:
    ~CFrustumManager();
     
     void Reset();
+    bool IsOverflowed() const
+    {
+        return m_need_realloc;
+    }
     frustum_p PortalFrustumIntersect(struct portal_s *portal, frustum_p emitter, struct camera_s *cam);
 
 private:
@@ -63,6 +67,18 @@ bool Frustum_IsAABBVisible(float bbmin[3], float bbmax[3], struct frustum_s *fru
 bool Frustum_IsOBBVisible(struct obb_s *obb, struct frustum_s *frustum);
 bool Frustum_IsOBBVisibleInFrustumList(struct obb_s *obb, struct frustum_s *frustum);
 
+/*
+ * Batched culling against the whole frustum list: bit i of mask is set when box i is visible.
+ * Box is rejected only when it lies fully behind one of the frustum planes, so the test is
+ * conservative - it may keep a box that Frustum_IsOBBVisible rejects near the frustum corners,
+ * but never drops a visible one. Uses temp mem, mask must have FRUSTUM_MASK_WORDS(count) words.
+ */
+#define FRUSTUM_MASK_WORDS(count)   (((count) + 31) / 32)
+#define FRUSTUM_MASK_TEST(mask, i)  ((mask)[(i) / 32] & (1U << ((i) % 32)))
+
+void Frustum_CullOBBs(struct obb_s **obbs, uint32_t count, struct frustum_s *frustum, uint32_t *mask);
+void Frustum_CullAABBs(const float *bb, uint32_t count, struct frustum_s *frustum, uint32_t *mask);  // bb: bb_min[3], bb_max[3] per box
+
 
 portal_p Portal_Create(unsigned int vcount);
 void     Portal_Clear(portal_p p);
@@ -0,0 +1,429 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define OCCLUSION_USE_SSE               (1)
+#endif
+
+#include "../core/system.h"
+#include "../core/vmath.h"
+#include "../core/polygon.h"
+#include "../core/obb.h"
+#include "../core/jobs.h"
+#include "../mesh.h"
+#include "occlusion.h"
+
+
+#define OCCLUSION_MAX_POLYGON_VERTICES  (8)
+#define OCCLUSION_MIN_AREA              (0.01f)                                 // doubled screen area in pixels, thinner polygons are dropped
+
+#define OCCLUSION_OUT_LEFT              (0x01)
+#define OCCLUSION_OUT_RIGHT             (0x02)
+#define OCCLUSION_OUT_BOTTOM            (0x04)
+#define OCCLUSION_OUT_TOP               (0x08)
+#define OCCLUSION_OUT_NEAR              (0x10)
+
+
+static void COcclusionBuffer_RasterizeBandJob(void *data, uint32_t index)
+{
+    ((COcclusionBuffer*)data)->RasterizeBand(index);
+}
+
+
+static inline void Occlusion_ClipTransform(float clip[4], const float m[16], const float v[3])
+{
+    clip[0] = m[0] * v[0] + m[4] * v[1] + m[8]  * v[2] + m[12];
+    clip[1] = m[1] * v[0] + m[5] * v[1] + m[9]  * v[2] + m[13];
+    clip[2] = m[2] * v[0] + m[6] * v[1] + m[10] * v[2] + m[14];
+    clip[3] = m[3] * v[0] + m[7] * v[1] + m[11] * v[2] + m[15];
+}
+
+
+static inline uint32_t Occlusion_OutCode(const float clip[4], float dist_near)
+{
+    uint32_t ret = 0x00;
+    ret |= (clip[0] < -clip[3]) ? (OCCLUSION_OUT_LEFT) : (0x00);
+    ret |= (clip[0] >  clip[3]) ? (OCCLUSION_OUT_RIGHT) : (0x00);
+    ret |= (clip[1] < -clip[3]) ? (OCCLUSION_OUT_BOTTOM) : (0x00);
+    ret |= (clip[1] >  clip[3]) ? (OCCLUSION_OUT_TOP) : (0x00);
+    ret |= (clip[3] <  dist_near) ? (OCCLUSION_OUT_NEAR) : (0x00);
+    return ret;
+}
+
+
+COcclusionBuffer::COcclusionBuffer() :
+m_near(1.0f),
+m_polygons_count(0),
+m_polygons_size(1024),
+m_ready(false)
+{
+    m_depth = (float*)calloc(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, sizeof(float));
+    m_polygons = (struct occluder_polygon_s*)malloc(m_polygons_size * sizeof(struct occluder_polygon_s));
+    Mat4_E_macro(m_view_proj);
+}
+
+
+COcclusionBuffer::~COcclusionBuffer()
+{
+    if(m_depth)
+    {
+        free(m_depth);
+        m_depth = NULL;
+    }
+    if(m_polygons)
+    {
+        free(m_polygons);
+        m_polygons = NULL;
+    }
+    m_polygons_count = 0;
+    m_polygons_size = 0;
+}
+
+
+void COcclusionBuffer::Begin(const float view_proj[16], float dist_near)
+{
+    memcpy(m_view_proj, view_proj, sizeof(m_view_proj));
+    m_near = dist_near;
+    m_polygons_count = 0;
+    m_ready = false;
+}
+
+
+void COcclusionBuffer::AddMesh(struct base_mesh_s *mesh, const float transform[16])
+{
+    float mvp[16];
+    float in[OCCLUSION_MAX_POLYGON_VERTICES][4];
+    float out[OCCLUSION_MAX_POLYGON_VERTICES + 1][3];
+
+    Mat4_Mat4_mul(mvp, m_view_proj, transform);
+    for(uint32_t i = 0; i < mesh->occluders_count; i++)
+    {
+        polygon_p p = mesh->polygons + mesh->occluders[i];
+        uint32_t codes_and = 0xFF;
+        uint32_t codes_or = 0x00;
+        uint16_t out_count = 0;
+
+        if(p->vertex_count > OCCLUSION_MAX_POLYGON_VERTICES)
+        {
+            continue;
+        }
+
+        for(uint16_t j = 0; j < p->vertex_count; j++)
+        {
+            uint32_t code;
+            Occlusion_ClipTransform(in[j], mvp, p->vertices[j].position);
+            code = Occlusion_OutCode(in[j], m_near);
+            codes_and &= code;
+            codes_or |= code;
+        }
+        if(codes_and)
+        {
+            continue;                                                           // all vertices are out of the same plane
+        }
+
+        // clip by near plane (w = near), then project to the buffer pixels
+        for(uint16_t j = 0; j < p->vertex_count; j++)
+        {
+            const float *a = in[j];
+            const float *b = in[(j + 1 == p->vertex_count) ? (0) : (j + 1)];
+            float clip[4];
+            if(a[3] >= m_near)
+            {
+                vec4_copy(clip, a);
+                out[out_count][0] = (clip[0] / clip[3] * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+                out[out_count][1] = (clip[1] / clip[3] * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+                out[out_count][2] = 1.0f / clip[3];
+                out_count++;
+            }
+            if((codes_or & OCCLUSION_OUT_NEAR) && ((a[3] >= m_near) != (b[3] >= m_near)))
+            {
+                float t = (m_near - a[3]) / (b[3] - a[3]);
+                clip[0] = a[0] + t * (b[0] - a[0]);
+                clip[1] = a[1] + t * (b[1] - a[1]);
+                clip[3] = m_near;
+                out[out_count][0] = (clip[0] / clip[3] * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+                out[out_count][1] = (clip[1] / clip[3] * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+                out[out_count][2] = 1.0f / clip[3];
+                out_count++;
+            }
+        }
+
+        this->AddPolygon(out, out_count);
+    }
+}
+
+
+void COcclusionBuffer::AddPolygon(const float (*v)[3], uint16_t count)
+{
+    struct occluder_polygon_s *poly;
+    float area = 0.0f, best_area = 0.0f, sign;
+    float min_x, max_x, min_y, max_y;
+    uint16_t best = 0;
+
+    if(count < 3)
+    {
+        return;
+    }
+
+    // 1 / w plane is taken from the largest fan triangle, polygon is flat
+    for(uint16_t j = 1; j + 1 < count; j++)
+    {
+        float a = (v[j][0] - v[0][0]) * (v[j + 1][1] - v[0][1]) - (v[j + 1][0] - v[0][0]) * (v[j][1] - v[0][1]);
+        area += a;
+        if(fabs(a) > fabs(best_area))
+        {
+            best_area = a;
+            best = j;
+        }
+    }
+    if((fabs(area) < OCCLUSION_MIN_AREA) || (fabs(best_area) < OCCLUSION_MIN_AREA))
+    {
+        return;
+    }
+    sign = (area > 0.0f) ? (1.0f) : (-1.0f);                                    // occluders are double sided
+
+    min_x = max_x = v[0][0];
+    min_y = max_y = v[0][1];
+    for(uint16_t j = 1; j < count; j++)
+    {
+        min_x = (v[j][0] < min_x) ? (v[j][0]) : (min_x);
+        max_x = (v[j][0] > max_x) ? (v[j][0]) : (max_x);
+        min_y = (v[j][1] < min_y) ? (v[j][1]) : (min_y);
+        max_y = (v[j][1] > max_y) ? (v[j][1]) : (max_y);
+    }
+    // pixels [x, x + 1) which may be fully inside
+    min_x = ceil(min_x);
+    max_x = floor(max_x) - 1.0f;
+    min_y = ceil(min_y);
+    max_y = floor(max_y) - 1.0f;
+    min_x = (min_x < 0.0f) ? (0.0f) : (min_x);
+    min_y = (min_y < 0.0f) ? (0.0f) : (min_y);
+    max_x = (max_x > OCCLUSION_WIDTH - 1) ? (OCCLUSION_WIDTH - 1) : (max_x);
+    max_y = (max_y > OCCLUSION_HEIGHT - 1) ? (OCCLUSION_HEIGHT - 1) : (max_y);
+    if((min_x > max_x) || (min_y > max_y))
+    {
+        return;
+    }
+
+    if(m_polygons_count >= m_polygons_size)
+    {
+        uint32_t new_size = m_polygons_size * 2;
+        struct occluder_polygon_s *new_polygons = (struct occluder_polygon_s*)realloc(m_polygons, new_size * sizeof(struct occluder_polygon_s));
+        if(new_polygons == NULL)
+        {
+            Sys_extWarn("COcclusionBuffer: out of memory, %d occluder polygons", m_polygons_size);
+            return;
+        }
+        m_polygons = new_polygons;
+        m_polygons_size = new_size;
+    }
+
+    poly = m_polygons + m_polygons_count++;
+    poly->min_x = min_x;
+    poly->max_x = max_x;
+    poly->min_y = min_y;
+    poly->max_y = max_y;
+    poly->edges_count = count;
+    for(uint16_t i = 0; i < count; i++)
+    {
+        const float *a = v[i];
+        const float *b = v[(i + 1 == count) ? (0) : (i + 1)];
+        float *e = poly->edges[i];
+        e[0] = sign * (a[1] - b[1]);
+        e[1] = sign * (b[0] - a[0]);
+        e[2] = sign * (a[0] * b[1] - b[0] * a[1]);
+        e[2] -= 0.5f * (fabs(e[0]) + fabs(e[1]));                              // the farthest pixel corner must be inside
+    }
+
+    {
+        const float *v0 = v[0];
+        const float *v1 = v[best];
+        const float *v2 = v[best + 1];
+        float d1 = v1[2] - v0[2];
+        float d2 = v2[2] - v0[2];
+        poly->iw[0] = (d1 * (v2[1] - v0[1]) - d2 * (v1[1] - v0[1])) / best_area;
+        poly->iw[1] = (d2 * (v1[0] - v0[0]) - d1 * (v2[0] - v0[0])) / best_area;
+        poly->iw[2] = v0[2] - poly->iw[0] * v0[0] - poly->iw[1] * v0[1];
+        poly->iw[2] -= 0.5f * (fabs(poly->iw[0]) + fabs(poly->iw[1]));          // the farthest point of the pixel
+    }
+}
+
+
+void COcclusionBuffer::Rasterize()
+{
+    job_t job;
+
+    Job_Init(&job, COcclusionBuffer_RasterizeBandJob, this, OCCLUSION_HEIGHT / OCCLUSION_BAND_HEIGHT);
+    Job_Submit(&job);
+    Job_Wait(&job);
+    m_ready = true;
+}
+
+
+void COcclusionBuffer::RasterizeBand(uint32_t band)
+{
+    int16_t band_min_y = band * OCCLUSION_BAND_HEIGHT;
+    int16_t band_max_y = band_min_y + OCCLUSION_BAND_HEIGHT - 1;
+    struct occluder_polygon_s *poly = m_polygons;
+
+    memset(m_depth + band_min_y * OCCLUSION_WIDTH, 0, OCCLUSION_BAND_HEIGHT * OCCLUSION_WIDTH * sizeof(float));
+    for(uint32_t i = 0; i < m_polygons_count; i++, poly++)
+    {
+        int16_t min_y = (poly->min_y > band_min_y) ? (poly->min_y) : (band_min_y);
+        int16_t max_y = (poly->max_y < band_max_y) ? (poly->max_y) : (band_max_y);
+        int16_t min_x = poly->min_x & ~0x03;                                    // WIDTH % 4 == 0, so 4 pixels steps stay inside the row
+
+        for(int16_t y = min_y; y <= max_y; y++)
+        {
+            float fy = (float)y + 0.5f;
+            float *row = m_depth + y * OCCLUSION_WIDTH;
+#ifdef OCCLUSION_USE_SSE
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 step = _mm_set1_ps(4.0f);
+            __m128 e_a[OCCLUSION_MAX_EDGES];
+            __m128 e_row[OCCLUSION_MAX_EDGES];
+            __m128 fx = _mm_add_ps(_mm_set1_ps((float)min_x), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+            __m128 iw_a = _mm_set1_ps(poly->iw[0]);
+            __m128 iw_row = _mm_set1_ps(poly->iw[1] * fy + poly->iw[2]);
+            for(uint16_t k = 0; k < poly->edges_count; k++)
+            {
+                e_a[k] = _mm_set1_ps(poly->edges[k][0]);
+                e_row[k] = _mm_set1_ps(poly->edges[k][1] * fy + poly->edges[k][2]);
+            }
+            for(int16_t x = min_x; x <= poly->max_x; x += 4)
+            {
+                __m128 e = _mm_add_ps(_mm_mul_ps(e_a[0], fx), e_row[0]);
+                for(uint16_t k = 1; k < poly->edges_count; k++)
+                {
+                    e = _mm_min_ps(e, _mm_add_ps(_mm_mul_ps(e_a[k], fx), e_row[k]));
+                }
+                __m128 inside = _mm_cmpge_ps(e, zero);
+                __m128 iw = _mm_and_ps(inside, _mm_add_ps(_mm_mul_ps(iw_a, fx), iw_row));
+                _mm_storeu_ps(row + x, _mm_max_ps(_mm_loadu_ps(row + x), iw));
+                fx = _mm_add_ps(fx, step);
+            }
+#else
+            for(int16_t x = min_x; x <= poly->max_x; x++)
+            {
+                float fx = (float)x + 0.5f;
+                bool inside = true;
+                for(uint16_t k = 0; inside && (k < poly->edges_count); k++)
+                {
+                    inside = (poly->edges[k][0] * fx + poly->edges[k][1] * fy + poly->edges[k][2] >= 0.0f);
+                }
+                if(inside)
+                {
+                    float iw = poly->iw[0] * fx + poly->iw[1] * fy + poly->iw[2];
+                    row[x] = (row[x] > iw) ? (row[x]) : (iw);
+                }
+            }
+#endif
+        }
+    }
+}
+
+
+bool COcclusionBuffer::IsBoxVisible(const float corners[8][3])
+{
+    float min_x = OCCLUSION_WIDTH, max_x = 0.0f;
+    float min_y = OCCLUSION_HEIGHT, max_y = 0.0f;
+    float max_iw = 0.0f;
+    int x0, x1, y0, y1;
+
+    if(!m_ready)
+    {
+        return true;
+    }
+
+    for(int i = 0; i < 8; i++)
+    {
+        float clip[4], x, y, iw;
+        Occlusion_ClipTransform(clip, m_view_proj, corners[i]);
+        if(clip[3] < m_near)
+        {
+            return true;                                                        // box crosses the near plane
+        }
+        iw = 1.0f / clip[3];
+        x = (clip[0] * iw * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+        y = (clip[1] * iw * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+        min_x = (x < min_x) ? (x) : (min_x);
+        max_x = (x > max_x) ? (x) : (max_x);
+        min_y = (y < min_y) ? (y) : (min_y);
+        max_y = (y > max_y) ? (y) : (max_y);
+        max_iw = (iw > max_iw) ? (iw) : (max_iw);
+    }
+
+    // every pixel the box touches, coordinates are clamped before the int conversion
+    min_x = (min_x < 0.0f) ? (0.0f) : (min_x);
+    min_y = (min_y < 0.0f) ? (0.0f) : (min_y);
+    max_x = (max_x > OCCLUSION_WIDTH - 1) ? (OCCLUSION_WIDTH - 1) : (max_x);
+    max_y = (max_y > OCCLUSION_HEIGHT - 1) ? (OCCLUSION_HEIGHT - 1) : (max_y);
+    x0 = min_x;
+    x1 = max_x;
+    y0 = min_y;
+    y1 = max_y;
+    if((x0 > x1) || (y0 > y1))
+    {
+        return true;                                                            // out of screen, frustum test decides
+    }
+
+    max_iw *= OCCLUSION_DEPTH_BIAS;
+    for(int y = y0; y <= y1; y++)
+    {
+        const float *row = m_depth + y * OCCLUSION_WIDTH;
+        for(int x = x0; x <= x1; x++)
+        {
+            if(row[x] <= max_iw)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+bool COcclusionBuffer::IsOBBVisible(struct obb_s *obb)
+{
+    float corners[8][3];
+    float axes[3][3];
+
+    for(int k = 0; k < 3; k++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            float axis = (obb->transform) ? (obb->transform[4 * k + j]) : ((k == j) ? (1.0f) : (0.0f));
+            axes[k][j] = axis * obb->extent[k];
+        }
+    }
+
+    for(int i = 0; i < 8; i++)
+    {
+        float s0 = (i & 0x01) ? (1.0f) : (-1.0f);
+        float s1 = (i & 0x02) ? (1.0f) : (-1.0f);
+        float s2 = (i & 0x04) ? (1.0f) : (-1.0f);
+        for(int j = 0; j < 3; j++)
+        {
+            corners[i][j] = obb->centre[j] + s0 * axes[0][j] + s1 * axes[1][j] + s2 * axes[2][j];
+        }
+    }
+
+    return this->IsBoxVisible(corners);
+}
+
+
+bool COcclusionBuffer::IsAABBVisible(const float bb_min[3], const float bb_max[3])
+{
+    float corners[8][3];
+
+    for(int i = 0; i < 8; i++)
+    {
+        corners[i][0] = (i & 0x01) ? (bb_max[0]) : (bb_min[0]);
+        corners[i][1] = (i & 0x02) ? (bb_max[1]) : (bb_min[1]);
+        corners[i][2] = (i & 0x04) ? (bb_max[2]) : (bb_min[2]);
+    }
+
+    return this->IsBoxVisible(corners);
+}
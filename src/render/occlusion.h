@@ -0,0 +1,69 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <stdint.h>
+
+struct base_mesh_s;
+struct obb_s;
+
+#define OCCLUSION_WIDTH             (256)
+#define OCCLUSION_HEIGHT            (128)
+#define OCCLUSION_BAND_HEIGHT       (16)                                        // rows rasterized by one job item
+#define OCCLUSION_DEPTH_BIAS        (1.002f)                                    // occluder must be that closer than the tested box
+#define OCCLUSION_MAX_EDGES         (9)                                         // 8 vertices polygon, clipped by the near plane
+
+/*
+ * Low resolution CPU depth buffer. Occluders (large opaque polygons, see BaseMesh_GenFaces)
+ * are transformed and clipped on the main thread, then rasterized in horizontal bands by
+ * the job system. Rasterization is conservative: a pixel is written only when the polygon
+ * covers all of it, with the farthest depth of the polygon inside the pixel. Buffer keeps
+ * 1 / w per pixel, 0 means nothing was drawn. Box is occluded when every pixel its screen
+ * rectangle touches holds an occluder closer than the nearest box corner.
+ */
+class COcclusionBuffer
+{
+public:
+    COcclusionBuffer();
+   ~COcclusionBuffer();
+
+    void Begin(const float view_proj[16], float dist_near);
+    void AddMesh(struct base_mesh_s *mesh, const float transform[16]);
+    void Rasterize();
+    void RasterizeBand(uint32_t band);                                          // job item, CPU only
+
+    bool IsReady() const
+    {
+        return m_ready;
+    }
+    uint32_t GetPolygonsCount() const
+    {
+        return m_polygons_count;
+    }
+    bool IsOBBVisible(struct obb_s *obb);
+    bool IsAABBVisible(const float bb_min[3], const float bb_max[3]);
+
+private:
+    struct occluder_polygon_s
+    {
+        float           edges[OCCLUSION_MAX_EDGES][3];                          // edge functions at pixel centre, whole pixel is inside when all >= 0
+        float           iw[3];                                                  // farthest 1 / w in the pixel: iw[0] * x + iw[1] * y + iw[2]
+        uint16_t        edges_count;
+        int16_t         min_x;
+        int16_t         max_x;
+        int16_t         min_y;
+        int16_t         max_y;
+    };
+
+    void AddPolygon(const float (*v)[3], uint16_t count);
+    bool IsBoxVisible(const float corners[8][3]);
+
+    float                           m_view_proj[16];
+    float                           m_near;
+    float                          *m_depth;
+    struct occluder_polygon_s      *m_polygons;
+    uint32_t                        m_polygons_count;
+    uint32_t                        m_polygons_size;
+    bool                            m_ready;
+};
+
+#endif
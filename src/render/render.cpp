@@ -1,6 +1,10 @@
 
 #include <cmath>
 #include <stdlib.h>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define RENDER_USE_SSE      (1)
+#endif
 #include <SDL2/SDL_platform.h>
 #include <SDL2/SDL_opengl.h>
 
@@ -11,6 +15,7 @@
 #include "../core/vmath.h"
 #include "../core/polygon.h"
 #include "../core/obb.h"
+#include "../core/perf.h"
 #include "../script/script.h"
 #include "../physics/physics.h"
 #include "../vt/tr_versions.h"
@@ -18,6 +23,7 @@
 #include "render.h"
 #include "bsp_tree.h"
 #include "frustum.h"
+#include "occlusion.h"
 #include "shader_description.h"
 #include "shader_manager.h"
 #include "../room.h"
@@ -30,8 +36,6 @@
 
 CRender renderer;
 
-void CalculateWaterTint(GLfloat *tint, uint8_t fixed_colour);
-
 #define DEBUG_DRAWER_DEFAULT_BUFFER_SIZE        (128 * 1024)
 
 /*
@@ -44,12 +48,38 @@ m_rooms(NULL),
 m_rooms_count(0),
 m_anim_sequences(NULL),
 m_anim_sequences_count(0),
+m_anim_tex_frames_count(0),
+m_anim_tex_first(NULL),
 m_active_transparency(0),
 m_active_texture(0),
+m_transparent_items_size(0),
+m_transparent_items_count(0),
+m_transparent_items(NULL),
+m_transparency_polygons(0),
+m_transparency_draws(0),
 r_list_size(0),
 r_list_active_count(0),
 r_list(NULL),
+m_vis_cache_valid(false),
+m_vis_pvs_room(NULL),
+m_vis_cache_hits(0),
+m_vis_cache_misses(0),
+m_vis_depth(0),
+m_vis_max_depth(0),
+m_packets_size(0),
+m_packets_count(0),
+m_packets(NULL),
+m_objects_size(0),
+m_objects_count(0),
+m_objects(NULL),
+m_ranges_size(0),
+m_ranges_count(0),
+m_ranges_counts(NULL),
+m_ranges_offsets(NULL),
+m_batch_object(0xFFFFFFFF),
+m_queue_shaders_count(0),
 frustumManager(NULL),
+occlusionBuffer(NULL),
 shaderManager(NULL),
 debugDrawer(NULL),
 dynamicBSP(NULL),
@@ -57,6 +87,7 @@ r_flags(0x00)
 {
     this->InitSettings();
     frustumManager = new CFrustumManager(32768);
+    occlusionBuffer = new COcclusionBuffer();
     debugDrawer    = new CRenderDebugDrawer();
     dynamicBSP     = new CDynamicBSP(512 * 1024);
 }
@@ -73,12 +104,59 @@ CRender::~CRender()
         r_list = NULL;
     }
 
+    if(m_packets)
+    {
+        m_packets_count = 0;
+        m_packets_size = 0;
+        free(m_packets);
+        m_packets = NULL;
+    }
+
+    if(m_objects)
+    {
+        m_objects_count = 0;
+        m_objects_size = 0;
+        free(m_objects);
+        m_objects = NULL;
+    }
+
+    if(m_transparent_items)
+    {
+        m_transparent_items_count = 0;
+        m_transparent_items_size = 0;
+        free(m_transparent_items);
+        m_transparent_items = NULL;
+    }
+
+    if(m_anim_tex_first)
+    {
+        m_anim_tex_frames_count = 0;
+        free(m_anim_tex_first);
+        m_anim_tex_first = NULL;
+    }
+
+    if(m_ranges_counts)
+    {
+        m_ranges_count = 0;
+        m_ranges_size = 0;
+        free(m_ranges_counts);
+        free(m_ranges_offsets);
+        m_ranges_counts = NULL;
+        m_ranges_offsets = NULL;
+    }
+
     if(frustumManager)
     {
         delete frustumManager;
         frustumManager = NULL;
     }
 
+    if(occlusionBuffer)
+    {
+        delete occlusionBuffer;
+        occlusionBuffer = NULL;
+    }
+
     if(debugDrawer)
     {
         delete debugDrawer;
@@ -114,6 +192,9 @@ void CRender::InitSettings()
     settings.fog_color[2] = 0.0f;
     settings.fog_start_depth = 10000.0f;
     settings.fog_end_depth = 16000.0f;
+    settings.static_batching = 1;
+    settings.occlusion = 0;
+    settings.transparency_mode = RENDER_TRANSPARENCY_SORTED;
 }
 
 void CRender::DoShaders()
@@ -128,11 +209,16 @@ void CRender::ResetWorld(struct room_s *rooms, uint32_t rooms_count, struct anim
 {
     this->CleanList();
     r_flags = 0x00;
+    m_vis_cache_valid = false;
+    m_vis_cache_hits = 0;
+    m_vis_cache_misses = 0;
+    m_vis_max_depth = 0;
 
     m_rooms = rooms;
     m_rooms_count = rooms_count;
     m_anim_sequences = anim_sequences;
     m_anim_sequences_count = anim_sequences_count;
+    this->GenAnimTexTable();
 
     if(m_rooms)
     {
@@ -159,6 +245,97 @@ void CRender::ResetWorld(struct room_s *rooms, uint32_t rooms_count, struct anim
     }
 }
 
+/*
+ * Animated textures table: every sequence takes frames_count slots, slot k holds the frame
+ * shown by polygons with frame offset k. Animated vertices of room and static meshes keep
+ * static slot indices, so only the table is updated per frame. If the table is larger than
+ * the shaders were built for, it is off and animated texcoords are mapped per mesh.
+ */
+void CRender::GenAnimTexTable()
+{
+    uint32_t slots = 1;
+    uint32_t max_slots = (shaderManager) ? (shaderManager->getAnimTexFramesCount()) : (0);
+
+    if(m_anim_tex_first)
+    {
+        free(m_anim_tex_first);
+        m_anim_tex_first = NULL;
+    }
+    m_anim_tex_frames_count = 0;
+
+    if(m_anim_sequences_count == 0)
+    {
+        return;
+    }
+
+    m_anim_tex_first = (uint32_t*)malloc(m_anim_sequences_count * sizeof(uint32_t));
+    for(uint32_t i = 0; i < m_anim_sequences_count; i++)
+    {
+        m_anim_tex_first[i] = slots;
+        slots += m_anim_sequences[i].frames_count;
+    }
+
+    if(slots > max_slots)
+    {
+        Sys_DebugLog(SYS_LOG_FILENAME, "Animated textures need %d table slots, only %d are available", slots, max_slots);
+        return;
+    }
+    m_anim_tex_frames_count = slots;
+
+    GLfloat *f = m_anim_tex_frames;
+    f[0] = 1.0f; f[1] = 0.0f; f[2] = 0.0f; f[3] = 1.0f;
+    f[4] = 0.0f; f[5] = 0.0f; f[6] = 0.0f; f[7] = 0.0f;
+    this->UpdateAnimTexTable();
+
+    for(uint32_t i = 0; i < m_rooms_count; i++)
+    {
+        room_content_p content = m_rooms[i].content;
+        if(content->mesh)
+        {
+            this->GenMeshAnimTexFrames(content->mesh);
+        }
+        for(uint32_t j = 0; j < content->static_mesh_count; j++)
+        {
+            this->GenMeshAnimTexFrames(content->static_mesh[j].mesh);
+        }
+    }
+}
+
+void CRender::GenMeshAnimTexFrames(struct base_mesh_s *mesh)
+{
+    if(!mesh || !mesh->animated_vertex_count || mesh->vbo_animated_frame_array)
+    {
+        return;
+    }
+
+    for(polygon_p p = mesh->animated_polygons; p; p = p->next)
+    {
+        if((p->anim_id > m_anim_sequences_count) || (m_anim_sequences[p->anim_id - 1].frames_count == 0))
+        {
+            return;                                                             // sequence added later by script - keep per mesh mapping
+        }
+    }
+
+    size_t buf_size = mesh->animated_vertex_count * sizeof(GLfloat);
+    GLfloat *buf = (GLfloat*)Sys_GetTempMem(buf_size);
+    GLfloat *data = buf;
+    for(polygon_p p = mesh->animated_polygons; p; p = p->next)
+    {
+        anim_seq_p seq = m_anim_sequences + p->anim_id - 1;
+        GLfloat slot = (GLfloat)(m_anim_tex_first[p->anim_id - 1] + p->frame_offset % seq->frames_count);
+        for(uint16_t i = 0; i < p->vertex_count; i++)
+        {
+            *data++ = slot;
+        }
+    }
+
+    qglGenBuffersARB(1, &mesh->vbo_animated_frame_array);
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh->vbo_animated_frame_array);
+    qglBufferDataARB(GL_ARRAY_BUFFER_ARB, buf_size, buf, GL_STATIC_DRAW_ARB);
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+    Sys_ReturnTempMem(buf_size);
+}
+
 // This function is used for updating global animated texture frame
 void CRender::UpdateAnimTextures()
 {
@@ -222,6 +399,32 @@ void CRender::UpdateAnimTextures()
                 };
             }
         }
+
+        this->UpdateAnimTexTable();
+    }
+}
+
+void CRender::UpdateAnimTexTable()
+{
+    if(m_anim_tex_frames_count)
+    {
+        anim_seq_p seq = m_anim_sequences;
+        for(uint32_t i = 0; i < m_anim_sequences_count; i++, seq++)
+        {
+            GLfloat *f = m_anim_tex_frames + 8 * m_anim_tex_first[i];
+            for(uint16_t k = 0; k < seq->frames_count; k++, f += 8)
+            {
+                tex_frame_p tf = seq->frames + (seq->current_frame + k) % seq->frames_count;
+                f[0] = tf->mat[0];
+                f[1] = tf->mat[1];
+                f[2] = tf->mat[2];
+                f[3] = tf->mat[3];
+                f[4] = tf->move[0];
+                f[5] = tf->move[1] - tf->current_uvrotate;
+                f[6] = 0.0f;
+                f[7] = 0.0f;
+            }
+        }
     }
 }
 
@@ -230,24 +433,44 @@ void CRender::UpdateAnimTextures()
  */
 void CRender::GenWorldList(struct camera_s *cam)
 {
-    this->CleanList();
+    struct vis_cache_key_s key;
     this->dynamicBSP->Reset(m_anim_sequences);
-    this->frustumManager->Reset();
     cam->frustum->next = NULL;
     m_camera = cam;
 
     if(m_rooms == NULL)
     {
+        this->CleanList();
+        this->frustumManager->Reset();
         return;
     }
 
     room_p curr_room = World_FindRoomByPosCogerrence(cam->transform.M4x4 + 12, cam->current_room);     // find room that contains camera
     GLfloat *cam_pos = cam->transform.M4x4 + 12;
     cam->current_room = curr_room;                                              // set camera's cuttent room pointer
+
+    /*
+     * The room list and rooms frustums chains depend only on camera room, camera transform
+     * and projection (and on flipped rooms - they drop the cache). While camera stands still
+     * the previous frame result is kept as is, skybox flag included.
+     */
+    this->GetVisibilityCacheKey(&key, cam, curr_room);
+    if(m_vis_cache_valid && (0 == memcmp(&key, &m_vis_cache_key, sizeof(key))))
+    {
+        m_vis_cache_hits++;
+        return;
+    }
+
+    m_vis_cache_misses++;
+    m_vis_depth = 0;
+    m_vis_max_depth = 0;
+    this->CleanList();
+    this->frustumManager->Reset();
     if(curr_room != NULL)                                                       // camera located in some room
     {
         const float eps = 10.0f;
         portal_p p = curr_room->content->portals;
+        m_vis_pvs_room = curr_room;
         curr_room->frustum = NULL;                                              // room with camera inside has no frustums!
         this->AddRoom(curr_room);                                               // room with camera inside adds to the render list immediately
         for(uint16_t i = 0; i < curr_room->content->portals_count; i++, p++)    // go through all start room portals
@@ -269,6 +492,7 @@ void CRender::GenWorldList(struct camera_s *cam)
                 dest_room->frustum = NULL;                                      // room with camera inside has no frustums!
                 if(this->AddRoom(dest_room))                                    // room with camera inside adds to the render list immediately
                 {
+                    m_vis_pvs_room = dest_room;
                     for(uint16_t ii = 0; ii < dest_room->content->portals_count; ii++, np++)// go through all start room portals
                     {
                         room_p ndest_room = np->dest_room->real_room;
@@ -280,20 +504,57 @@ void CRender::GenWorldList(struct camera_s *cam)
                             this->ProcessRoom(np, last_frus);                   // next start reccursion algorithm
                         }
                     }
+                    m_vis_pvs_room = curr_room;
                 }
             }
         }
     }
     else                                                                        // camera is out of all rooms
     {
+        size_t bb_size = 6 * m_rooms_count * sizeof(float);
+        size_t mask_size = FRUSTUM_MASK_WORDS(m_rooms_count) * sizeof(uint32_t);
+        uint32_t *visible = (uint32_t*)Sys_GetTempMem(mask_size);
+        float *bb = (float*)Sys_GetTempMem(bb_size);
         curr_room = m_rooms;                                                    // draw full level. Yes - it is slow, but it is not gameplay - it is debug.
         for(uint32_t i = 0; i < m_rooms_count; i++, curr_room++)
         {
-            if(Frustum_IsAABBVisible(curr_room->bb_min, curr_room->bb_max, cam->frustum))
+            vec3_copy(bb + 6 * i, curr_room->bb_min);
+            vec3_copy(bb + 6 * i + 3, curr_room->bb_max);
+        }
+        Frustum_CullAABBs(bb, m_rooms_count, cam->frustum, visible);
+        Sys_ReturnTempMem(bb_size);
+
+        curr_room = m_rooms;
+        for(uint32_t i = 0; i < m_rooms_count; i++, curr_room++)
+        {
+            if(FRUSTUM_MASK_TEST(visible, i))
             {
                 this->AddRoom(curr_room->real_room);
             }
         }
+        Sys_ReturnTempMem(mask_size);
+    }
+
+    // camera out of rooms is a debug case, overflowed frustums are reallocated by the next Reset()
+    m_vis_cache_key = key;
+    m_vis_cache_valid = (cam->current_room != NULL) && !frustumManager->IsOverflowed();
+}
+
+void CRender::GetVisibilityCacheKey(struct vis_cache_key_s *key, struct camera_s *cam, struct room_s *room)
+{
+    const float *m = cam->transform.M4x4;
+
+    memset(key, 0x00, sizeof(struct vis_cache_key_s));                          // padding takes part in comparison
+    key->camera = cam;
+    key->room = room;
+    key->fov = cam->fov;
+    key->aspect = cam->aspect;
+    for(int i = 0; i < 3; i++)
+    {
+        key->pos[i] = (int32_t)floorf(m[12 + i] / RENDER_VIS_CACHE_POS_STEP);
+        key->axes[i + 0] = (int16_t)floorf(m[0 + i] * RENDER_VIS_CACHE_AXIS_STEPS);
+        key->axes[i + 3] = (int16_t)floorf(m[4 + i] * RENDER_VIS_CACHE_AXIS_STEPS);
+        key->axes[i + 6] = (int16_t)floorf(m[8 + i] * RENDER_VIS_CACHE_AXIS_STEPS);
     }
 }
 
@@ -329,39 +590,57 @@ void CRender::DrawList()
         /*
          * room rendering
          */
+        this->UpdateOcclusion();
         for(uint32_t i = 0; i < r_list_active_count; i++)
         {
-            this->DrawRoom(r_list[i].room, m_camera->gl_view_mat, m_camera->gl_view_proj_mat);
+            if(r_list[i].active)
+            {
+                this->QueueRoom(r_list[i].room);
+            }
         }
+        this->DrawQueue();
 
         qglDisable(GL_CULL_FACE);
         for(uint32_t i = 0; i < r_list_active_count; i++)
         {
-            this->DrawRoomSprites(r_list[i].room);
+            if(r_list[i].active)
+            {
+                this->DrawRoomSprites(r_list[i].room);
+            }
         }
 
         /*
          * NOW render transparency polygons
          */
-        /*First generate BSP from base room mesh - it has good for start splitter polygons*/
+        m_transparency_polygons = 0;
+        m_transparency_draws = 0;
         for(uint32_t i = 0; i < r_list_active_count; i++)
         {
             room_p r = r_list[i].room;
-            if((r->content->mesh != NULL) && (r->content->mesh->transparency_polygons != NULL))
+            if(r_list[i].active && (r->content->mesh != NULL) && (r->content->mesh->transparency_polygons != NULL))
             {
-                dynamicBSP->AddNewPolygonList(r->content->mesh->transparency_polygons, r->transform, m_camera->frustum);
+                // base room mesh first - it has good for start splitter polygons
+                this->AddTransparentMesh(r->content->mesh, r->transform, true);
             }
         }
 
         for(uint32_t i = 0; i < r_list_active_count; i++)
         {
             room_p r = r_list[i].room;
+            uint32_t objects_count;
+            uint32_t *visible;
+            uint32_t obj = 0;
+            if(!r_list[i].active)
+            {
+                continue;
+            }
+            visible = this->CullRoomObjects(r, (r->frustum) ? (r->frustum) : (m_camera->frustum), &objects_count);
             // Add transparency polygons from static meshes (if they exists)
-            for(uint16_t j = 0; j < r->content->static_mesh_count; j++)
+            for(uint16_t j = 0; j < r->content->static_mesh_count; j++, obj++)
             {
-                if((r->content->static_mesh[j].mesh->transparency_polygons != NULL) && Frustum_IsOBBVisibleInFrustumList(r->content->static_mesh[j].obb, (r->frustum) ? (r->frustum) : (m_camera->frustum)))
+                if((r->content->static_mesh[j].mesh->transparency_polygons != NULL) && FRUSTUM_MASK_TEST(visible, obj))
                 {
-                    dynamicBSP->AddNewPolygonList(r->content->static_mesh[j].mesh->transparency_polygons, r->content->static_mesh[j].transform, m_camera->frustum);
+                    this->AddTransparentMesh(r->content->static_mesh[j].mesh, r->content->static_mesh[j].transform, false);
                 }
             }
 
@@ -371,7 +650,7 @@ void CRender::DrawList()
                 if(cont->object_type == OBJECT_ENTITY)
                 {
                     entity_p ent = (entity_p)cont->object;
-                    if((ent->state_flags & ENTITY_STATE_VISIBLE) && ent->bf->animations.model && (ent->bf->animations.model->transparency_flags == MESH_HAS_TRANSPARENCY) && Frustum_IsOBBVisibleInFrustumList(ent->obb, (r->frustum) ? (r->frustum) : (m_camera->frustum)))
+                    if((ent->state_flags & ENTITY_STATE_VISIBLE) && ent->bf->animations.model && (ent->bf->animations.model->transparency_flags == MESH_HAS_TRANSPARENCY) && FRUSTUM_MASK_TEST(visible, obj))
                     {
                         float tr[16];
                         for(uint16_t j = 0; j < ent->bf->bone_tag_count; j++)
@@ -379,36 +658,23 @@ void CRender::DrawList()
                             if(ent->bf->bone_tags[j].mesh_base->transparency_polygons != NULL)
                             {
                                 Mat4_Mat4_mul(tr, ent->transform.M4x4, ent->bf->bone_tags[j].full_transform);
-                                dynamicBSP->AddNewPolygonList(ent->bf->bone_tags[j].mesh_base->transparency_polygons, tr, m_camera->frustum);
+                                this->AddTransparentMesh(ent->bf->bone_tags[j].mesh_base, tr, false);
                             }
                         }
                     }
+                    obj++;
                 }
             }
+            Sys_ReturnTempMem(FRUSTUM_MASK_WORDS(objects_count) * sizeof(uint32_t));
         }
 
-        if(dynamicBSP->m_root->polygons_front && (dynamicBSP->m_vbo != 0))
+        if(settings.transparency_mode == RENDER_TRANSPARENCY_SORTED)
         {
-            const unlit_tinted_shader_description *shader = shaderManager->getRoomShader(false, false);
-            qglUseProgramObjectARB(shader->program);
-            qglUniform1iARB(shader->sampler, 0);
-            qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, m_camera->gl_view_proj_mat);
-            qglUniform1fARB(shader->dist_fog, m_camera->dist_far);
-            qglDepthMask(GL_FALSE);
-            qglDisable(GL_ALPHA_TEST);
-            qglEnable(GL_BLEND);
-            m_active_transparency = 0;
-            qglBindBufferARB(GL_ARRAY_BUFFER_ARB, dynamicBSP->m_vbo);
-            qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
-            qglBufferDataARB(GL_ARRAY_BUFFER_ARB, dynamicBSP->GetActiveVertexCount() * sizeof(vertex_t), dynamicBSP->GetVertexArray(), GL_DYNAMIC_DRAW);
-            qglVertexPointer(3, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, position));
-            qglColorPointer(4, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, color));
-            qglNormalPointer(GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, normal));
-            qglTexCoordPointer(2, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, tex_coord));
-            this->DrawBSPBackToFront(dynamicBSP->m_root);
-            qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
-            qglDepthMask(GL_TRUE);
-            qglDisable(GL_BLEND);
+            this->DrawTransparencySorted();
+        }
+        else
+        {
+            this->DrawTransparencyBSP();
         }
         //Reset polygon draw mode
         qglPolygonMode(GL_FRONT, GL_FILL);
@@ -416,133 +682,554 @@ void CRender::DrawList()
     }
 }
 
-void CRender::DrawListDebugLines()
+/*
+ * TRANSPARENCY
+ * BSP path splits and sorts every visible polygon each frame and uploads the whole tree.
+ * Sorted path keeps transparency polygons of every mesh in a static VBO: meshes are drawn
+ * back to front, polygons of the room meshes are sorted inside the room, and polygons with
+ * the same blending and texture go in one draw call. Most TR blending modes are additive,
+ * so the order inside a mesh is not important for them.
+ */
+void CRender::AddTransparentMesh(struct base_mesh_s *mesh, const float transform[16], bool sort_polygons)
 {
-    if(r_flags && m_camera)
+    if(settings.transparency_mode == RENDER_TRANSPARENCY_SORTED)
     {
-        debugDrawer->SetDrawFlags(r_flags);
+        struct transparent_item_s *item;
+        float centre[3];
 
-        /*
-         * Render world debug information
-         */
-        skeletal_model_p skybox = World_GetSkybox();
-        if((r_flags & R_DRAW_NORMALS) && skybox)
+        if(m_transparent_items_count >= m_transparent_items_size)
         {
-            GLfloat tr[16];
-            float *p;
-            Mat4_E_macro(tr);
-            p = skybox->animations->frames->bone_tags->offset;
-            vec3_add(tr + 12, m_camera->transform.M4x4 + 12, p);
-            p = skybox->animations->frames->bone_tags->qrotate;
-            Mat4_set_qrotation(tr, p);
-            debugDrawer->DrawMeshDebugLines(skybox->mesh_tree->mesh_base, tr, NULL, NULL);
+            m_transparent_items_size = (m_transparent_items_size) ? (2 * m_transparent_items_size) : (256);
+            m_transparent_items = (struct transparent_item_s*)realloc(m_transparent_items, m_transparent_items_size * sizeof(struct transparent_item_s));
         }
+        item = m_transparent_items + m_transparent_items_count++;
+        item->mesh = mesh;
+        item->sort_polygons = sort_polygons;
+        memcpy(item->transform, transform, sizeof(item->transform));
+        Mat4_vec3_mul_macro(centre, transform, mesh->centre);
+        item->dist = vec3_dist_sq(centre, m_camera->transform.M4x4 + 12);
+    }
+    else
+    {
+        dynamicBSP->AddNewPolygonList(mesh->transparency_polygons, (float*)transform, m_camera->frustum);
+    }
+}
 
-        for(uint32_t i = 0; i < r_list_active_count; i++)
-        {
-            debugDrawer->DrawRoomDebugLines(r_list[i].room, m_camera);
-        }
 
-        if(r_flags & R_DRAW_COLL)
-        {
-            Physics_DebugDrawWorld();
-        }
+void CRender::DrawTransparencyBSP()
+{
+    if(dynamicBSP->m_root->polygons_front && (dynamicBSP->m_vbo != 0))
+    {
+        const unlit_tinted_shader_description *shader = shaderManager->getRoomShader(false, false);
+        qglUseProgramObjectARB(shader->program);
+        qglUniform1iARB(shader->sampler, 0);
+        qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, m_camera->gl_view_proj_mat);
+        qglUniform1fARB(shader->dist_fog, m_camera->dist_far);
+        qglDepthMask(GL_FALSE);
+        qglDisable(GL_ALPHA_TEST);
+        qglEnable(GL_BLEND);
+        m_active_transparency = 0;
+        qglBindBufferARB(GL_ARRAY_BUFFER_ARB, dynamicBSP->m_vbo);
+        qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+        qglBufferDataARB(GL_ARRAY_BUFFER_ARB, dynamicBSP->GetActiveVertexCount() * sizeof(vertex_t), dynamicBSP->GetVertexArray(), GL_DYNAMIC_DRAW);
+        qglVertexPointer(3, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, position));
+        qglColorPointer(4, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, color));
+        qglNormalPointer(GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, normal));
+        qglTexCoordPointer(2, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, tex_coord));
+        this->DrawBSPBackToFront(dynamicBSP->m_root);
+        qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+        qglDepthMask(GL_TRUE);
+        qglDisable(GL_BLEND);
+        m_transparency_polygons = dynamicBSP->GetAddedPolygonsCount();
+    }
+}
 
-        if(r_flags & R_DRAW_FLYBY)
-        {
-            const float color_r[3] = {1.0f, 0.0f, 0.0f};
-            const float color_g[3] = {0.0f, 1.0f, 0.0f};
-            float v0[3], v1[3];
 
-            for(flyby_camera_sequence_p s = World_GetFlyBySequences(); s; s = s->next)
-            {
-                const float max_s = s->pos_x->base_points_count - 1;
-                const float dt = max_s / 256.0f;
-                for(float t = 0.0f; t <= max_s - dt; t += dt)
-                {
-                    v0[0] = Spline_Get(s->pos_x, t);
-                    v0[1] = Spline_Get(s->pos_y, t);
-                    v0[2] = Spline_Get(s->pos_z, t);
-                    v1[0] = Spline_Get(s->pos_x, t + dt);
-                    v1[1] = Spline_Get(s->pos_y, t + dt);
-                    v1[2] = Spline_Get(s->pos_z, t + dt);
-                    debugDrawer->DrawLine(v0, v1, color_r, color_r);
+static int CRender_CompareTransparentItems(const void *a, const void *b)
+{
+    float da = ((const CRender::transparent_item_s*)a)->dist;
+    float db = ((const CRender::transparent_item_s*)b)->dist;
+    return (da > db) ? (-1) : ((da < db) ? (1) : (0));                          // far first
+}
 
-                    v0[0] = Spline_Get(s->target_x, t);
-                    v0[1] = Spline_Get(s->target_y, t);
-                    v0[2] = Spline_Get(s->target_z, t);
-                    v1[0] = Spline_Get(s->target_x, t + dt);
-                    v1[1] = Spline_Get(s->target_y, t + dt);
-                    v1[2] = Spline_Get(s->target_z, t + dt);
-                    debugDrawer->DrawLine(v0, v1, color_g, color_g);
-                }
-            }
-        }
 
-        if(r_flags & R_DRAW_CINEMATICS)
-        {
-            const float color_r[3] = {1.0f, 0.0f, 0.0f};
-            const float color_g[3] = {0.0f, 1.0f, 0.0f};
-            float v0[3], v1[3];
-            uint32_t id = 0;
-            while(camera_frame_p frame = World_GetCinematicFrame(id++))
-            {
-                Mat4_vec3_mul(v0, engine_camera_state.cutscene_tr, frame->pos);
-                Mat4_vec3_mul(v1, engine_camera_state.cutscene_tr, frame->target);
-                debugDrawer->DrawLine(v0, v1, color_r, color_g);
-            }
-            debugDrawer->DrawAxis(4096.0f, engine_camera_state.cutscene_tr);
-        }
+typedef struct transparent_polygon_order_s
+{
+    float           dist;
+    uint32_t        index;
+}transparent_polygon_order_t, *transparent_polygon_order_p;
 
-        if(r_flags & R_DRAW_AI_BOXES)
-        {
-            float tr[16];
-            uint32_t id = 0;
+static int CRender_CompareTransparentPolygons(const void *a, const void *b)
+{
+    float da = ((const transparent_polygon_order_s*)a)->dist;
+    float db = ((const transparent_polygon_order_s*)b)->dist;
+    return (da > db) ? (-1) : ((da < db) ? (1) : (0));                          // far first
+}
 
-            Mat4_E_macro(tr);
-            debugDrawer->SetColor(0.7f, 0.6f, 0.3f);
-            for(room_box_p rb = World_GetRoomBoxByID(id); rb; rb = World_GetRoomBoxByID(++id))
-            {
-                debugDrawer->DrawBBox(rb->bb_min, rb->bb_max, tr);
-            }
-        }
 
-        if(r_flags & R_DRAW_CAMERAS)
-        {
-            uint32_t id = 0;
-            for(static_camera_sink_p sink = World_GetStaticCameraSink(id); sink; sink = World_GetStaticCameraSink(++id))
-            {
-                this->OutTextXYZ(sink->pos[0], sink->pos[1], sink->pos[2], "S[%d]", id);
-            }
-        }
+static int CRender_CompareTransparencyStates(const void *a, const void *b)
+{
+    polygon_p pa = *((polygon_p*)a);
+    polygon_p pb = *((polygon_p*)b);
+    if(pa->transparency != pb->transparency)
+    {
+        return (pa->transparency < pb->transparency) ? (-1) : (1);
     }
+    return (pa->texture_index < pb->texture_index) ? (-1) : ((pa->texture_index > pb->texture_index) ? (1) : (0));
+}
 
-    if(!debugDrawer->IsEmpty() && m_camera)
+
+void CRender::DrawTransparencySorted()
+{
+    if(m_transparent_items_count > 0)
     {
         const unlit_tinted_shader_description *shader = shaderManager->getRoomShader(false, false);
-        qglDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        qsort(m_transparent_items, m_transparent_items_count, sizeof(struct transparent_item_s), CRender_CompareTransparentItems);
+
         qglUseProgramObjectARB(shader->program);
         qglUniform1iARB(shader->sampler, 0);
-        qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, m_camera->gl_view_proj_mat);
         qglUniform1fARB(shader->dist_fog, m_camera->dist_far);
-        qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
-        m_active_texture = 0;
-        BindWhiteTexture();
+        if(shader->anim_tex_index >= 0)
+        {
+            qglDisableVertexAttribArrayARB(shader->anim_tex_index);
+            qglVertexAttrib1fARB(shader->anim_tex_index, 0.0f);                 // identity slot, texcoords are mapped on CPU
+        }
+        qglDepthMask(GL_FALSE);
+        qglDisable(GL_ALPHA_TEST);
+        qglEnable(GL_BLEND);
+        m_active_transparency = 0;
         qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
-        qglPointSize( 6.0f );
-        qglLineWidth( 3.0f );
-        debugDrawer->Render();
+        for(uint32_t i = 0; i < m_transparent_items_count; i++)
+        {
+            this->DrawTransparentItem(shader, m_transparent_items + i);
+        }
+        qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+        qglDepthMask(GL_TRUE);
+        qglDisable(GL_BLEND);
     }
-    debugDrawer->Reset();
+    m_transparent_items_count = 0;
 }
 
-void CRender::CleanList()
+
+void CRender::DrawTransparencyRun(struct mesh_transparency_s *mt, const GLuint *indices, GLsizei count)
 {
-    for(uint32_t i = 0; i < r_list_active_count; i++)
+    this->SetBlendMode(mt->transparency);
+    if(m_active_texture != mt->texture_index)
     {
-        r_list[i].active = 0;
-        r_list[i].dist = 0.0;
-        r_list[i].room = NULL;
+        m_active_texture = mt->texture_index;
+        qglBindTexture(GL_TEXTURE_2D, m_active_texture);
+    }
+    qglDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, indices);
+    m_transparency_draws++;
+}
+
+
+/*
+ * Same as CDynamicBSP::AddNewPolygonList does for the BSP path: current frame gives both
+ * the texcoords and the atlas page.
+ */
+void CRender::UpdateTransparencyTexCoords(struct base_mesh_s *mesh)
+{
+    GLuint first = mesh->transparency[mesh->transparency_animated_first].first_element;
+    GLuint last = mesh->transparency[mesh->transparency_count - 1].first_element + mesh->transparency[mesh->transparency_count - 1].elements_count;
+    size_t buf_size = (last - first) * sizeof(GLfloat [2]);
+    GLfloat *buf = (GLfloat*)Sys_GetTempMem(buf_size);
+    GLfloat *data = buf;
+
+    for(uint32_t i = mesh->transparency_animated_first; i < mesh->transparency_count; i++)
+    {
+        polygon_p p = mesh->transparency[i].anim_polygon;
+        anim_seq_p seq = m_anim_sequences + p->anim_id - 1;
+        tex_frame_p tf = seq->frames + (seq->current_frame + p->frame_offset) % seq->frames_count;
+        for(uint16_t j = 1; j + 1 < p->vertex_count; j++, data += 6)
+        {
+            ApplyAnimTextureTransformation(data + 0, p->vertices[0].tex_coord, tf);
+            ApplyAnimTextureTransformation(data + 2, p->vertices[j].tex_coord, tf);
+            ApplyAnimTextureTransformation(data + 4, p->vertices[j + 1].tex_coord, tf);
+        }
+    }
+
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh->vbo_transparency_texcoord_array);
+    qglBufferDataARB(GL_ARRAY_BUFFER_ARB, last * sizeof(GLfloat [2]), NULL, GL_STREAM_DRAW_ARB);    // orphan, static part is never read
+    qglBufferSubDataARB(GL_ARRAY_BUFFER_ARB, first * sizeof(GLfloat [2]), buf_size, buf);
+    Sys_ReturnTempMem(buf_size);
+}
+
+
+void CRender::DrawAnimatedTransparency(struct base_mesh_s *mesh, struct mesh_transparency_s *mt)
+{
+    polygon_p p = mt->anim_polygon;
+    anim_seq_p seq = m_anim_sequences + p->anim_id - 1;
+    tex_frame_p tf = seq->frames + (seq->current_frame + p->frame_offset) % seq->frames_count;
+
+    this->SetBlendMode(mt->transparency);
+    if(m_active_texture != tf->texture_index)
+    {
+        m_active_texture = tf->texture_index;
+        qglBindTexture(GL_TEXTURE_2D, m_active_texture);
+    }
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh->vbo_transparency_texcoord_array);
+    qglTexCoordPointer(2, GL_FLOAT, sizeof(GLfloat [2]), 0);
+    qglDrawArrays(GL_TRIANGLES, mt->first_element, mt->elements_count);
+    m_transparency_draws++;
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh->vbo_transparency_array);
+    qglTexCoordPointer(2, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, tex_coord));
+}
+
+
+void CRender::DrawTransparentItem(const struct unlit_tinted_shader_description *shader, struct transparent_item_s *item)
+{
+    base_mesh_p mesh = item->mesh;
+    GLfloat mvp[16];
+    GLuint elements = 0;
+
+    if(mesh->vbo_transparency_array == 0)
+    {
+        this->GenMeshTransparency(mesh);
+    }
+    for(uint32_t i = 0; i < mesh->transparency_count; i++)
+    {
+        elements += mesh->transparency[i].elements_count;
+    }
+    if(elements == 0)
+    {
+        return;
+    }
+
+    if(mesh->transparency_animated_first < mesh->transparency_count)
+    {
+        this->UpdateTransparencyTexCoords(mesh);
+    }
+    Mat4_Mat4_mul(mvp, m_camera->gl_view_proj_mat, item->transform);
+    qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, mvp);
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh->vbo_transparency_array);
+    qglVertexPointer(3, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, position));
+    qglColorPointer(4, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, color));
+    qglNormalPointer(GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, normal));
+    qglTexCoordPointer(2, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, tex_coord));
+    m_transparency_polygons += mesh->transparency_count;
+
+    if(item->sort_polygons)
+    {
+        // polygons back to front: indices are rebuilt, vertices stay in the VBO
+        size_t order_size = mesh->transparency_count * sizeof(transparent_polygon_order_t);
+        size_t indices_size = elements * sizeof(GLuint);
+        transparent_polygon_order_p order = (transparent_polygon_order_p)Sys_GetTempMem(order_size);
+        GLuint *indices = (GLuint*)Sys_GetTempMem(indices_size);
+        GLuint *index = indices;
+        GLuint *run = indices;
+        float cam_pos[3];
+        mesh_transparency_p prev = NULL;
+
+        Mat4_vec3_mul_inv_macro(cam_pos, item->transform, m_camera->transform.M4x4 + 12);
+        for(uint32_t i = 0; i < mesh->transparency_count; i++)
+        {
+            order[i].dist = vec3_dist_sq(mesh->transparency[i].centre, cam_pos);
+            order[i].index = i;
+        }
+        qsort(order, mesh->transparency_count, sizeof(transparent_polygon_order_t), CRender_CompareTransparentPolygons);
+
+        for(uint32_t i = 0; i < mesh->transparency_count; i++)
+        {
+            mesh_transparency_p mt = mesh->transparency + order[i].index;
+            if(prev && (mt->anim_polygon || (prev->transparency != mt->transparency) || (prev->texture_index != mt->texture_index)))
+            {
+                this->DrawTransparencyRun(prev, run, index - run);
+                run = index;
+                prev = NULL;
+            }
+            if(mt->anim_polygon)
+            {
+                this->DrawAnimatedTransparency(mesh, mt);
+                continue;
+            }
+            for(GLuint j = 0; j < mt->elements_count; j++)
+            {
+                *index++ = mt->first_element + j;
+            }
+            prev = mt;
+        }
+        if(prev)
+        {
+            this->DrawTransparencyRun(prev, run, index - run);
+        }
+
+        Sys_ReturnTempMem(indices_size);
+        Sys_ReturnTempMem(order_size);
+    }
+    else
+    {
+        // polygons are ordered by state at generation, so every static run is one draw
+        mesh_transparency_p mt = mesh->transparency;
+        for(uint32_t i = 0; i < mesh->transparency_animated_first; )
+        {
+            GLuint first = mt[i].first_element;
+            GLuint count = 0;
+            uint32_t j = i;
+            for(; (j < mesh->transparency_animated_first) && (mt[j].transparency == mt[i].transparency) && (mt[j].texture_index == mt[i].texture_index); j++)
+            {
+                count += mt[j].elements_count;
+            }
+            this->SetBlendMode(mt[i].transparency);
+            if(m_active_texture != mt[i].texture_index)
+            {
+                m_active_texture = mt[i].texture_index;
+                qglBindTexture(GL_TEXTURE_2D, m_active_texture);
+            }
+            qglDrawArrays(GL_TRIANGLES, first, count);
+            m_transparency_draws++;
+            i = j;
+        }
+        for(uint32_t i = mesh->transparency_animated_first; i < mesh->transparency_count; i++)
+        {
+            this->DrawAnimatedTransparency(mesh, mt + i);
+        }
+    }
+}
+
+
+/*
+ * Triangulated transparency polygons in mesh coordinates. Polygons with animated texture
+ * are kept at the end, they are drawn one by one with per frame texcoords and page.
+ */
+void CRender::GenMeshTransparency(struct base_mesh_s *mesh)
+{
+    uint32_t polygons_count = 0;
+    uint32_t static_count, animated_first;
+    uint32_t elements_count = 0;
+    polygon_p *polygons;
+    vertex_p vertices;
+    size_t polygons_size, buf_size;
+
+    for(polygon_p p = mesh->transparency_polygons; p; p = p->next)
+    {
+        if(p->vertex_count >= 3)
+        {
+            polygons_count++;
+            elements_count += 3 * (p->vertex_count - 2);
+        }
+    }
+    if(polygons_count == 0)
+    {
+        return;
+    }
+
+    // static polygons from the start, animated ones (their page is known per frame only) from the end
+    polygons_size = polygons_count * sizeof(polygon_p);
+    polygons = (polygon_p*)Sys_GetTempMem(polygons_size);
+    animated_first = polygons_count;
+    static_count = 0;
+    for(polygon_p p = mesh->transparency_polygons; p; p = p->next)
+    {
+        if(p->vertex_count >= 3)
+        {
+            bool animated = (p->anim_id > 0) && (p->anim_id <= m_anim_sequences_count) && (m_anim_sequences[p->anim_id - 1].frames_count > 0);
+            polygons[(animated) ? (--animated_first) : (static_count++)] = p;
+        }
+    }
+    qsort(polygons, static_count, sizeof(polygon_p), CRender_CompareTransparencyStates);
+    qsort(polygons + animated_first, polygons_count - animated_first, sizeof(polygon_p), CRender_CompareTransparencyStates);
+
+    buf_size = elements_count * sizeof(vertex_t);
+    vertices = (vertex_p)Sys_GetTempMem(buf_size);
+    mesh->transparency = (mesh_transparency_p)malloc(polygons_count * sizeof(mesh_transparency_t));
+    mesh->transparency_count = polygons_count;
+    mesh->transparency_animated_first = animated_first;
+
+    elements_count = 0;
+    for(uint32_t i = 0; i < polygons_count; i++)
+    {
+        polygon_p p = polygons[i];
+        mesh_transparency_p mt = mesh->transparency + i;
+
+        mt->anim_polygon = (i >= animated_first) ? (p) : (NULL);
+        mt->texture_index = p->texture_index;
+        mt->transparency = p->transparency;
+        mt->first_element = elements_count;
+        mt->elements_count = 3 * (p->vertex_count - 2);
+        vec3_set_zero(mt->centre);
+        for(uint16_t j = 0; j < p->vertex_count; j++)
+        {
+            vec3_add(mt->centre, mt->centre, p->vertices[j].position);
+        }
+        vec3_mul_scalar(mt->centre, mt->centre, 1.0f / (float)p->vertex_count);
+
+        for(uint16_t j = 1; j + 1 < p->vertex_count; j++)
+        {
+            vertices[elements_count++] = p->vertices[0];
+            vertices[elements_count++] = p->vertices[j];
+            vertices[elements_count++] = p->vertices[j + 1];
+        }
+    }
+
+    qglGenBuffersARB(1, &mesh->vbo_transparency_array);
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh->vbo_transparency_array);
+    qglBufferDataARB(GL_ARRAY_BUFFER_ARB, buf_size, vertices, GL_STATIC_DRAW_ARB);
+    if(animated_first < polygons_count)
+    {
+        qglGenBuffersARB(1, &mesh->vbo_transparency_texcoord_array);
+    }
+    Sys_ReturnTempMem(buf_size);
+    Sys_ReturnTempMem(polygons_size);
+}
+
+void CRender::DrawListDebugLines()
+{
+    if(r_flags && m_camera)
+    {
+        debugDrawer->SetDrawFlags(r_flags);
+
+        /*
+         * Render world debug information
+         */
+        skeletal_model_p skybox = World_GetSkybox();
+        if((r_flags & R_DRAW_NORMALS) && skybox)
+        {
+            GLfloat tr[16];
+            bone_tag_t sky_tag;
+            Mat4_E_macro(tr);
+            Anim_GetBoneTag(skybox->animations, 0, 0, &sky_tag);
+            vec3_add(tr + 12, m_camera->transform.M4x4 + 12, sky_tag.offset);
+            Mat4_set_qrotation(tr, sky_tag.qrotate);
+            debugDrawer->DrawMeshDebugLines(skybox->mesh_tree->mesh_base, tr, NULL, NULL);
+        }
+
+        for(uint32_t i = 0; i < r_list_active_count; i++)
+        {
+            debugDrawer->DrawRoomDebugLines(r_list[i].room, m_camera);
+        }
+
+        if(r_flags & R_DRAW_COLL)
+        {
+            Physics_DebugDrawWorld();
+        }
+
+        if(r_flags & R_DRAW_FLYBY)
+        {
+            const float color_r[3] = {1.0f, 0.0f, 0.0f};
+            const float color_g[3] = {0.0f, 1.0f, 0.0f};
+            float v0[3], v1[3];
+
+            for(flyby_camera_sequence_p s = World_GetFlyBySequences(); s; s = s->next)
+            {
+                const float max_s = s->pos_x->base_points_count - 1;
+                const float dt = max_s / 256.0f;
+                for(float t = 0.0f; t <= max_s - dt; t += dt)
+                {
+                    v0[0] = Spline_Get(s->pos_x, t);
+                    v0[1] = Spline_Get(s->pos_y, t);
+                    v0[2] = Spline_Get(s->pos_z, t);
+                    v1[0] = Spline_Get(s->pos_x, t + dt);
+                    v1[1] = Spline_Get(s->pos_y, t + dt);
+                    v1[2] = Spline_Get(s->pos_z, t + dt);
+                    debugDrawer->DrawLine(v0, v1, color_r, color_r);
+
+                    v0[0] = Spline_Get(s->target_x, t);
+                    v0[1] = Spline_Get(s->target_y, t);
+                    v0[2] = Spline_Get(s->target_z, t);
+                    v1[0] = Spline_Get(s->target_x, t + dt);
+                    v1[1] = Spline_Get(s->target_y, t + dt);
+                    v1[2] = Spline_Get(s->target_z, t + dt);
+                    debugDrawer->DrawLine(v0, v1, color_g, color_g);
+                }
+            }
+        }
+
+        if(r_flags & R_DRAW_CINEMATICS)
+        {
+            const float color_r[3] = {1.0f, 0.0f, 0.0f};
+            const float color_g[3] = {0.0f, 1.0f, 0.0f};
+            float v0[3], v1[3];
+            uint32_t id = 0;
+            while(camera_frame_p frame = World_GetCinematicFrame(id++))
+            {
+                Mat4_vec3_mul(v0, engine_camera_state.cutscene_tr, frame->pos);
+                Mat4_vec3_mul(v1, engine_camera_state.cutscene_tr, frame->target);
+                debugDrawer->DrawLine(v0, v1, color_r, color_g);
+            }
+            debugDrawer->DrawAxis(4096.0f, engine_camera_state.cutscene_tr);
+        }
+
+        if(r_flags & R_DRAW_AI_BOXES)
+        {
+            float tr[16];
+            uint32_t id = 0;
+
+            Mat4_E_macro(tr);
+            debugDrawer->SetColor(0.7f, 0.6f, 0.3f);
+            for(room_box_p rb = World_GetRoomBoxByID(id); rb; rb = World_GetRoomBoxByID(++id))
+            {
+                debugDrawer->DrawBBox(rb->bb_min, rb->bb_max, tr);
+            }
+        }
+
+        if(r_flags & R_DRAW_AI_PATH)
+        {
+            entity_p player = World_GetPlayer();
+            room_box_p root = (player && player->self->sector) ? (player->self->sector->box) : (NULL);
+            GLfloat color_from[3] = {0.0f, 0.4f, 0.0f};
+            GLfloat color_to[3] = {0.0f, 1.0f, 0.0f};
+            box_flow_field_p field;
+            for(uint32_t i = 0; root && (field = Room_GetFlowFieldByIndex(i)); ++i)
+            {
+                if(field->root != root->id)
+                {
+                    continue;
+                }
+                uint32_t id = 0;
+                for(room_box_p rb = World_GetRoomBoxByID(id); rb; rb = World_GetRoomBoxByID(++id))
+                {
+                    room_box_p next_box = (field->next[id] != id) ? (World_GetRoomBoxByID(field->next[id])) : (NULL);
+                    if(next_box)
+                    {
+                        GLfloat from[3], to[3];
+                        from[0] = 0.5f * (rb->bb_min[0] + rb->bb_max[0]);
+                        from[1] = 0.5f * (rb->bb_min[1] + rb->bb_max[1]);
+                        from[2] = rb->bb_min[2] + TR_METERING_STEP;
+                        Room_GetOverlapCenter(rb, next_box, to);
+                        to[2] = next_box->bb_min[2] + TR_METERING_STEP;
+                        debugDrawer->DrawLine(from, to, color_from, color_to);
+                    }
+                }
+            }
+        }
+
+        if(r_flags & R_DRAW_CAMERAS)
+        {
+            uint32_t id = 0;
+            for(static_camera_sink_p sink = World_GetStaticCameraSink(id); sink; sink = World_GetStaticCameraSink(++id))
+            {
+                this->OutTextXYZ(sink->pos[0], sink->pos[1], sink->pos[2], "S[%d]", id);
+            }
+        }
+    }
+
+    if(!debugDrawer->IsEmpty() && m_camera)
+    {
+        const unlit_tinted_shader_description *shader = shaderManager->getRoomShader(false, false);
+        qglDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        qglUseProgramObjectARB(shader->program);
+        qglUniform1iARB(shader->sampler, 0);
+        qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, m_camera->gl_view_proj_mat);
+        qglUniform1fARB(shader->dist_fog, m_camera->dist_far);
+        qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+        m_active_texture = 0;
+        BindWhiteTexture();
+        qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+        qglPointSize( 6.0f );
+        qglLineWidth( 3.0f );
+        debugDrawer->Render();
+    }
+    debugDrawer->Reset();
+}
+
+void CRender::CleanList()
+{
+    for(uint32_t i = 0; i < r_list_active_count; i++)
+    {
+        r_list[i].active = 0;
+        r_list[i].dist = 0.0;
+        r_list[i].room = NULL;
     }
 
     if(m_rooms)
@@ -561,15 +1248,15 @@ void CRender::CleanList()
 /*
  * Draw objects functions
  */
-void CRender::DrawBSPPolygon(struct bsp_polygon_s *p)
+void CRender::SetBlendMode(uint16_t transparency)
 {
     // Blending mode switcher.
     // Note that modes above 2 aren't explicitly used in TR textures, only for
     // internal particle processing. Theoretically it's still possible to use
     // them if you will force type via TRTextur utility.
-    if(m_active_transparency != p->transparency)
+    if(m_active_transparency != transparency)
     {
-        m_active_transparency = p->transparency;
+        m_active_transparency = transparency;
         switch(m_active_transparency)
         {
             case BM_MULTIPLY:                                    // Classic PC alpha
@@ -596,13 +1283,18 @@ void CRender::DrawBSPPolygon(struct bsp_polygon_s *p)
                 break;
         };
     }
+}
 
+void CRender::DrawBSPPolygon(struct bsp_polygon_s *p)
+{
+    this->SetBlendMode(p->transparency);
     if(m_active_texture != p->texture_index)
     {
         m_active_texture = p->texture_index;
         qglBindTexture(GL_TEXTURE_2D, m_active_texture);
     }
     qglDrawElements(GL_TRIANGLE_FAN, p->vertex_count, GL_UNSIGNED_INT, p->indexes);
+    m_transparency_draws++;
 }
 
 void CRender::DrawBSPFrontToBack(struct bsp_node_s *root)
@@ -701,9 +1393,23 @@ void CRender::DrawBSPBackToFront(struct bsp_node_s *root)
     }
 }
 
-void CRender::DrawMesh(struct base_mesh_s *mesh, const float *overrideVertices, const float *overrideNormals)
+/**
+ * @anim_tex_index - anim textures table slot attribute of the current shader, -1 if shader has no table
+ */
+void CRender::DrawMeshAnimatedFaces(struct base_mesh_s *mesh, GLint anim_tex_index)
 {
-    if(mesh->animated_vertex_count)
+    bool use_table = (anim_tex_index >= 0) && mesh->vbo_animated_frame_array && m_anim_tex_frames_count;
+
+    if(use_table)
+    {
+        // Slots are static, shader takes the frame from the table
+        qglBindBufferARB(GL_ARRAY_BUFFER, mesh->vbo_animated_frame_array);
+        qglEnableVertexAttribArrayARB(anim_tex_index);
+        qglVertexAttribPointerARB(anim_tex_index, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), 0);
+        qglBindBufferARB(GL_ARRAY_BUFFER, mesh->vbo_animated_vertex_array);
+        qglTexCoordPointer(2, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, tex_coord));
+    }
+    else
     {
         // Respecify the tex coord buffer
         qglBindBufferARB(GL_ARRAY_BUFFER, mesh->vbo_animated_texcoord_array);
@@ -726,22 +1432,38 @@ void CRender::DrawMesh(struct base_mesh_s *mesh, const float *overrideVertices,
 
         // Setup altered buffer
         qglTexCoordPointer(2, GL_FLOAT, sizeof(GLfloat [2]), 0);
-        // Setup static data
         qglBindBufferARB(GL_ARRAY_BUFFER, mesh->vbo_animated_vertex_array);
-        qglVertexPointer(3, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, position));
-        qglColorPointer(4, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, color));
-        qglNormalPointer(GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, normal));
+    }
+
+    // Setup static data
+    qglVertexPointer(3, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, position));
+    qglColorPointer(4, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, color));
+    qglNormalPointer(GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, normal));
 
-        mesh_face_p face = mesh->animated_faces;
-        for(uint32_t face_index = 0; face_index < mesh->animated_faces_count; face_index++, face++)
+    mesh_face_p face = mesh->animated_faces;
+    for(uint32_t face_index = 0; face_index < mesh->animated_faces_count; face_index++, face++)
+    {
+        if(m_active_texture != face->texture_index)
         {
-            if(m_active_texture != face->texture_index)
-            {
-                m_active_texture = face->texture_index;
-                qglBindTexture(GL_TEXTURE_2D, m_active_texture);
-            }
-            qglDrawElements(GL_TRIANGLES, face->elements_count, GL_UNSIGNED_INT, face->elements);
+            m_active_texture = face->texture_index;
+            qglBindTexture(GL_TEXTURE_2D, m_active_texture);
         }
+        qglDrawElements(GL_TRIANGLES, face->elements_count, GL_UNSIGNED_INT, face->elements);
+    }
+
+    if(use_table)
+    {
+        qglDisableVertexAttribArrayARB(anim_tex_index);
+        qglVertexAttrib1fARB(anim_tex_index, 0.0f);                             // back to identity slot
+    }
+}
+
+
+void CRender::DrawMesh(struct base_mesh_s *mesh, const float *overrideVertices, const float *overrideNormals)
+{
+    if(mesh->animated_vertex_count)
+    {
+        this->DrawMeshAnimatedFaces(mesh, -1);
     }
 
     if(mesh->vertex_count == 0)
@@ -768,6 +1490,11 @@ void CRender::DrawMesh(struct base_mesh_s *mesh, const float *overrideVertices,
         qglNormalPointer(GL_FLOAT, 0, overrideNormals);
     }
 
+    this->DrawMeshFaces(mesh);
+}
+
+void CRender::DrawMeshFaces(struct base_mesh_s *mesh)
+{
     mesh_face_p face = mesh->faces;
     for(uint32_t face_index = 0; face_index < mesh->faces_count; face_index++, face++)
     {
@@ -780,41 +1507,132 @@ void CRender::DrawMesh(struct base_mesh_s *mesh, const float *overrideVertices,
     }
 }
 
-void CRender::DrawSkinMesh(struct base_mesh_s *mesh, struct base_mesh_s *parent_mesh, uint32_t *map, float transform[16])
+/*
+ * Skinned vertices are kept per bone tag in a streaming VBO and recomputed only when the
+ * bone local transform (or skin / parent mesh) is changed.
+ */
+void CRender::DrawSkinMesh(struct ss_bone_tag_s *btag)
 {
-    uint32_t i;
-    vertex_p v;
-    float *p_vertex, *src_v, *dst_v;
-    GLfloat *p_normale, *src_n, *dst_n;
-    size_t buf_size = mesh->vertex_count * 3 * sizeof(GLfloat);
+    base_mesh_p mesh = btag->mesh_skin;
+    ss_skin_cache_p cache = btag->skin_cache;
+
+    if(mesh->animated_vertex_count)
+    {
+        this->DrawMeshAnimatedFaces(mesh, -1);
+    }
+
+    if(mesh->vertex_count == 0)
+    {
+        return;
+    }
+
+    if(cache == NULL)
+    {
+        cache = btag->skin_cache = (ss_skin_cache_p)calloc(1, sizeof(ss_skin_cache_t));
+    }
+    if((cache->mesh != mesh) || (cache->parent_mesh != btag->parent->mesh_base) || (cache->vbo == 0) ||
+       (0 != memcmp(cache->transform, btag->transform, sizeof(cache->transform))))
+    {
+        Perf_Call("SkinMesh", this->SkinMesh(btag, cache));
+    }
 
-    p_vertex  = (GLfloat*)Sys_GetTempMem(buf_size);
-    p_normale = (GLfloat*)Sys_GetTempMem(buf_size);
-    dst_v = p_vertex;
-    dst_n = p_normale;
-    v = mesh->vertices;
-    for(i = 0; i < mesh->vertex_count; i++, v++, map++)
+    if(mesh->vbo_vertex_array)
     {
-        src_v = v->position;
-        src_n = v->normal;
-        if(*map == 0xFFFFFFFF)
+        qglBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh->vbo_vertex_array);
+        qglColorPointer(4, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, color));
+        qglTexCoordPointer(2, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, tex_coord));
+    }
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, cache->vbo);
+    qglVertexPointer(3, GL_FLOAT, 0, (void*)0);
+    qglNormalPointer(GL_FLOAT, 0, (void*)(mesh->vertex_count * 3 * sizeof(GLfloat)));
+    this->DrawMeshFaces(mesh);
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+/*
+ * Skin vertex is the parent mesh vertex moved to the bone space: R^T * (p - t), normal is R^T * n.
+ * SSE path computes x * R^T[0] + y * R^T[1] + z * R^T[2] for the whole vertex at once and
+ * writes 4 floats, so output buffers have one float of tail.
+ */
+void CRender::SkinMesh(struct ss_bone_tag_s *btag, struct ss_skin_cache_s *cache)
+{
+    base_mesh_p mesh = btag->mesh_skin;
+    base_mesh_p parent_mesh = btag->parent->mesh_base;
+    const float *tr = btag->transform;
+    const uint32_t *map = btag->skin_map;
+    size_t buf_size = 2 * mesh->vertex_count * 3 * sizeof(GLfloat);
+    GLfloat *dst_v = (GLfloat*)Sys_GetTempMem(buf_size);
+    GLfloat *dst_n = dst_v + 3 * mesh->vertex_count;
+    vertex_p v = mesh->vertices;
+#ifdef RENDER_USE_SSE
+    const __m128 r0 = _mm_set_ps(0.0f, tr[8], tr[4], tr[0]);
+    const __m128 r1 = _mm_set_ps(0.0f, tr[9], tr[5], tr[1]);
+    const __m128 r2 = _mm_set_ps(0.0f, tr[10], tr[6], tr[2]);
+    const __m128 t  = _mm_set_ps(0.0f, tr[14], tr[13], tr[12]);
+
+    for(uint32_t i = 0; i < mesh->vertex_count; i++, v++, dst_v += 3, dst_n += 3)
+    {
+        if(map[i] == 0xFFFFFFFF)
+        {
+            vec3_copy(dst_v, v->position);
+            vec3_copy(dst_n, v->normal);
+        }
+        else
         {
-            vec3_copy(dst_v, src_v);
-            vec3_copy(dst_n, src_n);
+            __m128 p = _mm_sub_ps(_mm_loadu_ps(parent_mesh->vertices[map[i]].position), t);
+            __m128 n = _mm_loadu_ps(v->normal);
+            __m128 rp = _mm_mul_ps(r0, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0)));
+            __m128 rn = _mm_mul_ps(r0, _mm_shuffle_ps(n, n, _MM_SHUFFLE(0, 0, 0, 0)));
+            rp = _mm_add_ps(rp, _mm_mul_ps(r1, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))));
+            rn = _mm_add_ps(rn, _mm_mul_ps(r1, _mm_shuffle_ps(n, n, _MM_SHUFFLE(1, 1, 1, 1))));
+            rp = _mm_add_ps(rp, _mm_mul_ps(r2, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+            rn = _mm_add_ps(rn, _mm_mul_ps(r2, _mm_shuffle_ps(n, n, _MM_SHUFFLE(2, 2, 2, 2))));
+            if(i + 1 < mesh->vertex_count)
+            {
+                _mm_storeu_ps(dst_v, rp);                                       // 4th float is overwritten by the next vertex
+                _mm_storeu_ps(dst_n, rn);
+            }
+            else
+            {
+                float tmp[4];                                                   // last one borders the normals block / buffer end
+                _mm_storeu_ps(tmp, rp);
+                vec3_copy(dst_v, tmp);
+                _mm_storeu_ps(tmp, rn);
+                vec3_copy(dst_n, tmp);
+            }
+        }
+    }
+#else
+    for(uint32_t i = 0; i < mesh->vertex_count; i++, v++, dst_v += 3, dst_n += 3)
+    {
+        if(map[i] == 0xFFFFFFFF)
+        {
+            vec3_copy(dst_v, v->position);
+            vec3_copy(dst_n, v->normal);
         }
         else
         {
-            Mat4_vec3_mul_inv(dst_v, transform, parent_mesh->vertices[*map].position);
-            dst_n[0]  = transform[0] * src_n[0] + transform[1] * src_n[1] + transform[2]  * src_n[2];             // (M^-1 * src).x
-            dst_n[1]  = transform[4] * src_n[0] + transform[5] * src_n[1] + transform[6]  * src_n[2];             // (M^-1 * src).y
-            dst_n[2]  = transform[8] * src_n[0] + transform[9] * src_n[1] + transform[10] * src_n[2];             // (M^-1 * src).z
+            const float *src_n = v->normal;
+            Mat4_vec3_mul_inv_macro(dst_v, tr, parent_mesh->vertices[map[i]].position);
+            dst_n[0] = tr[0] * src_n[0] + tr[1] * src_n[1] + tr[2]  * src_n[2];
+            dst_n[1] = tr[4] * src_n[0] + tr[5] * src_n[1] + tr[6]  * src_n[2];
+            dst_n[2] = tr[8] * src_n[0] + tr[9] * src_n[1] + tr[10] * src_n[2];
         }
-        dst_v += 3;
-        dst_n += 3;
     }
+#endif
 
-    this->DrawMesh(mesh, p_vertex, p_normale);
-    Sys_ReturnTempMem(2 * buf_size);
+    if(cache->vbo == 0)
+    {
+        qglGenBuffersARB(1, &cache->vbo);
+    }
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, cache->vbo);
+    qglBufferDataARB(GL_ARRAY_BUFFER_ARB, buf_size, NULL, GL_STREAM_DRAW_ARB);   // orphan the old data
+    qglBufferSubDataARB(GL_ARRAY_BUFFER_ARB, 0, buf_size, dst_v - 3 * mesh->vertex_count);
+    Sys_ReturnTempMem(buf_size);
+
+    cache->mesh = mesh;
+    cache->parent_mesh = parent_mesh;
+    memcpy(cache->transform, tr, sizeof(cache->transform));
 }
 
 void CRender::DrawSkyBox(const float modelViewProjectionMatrix[16])
@@ -823,13 +1641,12 @@ void CRender::DrawSkyBox(const float modelViewProjectionMatrix[16])
     if((r_flags & R_DRAW_SKYBOX) && (skybox = World_GetSkybox()))
     {
         float tr[16];
-        float *p;
+        bone_tag_t sky_tag;
         qglDepthMask(GL_FALSE);
         tr[15] = 1.0;
-        p = skybox->animations->frames->bone_tags->offset;
-        vec3_add(tr + 12, m_camera->transform.M4x4 + 12, p);
-        p = skybox->animations->frames->bone_tags->qrotate;
-        Mat4_set_qrotation(tr, p);
+        Anim_GetBoneTag(skybox->animations, 0, 0, &sky_tag);
+        vec3_add(tr + 12, m_camera->transform.M4x4 + 12, sky_tag.offset);
+        Mat4_set_qrotation(tr, sky_tag.qrotate);
         float fullView[16];
         Mat4_Mat4_mul(fullView, modelViewProjectionMatrix, tr);
 
@@ -851,295 +1668,842 @@ void CRender::DrawSkyBox(const float modelViewProjectionMatrix[16])
  */
 void CRender::DrawSkeletalModel(const lit_shader_description *shader, struct ss_bone_frame_s *bframe, const float mvMatrix[16], const float mvpMatrix[16])
 {
+    skeletal_model_p model = bframe->animations.model;
     ss_bone_tag_p btag = bframe->bone_tags;
     float mvTransform[16];
     float mvpTransform[16];
     //mvMatrix = modelViewMatrix x entity->transform
     //mvpMatrix = modelViewProjectionMatrix x entity->transform
 
+    if(model && model->palette_mesh && (model->mesh_count == bframe->bone_tag_count) &&
+       (shader->bone_matrices >= 0) && (shader->bone_index >= 0))
+    {
+        this->DrawSkeletalModelPalette(shader, bframe, mvMatrix, mvpMatrix);
+        return;
+    }
+
     for(uint16_t i = 0; i < bframe->bone_tag_count; i++, btag++)
     {
-        if(!btag->is_hidden)
+        if(!btag->is_hidden)
+        {
+            Mat4_Mat4_mul(mvTransform, mvMatrix, btag->full_transform);
+            qglUniformMatrix4fvARB(shader->model_view, 1, false, mvTransform);
+
+            Mat4_Mat4_mul(mvpTransform, mvpMatrix, btag->full_transform);
+            qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, mvpTransform);
+
+            this->DrawMesh((btag->mesh_replace) ? (btag->mesh_replace) : (btag->mesh_base), NULL, NULL);
+            if(btag->mesh_slot)
+            {
+                this->DrawMesh(btag->mesh_slot, NULL, NULL);
+            }
+            if(btag->mesh_skin && btag->parent)
+            {
+                this->DrawSkinMesh(btag);
+            }
+        }
+    }
+}
+
+/**
+ * Bone matrices go to the shader palette once, then model palette mesh is drawn
+ * with one call per texture page. Bones with hidden, replaced or changed meshes get zero
+ * matrix in palette (their faces degenerate) and are drawn per bone, as well as animated
+ * texture faces, slots and skins.
+ */
+void CRender::DrawSkeletalModelPalette(const lit_shader_description *shader, struct ss_bone_frame_s *bframe, const float mvMatrix[16], const float mvpMatrix[16])
+{
+    skeletal_model_p model = bframe->animations.model;
+    ss_bone_tag_p btag = bframe->bone_tags;
+    GLfloat palette[16 * (SKELETAL_PALETTE_MAX_BONES + 1)];
+    GLfloat *m = palette + 16;
+    float mvTransform[16];
+    float mvpTransform[16];
+
+    Mat4_E_macro(palette);
+    for(uint16_t i = 0; i < bframe->bone_tag_count; i++, btag++, m += 16)
+    {
+        if(btag->is_hidden || btag->mesh_replace || (btag->mesh_base != model->palette_bones[i]))
+        {
+            memset(m, 0, 16 * sizeof(GLfloat));
+        }
+        else
+        {
+            memcpy(m, btag->full_transform, 16 * sizeof(GLfloat));
+        }
+    }
+
+    qglUniformMatrix4fvARB(shader->model_view, 1, false, mvMatrix);
+    qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, mvpMatrix);
+    qglUniformMatrix4fvARB(shader->bone_matrices, bframe->bone_tag_count + 1, false, palette);
+
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, model->palette_mesh->vbo_vertex_array);
+    qglEnableVertexAttribArrayARB(shader->bone_index);
+    qglVertexAttribPointerARB(shader->bone_index, 1, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*)(offsetof(vertex_t, position) + 3 * sizeof(GLfloat)));
+    this->DrawMesh(model->palette_mesh, NULL, NULL);
+    qglDisableVertexAttribArrayARB(shader->bone_index);
+
+    btag = bframe->bone_tags;
+    for(uint16_t i = 0; i < bframe->bone_tag_count; i++, btag++)
+    {
+        if(!btag->is_hidden)
+        {
+            int in_palette = !btag->mesh_replace && (btag->mesh_base == model->palette_bones[i]);
+            if(in_palette && !btag->mesh_base->animated_vertex_count && !btag->mesh_slot && !(btag->mesh_skin && btag->parent))
+            {
+                continue;
+            }
+
+            Mat4_Mat4_mul(mvTransform, mvMatrix, btag->full_transform);
+            qglUniformMatrix4fvARB(shader->model_view, 1, false, mvTransform);
+
+            Mat4_Mat4_mul(mvpTransform, mvpMatrix, btag->full_transform);
+            qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, mvpTransform);
+
+            if(!in_palette)
+            {
+                this->DrawMesh((btag->mesh_replace) ? (btag->mesh_replace) : (btag->mesh_base), NULL, NULL);
+            }
+            else if(btag->mesh_base->animated_vertex_count)
+            {
+                this->DrawMeshAnimatedFaces(btag->mesh_base, -1);
+            }
+            if(btag->mesh_slot)
+            {
+                this->DrawMesh(btag->mesh_slot, NULL, NULL);
+            }
+            if(btag->mesh_skin && btag->parent)
+            {
+                this->DrawSkinMesh(btag);
+            }
+        }
+    }
+}
+
+void CRender::DrawEntity(struct entity_s *entity, const float modelViewMatrix[16], const float modelViewProjectionMatrix[16])
+{
+    if(!(entity->state_flags & ENTITY_STATE_VISIBLE) || (entity->bf->animations.model->hide && !(r_flags & R_DRAW_NULLMESHES)))
+    {
+        return;
+    }
+
+    // Calculate lighting
+    const lit_shader_description *shader = this->SetupEntityLight(entity, modelViewMatrix);
+
+    if(entity->bf->animations.model && entity->bf->animations.model->animations)
+    {
+        float subModelView[16];
+        float subModelViewProjection[16];
+        if(entity->bf->bone_tag_count == 1)
+        {
+            float scaledTransform[16];
+            memcpy(scaledTransform, entity->transform.M4x4, sizeof(scaledTransform));
+            Mat4_Scale(scaledTransform, entity->transform.scaling[0], entity->transform.scaling[1], entity->transform.scaling[2]);
+            Mat4_Mat4_mul(subModelView, modelViewMatrix, scaledTransform);
+            Mat4_Mat4_mul(subModelViewProjection, modelViewProjectionMatrix, scaledTransform);
+        }
+        else
+        {
+            Mat4_Mat4_mul(subModelView, modelViewMatrix, entity->transform.M4x4);
+            Mat4_Mat4_mul(subModelViewProjection, modelViewProjectionMatrix, entity->transform.M4x4);
+        }
+
+        this->DrawSkeletalModel(shader, entity->bf, subModelView, subModelViewProjection);
+
+        if(entity->character && entity->character->hair_count)
+        {
+            base_mesh_p mesh;
+            float transform[16];
+            for(int h = 0; h < entity->character->hair_count; h++)
+            {
+                int num_elements = Hair_GetElementsCount(entity->character->hairs[h]);
+                for(uint16_t i = 0; i < num_elements; i++)
+                {
+                    Hair_GetElementInfo(entity->character->hairs[h], i, &mesh, transform);
+                    Mat4_Mat4_mul(subModelView, modelViewMatrix, transform);
+                    Mat4_Mat4_mul(subModelViewProjection, modelViewProjectionMatrix, transform);
+
+                    qglUniformMatrix4fvARB(shader->model_view, 1, GL_FALSE, subModelView);
+                    qglUniformMatrix4fvARB(shader->model_view_projection, 1, GL_FALSE, subModelViewProjection);
+                    this->DrawMesh(mesh, NULL, NULL);
+                }
+            }
+        }
+    }
+    
+    if((this->r_flags & R_DRAW_AI_PATH) && entity->character && entity->character->path_dist)
+    {
+        GLfloat red[3] = {1.0f, 0.0f, 0.0f};
+        GLfloat from[3], to[3];
+        vec3_copy(from, entity->self->sector->pos);
+        from[2] = entity->transform.M4x4[12 + 2] + TR_METERING_STEP;
+        this->debugDrawer->SetColor(0.0f, 0.0f, 0.0f);
+        for(int i = 1; i < entity->character->path_dist; ++i)
+        {
+            Room_GetOverlapCenter(entity->character->path[i], entity->character->path[i - 1], to);
+            this->debugDrawer->DrawLine(from, to, red, red);
+            vec3_copy(from, to);
+        }
+        if(entity->character->path_target)
+        {
+            vec3_copy(to, entity->character->path_target->pos);
+            to[2] = entity->transform.M4x4[12 + 2] + TR_METERING_STEP;
+            this->debugDrawer->DrawLine(from, to, red, red);
+        }
+    }
+}
+
+/**
+ * Visibility collection for one room of the render list: room mesh, static meshes and entities
+ * (also near room statics and entities which overlap the room) go to the render queue.
+ * Room mesh clipped by stencil frustum is drawn immediately.
+ */
+void CRender::QueueRoom(struct room_s *room)
+{
+    engine_container_p cont;
+    entity_p ent;
+    GLfloat tint[4];
+
+#if STENCIL_FRUSTUM
+    ////start test stencil test code
+    bool need_stencil = false;
+    if(room->frustum != NULL)
+    {
+        for(uint16_t i = 0; i < room->content->overlapped_room_list_size; i++)
+        {
+            if(room->content->overlapped_room_list[i]->real_room->is_in_r_list)
+            {
+                need_stencil = true;
+                break;
+            }
+        }
+
+        if(need_stencil)
+        {
+            const int elem_size = (3 + 3 + 4 + 2) * sizeof(GLfloat);
+            const unlit_tinted_shader_description *shader = shaderManager->getRoomShader(false, false);
+            size_t buf_size;
+
+            qglUseProgramObjectARB(shader->program);
+            qglUniform1iARB(shader->sampler, 0);
+            qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, engine_camera.gl_view_proj_mat);
+            qglUniform1fARB(shader->dist_fog, m_camera->dist_far);
+            qglEnable(GL_STENCIL_TEST);
+            qglClear(GL_STENCIL_BUFFER_BIT);
+            qglStencilFunc(GL_NEVER, 1, 0x00);
+            qglStencilOp(GL_REPLACE, GL_KEEP, GL_KEEP);
+            for(frustum_p f = room->frustum; f; f = f->next)
+            {
+                buf_size = f->vertex_count * elem_size;
+                GLfloat *v, *buf = (GLfloat*)Sys_GetTempMem(buf_size);
+                v=buf;
+                for(int16_t i = f->vertex_count - 1; i >= 0; i--)
+                {
+                    vec3_copy(v, f->vertex + 3 * i);                    v+=3;
+                    vec3_copy_inv(v, engine_camera.transform.M4x4 + 8);   v+=3;
+                    vec4_set_one(v);                                    v+=4;
+                    v[0] = v[1] = 0.0;                                  v+=2;
+                }
+
+                m_active_texture = 0;
+                BindWhiteTexture();
+                qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+                qglVertexPointer(3, GL_FLOAT, elem_size, buf+0);
+                qglNormalPointer(GL_FLOAT, elem_size, buf+3);
+                qglColorPointer(4, GL_FLOAT, elem_size, buf+3+3);
+                qglTexCoordPointer(2, GL_FLOAT, elem_size, buf+3+3+4);
+                qglDrawArrays(GL_TRIANGLE_FAN, 0, f->vertex_count);
+
+                Sys_ReturnTempMem(buf_size);
+            }
+            qglStencilFunc(GL_EQUAL, 1, 0xFF);
+        }
+    }
+#endif
+
+    if(!(r_flags & R_SKIP_ROOM) && room->content->mesh)
+    {
+        const unlit_tinted_shader_description *shader = shaderManager->getRoomShader(room->content->light_mode == 1, room->content->room_flags & 1);
+        CalculateWaterTint(tint, 1);
+
+#if STENCIL_FRUSTUM
+        if(need_stencil)
+        {
+            float modelViewProjectionTransform[16];
+            Mat4_Mat4_mul(modelViewProjectionTransform, m_camera->gl_view_proj_mat, room->transform);
+            qglUseProgramObjectARB(shader->program);
+            qglUniform4fvARB(shader->tint_mult, 1, tint);
+            qglUniform1fARB(shader->current_tick, (GLfloat) SDL_GetTicks());
+            qglUniform1iARB(shader->sampler, 0);
+            qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, modelViewProjectionTransform);
+            qglUniform1fARB(shader->dist_fog, m_camera->dist_far);
+            this->DrawMesh(room->content->mesh, NULL, NULL);
+            qglDisable(GL_STENCIL_TEST);
+        }
+        else
+#endif
+        {
+            this->QueueMesh(room->content->mesh, shader, room->transform, tint);
+        }
+    }
+#if STENCIL_FRUSTUM
+    else if(need_stencil)
+    {
+        qglDisable(GL_STENCIL_TEST);
+    }
+#endif
+
+    frustum_p frustum = (room->frustum) ? (room->frustum) : (m_camera->frustum);
+    uint32_t objects_count;
+    uint32_t *objects_visible = this->CullRoomObjects(room, frustum, &objects_count);
+    uint32_t obj = 0;
+    static_batch_p batch = room->content->static_batch;
+    uint8_t *batch_visible = (batch) ? ((uint8_t*)Sys_GetTempMem(room->content->static_mesh_count)) : (NULL);
+    for(uint32_t i = 0; i < room->content->static_mesh_count; i++, obj++)
+    {
+        static_mesh_p sm = room->content->static_mesh + i;
+        int visible = FRUSTUM_MASK_TEST(objects_visible, obj) &&
+                      (!sm->hide || (r_flags & R_DRAW_DUMMY_STATICS));
+        if(batch)
+        {
+            batch_visible[i] = visible && batch->in_batch[i];
+            visible = visible && !batch->in_batch[i];
+        }
+        if(visible)
+        {
+            vec4_copy(tint, sm->tint);
+            //If this static mesh is in a water room
+            if(room->content->room_flags & TR_ROOM_FLAG_WATER)
+            {
+                CalculateWaterTint(tint, 0);
+            }
+            this->QueueMesh(sm->mesh, shaderManager->getStaticMeshShader(), sm->transform, tint);
+        }
+    }
+    if(batch)
+    {
+        this->QueueStaticBatch(batch, batch_visible, room->content->static_mesh_count);
+        Sys_ReturnTempMem(room->content->static_mesh_count);
+    }
+
+    for(cont = room->containers; cont; cont = cont->next)
+    {
+        switch(cont->object_type)
+        {
+        case OBJECT_ENTITY:
+            ent = (entity_p)cont->object;
+            if(FRUSTUM_MASK_TEST(objects_visible, obj))
+            {
+                this->QueueEntity(ent);
+            }
+            obj++;
+            break;
+        };
+    }
+    Sys_ReturnTempMem(FRUSTUM_MASK_WORDS(objects_count) * sizeof(uint32_t));
+
+    for(uint16_t ni = 0; ni < room->content->near_room_list_size; ni++)
+    {
+        room_p near_room = room->content->near_room_list[ni]->real_room;
+        if(!room->content->near_room_list[ni]->is_in_r_list)
+        {
+            objects_visible = this->CullRoomObjects(near_room, frustum, &objects_count);
+            obj = 0;
+            batch = near_room->content->static_batch;
+            batch_visible = (batch) ? ((uint8_t*)Sys_GetTempMem(near_room->content->static_mesh_count)) : (NULL);
+            for(uint32_t si = 0; si < near_room->content->static_mesh_count; si++, obj++)
+            {
+                static_mesh_p sm = near_room->content->static_mesh + si;
+                int visible = FRUSTUM_MASK_TEST(objects_visible, obj) &&
+                              OBB_OBB_Test(sm->obb, room->obb, 0.0f) &&
+                              (!sm->hide || (r_flags & R_DRAW_DUMMY_STATICS));
+                if(batch)
+                {
+                    batch_visible[si] = visible && batch->in_batch[si];
+                    visible = visible && !batch->in_batch[si];
+                }
+                if(visible)
+                {
+                    vec4_copy(tint, sm->tint);
+                    //If this static mesh is in a water near_room
+                    if(near_room->content->room_flags & TR_ROOM_FLAG_WATER)
+                    {
+                        CalculateWaterTint(tint, 0);
+                    }
+                    this->QueueMesh(sm->mesh, shaderManager->getStaticMeshShader(), sm->transform, tint);
+                }
+            }
+            if(batch)
+            {
+                this->QueueStaticBatch(batch, batch_visible, near_room->content->static_mesh_count);
+                Sys_ReturnTempMem(near_room->content->static_mesh_count);
+            }
+
+            for(cont = near_room->containers; cont; cont=cont->next)
+            {
+                switch(cont->object_type)
+                {
+                case OBJECT_ENTITY:
+                    ent = (entity_p)cont->object;
+                    if(FRUSTUM_MASK_TEST(objects_visible, obj) &&
+                       OBB_OBB_Test(ent->obb, room->obb, 0.0f))
+                    {
+                        this->QueueEntity(ent);
+                    }
+                    obj++;
+                    break;
+                };
+            }
+            Sys_ReturnTempMem(FRUSTUM_MASK_WORDS(objects_count) * sizeof(uint32_t));
+        }
+    }
+}
+
+
+/*
+ * Gathers room static meshes and entities (in containers order) and culls them in one batch;
+ * returns visibility mask in temp mem, caller returns FRUSTUM_MASK_WORDS(*objects_count) words.
+ */
+uint32_t *CRender::CullRoomObjects(struct room_s *room, struct frustum_s *frustum, uint32_t *objects_count)
+{
+    uint32_t count = room->content->static_mesh_count;
+    uint32_t *mask;
+    obb_p *obbs;
+
+    for(engine_container_p cont = room->containers; cont; cont = cont->next)
+    {
+        count += (cont->object_type == OBJECT_ENTITY) ? (1) : (0);
+    }
+
+    *objects_count = count;
+    mask = (uint32_t*)Sys_GetTempMem(FRUSTUM_MASK_WORDS(count) * sizeof(uint32_t));
+    if(count > 0)
+    {
+        obbs = (obb_p*)Sys_GetTempMem(count * sizeof(obb_p));
+        count = 0;
+        for(uint32_t i = 0; i < room->content->static_mesh_count; i++)
+        {
+            obbs[count++] = room->content->static_mesh[i].obb;
+        }
+        for(engine_container_p cont = room->containers; cont; cont = cont->next)
+        {
+            if(cont->object_type == OBJECT_ENTITY)
+            {
+                obbs[count++] = ((entity_p)cont->object)->obb;
+            }
+        }
+        Frustum_CullOBBs(obbs, count, frustum, mask);
+        if(occlusionBuffer->IsReady())
+        {
+            for(uint32_t i = 0; i < count; i++)
+            {
+                if(FRUSTUM_MASK_TEST(mask, i) && !occlusionBuffer->IsOBBVisible(obbs[i]))
+                {
+                    mask[i / 32] &= ~(1U << (i % 32));
+                }
+            }
+        }
+        Sys_ReturnTempMem(count * sizeof(obb_p));
+    }
+
+    return mask;
+}
+
+
+/*
+ * Rasterizes large opaque polygons of the camera room and its static meshes into the
+ * CPU depth buffer, then deactivates rooms hidden behind them. Only the camera room is
+ * used: other rooms are seen through portals, so their polygons may cover screen areas
+ * where they are clipped away. Statics and entities are tested against the same buffer
+ * in CullRoomObjects.
+ */
+void CRender::UpdateOcclusion()
+{
+    occlusionBuffer->Begin(m_camera->gl_view_proj_mat, m_camera->dist_near);
+    for(uint32_t i = 0; i < r_list_active_count; i++)
+    {
+        r_list[i].active = 1;
+    }
+    if(!settings.occlusion)
+    {
+        return;
+    }
+
+    if(m_camera->current_room)
+    {
+        room_p r = m_camera->current_room;
+        if(r->content->mesh)
+        {
+            occlusionBuffer->AddMesh(r->content->mesh, r->transform);
+        }
+        for(uint32_t j = 0; j < r->content->static_mesh_count; j++)
+        {
+            static_mesh_p sm = r->content->static_mesh + j;
+            if(!sm->hide && sm->mesh->occluders_count)
+            {
+                occlusionBuffer->AddMesh(sm->mesh, sm->transform);
+            }
+        }
+    }
+    occlusionBuffer->Rasterize();
+
+    for(uint32_t i = 0; i < r_list_active_count; i++)
+    {
+        room_p r = r_list[i].room;
+        if((r != m_camera->current_room) && !occlusionBuffer->IsAABBVisible(r->bb_min, r->bb_max))
+        {
+            r_list[i].active = 0;
+        }
+    }
+}
+
+
+/// Visible statics and entities of the current rooms list: per object frustum test, or batched test plus occlusion; used by benchmark.
+uint32_t CRender::CountVisibleObjects(bool batched)
+{
+    uint32_t ret = 0;
+
+    for(uint32_t i = 0; i < r_list_active_count; i++)
+    {
+        room_p r = r_list[i].room;
+        frustum_p frustum = (r->frustum) ? (r->frustum) : (m_camera->frustum);
+        if(batched && !r_list[i].active)
+        {
+            continue;
+        }
+        else if(batched)
+        {
+            uint32_t objects_count;
+            uint32_t *visible = this->CullRoomObjects(r, frustum, &objects_count);
+            for(uint32_t j = 0; j < objects_count; j++)
+            {
+                ret += (FRUSTUM_MASK_TEST(visible, j)) ? (1) : (0);
+            }
+            Sys_ReturnTempMem(FRUSTUM_MASK_WORDS(objects_count) * sizeof(uint32_t));
+        }
+        else
+        {
+            for(uint32_t j = 0; j < r->content->static_mesh_count; j++)
+            {
+                ret += (Frustum_IsOBBVisibleInFrustumList(r->content->static_mesh[j].obb, frustum)) ? (1) : (0);
+            }
+            for(engine_container_p cont = r->containers; cont; cont = cont->next)
+            {
+                if((cont->object_type == OBJECT_ENTITY) && Frustum_IsOBBVisibleInFrustumList(((entity_p)cont->object)->obb, frustum))
+                {
+                    ret++;
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+/*
+ * RENDER QUEUE
+ * key, from high to low bits: packet type (8) | shader slot (8) | texture page (16) | mesh VBO or model id (16) | depth (16).
+ * Sorting by key groups packets by state, so the submitter changes program, texture and
+ * vertex buffer only when they really change; inside the same state packets go front to back.
+ */
+static int CRender_ComparePackets(const void *a, const void *b)
+{
+    uint64_t ka = ((const CRender::render_packet_s*)a)->key;
+    uint64_t kb = ((const CRender::render_packet_s*)b)->key;
+    return (ka < kb) ? (-1) : ((ka > kb) ? (1) : (0));
+}
+
+uint64_t CRender::GetPacketKey(uint16_t type, uint32_t shader_slot, uint32_t texture, uint32_t buffer, const float pos[3])
+{
+    float depth = vec3_dist(m_camera->transform.M4x4 + 12, pos) / m_camera->dist_far;
+    uint64_t depth_key;
+
+    depth = (depth < 0.0f) ? (0.0f) : ((depth > 1.0f) ? (1.0f) : (depth));
+    depth_key = (uint64_t)(depth * 65535.0f);
+
+    return ((uint64_t)type << 56) | ((uint64_t)(shader_slot & 0xFF) << 48) | ((uint64_t)(texture & 0xFFFF) << 32) | ((uint64_t)(buffer & 0xFFFF) << 16) | depth_key;
+}
+
+CRender::render_packet_s *CRender::AddPacket()
+{
+    if(m_packets_count >= m_packets_size)
+    {
+        m_packets_size = (m_packets_size) ? (2 * m_packets_size) : (1024);
+        m_packets = (struct render_packet_s*)realloc(m_packets, m_packets_size * sizeof(struct render_packet_s));
+    }
+    return m_packets + m_packets_count++;
+}
+
+uint32_t CRender::GetShaderSlot(const unlit_tinted_shader_description *shader)
+{
+    uint32_t shader_slot;
+    for(shader_slot = 0; shader_slot < m_queue_shaders_count; shader_slot++)
+    {
+        if(m_queue_shaders[shader_slot] == shader)
         {
-            Mat4_Mat4_mul(mvTransform, mvMatrix, btag->full_transform);
-            qglUniformMatrix4fvARB(shader->model_view, 1, false, mvTransform);
+            return shader_slot;
+        }
+    }
+    if(m_queue_shaders_count < RENDER_QUEUE_MAX_SHADERS)
+    {
+        m_queue_shaders[m_queue_shaders_count++] = shader;
+    }
+    return shader_slot;
+}
 
-            Mat4_Mat4_mul(mvpTransform, mvpMatrix, btag->full_transform);
-            qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, mvpTransform);
+uint32_t CRender::AddObject(const unlit_tinted_shader_description *shader, const float transform[16], const float tint[4])
+{
+    struct render_object_s *obj;
 
-            this->DrawMesh((btag->mesh_replace) ? (btag->mesh_replace) : (btag->mesh_base), NULL, NULL);
-            if(btag->mesh_slot)
-            {
-                this->DrawMesh(btag->mesh_slot, NULL, NULL);
-            }
-            if(btag->mesh_skin && btag->parent)
-            {
-                this->DrawSkinMesh(btag->mesh_skin, btag->parent->mesh_base, btag->skin_map, btag->transform);
-            }
-        }
+    if(m_objects_count >= m_objects_size)
+    {
+        m_objects_size = (m_objects_size) ? (2 * m_objects_size) : (256);
+        m_objects = (struct render_object_s*)realloc(m_objects, m_objects_size * sizeof(struct render_object_s));
     }
+    obj = m_objects + m_objects_count;
+    obj->shader = shader;
+    Mat4_Mat4_mul(obj->mvp, m_camera->gl_view_proj_mat, transform);
+    vec4_copy(obj->tint, tint);
+
+    return m_objects_count++;
 }
 
-void CRender::DrawEntity(struct entity_s *entity, const float modelViewMatrix[16], const float modelViewProjectionMatrix[16])
+void CRender::QueueMesh(struct base_mesh_s *mesh, const unlit_tinted_shader_description *shader, const float transform[16], const float tint[4])
 {
-    if(!(entity->state_flags & ENTITY_STATE_VISIBLE) || (entity->bf->animations.model->hide && !(r_flags & R_DRAW_NULLMESHES)))
+    struct render_packet_s *packet;
+    uint32_t shader_slot, object;
+    float pos[3];
+
+    if((mesh->faces_count == 0) && (mesh->animated_faces_count == 0))
     {
         return;
     }
 
-    // Calculate lighting
-    const lit_shader_description *shader = this->SetupEntityLight(entity, modelViewMatrix);
+    shader_slot = this->GetShaderSlot(shader);
+    object = this->AddObject(shader, transform, tint);
+    Mat4_vec3_mul_macro(pos, transform, mesh->centre);
 
-    if(entity->bf->animations.model && entity->bf->animations.model->animations)
+    if(mesh->vertex_count > 0)
     {
-        float subModelView[16];
-        float subModelViewProjection[16];
-        if(entity->bf->bone_tag_count == 1)
+        mesh_face_p face = mesh->faces;
+        for(uint32_t i = 0; i < mesh->faces_count; i++, face++)
         {
-            float scaledTransform[16];
-            memcpy(scaledTransform, entity->transform.M4x4, sizeof(scaledTransform));
-            Mat4_Scale(scaledTransform, entity->transform.scaling[0], entity->transform.scaling[1], entity->transform.scaling[2]);
-            Mat4_Mat4_mul(subModelView, modelViewMatrix, scaledTransform);
-            Mat4_Mat4_mul(subModelViewProjection, modelViewProjectionMatrix, scaledTransform);
-        }
-        else
-        {
-            Mat4_Mat4_mul(subModelView, modelViewMatrix, entity->transform.M4x4);
-            Mat4_Mat4_mul(subModelViewProjection, modelViewProjectionMatrix, entity->transform.M4x4);
+            packet = this->AddPacket();
+            packet->type = RENDER_PACKET_MESH_FACE;
+            packet->key = this->GetPacketKey(RENDER_PACKET_MESH_FACE, shader_slot, face->texture_index, mesh->vbo_vertex_array, pos);
+            packet->object = object;
+            packet->mesh = mesh;
+            packet->face = face;
+            packet->entity = NULL;
         }
+    }
 
-        this->DrawSkeletalModel(shader, entity->bf, subModelView, subModelViewProjection);
+    if(mesh->animated_vertex_count > 0)
+    {
+        packet = this->AddPacket();
+        packet->type = RENDER_PACKET_MESH_ANIMATED;
+        packet->key = this->GetPacketKey(RENDER_PACKET_MESH_ANIMATED, shader_slot, 0, mesh->vbo_animated_vertex_array, pos);
+        packet->object = object;
+        packet->mesh = mesh;
+        packet->face = NULL;
+        packet->entity = NULL;
+    }
+}
 
-        if(entity->character && entity->character->hair_count)
+/**
+ * Visible statics of the batch go as index ranges, neighbour visible statics are merged in one range.
+ */
+void CRender::QueueStaticBatch(struct static_batch_s *batch, const uint8_t *visible, uint32_t statics_count)
+{
+    const unlit_tinted_shader_description *shader = shaderManager->getStaticMeshShader();
+    uint32_t shader_slot = this->GetShaderSlot(shader);
+
+    if(m_batch_object == 0xFFFFFFFF)
+    {
+        float transform[16];
+        const float tint[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        Mat4_E_macro(transform);
+        m_batch_object = this->AddObject(shader, transform, tint);
+    }
+
+    for(uint32_t f = 0; f < batch->faces_count; f++)
+    {
+        static_batch_face_p face = batch->faces + f;
+        uint32_t first = m_ranges_count;
+        GLuint range_end = 0xFFFFFFFF;
+
+        for(uint32_t i = 0; i < statics_count; i++)
         {
-            base_mesh_p mesh;
-            float transform[16];
-            for(int h = 0; h < entity->character->hair_count; h++)
+            if(visible[i] && (face->counts[i] > 0))
             {
-                int num_elements = Hair_GetElementsCount(entity->character->hairs[h]);
-                for(uint16_t i = 0; i < num_elements; i++)
+                if(face->offsets[i] == range_end)
                 {
-                    Hair_GetElementInfo(entity->character->hairs[h], i, &mesh, transform);
-                    Mat4_Mat4_mul(subModelView, modelViewMatrix, transform);
-                    Mat4_Mat4_mul(subModelViewProjection, modelViewProjectionMatrix, transform);
-
-                    qglUniformMatrix4fvARB(shader->model_view, 1, GL_FALSE, subModelView);
-                    qglUniformMatrix4fvARB(shader->model_view_projection, 1, GL_FALSE, subModelViewProjection);
-                    this->DrawMesh(mesh, NULL, NULL);
+                    m_ranges_counts[m_ranges_count - 1] += face->counts[i];
+                }
+                else
+                {
+                    if(m_ranges_count >= m_ranges_size)
+                    {
+                        m_ranges_size = (m_ranges_size) ? (2 * m_ranges_size) : (1024);
+                        m_ranges_counts = (GLsizei*)realloc(m_ranges_counts, m_ranges_size * sizeof(GLsizei));
+                        m_ranges_offsets = (const GLvoid**)realloc(m_ranges_offsets, m_ranges_size * sizeof(GLvoid*));
+                    }
+                    m_ranges_counts[m_ranges_count] = face->counts[i];
+                    m_ranges_offsets[m_ranges_count] = (const GLvoid*)(face->offsets[i] * sizeof(GLuint));
+                    m_ranges_count++;
                 }
+                range_end = face->offsets[i] + face->counts[i];
             }
         }
-    }
-    
-    if((this->r_flags & R_DRAW_AI_PATH) && entity->character && entity->character->path_dist)
-    {
-        GLfloat red[3] = {1.0f, 0.0f, 0.0f};
-        GLfloat from[3], to[3];
-        vec3_copy(from, entity->self->sector->pos);
-        from[2] = entity->transform.M4x4[12 + 2] + TR_METERING_STEP;
-        this->debugDrawer->SetColor(0.0f, 0.0f, 0.0f);
-        for(int i = 1; i < entity->character->path_dist; ++i)
-        {
-            Room_GetOverlapCenter(entity->character->path[i], entity->character->path[i - 1], to);
-            this->debugDrawer->DrawLine(from, to, red, red);
-            vec3_copy(from, to);
-        }
-        if(entity->character->path_target)
+
+        if(m_ranges_count > first)
         {
-            vec3_copy(to, entity->character->path_target->pos);
-            to[2] = entity->transform.M4x4[12 + 2] + TR_METERING_STEP;
-            this->debugDrawer->DrawLine(from, to, red, red);
+            struct render_packet_s *packet = this->AddPacket();
+            packet->type = RENDER_PACKET_STATIC_BATCH;
+            packet->key = this->GetPacketKey(RENDER_PACKET_STATIC_BATCH, shader_slot, face->texture_index, batch->vbo, batch->centre);
+            packet->object = m_batch_object;
+            packet->mesh = NULL;
+            packet->face = NULL;
+            packet->entity = NULL;
+            packet->batch = batch;
+            packet->batch_face = f;
+            packet->ranges_first = first;
+            packet->ranges_count = m_ranges_count - first;
         }
     }
 }
 
-void CRender::DrawRoom(struct room_s *room, const float modelViewMatrix[16], const float modelViewProjectionMatrix[16])
+void CRender::QueueEntity(struct entity_s *entity)
 {
-    float transform[16];
-    engine_container_p cont;
-    entity_p ent;
+    struct render_packet_s *packet = this->AddPacket();
+    uint32_t model_id = (entity->bf->animations.model) ? (entity->bf->animations.model->id) : (0);
+
+    packet->type = RENDER_PACKET_ENTITY;
+    packet->key = this->GetPacketKey(RENDER_PACKET_ENTITY, 0, 0, model_id, entity->transform.M4x4 + 12);
+    packet->object = 0;
+    packet->mesh = NULL;
+    packet->face = NULL;
+    packet->entity = entity;
+}
 
-    const shader_description *lastShader = 0;
+void CRender::DrawQueue()
+{
+    const unlit_tinted_shader_description *shader = NULL;
+    uint32_t active_object = 0xFFFFFFFF;
+    GLuint active_vbo = 0;
+    GLuint active_ibo = 0;
+    struct render_packet_s *packet = m_packets;
 
-#if STENCIL_FRUSTUM
-    ////start test stencil test code
-    bool need_stencil = false;
-    if(room->frustum != NULL)
+    qsort(m_packets, m_packets_count, sizeof(struct render_packet_s), CRender_ComparePackets);
+    for(uint32_t i = 0; i < m_packets_count; i++, packet++)
     {
-        for(uint16_t i = 0; i < room->content->overlapped_room_list_size; i++)
+        if((active_ibo != 0) && (packet->type != RENDER_PACKET_STATIC_BATCH))
         {
-            if(room->content->overlapped_room_list[i]->real_room->is_in_r_list)
-            {
-                need_stencil = true;
-                break;
-            }
+            active_ibo = 0;
+            qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
         }
 
-        if(need_stencil)
+        if(packet->type == RENDER_PACKET_ENTITY)
         {
-            const int elem_size = (3 + 3 + 4 + 2) * sizeof(GLfloat);
-            const unlit_tinted_shader_description *shader = shaderManager->getRoomShader(false, false);
-            size_t buf_size;
+            this->DrawEntity(packet->entity, m_camera->gl_view_mat, m_camera->gl_view_proj_mat);
+            shader = NULL;
+            active_vbo = 0;
+            continue;
+        }
 
+        struct render_object_s *obj = m_objects + packet->object;
+        if(obj->shader != shader)
+        {
+            shader = obj->shader;
             qglUseProgramObjectARB(shader->program);
             qglUniform1iARB(shader->sampler, 0);
-            qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, engine_camera.gl_view_proj_mat);
+            qglUniform1fARB(shader->current_tick, (GLfloat) SDL_GetTicks());
             qglUniform1fARB(shader->dist_fog, m_camera->dist_far);
-            qglEnable(GL_STENCIL_TEST);
-            qglClear(GL_STENCIL_BUFFER_BIT);
-            qglStencilFunc(GL_NEVER, 1, 0x00);
-            qglStencilOp(GL_REPLACE, GL_KEEP, GL_KEEP);
-            for(frustum_p f = room->frustum; f; f = f->next)
+            if((shader->anim_tex_frames >= 0) && m_anim_tex_frames_count)
             {
-                buf_size = f->vertex_count * elem_size;
-                GLfloat *v, *buf = (GLfloat*)Sys_GetTempMem(buf_size);
-                v=buf;
-                for(int16_t i = f->vertex_count - 1; i >= 0; i--)
-                {
-                    vec3_copy(v, f->vertex + 3 * i);                    v+=3;
-                    vec3_copy_inv(v, engine_camera.transform.M4x4 + 8);   v+=3;
-                    vec4_set_one(v);                                    v+=4;
-                    v[0] = v[1] = 0.0;                                  v+=2;
-                }
-
-                m_active_texture = 0;
-                BindWhiteTexture();
-                qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
-                qglVertexPointer(3, GL_FLOAT, elem_size, buf+0);
-                qglNormalPointer(GL_FLOAT, elem_size, buf+3);
-                qglColorPointer(4, GL_FLOAT, elem_size, buf+3+3);
-                qglTexCoordPointer(2, GL_FLOAT, elem_size, buf+3+3+4);
-                qglDrawArrays(GL_TRIANGLE_FAN, 0, f->vertex_count);
-
-                Sys_ReturnTempMem(buf_size);
+                qglUniform4fvARB(shader->anim_tex_frames, 2 * m_anim_tex_frames_count, m_anim_tex_frames);
             }
-            qglStencilFunc(GL_EQUAL, 1, 0xFF);
+            active_object = 0xFFFFFFFF;
         }
-    }
-#endif
 
-    if(!(r_flags & R_SKIP_ROOM) && room->content->mesh)
-    {
-        float modelViewProjectionTransform[16];
-        Mat4_Mat4_mul(modelViewProjectionTransform, modelViewProjectionMatrix, room->transform);
-
-        const unlit_tinted_shader_description *shader = shaderManager->getRoomShader(room->content->light_mode == 1, room->content->room_flags & 1);
-
-        GLfloat tint[4];
-        CalculateWaterTint(tint, 1);
-        if (shader != lastShader)
+        if(packet->object != active_object)
         {
-            qglUseProgramObjectARB(shader->program);
+            active_object = packet->object;
+            qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, obj->mvp);
+            qglUniform4fvARB(shader->tint_mult, 1, obj->tint);
         }
 
-        lastShader = shader;
-        qglUniform4fvARB(shader->tint_mult, 1, tint);
-        qglUniform1fARB(shader->current_tick, (GLfloat) SDL_GetTicks());
-        qglUniform1iARB(shader->sampler, 0);
-        qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, modelViewProjectionTransform);
-        qglUniform1fARB(shader->dist_fog, m_camera->dist_far);
-        this->DrawMesh(room->content->mesh, NULL, NULL);
-    }
-
-#if STENCIL_FRUSTUM
-    if(need_stencil)
-    {
-        qglDisable(GL_STENCIL_TEST);
-    }
-#endif
-
-    if (room->content->static_mesh_count > 0)
-    {
-        const unlit_tinted_shader_description *shader = shaderManager->getStaticMeshShader();
-        qglUseProgramObjectARB(shader->program);
-        for(uint32_t i = 0; i < room->content->static_mesh_count; i++)
+        if(packet->type == RENDER_PACKET_MESH_ANIMATED)
         {
-            if(Frustum_IsOBBVisibleInFrustumList(room->content->static_mesh[i].obb, (room->frustum) ? (room->frustum) : (m_camera->frustum)) &&
-               (!room->content->static_mesh[i].hide || (r_flags & R_DRAW_DUMMY_STATICS)))
-            {
-                Mat4_Mat4_mul(transform, modelViewProjectionMatrix, room->content->static_mesh[i].transform);
-                qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, transform);
-                qglUniform1fARB(shader->dist_fog, m_camera->dist_far);
-                base_mesh_s *mesh = room->content->static_mesh[i].mesh;
-                GLfloat tint[4];
-
-                vec4_copy(tint, room->content->static_mesh[i].tint);
-
-                //If this static mesh is in a water room
-                if(room->content->room_flags & TR_ROOM_FLAG_WATER)
-                {
-                    CalculateWaterTint(tint, 0);
-                }
-                qglUniform4fvARB(shader->tint_mult, 1, tint);
-                this->DrawMesh(mesh, NULL, NULL);
-            }
+            this->DrawMeshAnimatedFaces(packet->mesh, shader->anim_tex_index);
+            active_vbo = 0;
+            continue;
         }
-    }
 
-    for(cont = room->containers; cont; cont = cont->next)
-    {
-        switch(cont->object_type)
+        if(packet->type == RENDER_PACKET_STATIC_BATCH)
         {
-        case OBJECT_ENTITY:
-            ent = (entity_p)cont->object;
-            if(Frustum_IsOBBVisibleInFrustumList(ent->obb, (room->frustum) ? (room->frustum) : (m_camera->frustum)))
+            static_batch_face_p face = packet->batch->faces + packet->batch_face;
+            if(active_vbo != packet->batch->vbo)
             {
-                this->DrawEntity(ent, modelViewMatrix, modelViewProjectionMatrix);
+                active_vbo = packet->batch->vbo;
+                qglBindBufferARB(GL_ARRAY_BUFFER_ARB, active_vbo);
+                qglVertexPointer(3, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, position));
+                qglColorPointer(4, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, color));
+                qglNormalPointer(GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, normal));
+                qglTexCoordPointer(2, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, tex_coord));
             }
-            break;
-        };
-    }
-
-    for(uint16_t ni = 0; ni < room->content->near_room_list_size; ni++)
-    {
-        room_p near_room = room->content->near_room_list[ni]->real_room;
-        if(!room->content->near_room_list[ni]->is_in_r_list)
-        {
-            if (near_room->content->static_mesh_count > 0)
+            if(active_ibo != packet->batch->ibo)
             {
-                const unlit_tinted_shader_description *shader = shaderManager->getStaticMeshShader();
-                for(uint32_t si = 0; si < near_room->content->static_mesh_count; si++)
-                {
-                    if(OBB_OBB_Test(near_room->content->static_mesh[si].obb, room->obb, 0.0f) &&
-                       Frustum_IsOBBVisibleInFrustumList(near_room->content->static_mesh[si].obb, (room->frustum) ? (room->frustum) : (m_camera->frustum)) &&
-                       (!near_room->content->static_mesh[si].hide || (r_flags & R_DRAW_DUMMY_STATICS)))
-                    {
-                        qglUseProgramObjectARB(shader->program);
-                        Mat4_Mat4_mul(transform, modelViewProjectionMatrix, near_room->content->static_mesh[si].transform);
-                        qglUniformMatrix4fvARB(shader->model_view_projection, 1, false, transform);
-                        qglUniform1fARB(shader->dist_fog, m_camera->dist_far);
-                        base_mesh_s *mesh = near_room->content->static_mesh[si].mesh;
-                        GLfloat tint[4];
-
-                        vec4_copy(tint, near_room->content->static_mesh[si].tint);
-
-                        //If this static mesh is in a water near_room
-                        if(near_room->content->room_flags & TR_ROOM_FLAG_WATER)
-                        {
-                            CalculateWaterTint(tint, 0);
-                        }
-                        qglUniform4fvARB(shader->tint_mult, 1, tint);
-                        this->DrawMesh(mesh, NULL, NULL);
-                    }
-                }
+                active_ibo = packet->batch->ibo;
+                qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, active_ibo);
             }
-
-            for(cont = near_room->containers; cont; cont=cont->next)
+            if(m_active_texture != face->texture_index)
             {
-                switch(cont->object_type)
+                m_active_texture = face->texture_index;
+                qglBindTexture(GL_TEXTURE_2D, m_active_texture);
+            }
+            if(qglMultiDrawElements)
+            {
+                qglMultiDrawElements(GL_TRIANGLES, m_ranges_counts + packet->ranges_first, GL_UNSIGNED_INT, m_ranges_offsets + packet->ranges_first, packet->ranges_count);
+            }
+            else
+            {
+                for(uint32_t j = packet->ranges_first; j < packet->ranges_first + packet->ranges_count; j++)
                 {
-                case OBJECT_ENTITY:
-                    ent = (entity_p)cont->object;
-                    if(OBB_OBB_Test(ent->obb, room->obb, 0.0f) &&
-                       Frustum_IsOBBVisibleInFrustumList(ent->obb, (room->frustum) ? (room->frustum) : (m_camera->frustum)))
-                    {
-                        this->DrawEntity(ent, modelViewMatrix, modelViewProjectionMatrix);
-                    }
-                    break;
-                };
+                    qglDrawElements(GL_TRIANGLES, m_ranges_counts[j], GL_UNSIGNED_INT, m_ranges_offsets[j]);
+                }
             }
+            continue;
+        }
+
+        if(active_vbo != packet->mesh->vbo_vertex_array)
+        {
+            active_vbo = packet->mesh->vbo_vertex_array;
+            qglBindBufferARB(GL_ARRAY_BUFFER_ARB, active_vbo);
+            qglVertexPointer(3, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, position));
+            qglColorPointer(4, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, color));
+            qglNormalPointer(GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, normal));
+            qglTexCoordPointer(2, GL_FLOAT, sizeof(vertex_t), (void*)offsetof(vertex_t, tex_coord));
+        }
+
+        if(m_active_texture != packet->face->texture_index)
+        {
+            m_active_texture = packet->face->texture_index;
+            qglBindTexture(GL_TEXTURE_2D, m_active_texture);
         }
+        qglDrawElements(GL_TRIANGLES, packet->face->elements_count, GL_UNSIGNED_INT, packet->face->elements);
     }
+
+    if(active_ibo != 0)
+    {
+        qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+    }
+
+    m_packets_count = 0;
+    m_objects_count = 0;
+    m_ranges_count = 0;
+    m_batch_object = 0xFFFFFFFF;
+    m_queue_shaders_count = 0;
 }
 
 
@@ -1267,10 +2631,19 @@ int CRender::ProcessRoom(struct portal_s *portal, struct frustum_s *frus)
         return 0;
     }
 
+    if(++m_vis_depth > m_vis_max_depth)
+    {
+        m_vis_max_depth = m_vis_depth;
+    }
+
     for(uint16_t i = 0; i < room->content->portals_count; i++)
     {
         portal_p p = room->content->portals + i;
         room_p dest_room = p->dest_room->real_room;
+        if(!Room_IsInPVS(m_vis_pvs_room, dest_room))
+        {
+            continue;
+        }
         frustum_p gen_frus = frustumManager->PortalFrustumIntersect(p, frus, m_camera);  // backface portals are filtered here
         if(gen_frus)
         {
@@ -1279,6 +2652,7 @@ int CRender::ProcessRoom(struct portal_s *portal, struct frustum_s *frus)
             this->ProcessRoom(p, gen_frus);
         }
     }
+    m_vis_depth--;
 
     return ret;
 }
@@ -1308,28 +2682,32 @@ const lit_shader_description *CRender::SetupEntityLight(struct entity_s *entity,
         }
 
         GLenum current_light_number = 0;
-        light_s *current_light = NULL;
+        light_s *selected_lights[MAX_NUM_LIGHTS];
+        light_s **sector_lights = Room_GetSectorLights(entity->self->sector);   // selected at load time for the entity sector
+        uint16_t lights_count = 0;
 
         GLfloat positions[3*MAX_NUM_LIGHTS];
         GLfloat colors[4*MAX_NUM_LIGHTS];
         GLfloat innerRadiuses[1*MAX_NUM_LIGHTS];
         GLfloat outerRadiuses[1*MAX_NUM_LIGHTS];
-        memset(positions, 0, sizeof(positions));
-        memset(colors, 0, sizeof(colors));
-        memset(innerRadiuses, 0, sizeof(innerRadiuses));
-        memset(outerRadiuses, 0, sizeof(outerRadiuses));
 
-        float *entity_pos = entity->transform.M4x4 + 12;
-
-        for(uint32_t i = 0; (i < room->content->lights_count) && (current_light_number < MAX_NUM_LIGHTS); i++)
+        if(sector_lights)
         {
-            current_light = &room->content->lights[i];
-
-            float x = entity_pos[0] - current_light->pos[0];
-            float y = entity_pos[1] - current_light->pos[1];
-            float z = entity_pos[2] - current_light->pos[2];
+            uint16_t candidates_count = 0;
+            while((candidates_count < ROOM_MAX_SECTOR_LIGHTS) && sector_lights[candidates_count])
+            {
+                candidates_count++;
+            }
+            lights_count = Room_RankLights(sector_lights, candidates_count, entity->transform.M4x4 + 12, selected_lights, MAX_NUM_LIGHTS);
+        }
+        else
+        {
+            lights_count = Room_SelectLights(room, entity->transform.M4x4 + 12, selected_lights, MAX_NUM_LIGHTS);
+        }
 
-            float distance = sqrtf(x * x + y * y + z * z);
+        for(uint16_t i = 0; (i < lights_count) && (current_light_number < MAX_NUM_LIGHTS); i++, current_light_number++)
+        {
+            light_s *current_light = selected_lights[i];
 
             // Find color
             colors[current_light_number*4 + 0] = std::fmin(std::fmax(current_light->colour[0], 0.0), 1.0);
@@ -1350,45 +2728,11 @@ const lit_shader_description *CRender::SetupEntityLight(struct entity_s *entity,
             {
                 innerRadiuses[current_light_number] = 1e20f;
                 outerRadiuses[current_light_number] = 1e21f;
-                current_light_number++;
             }
-            else if(distance <= current_light->outer + 1024.0f && (current_light->light_type == LT_POINT || current_light->light_type == LT_SHADOW))
+            else
             {
                 innerRadiuses[current_light_number] = std::fabs(current_light->inner);
                 outerRadiuses[current_light_number] = std::fabs(current_light->outer);
-                current_light_number++;
-            }
-        }
-
-        for(uint32_t room_index = 0; (current_light_number < MAX_NUM_LIGHTS) && (room_index < room->content->near_room_list_size); room_index++)
-        {
-            room_p near_room = room->content->near_room_list[room_index];
-            for(uint32_t i = 0; (i < near_room->content->lights_count) && (current_light_number < MAX_NUM_LIGHTS); i++)
-            {
-                current_light = &near_room->content->lights[i];
-
-                float x = entity_pos[0] - current_light->pos[0];
-                float y = entity_pos[1] - current_light->pos[1];
-                float z = entity_pos[2] - current_light->pos[2];
-
-                float distance = sqrtf(x * x + y * y + z * z);
-
-                // Find color
-                colors[current_light_number*4 + 0] = std::fmin(std::fmax(current_light->colour[0], 0.0), 1.0);
-                colors[current_light_number*4 + 1] = std::fmin(std::fmax(current_light->colour[1], 0.0), 1.0);
-                colors[current_light_number*4 + 2] = std::fmin(std::fmax(current_light->colour[2], 0.0), 1.0);
-                colors[current_light_number*4 + 3] = std::fmin(std::fmax(current_light->colour[3], 0.0), 1.0);
-
-                // Find position
-                Mat4_vec3_mul(&positions[3*current_light_number], modelViewMatrix, current_light->pos);
-
-                // Find fall-off
-                if(distance <= current_light->outer + 1024.0f && (current_light->light_type == LT_POINT || current_light->light_type == LT_SHADOW))
-                {
-                    innerRadiuses[current_light_number] = std::fabs(current_light->inner);
-                    outerRadiuses[current_light_number] = std::fabs(current_light->outer);
-                    current_light_number++;
-                }
             }
         }
 
@@ -33,6 +33,22 @@
 
 #define STENCIL_FRUSTUM 1
 
+#define RENDER_QUEUE_MAX_SHADERS        (16)
+
+#define RENDER_ANIM_TEX_MAX_FRAMES      (112)   // animated textures table slots, slot 0 is identity; upper bound, see shader_manager
+#define RENDER_ANIM_TEX_RESERVED_UNIFORMS (64)  // vertex uniform components kept for other uniforms of room and static mesh shaders
+
+#define RENDER_VIS_CACHE_POS_STEP       (1.0f)  // camera moves less than that keep the portal visibility
+#define RENDER_VIS_CACHE_AXIS_STEPS     (1024.0f)
+
+#define RENDER_PACKET_MESH_FACE         (0)     // one static texture page of the mesh
+#define RENDER_PACKET_STATIC_BATCH      (1)     // visible statics of one room batch texture page
+#define RENDER_PACKET_MESH_ANIMATED     (2)     // all animated texture faces of the mesh
+#define RENDER_PACKET_ENTITY            (3)     // whole entity, drawn by DrawEntity()
+
+#define RENDER_TRANSPARENCY_BSP         (0)     // per frame dynamic BSP of all transparency polygons
+#define RENDER_TRANSPARENCY_SORTED      (1)     // meshes back to front, room polygons sorted inside the room
+
 struct portal_s;
 struct frustum_s;
 struct world_s;
@@ -43,6 +59,8 @@ struct sprite_s;
 struct base_mesh_s;
 struct obb_s;
 struct lit_shader_description;
+struct ss_bone_tag_s;
+struct ss_skin_cache_s;
 
 // Native TR blending modes.
 
@@ -83,9 +101,14 @@ typedef struct render_settings_s
     GLfloat   fog_color[4];
     float     fog_start_depth;
     float     fog_end_depth;
+    int8_t    static_batching;                          // merge room static meshes into one VBO per room
+    int8_t    occlusion;                                // CPU occlusion culling of rooms, statics and entities
+    int8_t    transparency_mode;                        // RENDER_TRANSPARENCY_BSP or RENDER_TRANSPARENCY_SORTED
 }render_settings_t, *render_settings_p;
 
 
+void CalculateWaterTint(GLfloat *tint, uint8_t fixed_colour);
+
 class CRenderDebugDrawer
 {
     public:
@@ -148,23 +171,58 @@ class CRender
         void DrawList();
         void DrawListDebugLines();
         void CleanList();
+        void InvalidateVisibilityCache()
+        {
+            m_vis_cache_valid = false;
+        }
+        uint32_t GetVisibilityCacheHits() const {return m_vis_cache_hits;}
+        uint32_t GetVisibilityCacheMisses() const {return m_vis_cache_misses;}
+        uint16_t GetVisibilityDepth() const {return m_vis_max_depth;}
+        uint32_t GetRoomsListCount() const {return r_list_active_count;}
+        uint32_t CountVisibleObjects(bool batched);
+        void UpdateOcclusion();
+        uint32_t GetTransparencyPolygons() const {return m_transparency_polygons;}
+        uint32_t GetTransparencyDraws() const {return m_transparency_draws;}
 
         void DrawBSPPolygon(struct bsp_polygon_s *p);
         void DrawBSPFrontToBack(struct bsp_node_s *root);
         void DrawBSPBackToFront(struct bsp_node_s *root);
 
         void DrawMesh(struct base_mesh_s *mesh, const float *overrideVertices, const float *overrideNormals);
-        void DrawSkinMesh(struct base_mesh_s *mesh, struct base_mesh_s *parent_mesh, uint32_t *map, float transform[16]);
+        void DrawSkinMesh(struct ss_bone_tag_s *btag);
         void DrawSkyBox(const float matrix[16]);
 
         void DrawSkeletalModel(const struct lit_shader_description *shader, struct ss_bone_frame_s *bframe, const float mvMatrix[16], const float mvpMatrix[16]);
         void DrawEntity(struct entity_s *entity, const float modelViewMatrix[16], const float modelViewProjectionMatrix[16]);
 
-        void DrawRoom(struct room_s *room, const float matrix[16], const float modelViewProjectionMatrix[16]);
+        void QueueRoom(struct room_s *room);
+        void DrawQueue();
         void DrawRoomSprites(struct room_s *room);
 
         struct gl_text_line_s *OutTextXYZ(GLfloat x, GLfloat y, GLfloat z, const char *fmt, ...);
 
+        struct render_packet_s
+        {
+            uint64_t            key;
+            uint16_t            type;
+            uint32_t            object;                 // index in m_objects for mesh packets
+            struct base_mesh_s *mesh;
+            struct mesh_face_s *face;
+            struct entity_s    *entity;
+            struct static_batch_s *batch;
+            uint32_t            batch_face;
+            uint32_t            ranges_first;           // in m_ranges_counts / m_ranges_offsets
+            uint32_t            ranges_count;
+        };
+
+        struct transparent_item_s
+        {
+            struct base_mesh_s *mesh;
+            GLfloat            transform[16];
+            float              dist;                    // squared distance from the camera to the mesh centre
+            bool               sort_polygons;           // static room geometry: polygons are sorted too
+        };
+
     private:
         struct render_list_s
         {
@@ -173,10 +231,52 @@ class CRender
             float              dist;
         };
 
+        struct render_object_s
+        {
+            const struct unlit_tinted_shader_description *shader;
+            GLfloat            mvp[16];
+            GLfloat            tint[4];
+        };
+
+        struct vis_cache_key_s
+        {
+            struct camera_s   *camera;
+            struct room_s     *room;
+            GLfloat            fov;
+            GLfloat            aspect;
+            int32_t            pos[3];
+            int16_t            axes[9];
+        };
+
         void InitSettings();
         int  AddRoom(struct room_s *room);
         int  ProcessRoom(struct portal_s *portal, struct frustum_s *frus);
+        void GetVisibilityCacheKey(struct vis_cache_key_s *key, struct camera_s *cam, struct room_s *room);
+        uint32_t *CullRoomObjects(struct room_s *room, struct frustum_s *frustum, uint32_t *objects_count);
+        void SetBlendMode(uint16_t transparency);
+        void DrawMeshFaces(struct base_mesh_s *mesh);
+        void SkinMesh(struct ss_bone_tag_s *btag, struct ss_skin_cache_s *cache);
+        void AddTransparentMesh(struct base_mesh_s *mesh, const float transform[16], bool sort_polygons);
+        void GenMeshTransparency(struct base_mesh_s *mesh);
+        void DrawTransparencyBSP();
+        void DrawTransparencySorted();
+        void DrawTransparentItem(const struct unlit_tinted_shader_description *shader, struct transparent_item_s *item);
+        void DrawTransparencyRun(struct mesh_transparency_s *mt, const GLuint *indices, GLsizei count);
+        void DrawAnimatedTransparency(struct base_mesh_s *mesh, struct mesh_transparency_s *mt);
+        void UpdateTransparencyTexCoords(struct base_mesh_s *mesh);
+        void DrawMeshAnimatedFaces(struct base_mesh_s *mesh, GLint anim_tex_index);
+        void GenAnimTexTable();
+        void UpdateAnimTexTable();
+        void GenMeshAnimTexFrames(struct base_mesh_s *mesh);
+        void DrawSkeletalModelPalette(const struct lit_shader_description *shader, struct ss_bone_frame_s *bframe, const float mvMatrix[16], const float mvpMatrix[16]);
         const lit_shader_description *SetupEntityLight(struct entity_s *entity, const float modelViewMatrix[16]);
+        uint64_t GetPacketKey(uint16_t type, uint32_t shader_slot, uint32_t texture, uint32_t buffer, const float pos[3]);
+        struct render_packet_s *AddPacket();
+        void QueueMesh(struct base_mesh_s *mesh, const struct unlit_tinted_shader_description *shader, const float transform[16], const float tint[4]);
+        void QueueEntity(struct entity_s *entity);
+        void QueueStaticBatch(struct static_batch_s *batch, const uint8_t *visible, uint32_t statics_count);
+        uint32_t GetShaderSlot(const struct unlit_tinted_shader_description *shader);
+        uint32_t AddObject(const struct unlit_tinted_shader_description *shader, const float transform[16], const float tint[4]);
 
         struct camera_s            *m_camera;
 
@@ -185,13 +285,46 @@ class CRender
         struct anim_seq_s          *m_anim_sequences;
         uint32_t                    m_anim_sequences_count;
 
+        uint32_t                    m_anim_tex_frames_count;            // 0 - table is off, animated texcoords are mapped per mesh
+        uint32_t                   *m_anim_tex_first;                   // first table slot of every sequence
+        GLfloat                     m_anim_tex_frames[8 * RENDER_ANIM_TEX_MAX_FRAMES];
+
         uint16_t                    m_active_transparency;
         GLuint                      m_active_texture;
 
+        uint32_t                    m_transparent_items_size;
+        uint32_t                    m_transparent_items_count;
+        struct transparent_item_s  *m_transparent_items;
+        uint32_t                    m_transparency_polygons;            // last frame stats of the active transparency path
+        uint32_t                    m_transparency_draws;
+
         uint32_t                    r_list_size;
         uint32_t                    r_list_active_count;
         struct render_list_s       *r_list;
+
+        bool                        m_vis_cache_valid;
+        struct vis_cache_key_s      m_vis_cache_key;
+        struct room_s              *m_vis_pvs_room;                     // rooms out of its PVS are not processed
+        uint32_t                    m_vis_cache_hits;
+        uint32_t                    m_vis_cache_misses;
+        uint16_t                    m_vis_depth;
+        uint16_t                    m_vis_max_depth;
+
+        uint32_t                    m_packets_size;
+        uint32_t                    m_packets_count;
+        struct render_packet_s     *m_packets;
+        uint32_t                    m_objects_size;
+        uint32_t                    m_objects_count;
+        struct render_object_s     *m_objects;
+        uint32_t                    m_ranges_size;
+        uint32_t                    m_ranges_count;
+        GLsizei                    *m_ranges_counts;
+        const GLvoid              **m_ranges_offsets;
+        uint32_t                    m_batch_object;
+        uint32_t                    m_queue_shaders_count;
+        const struct unlit_tinted_shader_description *m_queue_shaders[RENDER_QUEUE_MAX_SHADERS];
         class CFrustumManager      *frustumManager;
+        class COcclusionBuffer     *occlusionBuffer;
 
     public:
         struct render_settings_s    settings;
@@ -68,6 +68,17 @@ lit_shader_description::lit_shader_description(const shader_stage &vertex, const
     light_inner_radius = qglGetUniformLocationARB(program, "light_innerRadius");
     light_outer_radius = qglGetUniformLocationARB(program, "light_outerRadius");
     light_ambient = qglGetUniformLocationARB(program, "light_ambient");
+    bone_matrices = qglGetUniformLocationARB(program, "boneMatrix");
+    bone_index = qglGetAttribLocationARB(program, "boneIndex");
+
+    if(bone_matrices >= 0)
+    {
+        // Slot 0 stays identity: meshes drawn without bone index array use it.
+        const GLfloat identity[16] = {1.0f, 0.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f, 0.0f,  0.0f, 0.0f, 1.0f, 0.0f,  0.0f, 0.0f, 0.0f, 1.0f};
+        qglUseProgramObjectARB(program);
+        qglUniformMatrix4fvARB(bone_matrices, 1, GL_FALSE, identity);
+        qglUseProgramObjectARB(0);
+    }
 }
 
 unlit_tinted_shader_description::unlit_tinted_shader_description(const shader_stage &vertex, const shader_stage &fragment)
@@ -75,4 +86,15 @@ unlit_tinted_shader_description::unlit_tinted_shader_description(const shader_st
 {
     current_tick = qglGetUniformLocationARB(program, "fCurrentTick");
     tint_mult = qglGetUniformLocationARB(program, "tintMult");
+    anim_tex_frames = qglGetUniformLocationARB(program, "animTexFrames");
+    anim_tex_index = qglGetAttribLocationARB(program, "animTexIndex");
+
+    if(anim_tex_frames >= 0)
+    {
+        // Slot 0 stays identity: vertices drawn without anim texture index array use it.
+        const GLfloat identity[8] = {1.0f, 0.0f, 0.0f, 1.0f,  0.0f, 0.0f, 0.0f, 0.0f};
+        qglUseProgramObjectARB(program);
+        qglUniform4fvARB(anim_tex_frames, 2, identity);
+        qglUseProgramObjectARB(0);
+    }
 }
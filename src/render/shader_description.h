@@ -65,6 +65,8 @@ struct lit_shader_description : public unlit_shader_description
     GLint light_inner_radius;
     GLint light_outer_radius;
     GLint light_ambient;
+    GLint bone_matrices;
+    GLint bone_index;                   // vertex attribute
     
     lit_shader_description(const shader_stage &vertex, const shader_stage &fragment);
 };
@@ -73,6 +75,8 @@ struct unlit_tinted_shader_description : public unlit_shader_description
 {
     GLint current_tick;
     GLint tint_mult;
+    GLint anim_tex_frames;
+    GLint anim_tex_index;               // vertex attribute
     
     unlit_tinted_shader_description(const shader_stage &vertex, const shader_stage &fragment);
 };
@@ -2,11 +2,31 @@
 #include <sstream>
 
 #include "shader_manager.h"
+#include "../skeletal_model.h"
+#include "render.h"
 
 shader_manager::shader_manager()
 {
+    // Table slot is 2 vec4; GL 2.x guarantees only 512 vertex uniform components,
+    // so the table is cut to what the driver has. Levels that need more slots
+    // map animated texcoords per mesh on CPU.
+    GLint max_components = 0;
+    qglGetIntegerv(GL_MAX_VERTEX_UNIFORM_COMPONENTS_ARB, &max_components);
+    anim_tex_frames_count = 1;
+    if(max_components > RENDER_ANIM_TEX_RESERVED_UNIFORMS + 8)
+    {
+        anim_tex_frames_count = (max_components - RENDER_ANIM_TEX_RESERVED_UNIFORMS) / 8;
+    }
+    if(anim_tex_frames_count > RENDER_ANIM_TEX_MAX_FRAMES)
+    {
+        anim_tex_frames_count = RENDER_ANIM_TEX_MAX_FRAMES;
+    }
+
+    std::ostringstream animTexStream;
+    animTexStream << "#define NUMBER_OF_ANIM_TEX_FRAMES " << anim_tex_frames_count << std::endl;
+
     //Color mult prog
-    static_mesh_shader = new unlit_tinted_shader_description(shader_stage(GL_VERTEX_SHADER_ARB, "shaders/static_mesh.vsh"), shader_stage(GL_FRAGMENT_SHADER_ARB, "shaders/static_mesh.fsh"));
+    static_mesh_shader = new unlit_tinted_shader_description(shader_stage(GL_VERTEX_SHADER_ARB, "shaders/static_mesh.vsh", animTexStream.str().c_str()), shader_stage(GL_FRAGMENT_SHADER_ARB, "shaders/static_mesh.fsh"));
 
     //Room prog
     shader_stage roomFragmentShader(GL_FRAGMENT_SHADER_ARB, "shaders/room.fsh");
@@ -17,13 +37,16 @@ shader_manager::shader_manager()
             std::ostringstream stream;
             stream << "#define IS_WATER " << isWater << std::endl;
             stream << "#define IS_FLICKER " << isFlicker << std::endl;
+            stream << animTexStream.str();
 
             room_shaders[isWater][isFlicker] = new unlit_tinted_shader_description(shader_stage(GL_VERTEX_SHADER_ARB, "shaders/room.vsh", stream.str().c_str()), roomFragmentShader);
         }
     }
 
     // Entity prog
-    shader_stage entityVertexShader(GL_VERTEX_SHADER_ARB, "shaders/entity.vsh");
+    std::ostringstream bonesStream;
+    bonesStream << "#define NUMBER_OF_BONES " << (SKELETAL_PALETTE_MAX_BONES + 1) << std::endl;
+    shader_stage entityVertexShader(GL_VERTEX_SHADER_ARB, "shaders/entity.vsh", bonesStream.str().c_str());
     for (int i = 0; i <= MAX_NUM_LIGHTS; i++) {
         std::ostringstream stream;
         stream << "#define NUMBER_OF_LIGHTS " << i << std::endl;
@@ -11,6 +11,7 @@ class shader_manager {
     unlit_tinted_shader_description *static_mesh_shader;
     lit_shader_description *entity_shader[MAX_NUM_LIGHTS+1];
     text_shader_description *text;
+    unsigned anim_tex_frames_count;
 
 public:
     shader_manager();
@@ -23,6 +24,9 @@ public:
     const unlit_tinted_shader_description *getRoomShader(bool isFlickering, bool isWater) const;
     
     const text_shader_description *getTextShader() const { return text; }
+
+    // Animated textures table slots the room and static mesh shaders were built with.
+    unsigned getAnimTexFramesCount() const { return anim_tex_frames_count; }
 };
 
 #endif /* defined(__OpenTomb__shader_manager__) */
@@ -1581,6 +1581,7 @@ void TR_GenSkeletalModel(struct skeletal_model_s *model, size_t model_id, struct
         model->animations->frames_count = 1;
         model->animations->max_frame = 1;
         model->animations->frames = (bone_frame_p)calloc(model->animations->frames_count , sizeof(bone_frame_t));
+        model->animations->keys = NULL;
         bone_frame = model->animations->frames;
 
         model->animations->id = 0;
@@ -1588,6 +1589,10 @@ void TR_GenSkeletalModel(struct skeletal_model_s *model, size_t model_id, struct
         model->animations->next_frame = 0;
         model->animations->state_change = NULL;
         model->animations->state_change_count = 0;
+        model->animations->state_lookup = NULL;
+        model->animations->dispatch_lookup = NULL;
+        model->animations->state_lookup_size = 0;
+        model->animations->dispatch_frames = 0;
         model->animations->commands = NULL;
         model->animations->effects = NULL;
         bone_frame->bone_tag_count = model->mesh_count;
@@ -1617,6 +1622,8 @@ void TR_GenSkeletalModel(struct skeletal_model_s *model, size_t model_id, struct
     }
 
     model->animations = (animation_frame_p)calloc(model->animation_count, sizeof(animation_frame_t));
+    // not from Sys_GetTempMem(): models are generated in job threads.
+    rotations = (tr5_vertex_t*)malloc(model->mesh_count * sizeof(tr5_vertex_t));
     anim = model->animations;
     for(uint16_t i = 0; i < model->animation_count; i++, anim++)
     {
@@ -1697,7 +1704,6 @@ void TR_GenSkeletalModel(struct skeletal_model_s *model, size_t model_id, struct
          * let us begin to load animations
          */
         bone_frame = anim->frames;
-        rotations = (tr5_vertex_t*)Sys_GetTempMem(model->mesh_count * sizeof(tr5_vertex_t));
         for(uint16_t frame_index = 0; frame_index < anim->frames_count; frame_index++, bone_frame++)
         {
             bone_frame->bone_tag_count = model->mesh_count;
@@ -1732,7 +1738,7 @@ void TR_GenSkeletalModel(struct skeletal_model_s *model, size_t model_id, struct
             }
         }
     }
-    Sys_ReturnTempMem(model->mesh_count * sizeof(tr5_vertex_t));
+    free(rotations);
     /*
      * Animations interpolation to 1/30 sec like in original. Needed for correct state change works.
      */
@@ -1821,6 +1827,7 @@ void TR_GenSkeletalModel(struct skeletal_model_s *model, size_t model_id, struct
                 }
             }
         }
+        Anim_GenStateLookup(anim);
     }
 }
 
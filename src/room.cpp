@@ -9,7 +9,10 @@
 #include "core/system.h"
 #include "core/polygon.h"
 #include "core/obb.h"
+#include "core/perf.h"
+#include "core/cache_file.h"
 #include "render/frustum.h"
+#include "render/render.h"
 #include "physics/physics.h"
 #include "engine.h"
 #include "entity.h"
@@ -20,6 +23,35 @@
 
 
 #define ROOM_LIST_SIZE_ALIGN    (8)
+#define ROOM_PVS_MAX_DEPTH      (64)
+#define ROOM_PVS_MAX_STEPS      (1 << 16)
+#define ROOM_PVS_MAX_VARIANTS   (16)
+#define ROOM_PVS_EPSILON        (1.0f)
+
+typedef struct room_pvs_state_s
+{
+    uint8_t                    *pvs;
+    uint32_t                    steps;
+    uint16_t                    depth;
+    struct portal_s            *path[ROOM_PVS_MAX_DEPTH];
+}room_pvs_state_t, *room_pvs_state_p;
+
+
+static void Room_FreeSectorTrigger(room_sector_p s)
+{
+    if(s->trigger)
+    {
+        for(trigger_command_p current_command = s->trigger->commands; current_command; )
+        {
+            trigger_command_p next_command = current_command->next;
+            current_command->next = NULL;
+            free(current_command);
+            current_command = next_command;
+        }
+        free(s->trigger);
+        s->trigger = NULL;
+    }
+}
 
 
 void Room_Clear(struct room_s *room)
@@ -76,6 +108,22 @@ void Room_Clear(struct room_s *room)
             content->static_mesh_count = 0;
         }
 
+        if(content->static_batch)
+        {
+            static_batch_p batch = content->static_batch;
+            qglDeleteBuffersARB(1, &batch->vbo);
+            qglDeleteBuffersARB(1, &batch->ibo);
+            if(batch->faces_count)
+            {
+                free(batch->faces[0].counts);
+                free(batch->faces[0].offsets);
+                free(batch->faces);
+            }
+            free(batch->in_batch);
+            free(batch);
+            content->static_batch = NULL;
+        }
+
         Physics_DeleteObject(content->physics_body);
         content->physics_body = NULL;
         Physics_DeleteObject(content->physics_alt_tween);
@@ -101,23 +149,18 @@ void Room_Clear(struct room_s *room)
             content->lights_count = 0;
         }
 
+        if(content->sector_lights)
+        {
+            free(content->sector_lights);
+            content->sector_lights = NULL;
+        }
+
         if(room->sectors_count)
         {
             room_sector_p s = content->sectors;
             for(uint32_t i = 0; i < room->sectors_count; i++, s++)
             {
-                if(s->trigger)
-                {
-                    for(trigger_command_p current_command = s->trigger->commands; current_command; )
-                    {
-                        trigger_command_p next_command = current_command->next;
-                        current_command->next = NULL;
-                        free(current_command);
-                        current_command = next_command;
-                    }
-                    free(s->trigger);
-                    s->trigger = NULL;
-                }
+                Room_FreeSectorTrigger(s);
             }
             free(content->sectors);
             content->sectors = NULL;
@@ -140,6 +183,12 @@ void Room_Clear(struct room_s *room)
             content->near_room_list = NULL;
         }
 
+        if(content->pvs)
+        {
+            free(content->pvs);
+            content->pvs = NULL;
+        }
+
         free(content);
     }
     room->original_content = NULL;
@@ -643,6 +692,655 @@ void Room_GenSpritesBuffer(struct room_s *room)
 }
 
 
+static int Room_IsStaticBatchable(static_mesh_p sm)
+{
+    return !sm->hide && sm->mesh && (sm->mesh->faces_count > 0) && (sm->mesh->animated_vertex_count == 0);
+}
+
+
+/*
+ * Any line of sight through portals chain p0, p1 ... pn crosses every portal plane
+ * only once, from the front (source room) side to the back side. So every next portal
+ * must reach behind the planes of all previous ones, and they must reach in front of its plane.
+ */
+static int Room_PVSIsPortalVisible(room_pvs_state_p state, struct portal_s *portal)
+{
+    for(uint16_t i = 0; i < state->depth; i++)
+    {
+        struct portal_s *prev = state->path[i];
+        int behind = 0, in_front = 0;
+        float *v = portal->vertex;
+        for(uint16_t j = 0; !behind && (j < portal->vertex_count); j++, v += 3)
+        {
+            behind = (vec3_plane_dist(prev->norm, v) < -ROOM_PVS_EPSILON);
+        }
+        v = prev->vertex;
+        for(uint16_t j = 0; !in_front && (j < prev->vertex_count); j++, v += 3)
+        {
+            in_front = (vec3_plane_dist(portal->norm, v) > ROOM_PVS_EPSILON);
+        }
+        if(!behind || !in_front)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static uint16_t Room_PVSAddVariant(struct room_s **variants, uint16_t count, struct room_s *r)
+{
+    for(uint16_t i = 0; i < count; i++)
+    {
+        if(variants[i] == r)
+        {
+            return count;
+        }
+    }
+    variants[count] = r;
+    return count + 1;
+}
+
+/// Collects all rooms that share the real room, their contents are swapped by flipmaps.
+static uint16_t Room_PVSGetVariants(struct room_s *real_room, struct room_s **variants)
+{
+    uint16_t ret = Room_PVSAddVariant(variants, 0, real_room);
+    for(room_p r = real_room->alternate_room_next; r && (ret < ROOM_PVS_MAX_VARIANTS); r = r->alternate_room_next)
+    {
+        uint16_t count = Room_PVSAddVariant(variants, ret, r);
+        if(count == ret)
+        {
+            break;                                                              // cycled sequence
+        }
+        ret = count;
+    }
+    for(room_p r = real_room->alternate_room_prev; r && (ret < ROOM_PVS_MAX_VARIANTS); r = r->alternate_room_prev)
+    {
+        uint16_t count = Room_PVSAddVariant(variants, ret, r);
+        if(count == ret)
+        {
+            break;
+        }
+        ret = count;
+    }
+
+    return ret;
+}
+
+/// @return 0 if walk was aborted by depth or steps limits.
+static int Room_PVSWalk(room_pvs_state_p state, struct portal_s *portal)
+{
+    room_p variants[ROOM_PVS_MAX_VARIANTS];
+    room_p dest_room = portal->dest_room->real_room;
+
+    if((++state->steps > ROOM_PVS_MAX_STEPS) || (state->depth >= ROOM_PVS_MAX_DEPTH))
+    {
+        return 0;
+    }
+
+    if(!Room_PVSIsPortalVisible(state, portal))
+    {
+        return 1;
+    }
+
+    state->pvs[dest_room->id / 8] |= 1 << (dest_room->id % 8);
+    state->path[state->depth++] = portal;
+    uint16_t variants_count = Room_PVSGetVariants(dest_room, variants);
+    for(uint16_t i = 0; i < variants_count; i++)
+    {
+        room_content_p content = variants[i]->content;
+        for(uint32_t j = 0; j < content->portals_count; j++)
+        {
+            if(!Room_PVSWalk(state, content->portals + j))
+            {
+                return 0;
+            }
+        }
+    }
+    state->depth--;
+
+    return 1;
+}
+
+
+void Room_GenPVS(struct room_s *room, uint32_t rooms_count)
+{
+    room_pvs_state_t state;
+    room_content_p content = room->content;
+    uint32_t size = (rooms_count + 7) / 8;
+
+    if(content->pvs)
+    {
+        free(content->pvs);
+    }
+    state.pvs = content->pvs = (uint8_t*)calloc(size, sizeof(uint8_t));
+    state.steps = 0;
+    state.depth = 0;
+    state.pvs[room->real_room->id / 8] |= 1 << (room->real_room->id % 8);
+
+    for(uint32_t i = 0; i < content->portals_count; i++)
+    {
+        if(!Room_PVSWalk(&state, content->portals + i))
+        {
+            free(content->pvs);                                                 // too complex portals graph, keep all rooms visible
+            content->pvs = NULL;
+            break;
+        }
+    }
+}
+
+
+int Room_IsInPVS(struct room_s *room, struct room_s *r)
+{
+    uint8_t *pvs = room->content->pvs;
+    uint32_t id = r->real_room->id;
+    return (pvs == NULL) || (pvs[id / 8] & (1 << (id % 8)));
+}
+
+
+void Room_StorePVS(struct room_s *room, struct cache_file_s *cache, uint32_t rooms_count)
+{
+    uint8_t has_pvs = (room->content->pvs) ? (1) : (0);
+    CacheFile_WriteValue(cache, has_pvs);
+    if(has_pvs)
+    {
+        CacheFile_Write(cache, room->content->pvs, (rooms_count + 7) / 8);
+    }
+}
+
+
+int Room_RestorePVS(struct room_s *room, struct cache_file_s *cache, uint32_t rooms_count)
+{
+    uint8_t has_pvs = 0;
+    room_content_p content = room->content;
+
+    if(content->pvs)
+    {
+        free(content->pvs);
+        content->pvs = NULL;
+    }
+    CacheFile_ReadValue(cache, has_pvs);
+    if(has_pvs)
+    {
+        content->pvs = (uint8_t*)CacheFile_ReadArray(cache, (rooms_count + 7) / 8, sizeof(uint8_t));
+    }
+
+    return !cache->failed;
+}
+
+
+#define ROOM_CACHE_VERSION      (1)
+
+/*
+ * Cached sector: everything Res_Sector_TranslateFloorData and Res_RoomSectorsCalculate
+ * add to the sector made by World_GenRoom. Rooms are stored as indexes, -1 - NULL.
+ */
+typedef struct room_cache_sector_s
+{
+    uint32_t                    flags;
+    uint32_t                    material;
+    int32_t                     floor;
+    int32_t                     ceiling;
+    int32_t                     portal_to_room;
+    int32_t                     room_below;
+    int32_t                     room_above;
+    float                       ceiling_corners[4][3];
+    float                       floor_corners[4][3];
+    uint8_t                     ceiling_diagonal_type;
+    uint8_t                     ceiling_penetration_config;
+    uint8_t                     floor_diagonal_type;
+    uint8_t                     floor_penetration_config;
+    uint16_t                    has_trigger;
+    uint16_t                    commands_count;
+}room_cache_sector_t;
+
+typedef struct room_cache_trigger_command_s
+{
+    uint16_t                    function;
+    uint16_t                    operands;
+    uint8_t                     camera_index;
+    uint8_t                     camera_timer;
+    uint8_t                     camera_move;
+    uint8_t                     once;
+}room_cache_trigger_command_t;
+
+
+uint32_t Room_GetCacheLayout()
+{
+    uint32_t sizes[2] = {sizeof(room_cache_sector_t), sizeof(room_cache_trigger_command_t)};
+    return CacheFile_GetLayout(ROOM_CACHE_VERSION, sizes, 2);
+}
+
+
+void Room_StoreSectors(struct room_s *room, struct cache_file_s *cache, struct room_s *rooms)
+{
+    room_sector_p rs = room->content->sectors;
+    for(uint32_t i = 0; i < room->sectors_count; i++, rs++)
+    {
+        room_cache_sector_t record;
+        record.flags = rs->flags;
+        record.material = rs->material;
+        record.floor = rs->floor;
+        record.ceiling = rs->ceiling;
+        record.portal_to_room = (rs->portal_to_room) ? (rs->portal_to_room - rooms) : (-1);
+        record.room_below = (rs->room_below) ? (rs->room_below - rooms) : (-1);
+        record.room_above = (rs->room_above) ? (rs->room_above - rooms) : (-1);
+        memcpy(record.ceiling_corners, rs->ceiling_corners, sizeof(record.ceiling_corners));
+        memcpy(record.floor_corners, rs->floor_corners, sizeof(record.floor_corners));
+        record.ceiling_diagonal_type = rs->ceiling_diagonal_type;
+        record.ceiling_penetration_config = rs->ceiling_penetration_config;
+        record.floor_diagonal_type = rs->floor_diagonal_type;
+        record.floor_penetration_config = rs->floor_penetration_config;
+        record.has_trigger = (rs->trigger) ? (1) : (0);
+        record.commands_count = 0;
+        for(trigger_command_p cmd = (rs->trigger) ? (rs->trigger->commands) : (NULL); cmd; cmd = cmd->next)
+        {
+            record.commands_count++;
+        }
+        CacheFile_WriteValue(cache, record);
+
+        if(rs->trigger)
+        {
+            uint16_t header[5] = {rs->trigger->function_value, rs->trigger->sub_function, rs->trigger->once, rs->trigger->timer, rs->trigger->mask};
+            CacheFile_WriteValue(cache, header);
+            for(trigger_command_p cmd = rs->trigger->commands; cmd; cmd = cmd->next)
+            {
+                room_cache_trigger_command_t cmd_record;
+                cmd_record.function = cmd->function;
+                cmd_record.operands = cmd->operands;
+                cmd_record.camera_index = cmd->camera.index;
+                cmd_record.camera_timer = cmd->camera.timer;
+                cmd_record.camera_move = cmd->camera.move;
+                cmd_record.once = cmd->once;
+                CacheFile_WriteValue(cache, cmd_record);
+            }
+        }
+    }
+}
+
+
+static room_p Room_GetCachedRoom(struct room_s *rooms, uint32_t rooms_count, int32_t index, struct cache_file_s *cache)
+{
+    if(index < 0)
+    {
+        return NULL;
+    }
+    if((uint32_t)index >= rooms_count)
+    {
+        cache->failed = 1;
+        return NULL;
+    }
+    return rooms + index;
+}
+
+
+/*
+ * Replaces floordata translation of the room made by World_GenRoom. Sectors are changed
+ * only if the whole room is read, so on failure they are ready for usual translation.
+ */
+int Room_RestoreSectors(struct room_s *room, struct cache_file_s *cache, struct room_s *rooms, uint32_t rooms_count)
+{
+    size_t buf_size = room->sectors_count * sizeof(room_sector_t);
+    room_sector_p sectors = (room_sector_p)Sys_GetTempMem(buf_size);
+    room_sector_p rs = sectors;
+
+    memcpy(sectors, room->content->sectors, buf_size);
+    for(uint32_t i = 0; i < room->sectors_count; i++, rs++)
+    {
+        room_cache_sector_t record;
+        rs->trigger = NULL;
+        if(!CacheFile_ReadValue(cache, record))
+        {
+            break;
+        }
+        rs->flags = record.flags;
+        rs->material = record.material;
+        rs->floor = record.floor;
+        rs->ceiling = record.ceiling;
+        rs->portal_to_room = Room_GetCachedRoom(rooms, rooms_count, record.portal_to_room, cache);
+        rs->room_below = Room_GetCachedRoom(rooms, rooms_count, record.room_below, cache);
+        rs->room_above = Room_GetCachedRoom(rooms, rooms_count, record.room_above, cache);
+        memcpy(rs->ceiling_corners, record.ceiling_corners, sizeof(record.ceiling_corners));
+        memcpy(rs->floor_corners, record.floor_corners, sizeof(record.floor_corners));
+        rs->ceiling_diagonal_type = record.ceiling_diagonal_type;
+        rs->ceiling_penetration_config = record.ceiling_penetration_config;
+        rs->floor_diagonal_type = record.floor_diagonal_type;
+        rs->floor_penetration_config = record.floor_penetration_config;
+
+        if(record.has_trigger)
+        {
+            uint16_t header[5];
+            trigger_command_p *last_command_ptr;
+            CacheFile_ReadValue(cache, header);
+            rs->trigger = (trigger_header_p)malloc(sizeof(trigger_header_t));
+            rs->trigger->function_value = header[0];
+            rs->trigger->sub_function = header[1];
+            rs->trigger->once = header[2];
+            rs->trigger->timer = header[3];
+            rs->trigger->mask = header[4];
+            rs->trigger->commands = NULL;
+            last_command_ptr = &rs->trigger->commands;
+            for(uint16_t j = 0; j < record.commands_count; j++)
+            {
+                room_cache_trigger_command_t cmd_record;
+                trigger_command_p command;
+                if(!CacheFile_ReadValue(cache, cmd_record))
+                {
+                    break;
+                }
+                command = (trigger_command_p)malloc(sizeof(trigger_command_t));
+                command->function = cmd_record.function;
+                command->operands = cmd_record.operands;
+                command->camera.index = cmd_record.camera_index;
+                command->camera.timer = cmd_record.camera_timer;
+                command->camera.move = cmd_record.camera_move;
+                command->camera.unused = 0;
+                command->once = cmd_record.once;
+                command->unused = 0;
+                command->next = NULL;
+                *last_command_ptr = command;
+                last_command_ptr = &command->next;
+            }
+        }
+    }
+
+    if(cache->failed)
+    {
+        for(uint32_t i = 0; i < room->sectors_count; i++)
+        {
+            Room_FreeSectorTrigger(sectors + i);
+        }
+    }
+    else
+    {
+        memcpy(room->content->sectors, sectors, buf_size);
+    }
+    Sys_ReturnTempMem(buf_size);
+
+    return !cache->failed;
+}
+
+
+/*
+ * Light influence as the entity shader sees it (soft lighting) at the nearest point
+ * of the vertical segment [pos, pos + height]; slack covers the entity size and its
+ * moves around the point.
+ */
+#define ROOM_ENTITY_LIGHT_SLACK     (TR_METERING_SECTORSIZE)
+#define ROOM_SECTOR_LIGHT_SLACK     (TR_METERING_SECTORSIZE * 1.7072f)          // + half diagonal of the sector
+
+static float Room_GetLightInfluence(struct light_s *light, const float pos[3], float height, float slack)
+{
+    float power = fabs(light->colour[0]) + fabs(light->colour[1]) + fabs(light->colour[2]);
+
+    if(light->light_type == LT_SUN)
+    {
+        return power;
+    }
+    else if((light->light_type == LT_POINT) || (light->light_type == LT_SHADOW))
+    {
+        float radius = fabs(light->outer) + slack;
+        float pt[3] = {pos[0], pos[1], pos[2]};
+        pt[2] = (light->pos[2] > pos[2] + height) ? (pos[2] + height) : ((light->pos[2] > pos[2]) ? (light->pos[2]) : (pos[2]));
+        float dist = vec3_dist(light->pos, pt);
+        if(dist <= radius)
+        {
+            return power * (radius - dist) / radius;
+        }
+    }
+
+    return 0.0f;
+}
+
+
+/// Insertion into the list sorted by influence, the weakest one drops out of the full list.
+static void Room_AddRankedLight(struct light_s *light, float f, struct light_s **lights, float *influence, uint16_t *count, uint16_t max_lights)
+{
+    if((f > 0.0f) && ((*count < max_lights) || (f > influence[*count - 1])))
+    {
+        uint16_t j = (*count < max_lights) ? ((*count)++) : (*count - 1);
+        for(; (j > 0) && (influence[j - 1] < f); j--)
+        {
+            influence[j] = influence[j - 1];
+            lights[j] = lights[j - 1];
+        }
+        influence[j] = f;
+        lights[j] = light;
+    }
+}
+
+
+static uint16_t Room_SelectLightsInternal(struct room_s *room, const float pos[3], float height, float slack, struct light_s **lights, uint16_t max_lights)
+{
+    float influence[ROOM_MAX_SECTOR_LIGHTS];
+    uint16_t ret = 0;
+
+    max_lights = (max_lights > ROOM_MAX_SECTOR_LIGHTS) ? (ROOM_MAX_SECTOR_LIGHTS) : (max_lights);
+    for(int32_t room_index = -1; room_index < room->content->near_room_list_size; room_index++)
+    {
+        room_p r = (room_index >= 0) ? (room->content->near_room_list[room_index]) : (room);
+        for(uint32_t i = 0; i < r->content->lights_count; i++)
+        {
+            light_p light = r->content->lights + i;
+            Room_AddRankedLight(light, Room_GetLightInfluence(light, pos, height, slack), lights, influence, &ret, max_lights);
+        }
+    }
+
+    return ret;
+}
+
+/// Takes the most influential lights of the room and its near rooms at the entity position; returns lights count.
+uint16_t Room_SelectLights(struct room_s *room, const float pos[3], struct light_s **lights, uint16_t max_lights)
+{
+    return Room_SelectLightsInternal(room, pos, 0.0f, ROOM_ENTITY_LIGHT_SLACK, lights, max_lights);
+}
+
+/// Same ranking as Room_SelectLights, but among the given lights (sector lights list).
+uint16_t Room_RankLights(struct light_s **candidates, uint16_t count, const float pos[3], struct light_s **lights, uint16_t max_lights)
+{
+    float influence[ROOM_MAX_SECTOR_LIGHTS];
+    uint16_t ret = 0;
+
+    max_lights = (max_lights > ROOM_MAX_SECTOR_LIGHTS) ? (ROOM_MAX_SECTOR_LIGHTS) : (max_lights);
+    for(uint16_t i = 0; i < count; i++)
+    {
+        Room_AddRankedLight(candidates[i], Room_GetLightInfluence(candidates[i], pos, 0.0f, ROOM_ENTITY_LIGHT_SLACK), lights, influence, &ret, max_lights);
+    }
+
+    return ret;
+}
+
+
+struct light_s **Room_GetSectorLights(struct room_sector_s *rs)
+{
+    room_content_p content = (rs && rs->owner_room) ? (rs->owner_room->content) : (NULL);
+    if(content && content->sector_lights && (rs >= content->sectors) && (rs < content->sectors + rs->owner_room->sectors_count))
+    {
+        return content->sector_lights + (rs - content->sectors) * ROOM_MAX_SECTOR_LIGHTS;
+    }
+    return NULL;                                                                // sector of flipped out content
+}
+
+
+void Room_GenSectorLights(struct room_s *room)
+{
+    room_content_p content = room->content;
+
+    if(content->sector_lights)
+    {
+        free(content->sector_lights);
+        content->sector_lights = NULL;
+    }
+
+    if(room->sectors_count == 0)
+    {
+        return;
+    }
+
+    content->sector_lights = (light_p*)calloc(room->sectors_count * ROOM_MAX_SECTOR_LIGHTS, sizeof(light_p));
+    for(uint32_t i = 0; i < room->sectors_count; i++)
+    {
+        room_sector_p rs = content->sectors + i;
+        float pos[3], height;
+        pos[0] = rs->pos[0];
+        pos[1] = rs->pos[1];
+        if((rs->floor != TR_METERING_WALLHEIGHT) && (rs->ceiling != TR_METERING_WALLHEIGHT) && (rs->floor < rs->ceiling))
+        {
+            pos[2] = rs->floor;
+            height = rs->ceiling - rs->floor;
+        }
+        else
+        {
+            pos[2] = room->bb_min[2];
+            height = room->bb_max[2] - room->bb_min[2];
+        }
+        // the whole floor to ceiling column, so lights near any entity of the sector stay in the list
+        Room_SelectLightsInternal(room, pos, height, ROOM_SECTOR_LIGHT_SLACK, content->sector_lights + i * ROOM_MAX_SECTOR_LIGHTS, ROOM_MAX_SECTOR_LIGHTS);
+    }
+}
+
+
+void Room_GenStaticBatch(struct room_s *room)
+{
+    room_content_p content = room->content;
+    static_batch_p batch;
+    uint32_t vertex_count = 0;
+    uint32_t elements_count = 0;
+    uint32_t batched_count = 0;
+    uint32_t *vertex_base;
+    vertex_p vertices, v;
+    GLuint *elements, *e;
+
+    content->static_batch = NULL;
+    for(uint32_t i = 0; i < content->static_mesh_count; i++)
+    {
+        static_mesh_p sm = content->static_mesh + i;
+        if(Room_IsStaticBatchable(sm))
+        {
+            vertex_count += sm->mesh->vertex_count;
+            for(uint32_t j = 0; j < sm->mesh->faces_count; j++)
+            {
+                elements_count += sm->mesh->faces[j].elements_count;
+            }
+            batched_count++;
+        }
+    }
+
+    if((batched_count < 2) || (elements_count == 0))
+    {
+        return;
+    }
+
+    batch = (static_batch_p)calloc(1, sizeof(static_batch_t));
+    batch->in_batch = (uint8_t*)calloc(content->static_mesh_count, sizeof(uint8_t));
+    vertex_base = (uint32_t*)malloc(content->static_mesh_count * sizeof(uint32_t));
+    vertices = (vertex_p)malloc(vertex_count * sizeof(vertex_t));
+    elements = (GLuint*)malloc(elements_count * sizeof(GLuint));
+
+    // world space vertices, tint is baked into the vertex colour
+    v = vertices;
+    for(uint32_t i = 0; i < content->static_mesh_count; i++)
+    {
+        static_mesh_p sm = content->static_mesh + i;
+        vertex_base[i] = v - vertices;
+        if(Room_IsStaticBatchable(sm))
+        {
+            GLfloat tint[4];
+            vec4_copy(tint, sm->tint);
+            if(content->room_flags & TR_ROOM_FLAG_WATER)
+            {
+                CalculateWaterTint(tint, 0);
+            }
+
+            vertex_p src = sm->mesh->vertices;
+            for(uint32_t j = 0; j < sm->mesh->vertex_count; j++, src++, v++)
+            {
+                Mat4_vec3_mul_macro(v->position, sm->transform, src->position);
+                v->position[3] = 1.0f;
+                Mat4_vec3_rot_macro(v->normal, sm->transform, src->normal);
+                v->normal[3] = 0.0f;
+                v->color[0] = src->color[0] * tint[0];
+                v->color[1] = src->color[1] * tint[1];
+                v->color[2] = src->color[2] * tint[2];
+                v->color[3] = src->color[3] * tint[3];
+                v->tex_coord[0] = src->tex_coord[0];
+                v->tex_coord[1] = src->tex_coord[1];
+            }
+            vec3_add_to(batch->centre, sm->transform + 12);
+            batch->in_batch[i] = 0x01;
+        }
+    }
+    vec3_mul_scalar(batch->centre, batch->centre, 1.0f / (float)batched_count);
+
+    // one batch face per texture page
+    for(uint32_t i = 0; i < content->static_mesh_count; i++)
+    {
+        if(batch->in_batch[i])
+        {
+            base_mesh_p mesh = content->static_mesh[i].mesh;
+            for(uint32_t j = 0; j < mesh->faces_count; j++)
+            {
+                uint32_t f = 0;
+                while((f < batch->faces_count) && (batch->faces[f].texture_index != mesh->faces[j].texture_index))
+                {
+                    f++;
+                }
+                if(f == batch->faces_count)
+                {
+                    batch->faces = (static_batch_face_p)realloc(batch->faces, (batch->faces_count + 1) * sizeof(static_batch_face_t));
+                    batch->faces[f].texture_index = mesh->faces[j].texture_index;
+                    batch->faces_count++;
+                }
+            }
+        }
+    }
+
+    batch->faces[0].counts = (GLsizei*)calloc(batch->faces_count * content->static_mesh_count, sizeof(GLsizei));
+    batch->faces[0].offsets = (GLuint*)calloc(batch->faces_count * content->static_mesh_count, sizeof(GLuint));
+    e = elements;
+    for(uint32_t f = 0; f < batch->faces_count; f++)
+    {
+        static_batch_face_p face = batch->faces + f;
+        face->counts = batch->faces[0].counts + f * content->static_mesh_count;
+        face->offsets = batch->faces[0].offsets + f * content->static_mesh_count;
+        for(uint32_t i = 0; i < content->static_mesh_count; i++)
+        {
+            face->offsets[i] = e - elements;
+            if(batch->in_batch[i])
+            {
+                base_mesh_p mesh = content->static_mesh[i].mesh;
+                for(uint32_t j = 0; j < mesh->faces_count; j++)
+                {
+                    mesh_face_p mf = mesh->faces + j;
+                    if(mf->texture_index == face->texture_index)
+                    {
+                        for(uint32_t k = 0; k < mf->elements_count; k++)
+                        {
+                            *e++ = mf->elements[k] + vertex_base[i];
+                        }
+                    }
+                }
+            }
+            face->counts[i] = (e - elements) - face->offsets[i];
+        }
+    }
+
+    qglGenBuffersARB(1, &batch->vbo);
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, batch->vbo);
+    qglBufferDataARB(GL_ARRAY_BUFFER_ARB, vertex_count * sizeof(vertex_t), vertices, GL_STATIC_DRAW_ARB);
+    qglGenBuffersARB(1, &batch->ibo);
+    qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, batch->ibo);
+    qglBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, elements_count * sizeof(GLuint), elements, GL_STATIC_DRAW_ARB);
+    qglBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+    qglBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+
+    free(elements);
+    free(vertices);
+    free(vertex_base);
+    content->static_batch = batch;
+}
+
+
 /*
  *   Sectors functionality
  */
@@ -824,105 +1522,341 @@ int  Room_IsInBox(room_box_p box, float pos[3])
 }
 
 
+/*
+ * Box path search: A* over the box edges (see World_GenBoxes) with lazy deletion binary heap.
+ * Weight is the XY manhattan distance between consequent overlap centers (entry point of the
+ * box), heuristic is the distance to the target box rectangle, so it never overestimates.
+ * Search nodes are stamped with the search generation, so nothing is cleared between calls.
+ * The search starts from the center of the start box, not from the sector position, so the
+ * path depends only on (from box, to box, options): the key of the small LRU cache results
+ * are kept in. Any is_blocked change flushes the cache. Flow fields are the same search run
+ * backward from the root box (also from its center) over the incoming edges, without heuristic.
+ * Main thread only.
+ */
+#define ROOM_PATH_CACHE_SIZE        (64)
+#define ROOM_PATH_CACHE_MAX_BOXES   (64)
+#define ROOM_PATH_NO_PARENT         (0xFFFF)
+
+typedef struct box_path_node_s
+{
+    uint32_t                generation;
+    uint16_t                parent;
+    uint16_t                unused;
+    float                   weight;
+    float                   entry[2];
+}box_path_node_t, *box_path_node_p;
+
+typedef struct box_path_heap_item_s
+{
+    float                   cost;                                               // weight + heuristic
+    float                   weight;
+    uint32_t                box;
+}box_path_heap_item_t, *box_path_heap_item_p;
+
+typedef struct box_path_cache_s
+{
+    uint32_t                last_use;                                           // 0 - empty entry
+    uint16_t                from;
+    uint16_t                to;
+    uint16_t                step_up;
+    uint16_t                step_down;
+    uint16_t                zone_type;
+    uint16_t                zone_alt;
+    uint32_t                path_size;                                          // 0 - no path
+    uint16_t                path[ROOM_PATH_CACHE_MAX_BOXES];                    // same order as path_buf
+}box_path_cache_t, *box_path_cache_p;
+
+static struct
+{
+    uint32_t                nodes_count;
+    uint32_t                generation;
+    struct box_path_node_s *nodes;
+    uint32_t                heap_size;
+    uint32_t                heap_count;
+    struct box_path_heap_item_s *heap;
+    uint32_t                cache_tick;
+    struct box_path_cache_s cache[ROOM_PATH_CACHE_SIZE];
+    uint32_t                blocked_generation;
+    uint32_t                flow_tick;
+    struct box_flow_field_s flow[ROOM_FLOW_FIELDS_MAX];
+} room_path_finder;
+
+
+static void Room_PathHeapPush(float cost, float weight, uint32_t box)
+{
+    box_path_heap_item_p heap;
+    uint32_t i = room_path_finder.heap_count++;
+
+    if(room_path_finder.heap_count > room_path_finder.heap_size)
+    {
+        room_path_finder.heap_size *= 2;
+        room_path_finder.heap = (box_path_heap_item_p)realloc(room_path_finder.heap, room_path_finder.heap_size * sizeof(box_path_heap_item_t));
+    }
+
+    heap = room_path_finder.heap;
+    while(i > 0)
+    {
+        uint32_t parent = (i - 1) / 2;
+        if(heap[parent].cost <= cost)
+        {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i].cost = cost;
+    heap[i].weight = weight;
+    heap[i].box = box;
+}
+
+
+static void Room_PathHeapPop(box_path_heap_item_p top)
+{
+    box_path_heap_item_p heap = room_path_finder.heap;
+    box_path_heap_item_p last = heap + (--room_path_finder.heap_count);
+    uint32_t count = room_path_finder.heap_count;
+    uint32_t i = 0;
+
+    *top = heap[0];
+    while(2 * i + 1 < count)
+    {
+        uint32_t child = 2 * i + 1;
+        if((child + 1 < count) && (heap[child + 1].cost < heap[child].cost))
+        {
+            child++;
+        }
+        if(last->cost <= heap[child].cost)
+        {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = *last;
+}
+
+
+static inline float Room_PathHeuristic(room_box_p target, const float pt[2])
+{
+    float dx = (pt[0] < target->bb_min[0]) ? (target->bb_min[0] - pt[0]) : ((pt[0] > target->bb_max[0]) ? (pt[0] - target->bb_max[0]) : (0.0f));
+    float dy = (pt[1] < target->bb_min[1]) ? (target->bb_min[1] - pt[1]) : ((pt[1] > target->bb_max[1]) ? (pt[1] - target->bb_max[1]) : (0.0f));
+    return (dx + dy) / TR_METERING_STEP;
+}
+
+
+static box_path_node_p Room_PathSearchBegin(room_box_p start_box, const float start_pos[2], float start_cost)
+{
+    uint32_t boxes_count = World_GetRoomBoxesCount();
+    box_path_node_p node;
+
+    if(room_path_finder.nodes_count != boxes_count)
+    {
+        free(room_path_finder.nodes);
+        room_path_finder.nodes_count = boxes_count;
+        room_path_finder.nodes = (box_path_node_p)calloc(boxes_count, sizeof(box_path_node_t));
+        room_path_finder.generation = 0;
+    }
+    if(!room_path_finder.heap)
+    {
+        room_path_finder.heap_size = 256;
+        room_path_finder.heap = (box_path_heap_item_p)malloc(room_path_finder.heap_size * sizeof(box_path_heap_item_t));
+    }
+    if(++room_path_finder.generation == 0)
+    {
+        memset(room_path_finder.nodes, 0x00, boxes_count * sizeof(box_path_node_t));
+        room_path_finder.generation = 1;
+    }
+
+    node = room_path_finder.nodes + start_box->id;
+    node->generation = room_path_finder.generation;
+    node->parent = ROOM_PATH_NO_PARENT;
+    node->weight = 0.0f;
+    node->entry[0] = start_pos[0];
+    node->entry[1] = start_pos[1];
+    room_path_finder.heap_count = 0;
+    Room_PathHeapPush(start_cost, 0.0f, start_box->id);
+
+    return room_path_finder.nodes;
+}
+
+
+static bool Room_PathSearch(room_box_p from_box, room_box_p to_box, box_validition_options_p op)
+{
+    room_box_p boxes = World_GetRoomBoxByID(0);
+    float from_pos[2] = {0.5f * (from_box->bb_min[0] + from_box->bb_max[0]), 0.5f * (from_box->bb_min[1] + from_box->bb_max[1])};
+    box_path_node_p nodes = Room_PathSearchBegin(from_box, from_pos, Room_PathHeuristic(to_box, from_pos));
+
+    while(room_path_finder.heap_count > 0)
+    {
+        box_path_heap_item_t top;
+        Room_PathHeapPop(&top);
+        box_path_node_p node = nodes + top.box;
+        if(top.weight > node->weight)
+        {
+            continue;                                                           // node was reached cheaper after that push
+        }
+        if(top.box == to_box->id)
+        {
+            return true;
+        }
+
+        room_box_p current_box = boxes + top.box;
+        box_edge_p edge = current_box->edges;
+        for(uint32_t i = 0; i < current_box->edges_count; ++i, ++edge)
+        {
+            room_box_p next_box = boxes + edge->box;
+            box_path_node_p next = nodes + edge->box;
+            float weight = node->weight + (fabs(edge->center[0] - node->entry[0]) + fabs(edge->center[1] - node->entry[1]) + 1.0f) / TR_METERING_STEP;
+            if((next_box != from_box) && ((next->generation != room_path_finder.generation) || (weight < next->weight)) &&
+               Room_IsBoxForPath(current_box, next_box, op))
+            {
+                next->generation = room_path_finder.generation;
+                next->parent = top.box;
+                next->weight = weight;
+                next->entry[0] = edge->center[0];
+                next->entry[1] = edge->center[1];
+                Room_PathHeapPush(weight + Room_PathHeuristic(to_box, edge->center), weight, edge->box);
+            }
+        }
+    }
+
+    return false;
+}
+
+
+/// Backward search: node parent is the next box toward the root, entry is the exit point.
+static void Room_BuildFlowField(box_flow_field_p field, room_box_p root, box_validition_options_p op)
+{
+    room_box_p boxes = World_GetRoomBoxByID(0);
+    uint32_t boxes_count = World_GetRoomBoxesCount();
+    float root_pos[2] = {0.5f * (root->bb_min[0] + root->bb_max[0]), 0.5f * (root->bb_min[1] + root->bb_max[1])};
+    box_path_node_p nodes = Room_PathSearchBegin(root, root_pos, 0.0f);
+
+    while(room_path_finder.heap_count > 0)
+    {
+        box_path_heap_item_t top;
+        Room_PathHeapPop(&top);
+        box_path_node_p node = nodes + top.box;
+        if(top.weight > node->weight)
+        {
+            continue;
+        }
+
+        room_box_p current_box = boxes + top.box;
+        box_edge_p edge = current_box->in_edges;
+        for(uint32_t i = 0; i < current_box->in_edges_count; ++i, ++edge)
+        {
+            room_box_p prev_box = boxes + edge->box;
+            box_path_node_p prev = nodes + edge->box;
+            float weight = node->weight + (fabs(edge->center[0] - node->entry[0]) + fabs(edge->center[1] - node->entry[1]) + 1.0f) / TR_METERING_STEP;
+            if((prev_box != root) && ((prev->generation != room_path_finder.generation) || (weight < prev->weight)) &&
+               Room_IsBoxForPath(prev_box, current_box, op))
+            {
+                prev->generation = room_path_finder.generation;
+                prev->parent = top.box;
+                prev->weight = weight;
+                prev->entry[0] = edge->center[0];
+                prev->entry[1] = edge->center[1];
+                Room_PathHeapPush(weight, weight, edge->box);
+            }
+        }
+    }
+
+    if(!field->next)
+    {
+        field->next = (uint16_t*)malloc(boxes_count * sizeof(uint16_t));
+    }
+    for(uint32_t i = 0; i < boxes_count; ++i)
+    {
+        field->next[i] = (nodes[i].generation == room_path_finder.generation) ? (nodes[i].parent) : (ROOM_FLOW_NO_BOX);
+    }
+    field->next[root->id] = root->id;
+    field->root = root->id;
+    field->blocked_generation = room_path_finder.blocked_generation;
+}
+
+
+static box_path_cache_p Room_GetPathCache(uint16_t from, uint16_t to, box_validition_options_p op, bool *found)
+{
+    box_path_cache_p ret = room_path_finder.cache;
+    box_path_cache_p c = room_path_finder.cache;
+
+    for(int i = 0; i < ROOM_PATH_CACHE_SIZE; ++i, ++c)
+    {
+        if(c->last_use && (c->from == from) && (c->to == to) && (c->step_up == op->step_up) &&
+           (c->step_down == op->step_down) && (c->zone_type == op->zone_type) && (c->zone_alt == op->zone_alt))
+        {
+            c->last_use = ++room_path_finder.cache_tick;
+            *found = true;
+            return c;
+        }
+        if(c->last_use < ret->last_use)
+        {
+            ret = c;
+        }
+    }
+
+    *found = false;
+    return ret;                                                                 // least recently used one for replace
+}
+
+
 int  Room_FindPath(room_box_p *path_buf, uint32_t max_boxes, room_sector_p from, room_sector_p to, box_validition_options_p op)
 {
     int ret = 0;
-    if(from->box && to->box)
+    if(from->box && to->box && (max_boxes > 0))
     {
         if(from->box->id != to->box->id)
         {
-            float pt_from[3], pt_to[3];
-            const int buf_size = sizeof(room_box_p) * max_boxes;
-            room_box_p *current_front = (room_box_p*)Sys_GetTempMem(3 * buf_size);
-            room_box_p *next_front = current_front + max_boxes;
-            room_box_p *parents = next_front + max_boxes;
-            int32_t *weights = (int32_t*)Sys_GetTempMem(max_boxes * sizeof(int32_t));
-            size_t current_front_size = 1;
-            size_t next_front_size = 0;
-
-            current_front[0] = from->box;
-            weights[current_front[0]->id] = 0;
-            memset(parents, 0x00, buf_size);
+            bool found = false;
+            box_path_cache_p cache = Room_GetPathCache(from->box->id, to->box->id, op, &found);
+            if(found)
+            {
+                ret = (cache->path_size < max_boxes) ? (cache->path_size) : (max_boxes);
+                for(int i = 0; i < ret; ++i)
+                {
+                    path_buf[i] = World_GetRoomBoxByID(cache->path[cache->path_size - ret + i]);
+                }
+                return ret;
+            }
 
-            while(current_front_size > 0)
+            uint32_t path_size = 0;
+            if(Room_PathSearch(from->box, to->box, op))
             {
-                for(size_t i = 0; i < current_front_size; ++i)
+                for(uint16_t p = to->box->id; p != ROOM_PATH_NO_PARENT; p = room_path_finder.nodes[p].parent)
+                {
+                    path_size++;
+                }
+                // too long path is cut from the target side, the start of the path is kept
+                uint32_t skip = (path_size > max_boxes) ? (path_size - max_boxes) : (0);
+                for(uint16_t p = to->box->id; p != ROOM_PATH_NO_PARENT; p = room_path_finder.nodes[p].parent)
                 {
-                    room_box_p current_box = current_front[i];
-                    box_overlap_p ov = current_box->overlaps;
-                    if(parents[current_box->id])
+                    if(skip > 0)
                     {
-                        Room_GetOverlapCenter(parents[current_box->id], current_box, pt_from);
+                        skip--;
                     }
                     else
                     {
-                        vec3_copy(pt_from, from->pos);
-                    }
-
-                    while(ov)
-                    {
-                        room_box_p next_box = World_GetRoomBoxByID(ov->box);
-                        Room_GetOverlapCenter(current_box, next_box, pt_to);
-                        int32_t weight = (fabs(pt_to[0] - pt_from[0]) + fabs(pt_to[1] - pt_from[1]) + 1.0f) / TR_METERING_STEP;
-                        if((next_box->id != from->box->id) && Room_IsBoxForPath(current_box, next_box, op) &&
-                           (!parents[to->box->id] || (weights[current_box->id] + weight < weights[to->box->id])))
-                        {
-                            if(!parents[next_box->id])
-                            {
-                                next_front[next_front_size++] = next_box;
-                                parents[next_box->id] = current_box;
-                                weights[next_box->id] = weights[current_box->id] + weight;
-                            }
-                            else if(weights[next_box->id] > weights[current_box->id] + weight)
-                            {
-                                bool not_in_front = true;
-                                parents[next_box->id] = current_box;
-                                weights[next_box->id] = weights[current_box->id] + weight;
-                                for(size_t j = 0; j < next_front_size; ++j)
-                                {
-                                    if(next_front[j]->id == next_box->id)
-                                    {
-                                        not_in_front = false;
-                                        break;
-                                    }
-                                }
-
-                                if(not_in_front)
-                                {
-                                    next_front[next_front_size++] = next_box;
-                                }
-                            }
-                        }
-
-                        if(ov->end)
-                        {
-                            break;
-                        }
-                        ov++;
+                        path_buf[ret++] = World_GetRoomBoxByID(p);
                     }
                 }
-
-                ///SWAP FRONTS HERE
-                {
-                    room_box_p *tn = current_front;
-                    current_front = next_front;
-                    current_front_size = next_front_size;
-                    next_front = tn;
-                    next_front_size = 0;
-                }
             }
 
-            if(parents[to->box->id])
+            if(path_size <= ROOM_PATH_CACHE_MAX_BOXES)
             {
-                room_box_p p = to->box;
-                while(p)
+                cache->last_use = ++room_path_finder.cache_tick;
+                cache->from = from->box->id;
+                cache->to = to->box->id;
+                cache->step_up = op->step_up;
+                cache->step_down = op->step_down;
+                cache->zone_type = op->zone_type;
+                cache->zone_alt = op->zone_alt;
+                cache->path_size = 0;
+                for(uint16_t p = to->box->id; (path_size > 0) && (p != ROOM_PATH_NO_PARENT); p = room_path_finder.nodes[p].parent)
                 {
-                    path_buf[ret++] = p;
-                    p = parents[p->id];
+                    cache->path[cache->path_size++] = p;
                 }
             }
-
-            Sys_ReturnTempMem(3 * buf_size + max_boxes * sizeof(int32_t));
         }
         else
         {
@@ -935,6 +1869,98 @@ int  Room_FindPath(room_box_p *path_buf, uint32_t max_boxes, room_sector_p from,
 }
 
 
+void Room_SetBoxBlocked(room_box_p box, int blocked)
+{
+    if(box->is_blocked != (blocked ? 0x01 : 0x00))
+    {
+        box->is_blocked = (blocked) ? (0x01) : (0x00);
+        room_path_finder.blocked_generation++;
+        room_path_finder.cache_tick = 0;
+        memset(room_path_finder.cache, 0x00, sizeof(room_path_finder.cache));
+    }
+}
+
+
+void Room_ClearPathCache()
+{
+    for(int i = 0; i < ROOM_FLOW_FIELDS_MAX; ++i)
+    {
+        free(room_path_finder.flow[i].next);
+    }
+    free(room_path_finder.nodes);
+    free(room_path_finder.heap);
+    memset(&room_path_finder, 0x00, sizeof(room_path_finder));
+}
+
+
+box_flow_field_p Room_GetFlowField(room_box_p root, box_validition_options_p op)
+{
+    box_flow_field_p ret = room_path_finder.flow;
+    box_flow_field_p f = room_path_finder.flow;
+
+    for(int i = 0; i < ROOM_FLOW_FIELDS_MAX; ++i, ++f)
+    {
+        if(f->last_use && (f->root == root->id) && (f->step_up == op->step_up) && (f->step_down == op->step_down) &&
+           (f->zone_type == op->zone_type) && (f->zone_alt == op->zone_alt))
+        {
+            ret = f;
+            break;
+        }
+        if(f->last_use < ret->last_use)
+        {
+            ret = f;
+        }
+    }
+
+    if(!ret->last_use || (ret->root != root->id) || (ret->blocked_generation != room_path_finder.blocked_generation) ||
+       (ret->step_up != op->step_up) || (ret->step_down != op->step_down) || (ret->zone_type != op->zone_type) || (ret->zone_alt != op->zone_alt))
+    {
+        ret->step_up = op->step_up;
+        ret->step_down = op->step_down;
+        ret->zone_type = op->zone_type;
+        ret->zone_alt = op->zone_alt;
+        Perf_Call("Room_BuildFlowField", Room_BuildFlowField(ret, root, op));
+    }
+    ret->last_use = ++room_path_finder.flow_tick;
+
+    return ret;
+}
+
+
+box_flow_field_p Room_GetFlowFieldByIndex(uint32_t index)
+{
+    if((index < ROOM_FLOW_FIELDS_MAX) && room_path_finder.flow[index].last_use)
+    {
+        return room_path_finder.flow + index;
+    }
+    return NULL;
+}
+
+
+/// Unlike Room_FindPath, path starts from the 'from' box; ends with 'to' if it fits into the buffer.
+int  Room_GetFlowPath(room_box_p *path_buf, uint32_t max_boxes, room_box_p from, room_box_p to, box_validition_options_p op)
+{
+    int ret = 0;
+    if(from && to && (max_boxes > 0))
+    {
+        box_flow_field_p field = Room_GetFlowField(to, op);
+        uint16_t id = from->id;
+        while((ret < (int)max_boxes) && (id != ROOM_FLOW_NO_BOX))
+        {
+            path_buf[ret++] = World_GetRoomBoxByID(id);
+            if(id == to->id)
+            {
+                break;
+            }
+            id = field->next[id];
+        }
+        ret = (field->next[from->id] == ROOM_FLOW_NO_BOX) ? (0) : (ret);
+    }
+
+    return ret;
+}
+
+
 void Room_GetOverlapCenter(room_box_p b1, room_box_p b2, float pos[3])
 {
     pos[0] = (b1->bb_min[0] > b2->bb_min[0]) ? (b1->bb_min[0]) : (b2->bb_min[0]);
@@ -22,6 +22,10 @@
 
 #define TR_METERING_WALLHEIGHT  (32512)
 
+// Most influential lights kept for every sector, entities in the sector re-rank them by their own position.
+
+#define ROOM_MAX_SECTOR_LIGHTS  (16)
+
 // Penetration configuration specifies collision type for floor and ceiling
 // sectors (squares).
 
@@ -111,6 +115,7 @@ struct frustum_s;
 struct base_mesh_s;
 struct physics_object_s;
 struct trigger_header_s;
+struct cache_file_s;
 
 
 typedef struct room_zone_s
@@ -130,6 +135,14 @@ typedef struct box_overlap_s
 }box_overlap_t, *box_overlap_p;
 
 
+typedef struct box_edge_s
+{
+    uint16_t        box;
+    uint16_t        unused;
+    float           center[2];                                                  // XY overlap center, path weights are measured between them
+}box_edge_t, *box_edge_p;
+
+
 typedef struct room_box_s
 {
     uint32_t                id : 16;
@@ -139,6 +152,10 @@ typedef struct room_box_s
     float                   bb_min[3];
     float                   bb_max[3];
     struct box_overlap_s   *overlaps;
+    struct box_edge_s      *edges;                                              // same as overlaps, unpacked for path search
+    uint32_t                edges_count;
+    struct box_edge_s      *in_edges;                                           // boxes which have that one in overlaps, for flow fields
+    uint32_t                in_edges_count;
     struct room_zone_s      zone[2];
 }room_box_t, *room_box_p;
 
@@ -160,6 +177,27 @@ typedef struct box_validition_options_s
 }box_validition_options_t, *box_validition_options_p;
 
 
+/*
+ * Flow field: next box toward the root box for every box of the level, shared by all AI
+ * with the same path options and target. Kept in a small LRU pool, rebuilt on request
+ * when the root box was changed or any box was blocked / unblocked since the last build.
+ */
+#define ROOM_FLOW_FIELDS_MAX    (8)
+#define ROOM_FLOW_NO_BOX        (0xFFFF)
+
+typedef struct box_flow_field_s
+{
+    uint32_t                last_use;                                           // 0 - free slot
+    uint32_t                blocked_generation;
+    uint16_t                root;
+    uint16_t                step_up;
+    uint16_t                step_down;
+    uint16_t                zone_type : 15;
+    uint16_t                zone_alt : 1;
+    uint16_t               *next;                                               // box id, ROOM_FLOW_NO_BOX if root is unreachable
+}box_flow_field_t, *box_flow_field_p;
+
+
 typedef struct room_sector_s
 {
     uint32_t                    trig_index; // Trigger function index.
@@ -232,6 +270,29 @@ typedef struct static_mesh_s
 }static_mesh_t, *static_mesh_p;
 
 
+/*
+ * Non hidden static meshes of the room, pretransformed to world space and merged
+ * by texture page into one VBO / IBO. Elements of every face are stored static by static,
+ * so visible statics are drawn with one glMultiDrawElements per texture page.
+ */
+typedef struct static_batch_face_s
+{
+    GLuint                      texture_index;
+    GLsizei                    *counts;                                         // elements count of every room static (0 - not in batch)
+    GLuint                     *offsets;                                        // first element of every room static in IBO
+}static_batch_face_t, *static_batch_face_p;
+
+typedef struct static_batch_s
+{
+    GLuint                      vbo;
+    GLuint                      ibo;
+    uint32_t                    faces_count;
+    struct static_batch_face_s *faces;
+    uint8_t                    *in_batch;                                       // per room static flag
+    float                       centre[3];
+}static_batch_t, *static_batch_p;
+
+
 typedef struct room_content_s
 {
     uint32_t                    original_room_id;
@@ -244,14 +305,17 @@ typedef struct room_content_s
     uint16_t                    overlapped_room_list_size;
     struct room_s             **near_room_list;
     struct room_s             **overlapped_room_list;
+    uint8_t                    *pvs;                                            // bit per room id: may be seen through portals, NULL - any room
 
     uint32_t                    static_mesh_count;
     struct static_mesh_s       *static_mesh;
+    struct static_batch_s      *static_batch;
     uint32_t                    sprites_count;
     struct room_sprite_s       *sprites;
     struct vertex_s            *sprites_vertices;
     uint32_t                    lights_count;
     struct light_s             *lights;
+    struct light_s            **sector_lights;                                  // ROOM_MAX_SECTOR_LIGHTS per sector, NULL terminated if less
 
     int16_t                     light_mode;                                     // (present only in TR2: 0 is normal, 1 is flickering(?), 2 and 3 are uncertain)
     uint8_t                     reverb_info;                                    // room reverb type
@@ -308,9 +372,22 @@ int  Room_IsJoined(struct room_s *r1, struct room_s *r2);
 int  Room_IsOverlapped(struct room_s *r0, struct room_s *r1);
 int  Room_IsInNearRoomsList(struct room_s *r0, struct room_s *r1);
 int  Room_IsInOverlappedRoomsList(struct room_s *r0, struct room_s *r1);
+void Room_GenPVS(struct room_s *room, uint32_t rooms_count);                    // needs real rooms, reads portals only
+int  Room_IsInPVS(struct room_s *room, struct room_s *r);
+uint32_t Room_GetCacheLayout();
+void Room_StorePVS(struct room_s *room, struct cache_file_s *cache, uint32_t rooms_count);
+int  Room_RestorePVS(struct room_s *room, struct cache_file_s *cache, uint32_t rooms_count);
+void Room_StoreSectors(struct room_s *room, struct cache_file_s *cache, struct room_s *rooms);
+int  Room_RestoreSectors(struct room_s *room, struct cache_file_s *cache, struct room_s *rooms, uint32_t rooms_count);   // instead of floordata translation
 void Room_MoveActiveItems(struct room_s *room_to, struct room_s *room_from);
 
+uint16_t Room_SelectLights(struct room_s *room, const float pos[3], struct light_s **lights, uint16_t max_lights);
+uint16_t Room_RankLights(struct light_s **candidates, uint16_t count, const float pos[3], struct light_s **lights, uint16_t max_lights);
+struct light_s **Room_GetSectorLights(struct room_sector_s *rs);
+void Room_GenSectorLights(struct room_s *room);                                 // needs near rooms lists
+
 void Room_GenSpritesBuffer(struct room_s *room);
+void Room_GenStaticBatch(struct room_s *room);                                  // GL upload, main thread only
 
 struct room_sector_s *Sector_GetNextSector(struct room_sector_s *rs, float dir[3]);
 struct room_sector_s *Sector_GetPortalSectorTargetRaw(struct room_sector_s *rs);
@@ -326,6 +403,11 @@ int Sectors_SimilarCeiling(room_sector_p s1, room_sector_p s2, int ignore_doors)
 
 int  Room_IsInBox(room_box_p box, float pos[3]);
 int  Room_FindPath(room_box_p *path_buf, uint32_t max_boxes, room_sector_p from, room_sector_p to, box_validition_options_p op);
+void Room_SetBoxBlocked(room_box_p box, int blocked);
+void Room_ClearPathCache();
+box_flow_field_p Room_GetFlowField(room_box_p root, box_validition_options_p op);
+box_flow_field_p Room_GetFlowFieldByIndex(uint32_t index);                      // debug access, no rebuild
+int  Room_GetFlowPath(room_box_p *path_buf, uint32_t max_boxes, room_box_p from, room_box_p to, box_validition_options_p op);
 void Room_GetOverlapCenter(room_box_p b1, room_box_p b2, float pos[3]);
 
 #endif //ROOM_H
@@ -445,6 +445,27 @@ int Script_ParseRender(lua_State *lua, struct render_settings_s *rs)
         rs->fog_end_depth = lua_tonumber(lua, -1);
         lua_pop(lua, 1);
 
+        lua_getfield(lua, -1, "static_batching");
+        if(lua_isnumber(lua, -1))
+        {
+            rs->static_batching = lua_tonumber(lua, -1);
+        }
+        lua_pop(lua, 1);
+
+        lua_getfield(lua, -1, "occlusion");
+        if(lua_isnumber(lua, -1))
+        {
+            rs->occlusion = lua_tonumber(lua, -1);
+        }
+        lua_pop(lua, 1);
+
+        lua_getfield(lua, -1, "transparency_mode");
+        if(lua_isnumber(lua, -1))
+        {
+            rs->transparency_mode = lua_tonumber(lua, -1);
+        }
+        lua_pop(lua, 1);
+
 
         lua_getfield(lua, -1, "fog_color");
         if(lua_istable(lua, -1))
@@ -43,6 +43,10 @@ int Script_ParseAudio(lua_State *lua, struct audio_settings_s *as)
         as->listener_is_player = lua_tointeger(lua, -1);
         lua_pop(lua, 1);
 
+        lua_getfield(lua, -1, "preload_samples");
+        as->preload_samples = lua_tointeger(lua, -1);
+        lua_pop(lua, 1);
+
         lua_settop(lua, top);
         return 1;
     }
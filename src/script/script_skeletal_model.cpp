@@ -48,6 +48,7 @@ int lua_SetStateChangeRange(lua_State * lua)
                                 af->state_change[i].anim_dispatch[dispatch].next_anim = lua_tointeger(lua, 7);
                                 af->state_change[i].anim_dispatch[dispatch].next_frame = lua_tointeger(lua, 8);
                             }
+                            Anim_GenStateLookup(af);
                         }
                         else
                         {
@@ -899,7 +899,7 @@ int lua_SetBoxBlocked(lua_State *lua)
         room_box_p box = World_GetRoomBoxByID(lua_tointeger(lua, 1));
         if(box && box->is_blockable)
         {
-            box->is_blocked = lua_toboolean(lua, 2);
+            Room_SetBoxBlocked(box, lua_toboolean(lua, 2));
         }
     }
     else
@@ -10,6 +10,9 @@ extern "C" {
 #define ANIM_CMD_CHANGE_DIRECTION   0x02
 #define ANIM_CMD_JUMP               0x04
 
+// state changes lookup is not built for bigger state ids, linear search is used then
+#define ANIM_STATE_LOOKUP_MAX_ID        (1024)
+
 /*
  * Animation control flags
  */
@@ -26,6 +29,13 @@ extern "C" {
 #define SS_CHANGING_HEAVY       (0x04)      // 0x04 - rough change by set animation;
 
     
+// bone matrices slots in entity shader palette, slot 0 is reserved for identity
+#define SKELETAL_PALETTE_MAX_BONES      (24)
+
+// SSBoneFrame_UpdateBatch: bones slerped by one job item and the least bones count worth the jobs
+#define SS_POSE_BATCH_BONES_PER_JOB     (256)
+#define SS_POSE_BATCH_MIN_JOB_BONES     (512)
+
 #define ANIM_TYPE_BASE                  (0x0000)
 #define ANIM_TYPE_WEAPON_LH             (0x0002)
 #define ANIM_TYPE_WEAPON_RH             (0x0003)
@@ -36,10 +46,12 @@ extern "C" {
 #define ANIM_TYPE_MISK_4                (0x0103)
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include "core/base_types.h"
     
 struct base_mesh_s;
+struct cache_file_s;
 
 /*
  * Animated skeletal model. Taken from openraider.
@@ -51,6 +63,19 @@ struct base_mesh_s;
  * SMOOTHED ANIMATIONS STRUCTURES
  * stack matrices are needed for skinned mesh transformations.
  */
+
+/*
+ * Skinned positions and normals of the bone tag skin mesh, kept by the renderer between
+ * frames; valid while skin mesh, parent mesh and bone local transform are the same.
+ */
+typedef struct ss_skin_cache_s
+{
+    struct base_mesh_s     *mesh;
+    struct base_mesh_s     *parent_mesh;
+    float                   transform[16];
+    uint32_t                vbo;                                                // GL buffer: positions, then normals
+}ss_skin_cache_t, *ss_skin_cache_p;
+
 typedef struct ss_bone_tag_s
 {
     struct ss_bone_tag_s   *parent;
@@ -72,6 +97,7 @@ typedef struct ss_bone_tag_s
     struct base_mesh_s     *mesh_slot;
     struct ss_animation_s  *alt_anim;
     uint32_t               *skin_map;                                           // vertices map for skin mesh
+    struct ss_skin_cache_s *skin_cache;                                         // created by renderer on the first skin draw
     float                   offset[3];                                          // model position offset
 
     float                   qrotate[4];                                         // quaternion rotation
@@ -142,13 +168,32 @@ typedef struct bone_frame_s
 {
     uint16_t            bone_tag_count;                                         // number of bones
     uint16_t            unused;                                                
-    struct bone_tag_s  *bone_tags;                                              // bones data
+    struct bone_tag_s  *bone_tags;                                              // bones data, NULL when animation keys are packed
     float               pos[3];                                                 // position (base offset)
     float               bb_min[3];                                              // bounding box min coordinates
     float               bb_max[3];                                              // bounding box max coordinates
     float               centre[3];                                              // bounding box centre
 }bone_frame_t, *bone_frame_p ;
 
+/*
+ * Packed bone keys of the whole animation, see Anim_PackKeys. Offsets are kept once per
+ * bone: TR frames have only rotations. Rotation is quantised to 48 bits: 3 smallest
+ * components by 15 bits, bits 15 of the words keep the index and the sign of the largest one.
+ * Rotation tracks those are the same for all frames are kept once.
+ */
+#define ANIM_KEYS_VARYING               (0x8000)                                // tracks flag: key per frame
+
+typedef struct anim_keys_s
+{
+    uint16_t            bones_count;
+    uint16_t            constant_count;                                         // rotation tracks with one key
+    uint16_t            varying_count;                                          // rotation tracks with a key per frame
+    uint16_t            unused;
+    uint16_t           *tracks;                                                 // per bone: key index | ANIM_KEYS_VARYING
+    float              *offsets;                                                // per bone: offset[3]
+    uint16_t           *rotations;                                              // 3 words per key: constant keys, then varying_count keys per frame
+}anim_keys_t, *anim_keys_p;
+
 /*
  * mesh tree base element structure
  */
@@ -209,7 +254,12 @@ typedef struct animation_frame_s
     uint16_t                    frames_count;           // Number of frames
     uint16_t                    state_change_count;     // Number of animation statechanges
     struct bone_frame_s        *frames;                 // Frame data
+    struct anim_keys_s         *keys;                   // packed bones of all frames (or NULL)
     struct state_change_s      *state_change;           // Animation statechanges data
+    uint16_t                    state_lookup_size;      // max state id + 1
+    uint16_t                    dispatch_frames;        // frames in one dispatch_lookup row
+    uint16_t                   *state_lookup;           // state id -> first state change index + 1, 0 - none (NULL - linear search)
+    int16_t                    *dispatch_lookup;        // row per state id (by state_lookup): frame -> dispatch case, -1 - none
     
     struct animation_command_s *commands;
     struct animation_effect_s  *effects;
@@ -242,6 +292,9 @@ typedef struct skeletal_model_s
     uint16_t                    mesh_count;                                     // number of model meshes
     struct mesh_tree_tag_s     *mesh_tree;                                      // base mesh tree.
     uint16_t                   *collision_map;
+
+    struct base_mesh_s         *palette_mesh;                                   // all bone meshes in one VBO, faces grouped by texture page
+    struct base_mesh_s        **palette_bones;                                  // bone meshes as they were merged into palette_mesh
 }skeletal_model_t, *skeletal_model_p;
 
 
@@ -249,14 +302,21 @@ void SkeletalModel_Clear(skeletal_model_p model);
 void SkeletalModel_GenParentsIndexes(skeletal_model_p model);
 
 void SkeletalModel_FillTransparency(skeletal_model_p model);
+void SkeletalModel_GenPaletteMesh(skeletal_model_p model);                     // CPU only, may be called from job threads
 void SkeletalModel_CopyMeshes(mesh_tree_tag_p dst, mesh_tree_tag_p src, int tags_count);
 void SkeletalModel_CopyAnims(skeletal_model_p dst, skeletal_model_p src);
+void SkeletalModel_PackAnims(skeletal_model_p model);                          // CPU only, may be called from job threads
+void SkeletalModel_GetAnimsSize(skeletal_model_p model, size_t *frames_size, size_t *packed_size);
+uint32_t SkeletalModel_GetCacheLayout();
+void SkeletalModel_Store(skeletal_model_p model, struct cache_file_s *cache, struct base_mesh_s *meshes);
+int  SkeletalModel_Restore(skeletal_model_p model, struct cache_file_s *cache, struct base_mesh_s *meshes, uint32_t meshes_count);
 void BoneFrame_Copy(bone_frame_p dst, bone_frame_p src);
 
 void SSBoneFrame_CreateFromModel(ss_bone_frame_p bf, skeletal_model_p model);
 void SSBoneFrame_Clear(ss_bone_frame_p bf);
 void SSBoneFrame_Copy(struct ss_bone_frame_s *dst, struct ss_bone_frame_s *src);
 void SSBoneFrame_Update(struct ss_bone_frame_s *bf, float time);
+void SSBoneFrame_UpdateBatch(struct ss_bone_frame_s **bfs, uint32_t count, float time, int use_jobs);
 void SSBoneFrame_RotateBone(struct ss_bone_frame_s *bf, const float q_rotate[4], int bone);
 int  SSBoneFrame_CheckTargetBoneLimit(struct ss_bone_frame_s *bf, struct ss_bone_tag_s *b_tag, float target[3]);
 void SSBoneFrame_TargetBoneToSlerp(struct ss_bone_frame_s *bf, struct ss_bone_tag_s *b_tag, float time);
@@ -272,10 +332,16 @@ void SSBoneFrame_DisableOverrideAnim(struct ss_bone_frame_s *bf, struct ss_anima
 void SSBoneFrame_FillSkinnedMeshMap(ss_bone_frame_p model);
 
 void Anim_AddCommand(struct animation_frame_s *anim, const animation_command_p command);
+void Anim_PackKeys(struct animation_frame_s *anim);
+void Anim_GetBoneTag(struct animation_frame_s *anim, uint16_t frame, uint16_t bone, struct bone_tag_s *tag);
 void Anim_AddEffect(struct animation_frame_s *anim, const animation_effect_p effect);
 struct state_change_s *Anim_FindStateChangeByAnim(struct animation_frame_s *anim, int state_change_anim);
 struct state_change_s *Anim_FindStateChangeByID(struct animation_frame_s *anim, uint32_t id);
 int  Anim_GetAnimDispatchCase(struct ss_animation_s *ss_anim, uint32_t id);
+struct state_change_s *Anim_FindStateChangeByIDLinear(struct animation_frame_s *anim, uint32_t id);
+int  Anim_GetAnimDispatchCaseLinear(struct ss_animation_s *ss_anim, uint32_t id);
+void Anim_GenStateLookup(struct animation_frame_s *anim);                      // must be rebuilt after any state changes edit
+void Anim_ClearStateLookup(struct animation_frame_s *anim);
 void Anim_SetAnimation(struct ss_animation_s *ss_anim, int animation, int frame);
 int  Anim_SetNextFrame(struct ss_animation_s *ss_anim, float time);
 int  Anim_IncTime(struct ss_animation_s *ss_anim, float time);
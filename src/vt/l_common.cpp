@@ -27,6 +27,30 @@
 #include "l_main.h"
 #include "../core/system.h"
 
+/** \brief copies size bytes from src to dst.
+  *
+  * Level files are slurped into memory by read_level() and all compressed TR4-5 blocks
+  * are wrapped by SDL_RWFromMem(), so nearly every read hits a memory RWops. Those are
+  * served straight from the memory cursor, without going through SDL_RWread().
+  * returns 1 when all the bytes were read, 0 otherwise.
+  */
+static inline int TR_ReadBytes(SDL_RWops * const src, void *dst, size_t size)
+{
+    if((src->type == SDL_RWOPS_MEMORY) || (src->type == SDL_RWOPS_MEMORY_RO))
+    {
+        if((size_t)(src->hidden.mem.stop - src->hidden.mem.here) < size)
+        {
+            src->hidden.mem.here = src->hidden.mem.stop;
+            return 0;
+        }
+        memcpy(dst, src->hidden.mem.here, size);
+        src->hidden.mem.here += size;
+        return 1;
+    }
+
+    return (size == 0) || (SDL_RWread(src, dst, size, 1) == 1);
+}
+
 /** \brief reads signed 8-bit value.
   *
   * uses current position from src. throws TR_ReadError when not successful.
@@ -39,7 +63,7 @@ int8_t TR_Level::read_bit8(SDL_RWops * const src)
     if (src == NULL)
         Sys_extError("read_bit8: src == NULL");
 
-    if (SDL_RWread(src, &data, 1, 1) < 1)
+    if (!TR_ReadBytes(src, &data, 1))
         Sys_extError("read_bit8");
 
     return data;
@@ -56,7 +80,7 @@ uint8_t TR_Level::read_bitu8(SDL_RWops * const src)
     if (src == NULL)
         Sys_extError("read_bitu8: src == NULL");
 
-    if (SDL_RWread(src, &data, 1, 1) < 1)
+    if (!TR_ReadBytes(src, &data, 1))
         Sys_extError("read_bitu8");
 
     return data;
@@ -73,7 +97,7 @@ int16_t TR_Level::read_bit16(SDL_RWops * const src)
     if (src == NULL)
         Sys_extError("read_bit16: src == NULL");
 
-    if (SDL_RWread(src, &data, 2, 1) < 1)
+    if (!TR_ReadBytes(src, &data, 2))
         Sys_extError("read_bit16");
 
     data = SDL_SwapLE16(data);
@@ -92,7 +116,7 @@ uint16_t TR_Level::read_bitu16(SDL_RWops * const src)
     if (src == NULL)
         Sys_extError("read_bitu16: src == NULL");
 
-    if (SDL_RWread(src, &data, 2, 1) < 1)
+    if (!TR_ReadBytes(src, &data, 2))
         Sys_extError("read_bitu16");
 
     data = SDL_SwapLE16(data);
@@ -111,7 +135,7 @@ int32_t TR_Level::read_bit32(SDL_RWops * const src)
     if (src == NULL)
         Sys_extError("read_bit32: src == NULL");
 
-    if (SDL_RWread(src, &data, 4, 1) < 1)
+    if (!TR_ReadBytes(src, &data, 4))
         Sys_extError("read_bit32");
 
     data = SDL_SwapLE32(data);
@@ -130,7 +154,7 @@ uint32_t TR_Level::read_bitu32(SDL_RWops * const src)
     if (src == NULL)
         Sys_extError("read_bitu32: src == NULL");
 
-    if (SDL_RWread(src, &data, 4, 1) < 1)
+    if (!TR_ReadBytes(src, &data, 4))
         Sys_extError("read_bitu32");
 
     data = SDL_SwapLE32(data);
@@ -149,7 +173,7 @@ float TR_Level::read_float(SDL_RWops * const src)
     if (src == NULL)
         Sys_extError("read_float: src == NULL");
 
-    if (SDL_RWread(src, &data, 4, 1) < 1)
+    if (!TR_ReadBytes(src, &data, 4))
         Sys_extError("read_float");
 
     data = SDL_SwapLE32(data);
@@ -169,7 +193,7 @@ float TR_Level::read_mixfloat(SDL_RWops * const src)
     if (src == NULL)
         Sys_extError("read_mixfloat: src == NULL");
 
-    if ((SDL_RWread(src, &sign_int, 2, 1) < 1) || (SDL_RWread(src, &base_int, 2, 1) < 1))
+    if (!TR_ReadBytes(src, &sign_int, 2) || !TR_ReadBytes(src, &base_int, 2))
         Sys_extError("read_mixfloat");
 
     base_int = SDL_SwapLE32(base_int);
@@ -177,3 +201,61 @@ float TR_Level::read_mixfloat(SDL_RWops * const src)
 
     return ((float)base_int + ((float)sign_int / 65535.0));
 }
+
+/** \brief reads an array of unsigned 8-bit values.
+  *
+  * uses current position from src. throws TR_ReadError when not successful.
+  */
+void TR_Level::read_bitu8_array(SDL_RWops * const src, uint8_t *dst, uint32_t count)
+{
+    if (src == NULL)
+        Sys_extError("read_bitu8_array: src == NULL");
+
+    if (!TR_ReadBytes(src, dst, count))
+        Sys_extError("read_bitu8_array");
+}
+
+/** \brief reads an array of signed 16-bit values.
+  *
+  * uses current position from src. does endian correction. throws TR_ReadError when not successful.
+  */
+void TR_Level::read_bit16_array(SDL_RWops * const src, int16_t *dst, uint32_t count)
+{
+    read_bitu16_array(src, (uint16_t*)dst, count);
+}
+
+/** \brief reads an array of unsigned 16-bit values.
+  *
+  * uses current position from src. does endian correction. throws TR_ReadError when not successful.
+  */
+void TR_Level::read_bitu16_array(SDL_RWops * const src, uint16_t *dst, uint32_t count)
+{
+    if (src == NULL)
+        Sys_extError("read_bitu16_array: src == NULL");
+
+    if (!TR_ReadBytes(src, dst, (size_t)count * 2))
+        Sys_extError("read_bitu16_array");
+
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    for (uint32_t i = 0; i < count; i++)
+        dst[i] = SDL_SwapLE16(dst[i]);
+#endif
+}
+
+/** \brief reads an array of unsigned 32-bit values.
+  *
+  * uses current position from src. does endian correction. throws TR_ReadError when not successful.
+  */
+void TR_Level::read_bitu32_array(SDL_RWops * const src, uint32_t *dst, uint32_t count)
+{
+    if (src == NULL)
+        Sys_extError("read_bitu32_array: src == NULL");
+
+    if (!TR_ReadBytes(src, dst, (size_t)count * 4))
+        Sys_extError("read_bitu32_array");
+
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    for (uint32_t i = 0; i < count; i++)
+        dst[i] = SDL_SwapLE32(dst[i]);
+#endif
+}
@@ -21,18 +21,116 @@
 
 #include <SDL2/SDL.h>
 #include <string.h>
+#include <pthread.h>
+#include <zlib.h>
 
 #include "l_main.h"
 #include "../core/system.h"
 
 #define RCSID "$Id: l_main.cpp,v 1.10 2002/09/20 15:59:02 crow Exp $"
 
-/// \brief reads the mesh data.
+/** \brief reads sizes and packed data of a zlib block.
+  *
+  * When skip is set or the block is empty, the packed data is not kept and chunk.comp_buffer stays NULL.
+  */
+void TR_Level::read_zlib_chunk(SDL_RWops * const src, tr_zlib_chunk_t & chunk, bool skip, const char *name)
+{
+    chunk.comp_buffer = NULL;
+    chunk.uncomp_buffer = NULL;
+    chunk.inflated_size = 0;
+    chunk.result = Z_OK;
+
+    chunk.uncomp_size = read_bitu32(src);
+    if (chunk.uncomp_size == 0)
+        Sys_extError("read_zlib_chunk: %s uncomp_size == 0", name);
+
+    chunk.comp_size = read_bitu32(src);
+    if (chunk.comp_size > 0)
+    {
+        if (skip)
+        {
+            SDL_RWseek(src, chunk.comp_size, RW_SEEK_CUR);
+            return;
+        }
+
+        chunk.comp_buffer = new uint8_t[chunk.comp_size];
+        read_bitu8_array(src, chunk.comp_buffer, chunk.comp_size);
+        chunk.uncomp_buffer = new uint8_t[chunk.uncomp_size];
+    }
+}
+
+static void *TR_InflateChunk(void *data)
+{
+    tr_zlib_chunk_t *chunk = (tr_zlib_chunk_t*)data;
+    unsigned long size = chunk->uncomp_size;
+
+    chunk->result = uncompress(chunk->uncomp_buffer, &size, chunk->comp_buffer, chunk->comp_size);
+    chunk->inflated_size = size;
+
+    return NULL;
+}
+
+/** \brief inflates all read zlib blocks in parallel.
+  *
+  * Every block but the first one gets its own worker thread, the first one is inflated by the caller.
+  * Packed data is released afterwards; uncomp_buffer of each block is owned by the caller.
+  */
+void TR_Level::inflate_zlib_chunks(tr_zlib_chunk_t *chunks, int count)
+{
+    pthread_t threads[TR_ZLIB_MAX_CHUNKS];
+    bool started[TR_ZLIB_MAX_CHUNKS];
+    int i;
+
+    if (count > TR_ZLIB_MAX_CHUNKS)
+        Sys_extError("inflate_zlib_chunks: too many chunks");
+
+    for (i = 0; i < count; i++)
+    {
+        started[i] = false;
+        if ((i > 0) && chunks[i].comp_buffer)
+            started[i] = (pthread_create(threads + i, NULL, TR_InflateChunk, chunks + i) == 0);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else if (chunks[i].comp_buffer)
+            TR_InflateChunk(chunks + i);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (chunks[i].comp_buffer)
+        {
+            delete [] chunks[i].comp_buffer;
+            chunks[i].comp_buffer = NULL;
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (chunks[i].uncomp_buffer && ((chunks[i].result != Z_OK) || (chunks[i].inflated_size != chunks[i].uncomp_size)))
+        {
+            bool size_mismatch = (chunks[i].result == Z_OK);
+            for (int j = 0; j < count; j++)
+            {
+                delete [] chunks[j].uncomp_buffer;
+                chunks[j].uncomp_buffer = NULL;
+            }
+
+            Sys_extError("inflate_zlib_chunks: %s", (size_mismatch) ? ("uncompress size mismatch") : ("uncompress"));
+        }
+    }
+}
+
+/** \brief reads the mesh data.
+  *
+  * Meshes are only located here, parsing is left to read_meshes(): generated meshes
+  * may be taken from the world cache.
+  */
 void TR_Level::read_mesh_data(SDL_RWops * const src)
 {
-    uint8_t *buffer;
-    SDL_RWops *newsrc = NULL;
-    uint32_t size;
     uint32_t pos = 0;
     int mesh = 0;
     uint32_t i;
@@ -40,22 +138,17 @@ void TR_Level::read_mesh_data(SDL_RWops * const src)
 
     num_mesh_data = read_bitu32(src);
 
-    size = num_mesh_data * 2;
-    buffer = new uint8_t[size];
-
-    if (SDL_RWread(src, buffer, 1, size) < size)
-        Sys_extError("read_tr_mesh_data: SDL_RWread(buffer)");
-
-    if ((newsrc = SDL_RWFromMem(buffer, size)) == NULL)
-        Sys_extError("read_tr_mesh_data: SDL_RWFromMem");
+    this->mesh_data_size = num_mesh_data * 2;
+    this->mesh_data = new uint8_t[this->mesh_data_size];
+    read_bitu8_array(src, this->mesh_data, this->mesh_data_size);
 
     this->mesh_indices_count = read_bitu32(src);
     this->mesh_indices = (uint32_t*)malloc(this->mesh_indices_count * sizeof(uint32_t));
-    for (i = 0; i < this->mesh_indices_count; i++)
-        this->mesh_indices[i] = read_bitu32(src);
+    read_bitu32_array(src, this->mesh_indices, this->mesh_indices_count);
 
     this->meshes_count = this->mesh_indices_count;
     this->meshes = (tr4_mesh_t*)calloc(this->meshes_count, sizeof(tr4_mesh_t));
+    this->mesh_offsets = (uint32_t*)malloc(this->meshes_count * sizeof(uint32_t));
 
     for (i = 0; i < this->mesh_indices_count; i++)
     {
@@ -65,13 +158,7 @@ void TR_Level::read_mesh_data(SDL_RWops * const src)
             if (this->mesh_indices[j] == pos)
                 this->mesh_indices[j] = mesh;
 
-        SDL_RWseek(newsrc, pos, RW_SEEK_SET);
-
-        if (this->game_version >= TR_IV)
-            read_tr4_mesh(newsrc, this->meshes[mesh]);
-        else
-            read_tr_mesh(newsrc, this->meshes[mesh]);
-
+        this->mesh_offsets[mesh] = pos;
         mesh++;
 
         for (j = 0; j < this->mesh_indices_count; j++)
@@ -81,9 +168,33 @@ void TR_Level::read_mesh_data(SDL_RWops * const src)
                 break;
             }
     }
-    SDL_RWclose(newsrc);
-    newsrc = NULL;
-    delete [] buffer;
+}
+
+/// \brief parses meshes located by read_mesh_data(), once.
+void TR_Level::read_meshes()
+{
+    SDL_RWops *src;
+
+    if (this->meshes_parsed || (this->meshes_count == 0))
+        return;
+
+    this->meshes_parsed = true;
+    if ((src = SDL_RWFromConstMem(this->mesh_data, this->mesh_data_size)) == NULL)
+        Sys_extError("read_meshes: SDL_RWFromConstMem");
+
+    for (uint32_t i = 0; i < this->meshes_count; i++)
+    {
+        SDL_RWseek(src, this->mesh_offsets[i], RW_SEEK_SET);
+        if (this->game_version >= TR_IV)
+            read_tr4_mesh(src, this->meshes[i]);
+        else
+            read_tr_mesh(src, this->meshes[i]);
+    }
+    SDL_RWclose(src);
+
+    // Disable unused skybox polygons.
+    if ((this->skybox_mesh < this->meshes_count) && (this->meshes[this->skybox_mesh].num_coloured_triangles > 16))
+        this->meshes[this->skybox_mesh].num_coloured_triangles = 16;
 }
 
 /// \brief reads frame and moveable data.
@@ -96,9 +207,7 @@ void TR_Level::read_frame_moveable_data(SDL_RWops * const src)
 
     this->frame_data_size = read_bitu32(src);
     this->frame_data = (uint16_t*)malloc(this->frame_data_size * sizeof(uint16_t));
-
-    if (SDL_RWread(src, this->frame_data, sizeof(uint16_t), this->frame_data_size) < frame_data_size)
-        Sys_extError("read_tr_level: frame_data: SDL_RWread(buffer)");
+    read_bitu16_array(src, this->frame_data, this->frame_data_size);
 
     if ((newsrc = SDL_RWFromMem(this->frame_data, this->frame_data_size)) == NULL)
         Sys_extError("read_tr_level: frame_data: SDL_RWFromMem");
@@ -141,16 +250,45 @@ void TR_Level::read_frame_moveable_data(SDL_RWops * const src)
     newsrc = NULL;
 }
 
+/** \brief reads the level file.
+  *
+  * The whole file is read into memory with a single call and parsed from there,
+  * so field reads never hit the file system. If the file can't be slurped,
+  * it is parsed directly from the file stream.
+  */
 void TR_Level::read_level(const char *filename, int32_t game_version)
 {
     int len, i, len2;
-    SDL_RWops *src = SDL_RWFromFile(filename, "rb");
+    Sint64 file_size;
 
-    if(src == NULL)
+    // members, not locals: if Sys_Error interrupts reading, the destructor frees them
+    this->file_src = SDL_RWFromFile(filename, "rb");
+    if(this->file_src == NULL)
     {
         return;
     }
 
+    file_size = SDL_RWsize(this->file_src);
+    if(file_size > 0)
+    {
+        this->file_data = (uint8_t*)malloc(file_size);
+    }
+
+    if(this->file_data != NULL)
+    {
+        if(SDL_RWread(this->file_src, this->file_data, file_size, 1) == 1)
+        {
+            SDL_RWclose(this->file_src);
+            this->file_src = SDL_RWFromConstMem(this->file_data, file_size);
+        }
+        else
+        {
+            free(this->file_data);
+            this->file_data = NULL;
+            SDL_RWseek(this->file_src, 0, RW_SEEK_SET);
+        }
+    }
+
     len = strlen(filename);
     len2 = 0;
     for(i = 0; i < len; i++)
@@ -168,8 +306,15 @@ void TR_Level::read_level(const char *filename, int32_t game_version)
         strncat(this->sfx_path, "MAIN.SFX", 256);
     }
 
-    this->read_level(src, game_version);
-    SDL_RWclose(src);
+    this->read_level(this->file_src, game_version);
+    SDL_RWclose(this->file_src);
+    this->file_src = NULL;
+
+    if(this->file_data != NULL)
+    {
+        free(this->file_data);
+        this->file_data = NULL;
+    }
 }
 
 /** \brief reads the level.
@@ -29,6 +29,22 @@
 #define TR_AUDIO_DEFAULT_RANGE 8
 #define TR_AUDIO_DEFAULT_PITCH 1.0       // 0.0 - only noise
 
+#define TR_ZLIB_MAX_CHUNKS     4
+
+/** \brief zlib packed block of a TR4-5 level file.
+  *
+  * All blocks are scanned first and then inflated at once, see TR_Level::inflate_zlib_chunks.
+  */
+typedef struct tr_zlib_chunk_s
+{
+    uint32_t    uncomp_size;
+    uint32_t    comp_size;
+    uint8_t    *comp_buffer;                ///< \brief NULL for absent or skipped blocks.
+    uint8_t    *uncomp_buffer;
+    uint32_t    inflated_size;
+    int         result;                     ///< \brief zlib return code of uncompress().
+} tr_zlib_chunk_t;
+
 /** \brief A complete TR level.
   *
   * This contains all necessary functions to load a TR level.
@@ -115,6 +131,13 @@ class TR_Level
             
             this->meshes_count = 0;             // destroyed
             this->meshes = NULL;                // destroyed
+            this->mesh_data_size = 0;           // destroyed
+            this->mesh_data = NULL;             // destroyed
+            this->mesh_offsets = NULL;          // destroyed
+            this->meshes_parsed = false;
+            this->skybox_mesh = 0xFFFFFFFF;
+            this->file_data = NULL;             // destroyed
+            this->file_src = NULL;              // destroyed
             this->rooms_count = 0;              // destroyed
             this->rooms = NULL;                 // destroyed
         }
@@ -392,6 +415,32 @@ class TR_Level
                 free(this->meshes); 
                 this->meshes = NULL; 
             }
+
+            if(this->mesh_data)
+            {
+                delete [] this->mesh_data;
+                this->mesh_data = NULL;
+                this->mesh_data_size = 0;
+            }
+
+            if(this->mesh_offsets)
+            {
+                free(this->mesh_offsets);
+                this->mesh_offsets = NULL;
+            }
+
+            /**left by interrupted read_level()**/
+            if(this->file_src)
+            {
+                SDL_RWclose(this->file_src);
+                this->file_src = NULL;
+            }
+
+            if(this->file_data)
+            {
+                free(this->file_data);
+                this->file_data = NULL;
+            }
             
             if(this->rooms_count)
             {
@@ -546,8 +595,16 @@ class TR_Level
     void read_level(SDL_RWops * const src, int32_t game_version);
     tr_mesh_thee_tag_t get_mesh_tree_tag_for_model(tr_moveable_t *model, int index);
     void get_anim_frame_data(tr5_vertex_t min_max_pos[3], tr5_vertex_t *rotations, int meshes_count, tr_animation_t *anim, int frame);
+    void read_meshes();
     
     protected:
+    uint32_t mesh_data_size;
+    uint8_t *mesh_data;             ///< \brief raw mesh data, meshes are parsed by read_meshes() only if they are needed.
+    uint32_t *mesh_offsets;         ///< \brief offsets of meshes in mesh_data.
+    bool meshes_parsed;
+    uint32_t skybox_mesh;           ///< \brief TR3 skybox mesh with unused polygons.
+    uint8_t *file_data;             ///< \brief whole level file, kept only while read_level() runs.
+    SDL_RWops *file_src;            ///< \brief stream read_level() parses, kept only while it runs.
     uint32_t num_textiles;          ///< \brief number of 256x256 textiles.
     uint32_t num_room_textiles;     ///< \brief number of 256x256 room textiles (TR4-5).
     uint32_t num_obj_textiles;      ///< \brief number of 256x256 object textiles (TR4-5).
@@ -563,6 +620,13 @@ class TR_Level
     uint32_t read_bitu32(SDL_RWops * const src);
     float read_float(SDL_RWops * const src);
     float read_mixfloat(SDL_RWops * const src);
+    void read_bitu8_array(SDL_RWops * const src, uint8_t *dst, uint32_t count);
+    void read_bit16_array(SDL_RWops * const src, int16_t *dst, uint32_t count);
+    void read_bitu16_array(SDL_RWops * const src, uint16_t *dst, uint32_t count);
+    void read_bitu32_array(SDL_RWops * const src, uint32_t *dst, uint32_t count);
+
+    void read_zlib_chunk(SDL_RWops * const src, tr_zlib_chunk_t & chunk, bool skip, const char *name);
+    void inflate_zlib_chunks(tr_zlib_chunk_t *chunks, int count);
 
     void read_mesh_data(SDL_RWops * const src);
     void read_frame_moveable_data(SDL_RWops * const src);
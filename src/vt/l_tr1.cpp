@@ -96,16 +96,13 @@ void TR_Level::read_tr_face4(SDL_RWops * const src, tr4_face4_t & meshface)
 /// \brief reads a 8-bit 256x256 textile.
 void TR_Level::read_tr_textile8(SDL_RWops * const src, tr_textile8_t & textile)
 {
-    for (int i = 0; i < 256; i++)
-        if (SDL_RWread(src, textile.pixels[i], 1, 256) < 256)
-                        Sys_extError("read_tr_textile8");
+    read_bitu8_array(src, textile.pixels[0], 256 * 256);
 }
 
 /// \brief reads the lightmap.
 void TR_Level::read_tr_lightmap(SDL_RWops * const src, tr_lightmap_t & lightmap)
 {
-    for (int i = 0; i < (32 * 256); i++)
-        lightmap.map[i] = read_bitu8(src);
+    read_bitu8_array(src, lightmap.map, 32 * 256);
 }
 
 /// \brief reads the 256 colour palette values.
@@ -557,10 +554,10 @@ void TR_Level::read_tr_moveable(SDL_RWops * const src, tr_moveable_t & moveable)
     moveable.frame_offset = read_bitu32(src);
     moveable.animation_index = read_bitu16(src);
 
-    // Disable unused skybox polygons.
+    // Unused skybox polygons are disabled by read_meshes().
     if((this->game_version == TR_III) && (moveable.object_id == 355))
     {
-        this->meshes[(this->mesh_indices[moveable.starting_mesh])].num_coloured_triangles = 16;
+        this->skybox_mesh = this->mesh_indices[moveable.starting_mesh];
     }
 }
 
@@ -650,8 +647,7 @@ void TR_Level::read_tr_level(SDL_RWops * const src, bool demo_or_ub)
 
     this->floor_data_size = read_bitu32(src);
     this->floor_data = (uint16_t*)malloc(this->floor_data_size * sizeof(uint16_t));
-    for(i = 0; i < this->floor_data_size; i++)
-        this->floor_data[i] = read_bitu16(src);
+    read_bitu16_array(src, this->floor_data, this->floor_data_size);
 
     read_mesh_data(src);
 
@@ -672,13 +668,11 @@ void TR_Level::read_tr_level(SDL_RWops * const src, bool demo_or_ub)
 
     this->anim_commands_count = read_bitu32(src);
     this->anim_commands = (int16_t*)malloc(this->anim_commands_count * sizeof(int16_t));
-    for (i = 0; i < this->anim_commands_count; i++)
-        this->anim_commands[i] = read_bit16(src);
+    read_bit16_array(src, this->anim_commands, this->anim_commands_count);
 
     this->mesh_tree_data_size = read_bitu32(src);
     this->mesh_tree_data = (uint32_t*)malloc(this->mesh_tree_data_size * sizeof(uint32_t));
-    for (i = 0; i < this->mesh_tree_data_size; i++)
-        this->mesh_tree_data[i] = read_bitu32(src);
+    read_bitu32_array(src, this->mesh_tree_data, this->mesh_tree_data_size);
 
     read_frame_moveable_data(src);
 
@@ -744,8 +738,7 @@ void TR_Level::read_tr_level(SDL_RWops * const src, bool demo_or_ub)
 
     this->overlaps_count = read_bitu32(src);
     this->overlaps = (uint16_t*)malloc(this->overlaps_count * sizeof(uint16_t));
-    for (i = 0; i < this->overlaps_count; i++)
-        this->overlaps[i] = read_bitu16(src);
+    read_bitu16_array(src, this->overlaps, this->overlaps_count);
 
     // Zones
     for (i = 0; i < this->boxes_count; i++)
@@ -754,10 +747,7 @@ void TR_Level::read_tr_level(SDL_RWops * const src, bool demo_or_ub)
     this->animated_textures_count = read_bitu32(src);
     this->animated_textures_uv_count = 0; // No UVRotate in TR1
     this->animated_textures = (uint16_t*)malloc(this->animated_textures_count * sizeof(uint16_t));
-    for (i = 0; i < this->animated_textures_count; i++)
-    {
-        this->animated_textures[i] = read_bitu16(src);
-    }
+    read_bitu16_array(src, this->animated_textures, this->animated_textures_count);
 
     this->items_count = read_bitu32(src);
     this->items = (tr2_item_t*)malloc(this->items_count * sizeof(tr2_item_t));
@@ -778,13 +768,11 @@ void TR_Level::read_tr_level(SDL_RWops * const src, bool demo_or_ub)
 
     this->demo_data_count = read_bitu16(src);
     this->demo_data = (uint8_t*)malloc(this->demo_data_count * sizeof(uint8_t));
-    for(i=0; i < this->demo_data_count; i++)
-        this->demo_data[i] = read_bitu8(src);
+    read_bitu8_array(src, this->demo_data, this->demo_data_count);
 
     // Soundmap
     this->soundmap = (int16_t*)malloc(TR_AUDIO_MAP_SIZE_TR1 * sizeof(int16_t));
-    for(i=0; i < TR_AUDIO_MAP_SIZE_TR1; i++)
-        this->soundmap[i] = read_bit16(src);
+    read_bit16_array(src, this->soundmap, TR_AUDIO_MAP_SIZE_TR1);
 
     this->sound_details_count = read_bitu32(src);
     this->sound_details = (tr_sound_details_t*)malloc(this->sound_details_count * sizeof(tr_sound_details_t));
@@ -808,10 +796,10 @@ void TR_Level::read_tr_level(SDL_RWops * const src, bool demo_or_ub)
     this->samples_count = 0;
     this->samples_data_size = read_bitu32(src);
     this->samples_data = (uint8_t*)malloc(this->samples_data_size * sizeof(uint8_t));
-    for(i=0; i < this->samples_data_size; i++)
+    read_bitu8_array(src, this->samples_data, this->samples_data_size);
+    for(i = 4; i < this->samples_data_size; i++)
     {
-        this->samples_data[i] = read_bitu8(src);
-        if((i >= 4) && (*((uint32_t*)(this->samples_data+i-4)) == 0x46464952))   /// RIFF
+        if(*((uint32_t*)(this->samples_data+i-4)) == 0x46464952)   /// RIFF
         {
             this->samples_count++;
         }
@@ -819,6 +807,5 @@ void TR_Level::read_tr_level(SDL_RWops * const src, bool demo_or_ub)
 
     this->sample_indices_count = read_bitu32(src);
     this->sample_indices = (uint32_t*)malloc(this->sample_indices_count * sizeof(uint32_t));
-    for(i=0; i < this->sample_indices_count; i++)
-        this->sample_indices[i] = read_bitu32(src);
+    read_bitu32_array(src, this->sample_indices, this->sample_indices_count);
 }
@@ -21,7 +21,6 @@
 
 #include <SDL2/SDL_endian.h>
 
-#include <zlib.h>
 #include "l_main.h"
 #include "tr_versions.h"
 #include "../core/system.h"
@@ -37,13 +36,11 @@ void TR_Level::read_tr4_vertex_float(SDL_RWops * const src, tr5_vertex_t & verte
 
 void TR_Level::read_tr4_textile32(SDL_RWops * const src, tr4_textile32_t & textile)
 {
-    for (int i = 0; i < 256; i++) {
-        if (SDL_RWread(src, textile.pixels[i], 4, 256) < 256)
-            Sys_extError("read_tr4_textile32");
+    uint32_t *pixel = textile.pixels[0];
 
-        for (int j = 0; j < 256; j++)
-            textile.pixels[i][j] = SDL_SwapLE32((textile.pixels[i][j] & 0xff00ff00) | ((textile.pixels[i][j] & 0x00ff0000) >> 16) | ((textile.pixels[i][j] & 0x000000ff) << 16));
-    }
+    read_bitu32_array(src, pixel, 256 * 256);
+    for (int i = 0; i < 256 * 256; i++, pixel++)
+        *pixel = (*pixel & 0xff00ff00) | ((*pixel & 0x00ff0000) >> 16) | ((*pixel & 0x000000ff) << 16);
 }
 
 void TR_Level::read_tr4_face3(SDL_RWops * const src, tr4_face3_t & meshface)
@@ -346,7 +343,6 @@ void TR_Level::read_tr4_level(SDL_RWops * const _src)
     SDL_RWops *src = _src;
     uint32_t i;
     uint8_t *uncomp_buffer = NULL;
-    uint8_t *comp_buffer = NULL;
     SDL_RWops *newsrc = NULL;
 
     // Version
@@ -363,9 +359,7 @@ void TR_Level::read_tr4_level(SDL_RWops * const _src)
     this->read_32bit_textiles = false;
 
     {
-        uint32_t uncomp_size;
-        uint32_t comp_size;
-        unsigned long size;
+        tr_zlib_chunk_t chunks[4];
 
         this->num_room_textiles = read_bitu16(src);
         this->num_obj_textiles = read_bitu16(src);
@@ -373,196 +367,75 @@ void TR_Level::read_tr4_level(SDL_RWops * const _src)
         this->num_misc_textiles = 2;
         this->num_textiles = this->num_room_textiles + this->num_obj_textiles + this->num_bump_textiles + this->num_misc_textiles;
 
-        uncomp_size = read_bitu32(src);
-        if (uncomp_size == 0)
-            Sys_extError("read_tr4_level: textiles32 uncomp_size == 0");
+        // All four blocks are independent: read them first, then inflate them at once.
+        read_zlib_chunk(src, chunks[0], false, "textiles32");
+        read_zlib_chunk(src, chunks[1], chunks[0].comp_size > 0, "textiles16");
+        read_zlib_chunk(src, chunks[2], false, "textiles32d");
+        if ((chunks[2].comp_size > 0) && ((chunks[2].uncomp_size / (256 * 256 * 4)) > 2))
+            Sys_extWarn("read_tr4_level: num_misc_textiles > 2");
+        read_zlib_chunk(src, chunks[3], false, "packed geometry");
+        if (chunks[3].comp_size == 0)
+            Sys_extError("read_tr4_level: packed geometry");
+
+        inflate_zlib_chunks(chunks, 4);
 
-        comp_size = read_bitu32(src);
-        if (comp_size > 0)
+        if (chunks[0].uncomp_buffer)
         {
-            uncomp_buffer = new uint8_t[uncomp_size];
-
             this->textile32_count = this->num_textiles;
             this->textile32 = (tr4_textile32_t*)malloc(this->textile32_count * sizeof(tr4_textile32_t));
-            comp_buffer = new uint8_t[comp_size];
-
-            if (SDL_RWread(src, comp_buffer, 1, comp_size) < comp_size)
-                Sys_extError("read_tr4_level: textiles32");
-
-            size = uncomp_size;
-            if (uncompress(uncomp_buffer, &size, comp_buffer, comp_size) != Z_OK)
-                Sys_extError("read_tr4_level: uncompress");
-
-            if (size != uncomp_size)
-                Sys_extError("read_tr4_level: uncompress size mismatch");
-            delete [] comp_buffer;
 
-            comp_buffer = NULL;
-            if ((newsrc = SDL_RWFromMem(uncomp_buffer, uncomp_size)) == NULL)
+            if ((newsrc = SDL_RWFromMem(chunks[0].uncomp_buffer, chunks[0].uncomp_size)) == NULL)
                 Sys_extError("read_tr4_level: SDL_RWFromMem");
 
             for (i = 0; i < (this->num_textiles - this->num_misc_textiles); i++)
                 read_tr4_textile32(newsrc, this->textile32[i]);
             SDL_RWclose(newsrc);
             newsrc = NULL;
-            delete [] uncomp_buffer;
+            delete [] chunks[0].uncomp_buffer;
+            chunks[0].uncomp_buffer = NULL;
 
-            uncomp_buffer = NULL;
             this->read_32bit_textiles = true;
         }
 
-        uncomp_size = read_bitu32(src);
-        if (uncomp_size == 0)
-            Sys_extError("read_tr4_level: textiles16 uncomp_size == 0");
-
-        comp_size = read_bitu32(src);
-        if (comp_size > 0)
+        if (chunks[1].uncomp_buffer)
         {
-            if (this->textile32_count == 0)
-            {
-                uncomp_buffer = new uint8_t[uncomp_size];
-
-                this->textile16_count = this->num_textiles;
-                this->textile16 = (tr2_textile16_t*)malloc(this->textile16_count * sizeof(tr2_textile16_t));
-                comp_buffer = new uint8_t[comp_size];
-
-                if (SDL_RWread(src, comp_buffer, 1, comp_size) < comp_size)
-                {
-                    delete [] comp_buffer;
-                    delete [] uncomp_buffer;
-                    Sys_extError("read_tr4_level: textiles16");
-                }
-
-                size = uncomp_size;
-                if (uncompress(uncomp_buffer, &size, comp_buffer, comp_size) != Z_OK)
-                {
-                    delete [] comp_buffer;
-                    delete [] uncomp_buffer;
-                    Sys_extError("read_tr4_level: uncompress");
-                }
-
-                delete [] comp_buffer;
-                comp_buffer = NULL;
-
-                if (size != uncomp_size)
-                {
-                    delete [] uncomp_buffer;
-                    Sys_extError("read_tr4_level: uncompress size mismatch");
-                }
-
-                if ((newsrc = SDL_RWFromMem(uncomp_buffer, uncomp_size)) == NULL)
-                {
-                    delete [] uncomp_buffer;
-                    Sys_extError("read_tr4_level: SDL_RWFromMem");
-                }
-
-                for (i = 0; i < (this->num_textiles - this->num_misc_textiles); i++)
-                    read_tr2_textile16(newsrc, this->textile16[i]);
-
-                SDL_RWclose(newsrc);
-                newsrc = NULL;
-                delete [] uncomp_buffer;
-                uncomp_buffer = NULL;
-            }
-            else
-            {
-                SDL_RWseek(src, comp_size, SEEK_CUR);
-            }
-        }
+            this->textile16_count = this->num_textiles;
+            this->textile16 = (tr2_textile16_t*)malloc(this->textile16_count * sizeof(tr2_textile16_t));
 
-        uncomp_size = read_bitu32(src);
-        if (uncomp_size == 0)
-            Sys_extError("read_tr4_level: textiles32d uncomp_size == 0");
+            if ((newsrc = SDL_RWFromMem(chunks[1].uncomp_buffer, chunks[1].uncomp_size)) == NULL)
+                Sys_extError("read_tr4_level: SDL_RWFromMem");
 
-        comp_size = read_bitu32(src);
-        if (comp_size > 0)
-        {
-            uncomp_buffer = new uint8_t[uncomp_size];
+            for (i = 0; i < (this->num_textiles - this->num_misc_textiles); i++)
+                read_tr2_textile16(newsrc, this->textile16[i]);
 
-            if ((uncomp_size / (256 * 256 * 4)) > 2)
-                Sys_extWarn("read_tr4_level: num_misc_textiles > 2");
+            SDL_RWclose(newsrc);
+            newsrc = NULL;
+            delete [] chunks[1].uncomp_buffer;
+            chunks[1].uncomp_buffer = NULL;
+        }
 
+        if (chunks[2].uncomp_buffer)
+        {
             if (this->textile32_count == 0)
             {
                 this->textile32_count = this->num_textiles;
                 this->textile32 = (tr4_textile32_t*)malloc(this->textile32_count * sizeof(tr4_textile32_t));
             }
-            comp_buffer = new uint8_t[comp_size];
-
-            if (SDL_RWread(src, comp_buffer, 1, comp_size) < comp_size)
-            {
-                delete [] uncomp_buffer;
-                delete [] comp_buffer;
-                Sys_extError("read_tr4_level: misc_textiles");
-            }
-
-            size = uncomp_size;
-            if (uncompress(uncomp_buffer, &size, comp_buffer, comp_size) != Z_OK)
-            {
-                delete [] uncomp_buffer;
-                delete [] comp_buffer;
-                Sys_extError("read_tr4_level: uncompress");
-            }
-
-            delete [] comp_buffer;
-            comp_buffer = NULL;
-            if (size != uncomp_size)
-            {
-                delete [] uncomp_buffer;
-                Sys_extError("read_tr4_level: uncompress size mismatch");
-            }
 
-            if ((newsrc = SDL_RWFromMem(uncomp_buffer, uncomp_size)) == NULL)
-            {
-                delete [] uncomp_buffer;
+            if ((newsrc = SDL_RWFromMem(chunks[2].uncomp_buffer, chunks[2].uncomp_size)) == NULL)
                 Sys_extError("read_tr4_level: SDL_RWFromMem");
-            }
 
             for (i = (this->num_textiles - this->num_misc_textiles); i < this->num_textiles; i++)
                 read_tr4_textile32(newsrc, this->textile32[i]);
 
             SDL_RWclose(newsrc);
             newsrc = NULL;
-            delete [] uncomp_buffer;
-            uncomp_buffer = NULL;
+            delete [] chunks[2].uncomp_buffer;
+            chunks[2].uncomp_buffer = NULL;
         }
 
-        uncomp_size = read_bitu32(src);
-        if (uncomp_size == 0)
-            Sys_extError("read_tr4_level: packed geometry uncomp_size == 0");
-
-        comp_size = read_bitu32(src);
-
-        if (!comp_size)
-            Sys_extError("read_tr4_level: packed geometry");
-
-        uncomp_buffer = new uint8_t[uncomp_size];
-        comp_buffer = new uint8_t[comp_size];
-
-        if (SDL_RWread(src, comp_buffer, 1, comp_size) < comp_size)
-        {
-            delete [] uncomp_buffer;
-            delete [] comp_buffer;
-            Sys_extError("read_tr4_level: packed geometry");
-        }
-
-        size = uncomp_size;
-        if (uncompress(uncomp_buffer, &size, comp_buffer, comp_size) != Z_OK)
-        {
-            delete [] uncomp_buffer;
-            delete [] comp_buffer;
-            Sys_extError("read_tr4_level: uncompress");
-        }
-
-        delete [] comp_buffer;
-        comp_buffer = NULL;
-        if (size != uncomp_size)
-        {
-            delete [] uncomp_buffer;
-            Sys_extError("read_tr4_level: uncompress size mismatch");
-        }
-
-        if ((newsrc = SDL_RWFromMem(uncomp_buffer, uncomp_size)) == NULL)
+        uncomp_buffer = chunks[3].uncomp_buffer;
+        if ((newsrc = SDL_RWFromMem(uncomp_buffer, chunks[3].uncomp_size)) == NULL)
         {
             delete [] uncomp_buffer;
             Sys_extError("read_tr4_level: SDL_RWFromMem");
@@ -580,8 +453,7 @@ void TR_Level::read_tr4_level(SDL_RWops * const _src)
 
     this->floor_data_size = read_bitu32(newsrc);
     this->floor_data = (uint16_t*)malloc(this->floor_data_size * sizeof(uint16_t));
-    for(i = 0; i < this->floor_data_size; i++)
-        this->floor_data[i] = read_bitu16(newsrc);
+    read_bitu16_array(newsrc, this->floor_data, this->floor_data_size);
 
     read_mesh_data(newsrc);
 
@@ -602,13 +474,11 @@ void TR_Level::read_tr4_level(SDL_RWops * const _src)
 
     this->anim_commands_count = read_bitu32(newsrc);
     this->anim_commands = (int16_t*)malloc(this->anim_commands_count * sizeof(int16_t));
-    for (i = 0; i < this->anim_commands_count; i++)
-        this->anim_commands[i] = read_bit16(newsrc);
+    read_bit16_array(newsrc, this->anim_commands, this->anim_commands_count);
 
     this->mesh_tree_data_size = read_bitu32(newsrc);
     this->mesh_tree_data = (uint32_t*)malloc(this->mesh_tree_data_size * sizeof(uint32_t));
-    for (i = 0; i < this->mesh_tree_data_size; i++)
-        this->mesh_tree_data[i] = read_bitu32(newsrc);                     // 4 bytes
+    read_bitu32_array(newsrc, this->mesh_tree_data, this->mesh_tree_data_size);
 
     read_frame_moveable_data(newsrc);
 
@@ -692,8 +562,7 @@ void TR_Level::read_tr4_level(SDL_RWops * const _src)
 
     this->overlaps_count = read_bitu32(newsrc);
     this->overlaps = (uint16_t*)malloc(this->overlaps_count * sizeof(uint16_t));
-    for (i = 0; i < this->overlaps_count; i++)
-        this->overlaps[i] = read_bitu16(newsrc);
+    read_bitu16_array(newsrc, this->overlaps, this->overlaps_count);
 
     // Zones
     for (i = 0; i < this->boxes_count; i++)
@@ -701,10 +570,7 @@ void TR_Level::read_tr4_level(SDL_RWops * const _src)
 
     this->animated_textures_count = read_bitu32(newsrc);
     this->animated_textures = (uint16_t*)malloc(this->animated_textures_count * sizeof(uint16_t));
-    for (i = 0; i < this->animated_textures_count; i++)
-    {
-        this->animated_textures[i] = read_bitu16(newsrc);
-    }
+    read_bitu16_array(newsrc, this->animated_textures, this->animated_textures_count);
 
     this->animated_textures_uv_count = read_bitu8(newsrc);
 
@@ -745,13 +611,11 @@ void TR_Level::read_tr4_level(SDL_RWops * const _src)
 
     this->demo_data_count = read_bitu16(newsrc);
     this->demo_data = (uint8_t*)malloc(this->demo_data_count * sizeof(uint8_t));
-    for(i=0; i < this->demo_data_count; i++)
-        this->demo_data[i] = read_bitu8(newsrc);
+    read_bitu8_array(newsrc, this->demo_data, this->demo_data_count);
 
     // Soundmap
     this->soundmap = (int16_t*)malloc(TR_AUDIO_MAP_SIZE_TR4 * sizeof(int16_t));
-    for(i=0; i < TR_AUDIO_MAP_SIZE_TR4; i++)
-        this->soundmap[i] = read_bit16(newsrc);
+    read_bit16_array(newsrc, this->soundmap, TR_AUDIO_MAP_SIZE_TR4);
 
     this->sound_details_count = 0;
     i = read_bitu32(newsrc);
@@ -779,8 +643,7 @@ void TR_Level::read_tr4_level(SDL_RWops * const _src)
         this->sample_indices_count = i;
 
         this->sample_indices = (uint32_t*)malloc(this->sample_indices_count * sizeof(uint32_t));
-        for(i=0; i < this->sample_indices_count; i++)
-            this->sample_indices[i] = read_bitu32(newsrc);
+        read_bitu32_array(newsrc, this->sample_indices, this->sample_indices_count);
     }
     else
     {
@@ -802,7 +665,6 @@ void TR_Level::read_tr4_level(SDL_RWops * const _src)
         // block of file as single array.
         this->samples_data_size = (uint32_t) (SDL_RWsize(src) - SDL_RWtell(src));
         this->samples_data = (uint8_t*)malloc(this->samples_data_size * sizeof(uint8_t));
-        for(i = 0; i < this->samples_data_size; i++)
-            this->samples_data[i] = read_bitu8(src);
+        read_bitu8_array(src, this->samples_data, this->samples_data_size);
     }
 }
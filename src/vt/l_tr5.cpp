@@ -20,7 +20,6 @@
  */
 
 #include <SDL2/SDL.h>
-#include <zlib.h>
 #include "l_main.h"
 #include "../core/system.h"
 
@@ -412,8 +411,6 @@ void TR_Level::read_tr5_moveable(SDL_RWops * const src, tr_moveable_t & moveable
 void TR_Level::read_tr5_level(SDL_RWops * const src)
 {
     uint32_t i;
-    uint8_t *comp_buffer = NULL;
-    uint8_t *uncomp_buffer = NULL;
     SDL_RWops *newsrc = NULL;
 
     // Version
@@ -429,9 +426,7 @@ void TR_Level::read_tr5_level(SDL_RWops * const src)
     this->num_misc_textiles = 0;
     this->read_32bit_textiles = false;
 
-    uint32_t uncomp_size;
-    uint32_t comp_size;
-    unsigned long size;
+    tr_zlib_chunk_t chunks[3];
 
     this->num_room_textiles = read_bitu16(src);
     this->num_obj_textiles = read_bitu16(src);
@@ -439,166 +434,69 @@ void TR_Level::read_tr5_level(SDL_RWops * const src)
     this->num_misc_textiles = 3;
     this->num_textiles = this->num_room_textiles + this->num_obj_textiles + this->num_bump_textiles + this->num_misc_textiles;
 
-    uncomp_size = read_bitu32(src);
-    if (uncomp_size == 0)
-        Sys_extError("read_tr5_level: textiles32 uncomp_size == 0");
+    // All texture blocks are independent: read them first, then inflate them at once.
+    read_zlib_chunk(src, chunks[0], false, "textiles32");
+    read_zlib_chunk(src, chunks[1], chunks[0].comp_size > 0, "textiles16");
+    read_zlib_chunk(src, chunks[2], false, "textiles32d");
+    if ((chunks[2].comp_size > 0) && ((chunks[2].uncomp_size / (256 * 256 * 4)) > 3))
+        Sys_extWarn("read_tr5_level: num_misc_textiles > 3");
 
-    comp_size = read_bitu32(src);
-    if (comp_size > 0)
+    inflate_zlib_chunks(chunks, 3);
+
+    if (chunks[0].uncomp_buffer)
     {
-        comp_buffer = new uint8_t[comp_size];
         this->textile32_count = this->num_textiles;
         this->textile32 = (tr4_textile32_t*)malloc(this->textile32_count * sizeof(tr4_textile32_t));
 
-        if (SDL_RWread(src, comp_buffer, 1, comp_size) < comp_size)
-        {
-            delete [] comp_buffer;
-            Sys_extError("read_tr5_level: textiles32");
-        }
-
-        uncomp_buffer = new uint8_t[uncomp_size];
-        size = uncomp_size;
-        if (uncompress(uncomp_buffer, &size, comp_buffer, comp_size) != Z_OK)
-        {
-            delete [] comp_buffer;
-            delete [] uncomp_buffer;
-            Sys_extError("read_tr5_level: uncompress");
-        }
-
-        delete [] comp_buffer;
-        comp_buffer = NULL;
-        if (size != uncomp_size)
-        {
-            delete [] uncomp_buffer;
-            Sys_extError("read_tr5_level: uncompress size mismatch");
-        }
-
-        if ((newsrc = SDL_RWFromMem(uncomp_buffer, uncomp_size)) == NULL)
-        {
-            delete [] uncomp_buffer;
+        if ((newsrc = SDL_RWFromMem(chunks[0].uncomp_buffer, chunks[0].uncomp_size)) == NULL)
             Sys_extError("read_tr5_level: SDL_RWFromMem");
-        }
 
         for (i = 0; i < (this->num_textiles - this->num_misc_textiles); i++)
             read_tr4_textile32(newsrc, this->textile32[i]);
 
         SDL_RWclose(newsrc);
         newsrc = NULL;
-        delete [] uncomp_buffer;
-        uncomp_buffer = NULL;
+        delete [] chunks[0].uncomp_buffer;
+        chunks[0].uncomp_buffer = NULL;
 
         this->read_32bit_textiles = true;
     }
 
-    uncomp_size = read_bitu32(src);
-    if (uncomp_size == 0)
-        Sys_extError("read_tr5_level: textiles16 uncomp_size == 0");
-
-    comp_size = read_bitu32(src);
-    if (comp_size > 0)
+    if (chunks[1].uncomp_buffer)
     {
-        if (this->textile32_count == 0)
-        {
-            comp_buffer = new uint8_t[comp_size];
-            this->textile16_count = this->num_textiles;
-            this->textile16 = (tr2_textile16_t*)malloc(this->textile16_count * sizeof(tr2_textile16_t));
-
-            if (SDL_RWread(src, comp_buffer, 1, comp_size) < comp_size)
-            {
-                delete [] comp_buffer;
-                Sys_extError("read_tr5_level: textiles16");
-            }
+        this->textile16_count = this->num_textiles;
+        this->textile16 = (tr2_textile16_t*)malloc(this->textile16_count * sizeof(tr2_textile16_t));
 
-            uncomp_buffer = new uint8_t[uncomp_size];
-            size = uncomp_size;
-            if (uncompress(uncomp_buffer, &size, comp_buffer, comp_size) != Z_OK)
-            {
-                delete [] comp_buffer;
-                delete [] uncomp_buffer;
-                Sys_extError("read_tr5_level: uncompress");
-            }
-            delete [] comp_buffer;
-            comp_buffer = NULL;
-
-            if (size != uncomp_size)
-            {
-                delete [] uncomp_buffer;
-                Sys_extError("read_tr5_level: uncompress size mismatch");
-            }
-
-            if ((newsrc = SDL_RWFromMem(uncomp_buffer, uncomp_size)) == NULL)
-            {
-                delete [] uncomp_buffer;
-                Sys_extError("read_tr5_level: SDL_RWFromMem");
-            }
+        if ((newsrc = SDL_RWFromMem(chunks[1].uncomp_buffer, chunks[1].uncomp_size)) == NULL)
+            Sys_extError("read_tr5_level: SDL_RWFromMem");
 
-            for (i = 0; i < (this->num_textiles - this->num_misc_textiles); i++)
-                read_tr2_textile16(newsrc, this->textile16[i]);
+        for (i = 0; i < (this->num_textiles - this->num_misc_textiles); i++)
+            read_tr2_textile16(newsrc, this->textile16[i]);
 
-            SDL_RWclose(newsrc);
-            newsrc = NULL;
-            delete [] uncomp_buffer;
-            uncomp_buffer = NULL;
-        }
-        else
-        {
-            SDL_RWseek(src, comp_size, SEEK_CUR);
-        }
+        SDL_RWclose(newsrc);
+        newsrc = NULL;
+        delete [] chunks[1].uncomp_buffer;
+        chunks[1].uncomp_buffer = NULL;
     }
 
-    uncomp_size = read_bitu32(src);
-    if (uncomp_size == 0)
-        Sys_extError("read_tr5_level: textiles32d uncomp_size == 0");
-
-    comp_size = read_bitu32(src);
-    if (comp_size > 0)
+    if (chunks[2].uncomp_buffer)
     {
-        if ((uncomp_size / (256 * 256 * 4)) > 3)
-            Sys_extWarn("read_tr5_level: num_misc_textiles > 3");
-
         if (this->textile32_count == 0)
         {
             this->textile32_count = this->num_misc_textiles;
             this->textile32 = (tr4_textile32_t*)malloc(this->textile32_count * sizeof(tr4_textile32_t));
         }
 
-        comp_buffer = new uint8_t[comp_size];
-        if (SDL_RWread(src, comp_buffer, 1, comp_size) < comp_size)
-        {
-            delete [] comp_buffer;
-            Sys_extError("read_tr5_level: misc_textiles");
-        }
-
-        uncomp_buffer = new uint8_t[uncomp_size];
-        size = uncomp_size;
-        if (uncompress(uncomp_buffer, &size, comp_buffer, comp_size) != Z_OK)
-        {
-            delete [] uncomp_buffer;
-            delete [] comp_buffer;
-            Sys_extError("read_tr5_level: uncompress");
-        }
-        delete [] comp_buffer;
-        comp_buffer = NULL;
-
-        if (size != uncomp_size)
-        {
-            delete [] uncomp_buffer;
-            Sys_extError("read_tr5_level: uncompress size mismatch");
-        }
-
-        if ((newsrc = SDL_RWFromMem(uncomp_buffer, uncomp_size)) == NULL)
-        {
-            delete [] uncomp_buffer;
+        if ((newsrc = SDL_RWFromMem(chunks[2].uncomp_buffer, chunks[2].uncomp_size)) == NULL)
             Sys_extError("read_tr5_level: SDL_RWFromMem");
-        }
 
         for (i = (this->num_textiles - this->num_misc_textiles); i < this->num_textiles; i++)
             read_tr4_textile32(newsrc, this->textile32[i]);
 
         SDL_RWclose(newsrc);
         newsrc = NULL;
-        delete [] uncomp_buffer;
-        uncomp_buffer = NULL;
+        delete [] chunks[2].uncomp_buffer;
+        chunks[2].uncomp_buffer = NULL;
     }
 
     // flags?
@@ -653,8 +551,7 @@ void TR_Level::read_tr5_level(SDL_RWops * const src)
 
     this->floor_data_size = read_bitu32(src);
     this->floor_data = (uint16_t*)malloc(this->floor_data_size * sizeof(uint16_t));
-    for(i = 0; i < this->floor_data_size; i++)
-        this->floor_data[i] = read_bitu16(src);
+    read_bitu16_array(src, this->floor_data, this->floor_data_size);
 
     read_mesh_data(src);
 
@@ -677,13 +574,11 @@ void TR_Level::read_tr5_level(SDL_RWops * const src)
 
     this->anim_commands_count = read_bitu32(src);
     this->anim_commands = (int16_t*)malloc(this->anim_commands_count * sizeof(int16_t));
-    for (i = 0; i < this->anim_commands_count; i++)
-        this->anim_commands[i] = read_bit16(src);
+    read_bit16_array(src, this->anim_commands, this->anim_commands_count);
 
     this->mesh_tree_data_size = read_bitu32(src);
     this->mesh_tree_data = (uint32_t*)malloc(this->mesh_tree_data_size * sizeof(uint32_t));
-    for (i = 0; i < this->mesh_tree_data_size; i++)
-        this->mesh_tree_data[i] = read_bitu32(src);                     // 4 bytes
+    read_bitu32_array(src, this->mesh_tree_data, this->mesh_tree_data_size);
 
     read_frame_moveable_data(src);
 
@@ -769,8 +664,7 @@ void TR_Level::read_tr5_level(SDL_RWops * const src)
 
     this->overlaps_count = read_bitu32(src);
     this->overlaps = (uint16_t*)malloc(this->overlaps_count * sizeof(uint16_t));
-    for (i = 0; i < this->overlaps_count; i++)
-        this->overlaps[i] = read_bitu16(src);
+    read_bitu16_array(src, this->overlaps, this->overlaps_count);
 
     // Zones
     for (i = 0; i < this->boxes_count; i++)
@@ -778,10 +672,7 @@ void TR_Level::read_tr5_level(SDL_RWops * const src)
 
     this->animated_textures_count = read_bitu32(src);
     this->animated_textures = (uint16_t*)malloc(this->animated_textures_count * sizeof(uint16_t));
-    for (i = 0; i < this->animated_textures_count; i++)
-    {
-        this->animated_textures[i] = read_bitu16(src);
-    }
+    read_bitu16_array(src, this->animated_textures, this->animated_textures_count);
 
     this->animated_textures_uv_count = read_bitu8(src);
 
@@ -829,13 +720,11 @@ void TR_Level::read_tr5_level(SDL_RWops * const src)
 
     this->demo_data_count = read_bitu16(src);
     this->demo_data = (uint8_t*)malloc(this->demo_data_count * sizeof(uint8_t));
-    for(i=0; i < this->demo_data_count; i++)
-        this->demo_data[i] = read_bitu8(src);
+    read_bitu8_array(src, this->demo_data, this->demo_data_count);
 
     // Soundmap
     this->soundmap = (int16_t*)malloc(TR_AUDIO_MAP_SIZE_TR5 * sizeof(int16_t));
-    for(i=0; i < TR_AUDIO_MAP_SIZE_TR5; i++)
-        this->soundmap[i] = read_bit16(src);
+    read_bit16_array(src, this->soundmap, TR_AUDIO_MAP_SIZE_TR5);
 
     this->sound_details_count = read_bitu32(src);
     this->sound_details = (tr_sound_details_t*)malloc(this->sound_details_count * sizeof(tr_sound_details_t));
@@ -853,8 +742,7 @@ void TR_Level::read_tr5_level(SDL_RWops * const src)
 
     this->sample_indices_count = read_bitu32(src);
     this->sample_indices = (uint32_t*)malloc(this->sample_indices_count * sizeof(uint32_t));
-    for(i=0; i < this->sample_indices_count; i++)
-        this->sample_indices[i] = read_bitu32(src);
+    read_bitu32_array(src, this->sample_indices, this->sample_indices_count);
 
     SDL_RWseek(src, 6, SEEK_CUR);   // In TR5, sample indices are followed by 6 0xCD bytes. - correct - really 0xCDCDCDCDCDCD
 
@@ -866,7 +754,6 @@ void TR_Level::read_tr5_level(SDL_RWops * const src)
         // block of file as single array.
         this->samples_data_size = SDL_RWsize(src) - SDL_RWtell(src);
         this->samples_data = (uint8_t*)malloc(this->samples_data_size * sizeof(uint8_t));
-        for(i = 0; i < this->samples_data_size; i++)
-            this->samples_data[i] = read_bitu8(src);
+        read_bitu8_array(src, this->samples_data, this->samples_data_size);
     }
 }
@@ -4,6 +4,11 @@
 #include "tr_versions.h"
 #include "vt_level.h"
 #include <ctype.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "../core/jobs.h"
 
 //#define RCSID "$Id: vt_level.cpp,v 1.1 2002/09/20 15:59:02 crow Exp $"
 
@@ -139,10 +144,94 @@ int VT_Level::get_PC_level_version(const char *name)
     return ret;
 }
 
+/*
+ * Texture conversion kernels, one 256x256 page per call.
+ * 8 bit pages go through a 32 bit palette table (index 0 is the transparent key);
+ * 16 bit ARGB1555 pages are expanded 8 pixels per step with SSE2 when available.
+ */
+void VT_ConvertTextile8(const tr_textile8_t *tex, const uint32_t lut[256], tr4_textile32_t *dst)
+{
+    const uint8_t *src = &tex->pixels[0][0];
+    uint32_t *out = &dst->pixels[0][0];
+
+    for (int i = 0; i < 256 * 256; i += 4)
+    {
+        out[i + 0] = lut[src[i + 0]];
+        out[i + 1] = lut[src[i + 1]];
+        out[i + 2] = lut[src[i + 2]];
+        out[i + 3] = lut[src[i + 3]];
+    }
+}
+
+void VT_ConvertTextile16(const tr2_textile16_t *tex, tr4_textile32_t *dst)
+{
+    const uint16_t *src = &tex->pixels[0][0];
+    uint32_t *out = &dst->pixels[0][0];
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i mask_f8 = _mm_set1_epi16(0x00F8);
+    const __m128i alpha = _mm_set1_epi16((short)0xFF00);
+    for (; i < 256 * 256; i += 8)
+    {
+        __m128i col = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i r = _mm_and_si128(_mm_srli_epi16(col, 7), mask_f8);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(col, 2), mask_f8);
+        __m128i b = _mm_and_si128(_mm_slli_epi16(col, 3), mask_f8);
+        __m128i key = _mm_srai_epi16(col, 15);                                  // 0xFFFF for opaque pixels
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        __m128i ba = _mm_or_si128(b, alpha);
+        __m128i lo = _mm_and_si128(_mm_unpacklo_epi16(rg, ba), _mm_unpacklo_epi16(key, key));
+        __m128i hi = _mm_and_si128(_mm_unpackhi_epi16(rg, ba), _mm_unpackhi_epi16(key, key));
+        _mm_storeu_si128((__m128i*)(out + i), lo);
+        _mm_storeu_si128((__m128i*)(out + i + 4), hi);
+    }
+#endif
+
+    for (; i < 256 * 256; i++)
+    {
+        uint32_t col = src[i];
+        if (col & 0x8000)
+            out[i] = ((col & 0x00007c00) >> 7) | (((col & 0x000003e0) >> 2) << 8) | (((col & 0x0000001f) << 3) << 16) | 0xff000000;
+        else
+            out[i] = 0x00000000;
+    }
+}
+
+void VT_MakePaletteLUT(const tr2_palette_t *pal, uint32_t lut[256])
+{
+    lut[0] = 0x00000000;
+    for (int col = 1; col < 256; col++)
+    {
+        lut[col] = ((uint32_t)pal->colour[col].r) | ((uint32_t)pal->colour[col].g << 8) | ((uint32_t)pal->colour[col].b << 16) | (0xffU << 24);
+    }
+}
+
+typedef struct vt_textile_job_s
+{
+    VT_Level   *tr;
+    uint32_t    lut[256];
+} vt_textile_job_t;
+
+static void VT_ConvertTextile8Job(void *data, uint32_t index)
+{
+    vt_textile_job_t *job_data = (vt_textile_job_t*)data;
+    VT_ConvertTextile8(job_data->tr->textile8 + index, job_data->lut, job_data->tr->textile32 + index);
+}
+
+static void VT_ConvertTextile16Job(void *data, uint32_t index)
+{
+    vt_textile_job_t *job_data = (vt_textile_job_t*)data;
+    VT_ConvertTextile16(job_data->tr->textile16 + index, job_data->tr->textile32 + index);
+}
+
+/// Converts all 8 / 16 bit pages to textile32, pages are converted in parallel by job threads.
 void VT_Level::prepare_level()
 {
-    uint32_t i;
+    vt_textile_job_t job_data;
+    job_t job;
 
+    job_data.tr = this;
     if ((game_version >= TR_II) && (game_version <= TR_V))
     {
         if (!read_32bit_textiles)
@@ -152,16 +241,19 @@ void VT_Level::prepare_level()
                 this->textile32_count = this->num_textiles;
                 this->textile32 = (tr4_textile32_t*)malloc(this->textile32_count * sizeof(tr4_textile32_t));
             }
-            for (i = 0; i < (num_textiles - num_misc_textiles); i++)
-                convert_textile16_to_textile32(textile16[i], textile32[i]);
+            Job_Init(&job, VT_ConvertTextile16Job, &job_data, num_textiles - num_misc_textiles);
+            Job_Submit(&job);
+            Job_Wait(&job);
         }
     }
     else
     {
         this->textile32_count = this->num_textiles;
-            this->textile32 = (tr4_textile32_t*)malloc(this->textile32_count * sizeof(tr4_textile32_t));
-        for (i = 0; i < num_textiles; i++)
-            convert_textile8_to_textile32(textile8[i], palette, textile32[i]);
+        this->textile32 = (tr4_textile32_t*)malloc(this->textile32_count * sizeof(tr4_textile32_t));
+        VT_MakePaletteLUT(&palette, job_data.lut);
+        Job_Init(&job, VT_ConvertTextile8Job, &job_data, num_textiles);
+        Job_Submit(&job);
+        Job_Wait(&job);
     }
 }
 
@@ -198,42 +290,6 @@ tr_moveable_t *VT_Level::find_moveable_id(uint32_t object_id)
     return NULL;
 }
 
-void VT_Level::convert_textile8_to_textile32(tr_textile8_t & tex, tr2_palette_t & pal, tr4_textile32_t & dst)
-{
-    int x, y;
-
-    for (y = 0; y < 256; y++)
-    {
-        for (x = 0; x < 256; x++)
-        {
-            int col = tex.pixels[y][x];
-
-            if (col > 0)
-                dst.pixels[y][x] = ((int)pal.colour[col].r) | ((int)pal.colour[col].g << 8) | ((int)pal.colour[col].b << 16) | (0xff << 24);
-            else
-                dst.pixels[y][x] = 0x00000000;
-        }
-    }
-}
-
-void VT_Level::convert_textile16_to_textile32(tr2_textile16_t & tex, tr4_textile32_t & dst)
-{
-    int x, y;
-
-    for (y = 0; y < 256; y++)
-    {
-        for (x = 0; x < 256; x++)
-        {
-            int col = tex.pixels[y][x];
-
-            if (col & 0x8000)
-                dst.pixels[y][x] = ((col & 0x00007c00) >> 7) | (((col & 0x000003e0) >> 2) << 8) | (((col & 0x0000001f) << 3) << 16) | 0xff000000;
-            else
-                dst.pixels[y][x] = 0x00000000;
-        }
-    }
-}
-
 void WriteTGAfile(const char *filename, const uint8_t *data, const int width, const int height, char invY)
 {
     unsigned char c;
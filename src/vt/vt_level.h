@@ -11,6 +11,11 @@
 
 void WriteTGAfile(const char *filename, const uint8_t *data, const int width, const int height, char invY);
 
+// Texture page conversion kernels used by prepare_level, checked against plain per pixel conversion by opentomb_test_textiles.
+void VT_MakePaletteLUT(const tr2_palette_t *pal, uint32_t lut[256]);
+void VT_ConvertTextile8(const tr_textile8_t *tex, const uint32_t lut[256], tr4_textile32_t *dst);
+void VT_ConvertTextile16(const tr2_textile16_t *tex, tr4_textile32_t *dst);
+
 class VT_Level : public TR_Level 
 {
     public:
@@ -21,10 +26,6 @@ class VT_Level : public TR_Level
     tr_staticmesh_t *find_staticmesh_id(uint32_t object_id);
     tr2_item_t *find_item_id(int32_t object_id);
     tr_moveable_t *find_moveable_id(uint32_t object_id);
-
-    protected:
-    void convert_textile8_to_textile32(tr_textile8_t & tex, tr2_palette_t & pal, tr4_textile32_t & dst);
-    void convert_textile16_to_textile32(tr2_textile16_t & tex, tr4_textile32_t & dst);
 };
 
 #endif // _VT_LEVEL_H_
\ No newline at end of file
@@ -1,8 +1,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_rwops.h>
+#include <pthread.h>
 
 extern "C" {
 #include <lua.h>
@@ -17,6 +19,9 @@ extern "C" {
 #include "core/vmath.h"
 #include "core/polygon.h"
 #include "core/obb.h"
+#include "core/jobs.h"
+#include "core/perf.h"
+#include "core/cache_file.h"
 #include "render/camera.h"
 #include "render/frustum.h"
 #include "render/render.h"
@@ -40,6 +45,10 @@ extern "C" {
 #include "inventory.h"
 #include "trigger.h"
 
+#define WORLD_CACHE_MAGIC       (0x4357544F)                                    // "OTWC"
+#define WORLD_CACHE_VERSION     (2)
+#define WORLD_CACHE_NO_INDEX    (0xFFFFFFFF)
+
 
  struct world_s
 {
@@ -55,6 +64,8 @@ extern "C" {
 
     struct box_overlap_s           *overlaps;
     uint32_t                        overlaps_count;
+    struct box_edge_s              *box_edges;
+    uint32_t                        box_edges_count;
 
     uint32_t                        flip_count;             // Number of flips
     uint8_t                        *flip_map;               // Flipped room activity array.
@@ -94,6 +105,17 @@ extern "C" {
     struct flyby_camera_sequence_s *flyby_camera_sequences;
 } global_world;
 
+// Next level CPU-side data is read in background while current level is played.
+static struct
+{
+    pthread_t                       thread;
+    int                             thread_active;
+    int                             version;
+    char                            path[1024];
+    class VT_Level                 *level;
+    sys_thread_log_t                log;                     // warnings and errors of preload thread
+} world_preload;
+
 
 // private load level functions prototipes:
 void World_SetEntityModelProperties(struct entity_s *ent);
@@ -105,26 +127,36 @@ void World_AutoexecOpen();
 bool Res_CreateEntityFunc(lua_State *lua, const char* func_name, int entity_id);
 
 
-void World_GenTextures(class VT_Level *tr);
+void World_OpenCache(struct cache_file_s *cache, const char *path, class VT_Level *tr);
+void World_StoreGeneratedData(struct cache_file_s *cache);
+void World_CloseCache(struct cache_file_s *cache);
+void World_GenTextures(class VT_Level *tr, struct cache_file_s *cache);
 void World_GenAnimTextures(class VT_Level *tr);
-void World_GenMeshes(class VT_Level *tr);
+void World_GenMeshes(class VT_Level *tr, struct job_s *job, struct cache_file_s *cache);
+void World_GenMeshesVBO();
 void World_GenSprites(class VT_Level *tr);
-void World_GenBoxes(class VT_Level *tr);
+void World_GenBoxes(class VT_Level *tr, struct cache_file_s *cache);
 void World_GenCameras(class VT_Level *tr);
 void World_GenCinematicCameras(class VT_Level *tr);
 void World_GenFlyByCameras(class VT_Level *tr);
 void World_GenRoom(struct room_s *room, class VT_Level *tr);
+void World_GenRoomMeshes(class VT_Level *tr, struct job_s *job, struct cache_file_s *cache);
 void World_GenRooms(class VT_Level *tr);
 void World_GenRoomFlipMap();
-void World_GenSkeletalModels(class VT_Level *tr);
+void World_GenSkeletalModels(class VT_Level *tr, struct job_s *job, struct job_s *meshes_job, struct cache_file_s *cache);
+void World_GenSkeletalModelsVBO();
 void World_GenEntities(class VT_Level *tr);
 void World_GenBaseItems();
 void World_GenSpritesBuffer();
-void World_GenRoomProperties(class VT_Level *tr);
+void World_GenRoomProperties(class VT_Level *tr, struct cache_file_s *cache);
+void World_GenRoomPVS(struct job_s *job, struct cache_file_s *cache);
 void World_GenRoomCollision();
 void World_FixRooms();
 void World_BuildNearRoomsList(struct room_s *room);
 void World_BuildOverlappedRoomsList(struct room_s *room);
+void World_WaitJob(struct job_s *job, int progress_from, int progress_to);
+void World_ReadLevel(class VT_Level *tr, const char *path, int trv);
+class VT_Level *World_TakePreloadedLevel(const char *path, int trv);
 
 extern "C" void AVL_DeleteEntity(void *p) { Entity_Delete((entity_p)p); }
 extern "C" void AVL_DeleteItem(void *p) { BaseItem_Delete((base_item_p)p); }
@@ -157,6 +189,8 @@ void World_Prepare()
     global_world.room_boxes_count = 0;
     global_world.overlaps = NULL;
     global_world.overlaps_count = 0;
+    global_world.box_edges = NULL;
+    global_world.box_edges_count = 0;
     global_world.cameras_sinks = NULL;
     global_world.cameras_sinks_count = 0;
     global_world.flyby_frames = NULL;
@@ -174,68 +208,187 @@ void World_Prepare()
 }
 
 
-void World_Open(const char *path, int trv)
+/*
+ * Reads level file to prepared VT_Level. No GL, AL or Lua here:
+ * function is called from level preload thread too.
+ */
+void World_ReadLevel(VT_Level *tr, const char *path, int trv)
 {
-    VT_Level *tr = new VT_Level();
     tr->read_level(path, trv);
     tr->prepare_level();
+}
+
+
+/*
+ * Messages of preload thread are kept in world_preload.log. Sys_Error there jumps back
+ * here and the thread returns non-NULL; World_JoinPreloadThread deletes the partially
+ * read level and World_Open reads the level again on the main thread.
+ */
+static void *World_PreloadThreadFunc(void *data)
+{
+    jmp_buf error_jump;
+    (void)data;
+
+    world_preload.level = new VT_Level();
+    world_preload.log.error_jump = &error_jump;
+    Sys_SetThreadLog(&world_preload.log);
+    if(setjmp(error_jump) == 0)
+    {
+        World_ReadLevel(world_preload.level, world_preload.path, world_preload.version);
+    }
+    Sys_SetThreadLog(NULL);
+    world_preload.log.error_jump = NULL;
+
+    return (void*)(intptr_t)world_preload.log.error;
+}
+
+
+static void World_JoinPreloadThread()
+{
+    void *error = NULL;
+    pthread_join(world_preload.thread, &error);
+    world_preload.thread_active = 0;
+    if(error)
+    {
+        Sys_DebugLog(SYS_LOG_FILENAME, "Level preload failed: \"%s\"", world_preload.path);
+        delete world_preload.level;                             // destructor frees what was read, file buffer too
+        world_preload.level = NULL;
+    }
+    Sys_ReportThreadLog(&world_preload.log);
+}
+
+
+void World_PreloadLevel(const char *path, int trv)
+{
+    if(world_preload.thread_active)
+    {
+        if(path && (trv == world_preload.version) && (strncmp(path, world_preload.path, sizeof(world_preload.path)) == 0))
+        {
+            return;
+        }
+        World_JoinPreloadThread();
+    }
+
+    if(world_preload.level)
+    {
+        delete world_preload.level;
+        world_preload.level = NULL;
+    }
+    world_preload.path[0] = 0;
+
+    if(path && (strlen(path) < sizeof(world_preload.path)))
+    {
+        strncpy(world_preload.path, path, sizeof(world_preload.path));
+        world_preload.version = trv;
+        world_preload.thread_active = (pthread_create(&world_preload.thread, NULL, World_PreloadThreadFunc, NULL) == 0);
+        if(!world_preload.thread_active)
+        {
+            world_preload.path[0] = 0;
+        }
+    }
+}
+
+
+/// Returns preloaded level if it matches requested one, waits for the preload thread if it is still working; reports thread messages.
+VT_Level *World_TakePreloadedLevel(const char *path, int trv)
+{
+    VT_Level *ret = NULL;
+    if(world_preload.thread_active && (trv == world_preload.version) && (strncmp(path, world_preload.path, sizeof(world_preload.path)) == 0))
+    {
+        World_JoinPreloadThread();                              // on failure level is NULL and is read synchronously
+        world_preload.path[0] = 0;
+        ret = world_preload.level;
+        world_preload.level = NULL;
+    }
+    else
+    {
+        World_PreloadLevel(NULL, 0);
+    }
+
+    return ret;
+}
+
+
+void World_Open(const char *path, int trv)
+{
+    VT_Level *tr = World_TakePreloadedLevel(path, trv);
+    job_t meshes_job, room_meshes_job, models_job, pvs_job;
+    cache_file_t cache;
+
+    if(!tr)
+    {
+        tr = new VT_Level();
+        Perf_Call("World_ReadLevel", World_ReadLevel(tr, path, trv));
+    }
     //tr_level->dump_textures();
     World_Clear();
 
     global_world.version = tr->game_version;
     
-    World_ScriptsOpen(path);            // Open configuration scripts.
+    Perf_Call("World_ScriptsOpen", World_ScriptsOpen(path));           // Open configuration scripts.
+    Perf_Call("World_OpenCache", World_OpenCache(&cache, path, tr));   // Generated data of the previous load, if level is the same.
     Gui_DrawLoadScreen(200);
 
-    World_GenTextures(tr);              // Generate OGL textures
+    Perf_Call("World_GenTextures", World_GenTextures(tr, &cache));     // Generate OGL textures
     Gui_DrawLoadScreen(300);
 
-    World_GenAnimTextures(tr);          // Generate animated textures
+    Perf_Call("World_GenAnimTextures", World_GenAnimTextures(tr));     // Generate animated textures
     Gui_DrawLoadScreen(320);
 
-    World_GenMeshes(tr);                // Generate all meshes
-    Gui_DrawLoadScreen(400);
+    // CPU only parts of meshes, room meshes and skeletal models generation are done in job threads,
+    // meanwhile main thread does GL uploads, scripts and physics.
+    Perf_Call("World_GenMeshes", World_GenMeshes(tr, &meshes_job, &cache));
+    Perf_Call("World_GenRoomMeshes", World_GenRoomMeshes(tr, &room_meshes_job, &cache));
+    // Build all skeletal models. Must be generated before TR_Sector_Calculate() function.
+    Perf_Call("World_GenSkeletalModels", World_GenSkeletalModels(tr, &models_job, &meshes_job, &cache));
+
+    Perf_Call("World_GenSprites", World_GenSprites(tr));               // Generate all sprites
+    Perf_Call("World_GenBoxes", World_GenBoxes(tr, &cache));           // Generate boxes.
+    Gui_DrawLoadScreen(340);
 
-    World_GenSprites(tr);               // Generate all sprites
+    Perf_Call("World_WaitMeshes", World_WaitJob(&meshes_job, 340, 400));
+    Perf_Call("World_GenMeshesVBO", World_GenMeshesVBO());             // Generate all meshes
     Gui_DrawLoadScreen(420);
 
-    World_GenBoxes(tr);                 // Generate boxes.
-    Gui_DrawLoadScreen(440);
-
-    World_GenRooms(tr);                 // Build all rooms
+    Perf_Call("World_WaitRoomMeshes", World_WaitJob(&room_meshes_job, 420, 440));
+    Perf_Call("World_GenRooms", World_GenRooms(tr));                   // Build all rooms
     Gui_DrawLoadScreen(480);
 
-    World_GenCameras(tr);               // Generate cameras & sinks.
-    World_GenCinematicCameras(tr);
-    World_GenFlyByCameras(tr);
+    Perf_Call("World_GenCameras", World_GenCameras(tr));               // Generate cameras & sinks.
+    Perf_Call("World_GenCinematicCameras", World_GenCinematicCameras(tr));
+    Perf_Call("World_GenFlyByCameras", World_GenFlyByCameras(tr));
     Gui_DrawLoadScreen(500);
 
-    World_GenRoomFlipMap();             // Generate room flipmaps
+    Perf_Call("World_GenRoomFlipMap", World_GenRoomFlipMap());         // Generate room flipmaps
     Gui_DrawLoadScreen(520);
 
-    // Build all skeletal models. Must be generated before TR_Sector_Calculate() function.
-    World_GenSkeletalModels(tr);
-    Gui_DrawLoadScreen(600);
+    Perf_Call("World_WaitSkeletalModels", World_WaitJob(&models_job, 520, 600));
+    Perf_Call("World_StoreGeneratedData", World_StoreGeneratedData(&cache));
+    Perf_Call("World_GenSkeletalModelsVBO", World_GenSkeletalModelsVBO());
 
-    World_GenEntities(tr);              // Build all moveables (entities)
+    Perf_Call("World_GenEntities", World_GenEntities(tr));             // Build all moveables (entities)
     Gui_DrawLoadScreen(650);
 
-    World_GenBaseItems();               // Generate inventory item entries.
+    Perf_Call("World_GenBaseItems", World_GenBaseItems());             // Generate inventory item entries.
     Gui_DrawLoadScreen(680);
 
     // Generate sprite buffers. Only now because entity generation adds new sprites
-    World_GenSpritesBuffer();
+    Perf_Call("World_GenSpritesBuffer", World_GenSpritesBuffer());
     Gui_DrawLoadScreen(700);
 
     // Initialize audio.
-    Audio_GenSamples(tr);
+    Perf_Call("Audio_GenSamples", Audio_GenSamples(tr));
     Gui_DrawLoadScreen(750);
 
-    World_GenRoomProperties(tr);
+    Perf_Call("World_GenRoomProperties", World_GenRoomProperties(tr, &cache));
+    Perf_Call("World_GenRoomPVS", World_GenRoomPVS(&pvs_job, &cache)); // real rooms are known now
     Gui_DrawLoadScreen(800);
 
-    World_GenRoomCollision();
-    Gui_DrawLoadScreen(850);
+    Perf_Call("World_GenRoomCollision", World_GenRoomCollision());
+    // must be done before any room flipping by scripts
+    Perf_Call("World_WaitRoomPVS", World_WaitJob(&pvs_job, 820, 850));
+    Perf_Call("World_CloseCache", World_CloseCache(&cache));
+    Perf_Call("Audio_StartSamplesWarmup", Audio_StartSamplesWarmup());
 
     // Find and set skybox.
     global_world.sky_box = World_GetSkybox();
@@ -253,8 +406,8 @@ void World_Open(const char *path, int trv)
     Gui_DrawLoadScreen(940);
 
     // Process level autoexec loading.
-    Audio_Init();
-    World_AutoexecOpen();
+    Perf_Call("Audio_Init", Audio_Init());
+    Perf_Call("World_AutoexecOpen", World_AutoexecOpen());
     Gui_DrawLoadScreen(960);
 
     // Fix initial room states
@@ -326,6 +479,14 @@ void World_Clear()
         global_world.overlaps = NULL;
     }
 
+    if(global_world.box_edges_count)
+    {
+        global_world.box_edges_count = 0;
+        free(global_world.box_edges);
+        global_world.box_edges = NULL;
+    }
+    Room_ClearPathCache();
+
     if(global_world.cameras_sinks_count)
     {
         global_world.cameras_sinks_count = 0;
@@ -1100,6 +1261,7 @@ int World_SetFlipState(uint32_t flip_index, uint32_t flip_state)
 
     if(ret)
     {
+        renderer.InvalidateVisibilityCache();                                   // flipped rooms have dropped their frustums
         World_UpdateFlipCollisions();
     }
 
@@ -1303,19 +1465,220 @@ void World_SetEntityFunction(struct entity_s *ent)
     }
 }
 
+/*
+ * Cache key: any change of the stored records (layout signatures of the modules, see
+ * CacheFile_GetLayout), texture settings or the level file makes cache stale. Level file
+ * is matched by size and mtime, its crc is calculated only if mtime differs (copied or
+ * touched file), then the new mtime is kept in the cache.
+ */
+typedef struct world_cache_key_s
+{
+    uint32_t                    layout[5];
+    uint32_t                    game_version;
+    uint32_t                    texture_border;
+    uint32_t                    max_page_width;
+    uint32_t                    counts[8];
+    uint64_t                    level_size;
+    int64_t                     level_mtime;
+    uint32_t                    level_crc;
+    uint32_t                    unused;
+}world_cache_key_t;
+
+typedef struct world_cache_box_s
+{
+    uint16_t                    id;
+    uint16_t                    is_blockable;
+    float                       bb_min[3];
+    float                       bb_max[3];
+    uint32_t                    overlaps;
+    uint32_t                    edges;
+    uint32_t                    edges_count;
+    uint32_t                    in_edges;
+    uint32_t                    in_edges_count;
+    room_zone_t                 zone[2];
+}world_cache_box_t;
+
+
+/*
+ * Generated world data of the previous load is kept in the save folder. Cache is left
+ * in read mode if it matches the level, in write mode if it is absent or stale; Gen
+ * functions restore or store their sections in the order of World_Open.
+ */
+void World_OpenCache(struct cache_file_s *cache, const char *path, class VT_Level *tr)
+{
+    char cache_path[CACHE_FILE_NAME_MAX_LEN];
+    char level_name[LEVEL_NAME_MAX_LEN];
+    world_cache_key_t key, cached_key;
+    uint32_t world_layout[5] = {sizeof(world_cache_key_t), sizeof(world_cache_box_t), sizeof(box_overlap_t), sizeof(box_edge_t), sizeof(room_zone_t)};
+    int border_size = renderer.settings.texture_border;
+    int64_t level_mtime;
+
+    memset(cache, 0, sizeof(cache_file_t));
+    memset(&key, 0, sizeof(key));
+    if(!Sys_FileStat(path, &key.level_size, &key.level_mtime))
+    {
+        return;
+    }
+
+    key.layout[0] = bordered_texture_atlas::getCacheLayout();
+    key.layout[1] = BaseMesh_GetCacheLayout();
+    key.layout[2] = SkeletalModel_GetCacheLayout();
+    key.layout[3] = Room_GetCacheLayout();
+    key.layout[4] = CacheFile_GetLayout(WORLD_CACHE_VERSION, world_layout, 5);
+    key.game_version = tr->game_version;
+    border_size = (border_size < 0) ? (0) : (border_size);
+    key.texture_border = (border_size > 128) ? (128) : (border_size);
+    key.max_page_width = bordered_texture_atlas::getMaxPageWidth();
+    key.counts[0] = tr->rooms_count;
+    key.counts[1] = tr->meshes_count;
+    key.counts[2] = tr->moveables_count;
+    key.counts[3] = tr->boxes_count;
+    key.counts[4] = tr->overlaps_count;
+    key.counts[5] = tr->object_textures_count;
+    key.counts[6] = tr->sprite_textures_count;
+    key.counts[7] = tr->textile32_count;
+    level_mtime = key.level_mtime;
+
+    Engine_GetLevelName(level_name, path);
+    snprintf(cache_path, sizeof(cache_path), "%ssave/%s_%d.otc", Engine_GetBasePath(), level_name, tr->game_version);
+    if(CacheFile_OpenRead(cache, cache_path, WORLD_CACHE_MAGIC, WORLD_CACHE_VERSION))
+    {
+        size_t key_offset = CacheFile_Tell(cache);
+        CacheFile_ReadValue(cache, cached_key);
+        key.level_mtime = cached_key.level_mtime;
+        key.level_crc = cached_key.level_crc;
+        if(!cache->failed && (memcmp(&key, &cached_key, sizeof(key)) == 0))
+        {
+            if(level_mtime == cached_key.level_mtime)
+            {
+                return;
+            }
+            if(CacheFile_GetFileCRC(path) == cached_key.level_crc)
+            {
+                cached_key.level_mtime = level_mtime;
+                CacheFile_Rewrite(cache, key_offset, &cached_key, sizeof(cached_key));
+                return;
+            }
+        }
+        CacheFile_Close(cache);
+        key.level_mtime = level_mtime;
+    }
+
+    key.level_crc = CacheFile_GetFileCRC(path);
+    if(CacheFile_OpenWrite(cache, cache_path, WORLD_CACHE_MAGIC, WORLD_CACHE_VERSION))
+    {
+        CacheFile_WriteValue(cache, key);
+    }
+}
+
+
+/// Meshes, room meshes, models and boxes are written together, when models job is done.
+void World_StoreGeneratedData(struct cache_file_s *cache)
+{
+    if(cache->mode != CACHE_FILE_WRITE)
+    {
+        return;
+    }
+
+    for(uint32_t i = 0; i < global_world.meshes_count; i++)
+    {
+        BaseMesh_Store(global_world.meshes + i, cache, global_world.textures, global_world.tex_count);
+    }
+
+    for(uint32_t i = 0; i < global_world.rooms_count; i++)
+    {
+        base_mesh_p mesh = global_world.rooms[i].content->mesh;
+        uint8_t has_mesh = (mesh) ? (1) : (0);
+        CacheFile_WriteValue(cache, has_mesh);
+        if(mesh)
+        {
+            BaseMesh_Store(mesh, cache, global_world.textures, global_world.tex_count);
+        }
+    }
+
+    for(uint32_t i = 0; i < global_world.skeletal_models_count; i++)
+    {
+        SkeletalModel_Store(global_world.skeletal_models + i, cache, global_world.meshes);
+    }
+
+    CacheFile_WriteValue(cache, global_world.room_boxes_count);
+    CacheFile_WriteValue(cache, global_world.overlaps_count);
+    CacheFile_WriteValue(cache, global_world.box_edges_count);
+    CacheFile_Write(cache, global_world.overlaps, global_world.overlaps_count * sizeof(box_overlap_t));
+    CacheFile_Write(cache, global_world.box_edges, global_world.box_edges_count * sizeof(box_edge_t));
+    for(uint32_t i = 0; i < global_world.room_boxes_count; i++)
+    {
+        room_box_p r_box = global_world.room_boxes + i;
+        world_cache_box_t record;
+        record.id = r_box->id;
+        record.is_blockable = r_box->is_blockable;
+        vec3_copy(record.bb_min, r_box->bb_min);
+        vec3_copy(record.bb_max, r_box->bb_max);
+        record.overlaps = (r_box->overlaps) ? (r_box->overlaps - global_world.overlaps) : (WORLD_CACHE_NO_INDEX);
+        record.edges = (r_box->edges) ? (r_box->edges - global_world.box_edges) : (WORLD_CACHE_NO_INDEX);
+        record.edges_count = r_box->edges_count;
+        record.in_edges = (r_box->in_edges) ? (r_box->in_edges - global_world.box_edges) : (WORLD_CACHE_NO_INDEX);
+        record.in_edges_count = r_box->in_edges_count;
+        record.zone[0] = r_box->zone[0];
+        record.zone[1] = r_box->zone[1];
+        CacheFile_WriteValue(cache, record);
+    }
+}
+
+
+/// PVS is the last section, cache is saved here if it was written.
+void World_CloseCache(struct cache_file_s *cache)
+{
+    if(cache->mode == CACHE_FILE_WRITE)
+    {
+        for(uint32_t i = 0; i < global_world.rooms_count; i++)
+        {
+            Room_StorePVS(global_world.rooms + i, cache, global_world.rooms_count);
+        }
+        if(!CacheFile_Close(cache))
+        {
+            Sys_DebugLog(SYS_LOG_FILENAME, "Can not write world cache \"%s\"", cache->name);
+        }
+    }
+    else
+    {
+        CacheFile_Close(cache);
+    }
+}
+
+
 // Functions setting parameters from configuration scripts.
-void World_GenTextures(class VT_Level *tr)
+void World_GenTextures(class VT_Level *tr, struct cache_file_s *cache)
 {
     int border_size = renderer.settings.texture_border;
     border_size = (border_size < 0) ? (0) : (border_size);
     border_size = (border_size > 128) ? (128) : (border_size);
-    global_world.tex_atlas = new bordered_texture_atlas(border_size,
-                                                  tr->textile32_count,
-                                                  tr->textile32,
-                                                  tr->object_textures_count,
-                                                  tr->object_textures,
-                                                  tr->sprite_textures_count,
-                                                  tr->sprite_textures);
+    global_world.tex_atlas = NULL;
+    if(cache->mode == CACHE_FILE_READ)
+    {
+        global_world.tex_atlas = new bordered_texture_atlas(border_size, tr->textile32_count, tr->textile32, cache);
+        if(cache->failed)
+        {
+            delete global_world.tex_atlas;
+            global_world.tex_atlas = NULL;
+            CacheFile_Discard(cache);
+        }
+    }
+
+    if(!global_world.tex_atlas)
+    {
+        global_world.tex_atlas = new bordered_texture_atlas(border_size,
+                                                      tr->textile32_count,
+                                                      tr->textile32,
+                                                      tr->object_textures_count,
+                                                      tr->object_textures,
+                                                      tr->sprite_textures_count,
+                                                      tr->sprite_textures);
+        if(cache->mode == CACHE_FILE_WRITE)
+        {
+            global_world.tex_atlas->storeLayout(cache);
+        }
+    }
 
     global_world.tex_count = (uint32_t) global_world.tex_atlas->getNumAtlasPages();
     global_world.textures = (GLuint*)malloc(global_world.tex_count * sizeof(GLuint));
@@ -1469,16 +1832,58 @@ void World_GenAnimTextures(class VT_Level *tr)
 }
 
 
-void World_GenMeshes(class VT_Level *tr)
+static void World_GenMeshJob(void *data, uint32_t index)
+{
+    base_mesh_p base_mesh = global_world.meshes + index;
+    TR_GenMesh(base_mesh, index, global_world.anim_sequences, global_world.anim_sequences_count, global_world.tex_atlas, (VT_Level*)data);
+    BaseMesh_GenFaces(base_mesh);
+}
+
+
+static void World_GenMeshFacesJob(void *data, uint32_t index)
 {
-    base_mesh_p base_mesh;
+    (void)data;
+    BaseMesh_GenFaces(global_world.meshes + index);
+}
+
 
+/// Cached meshes are restored here, job makes only their faces.
+void World_GenMeshes(class VT_Level *tr, struct job_s *job, struct cache_file_s *cache)
+{
     global_world.meshes_count = tr->meshes_count;
-    base_mesh = global_world.meshes = (base_mesh_p)calloc(global_world.meshes_count, sizeof(base_mesh_t));
+    global_world.meshes = (base_mesh_p)calloc(global_world.meshes_count, sizeof(base_mesh_t));
+    if(cache->mode == CACHE_FILE_READ)
+    {
+        for(uint32_t i = 0; (i < global_world.meshes_count) && !cache->failed; i++)
+        {
+            BaseMesh_Restore(global_world.meshes + i, cache, global_world.textures, global_world.tex_count);
+        }
+        if(!cache->failed)
+        {
+            Job_Init(job, World_GenMeshFacesJob, NULL, global_world.meshes_count);
+            Job_Submit(job);
+            return;
+        }
+        for(uint32_t i = 0; i < global_world.meshes_count; i++)
+        {
+            BaseMesh_Clear(global_world.meshes + i);
+        }
+        memset(global_world.meshes, 0, global_world.meshes_count * sizeof(base_mesh_t));
+        CacheFile_Discard(cache);
+    }
+
+    tr->read_meshes();
+    Job_Init(job, World_GenMeshJob, tr, global_world.meshes_count);
+    Job_Submit(job);
+}
+
+
+void World_GenMeshesVBO()
+{
+    base_mesh_p base_mesh = global_world.meshes;
     for(uint32_t i = 0; i < global_world.meshes_count; i++, base_mesh++)
     {
-        TR_GenMesh(base_mesh, i, global_world.anim_sequences, global_world.anim_sequences_count, global_world.tex_atlas, tr);
-        BaseMesh_GenFaces(base_mesh);
+        BaseMesh_GenVBO(base_mesh);
     }
 }
 
@@ -1520,8 +1925,84 @@ void World_GenSprites(class VT_Level *tr)
 }
 
 
-void World_GenBoxes(class VT_Level *tr)
+static int World_RestoreBoxes(struct cache_file_s *cache)
 {
+    uint32_t boxes_count = 0;
+    CacheFile_ReadValue(cache, boxes_count);
+    CacheFile_ReadValue(cache, global_world.overlaps_count);
+    CacheFile_ReadValue(cache, global_world.box_edges_count);
+    if(cache->failed || (boxes_count != global_world.room_boxes_count))
+    {
+        cache->failed = 1;
+        return 0;
+    }
+
+    global_world.overlaps = (box_overlap_p)CacheFile_ReadArray(cache, global_world.overlaps_count, sizeof(box_overlap_t));
+    global_world.box_edges = (box_edge_p)CacheFile_ReadArray(cache, global_world.box_edges_count, sizeof(box_edge_t));
+    for(uint32_t i = 0; !cache->failed && (i < global_world.box_edges_count); i++)
+    {
+        cache->failed = (global_world.box_edges[i].box >= global_world.room_boxes_count);
+    }
+    if(global_world.room_boxes_count && !cache->failed)
+    {
+        global_world.room_boxes = (room_box_p)malloc(global_world.room_boxes_count * sizeof(room_box_t));
+    }
+    for(uint32_t i = 0; !cache->failed && (i < global_world.room_boxes_count); i++)
+    {
+        room_box_p r_box = global_world.room_boxes + i;
+        world_cache_box_t record;
+        CacheFile_ReadValue(cache, record);
+        if(((record.overlaps != WORLD_CACHE_NO_INDEX) && (record.overlaps >= global_world.overlaps_count)) ||
+           ((record.edges != WORLD_CACHE_NO_INDEX) && ((record.edges > global_world.box_edges_count) || (record.edges_count > global_world.box_edges_count - record.edges))) ||
+           ((record.in_edges != WORLD_CACHE_NO_INDEX) && ((record.in_edges > global_world.box_edges_count) || (record.in_edges_count > global_world.box_edges_count - record.in_edges))))
+        {
+            cache->failed = 1;
+            break;
+        }
+        r_box->id = record.id;
+        r_box->is_blockable = record.is_blockable;
+        r_box->is_blocked = 0x00;
+        vec3_copy(r_box->bb_min, record.bb_min);
+        vec3_copy(r_box->bb_max, record.bb_max);
+        r_box->overlaps = (record.overlaps != WORLD_CACHE_NO_INDEX) ? (global_world.overlaps + record.overlaps) : (NULL);
+        r_box->edges = (record.edges != WORLD_CACHE_NO_INDEX) ? (global_world.box_edges + record.edges) : (NULL);
+        r_box->edges_count = (r_box->edges) ? (record.edges_count) : (0);
+        r_box->in_edges = (record.in_edges != WORLD_CACHE_NO_INDEX) ? (global_world.box_edges + record.in_edges) : (NULL);
+        r_box->in_edges_count = (r_box->in_edges) ? (record.in_edges_count) : (0);
+        r_box->zone[0] = record.zone[0];
+        r_box->zone[1] = record.zone[1];
+    }
+
+    if(cache->failed)
+    {
+        free(global_world.overlaps);
+        free(global_world.box_edges);
+        free(global_world.room_boxes);
+        global_world.overlaps = NULL;
+        global_world.overlaps_count = 0;
+        global_world.box_edges = NULL;
+        global_world.box_edges_count = 0;
+        global_world.room_boxes = NULL;
+        return 0;
+    }
+    Room_ClearPathCache();
+
+    return 1;
+}
+
+
+void World_GenBoxes(class VT_Level *tr, struct cache_file_s *cache)
+{
+    global_world.room_boxes_count = tr->boxes_count;
+    if(cache->mode == CACHE_FILE_READ)
+    {
+        if(World_RestoreBoxes(cache))
+        {
+            return;
+        }
+        CacheFile_Discard(cache);
+    }
+
     global_world.overlaps = NULL;
     global_world.overlaps_count = tr->overlaps_count;
 
@@ -1576,7 +2057,78 @@ void World_GenBoxes(class VT_Level *tr)
             r_box->zone[1].GroundZone4 = tr->zones[i].GroundZone4_Alternate;
             r_box->zone[1].FlyZone = tr->zones[i].FlyZone_Alternate;
         }
+
+        /*
+         * Path search adjacency: one flat array, every box owns a continuous range of it
+         * with the overlap centers already computed. Incoming edges follow the outgoing ones.
+         */
+        global_world.box_edges_count = 0;
+        for(uint32_t i = 0; i < global_world.room_boxes_count; i++)
+        {
+            room_box_p r_box = global_world.room_boxes + i;
+            r_box->edges = NULL;
+            r_box->edges_count = 0;
+            r_box->in_edges = NULL;
+            r_box->in_edges_count = 0;
+        }
+        for(uint32_t i = 0; i < global_world.room_boxes_count; i++)
+        {
+            room_box_p r_box = global_world.room_boxes + i;
+            for(box_overlap_p ov = r_box->overlaps; ov; ov++)
+            {
+                if(ov->box < global_world.room_boxes_count)
+                {
+                    r_box->edges_count++;
+                    global_world.room_boxes[ov->box].in_edges_count++;
+                }
+                if(ov->end)
+                {
+                    break;
+                }
+            }
+            global_world.box_edges_count += 2 * r_box->edges_count;
+        }
+
+        if(global_world.box_edges_count)
+        {
+            box_edge_p edge = (box_edge_p)malloc(global_world.box_edges_count * sizeof(box_edge_t));
+            box_edge_p in_edge = edge + global_world.box_edges_count / 2;
+            global_world.box_edges = edge;
+            for(uint32_t i = 0; i < global_world.room_boxes_count; i++)
+            {
+                room_box_p r_box = global_world.room_boxes + i;
+                r_box->in_edges = (r_box->in_edges_count) ? (in_edge) : (NULL);
+                in_edge += r_box->in_edges_count;
+                r_box->in_edges_count = 0;                                      // refilled below
+            }
+            for(uint32_t i = 0; i < global_world.room_boxes_count; i++)
+            {
+                room_box_p r_box = global_world.room_boxes + i;
+                r_box->edges = (r_box->edges_count) ? (edge) : (NULL);
+                for(box_overlap_p ov = r_box->overlaps; r_box->edges_count && ov; ov++)
+                {
+                    if(ov->box < global_world.room_boxes_count)
+                    {
+                        float center[3];
+                        Room_GetOverlapCenter(r_box, global_world.room_boxes + ov->box, center);
+                        edge->box = ov->box;
+                        edge->unused = 0;
+                        edge->center[0] = center[0];
+                        edge->center[1] = center[1];
+                        room_box_p next_box = global_world.room_boxes + ov->box;
+                        next_box->in_edges[next_box->in_edges_count] = *edge;
+                        next_box->in_edges[next_box->in_edges_count++].box = i;
+                        edge++;
+                    }
+                    if(ov->end)
+                    {
+                        break;
+                    }
+                }
+            }
+        }
     }
+    Room_ClearPathCache();
 }
 
 
@@ -1712,7 +2264,6 @@ void World_GenRoom(struct room_s *room, class VT_Level *tr)
     room->self->collision_shape = COLLISION_SHAPE_TRIMESH;
     room->self->object_type = OBJECT_ROOM_BASE;
 
-    room->content = (room_content_p)malloc(sizeof(room_content_t));
     room->original_content = room->content;
     room->content->original_room_id = room->id;
     room->content->room_flags = tr->rooms[room->id].flags;
@@ -1722,7 +2273,6 @@ void World_GenRoom(struct room_s *room, class VT_Level *tr)
     room->content->overlapped_room_list = NULL;
     room->content->physics_body = NULL;
     room->content->physics_alt_tween = NULL;
-    room->content->mesh = NULL;
     room->content->static_mesh = NULL;
     room->content->sprites = NULL;
     room->content->sprites_vertices = NULL;
@@ -1736,10 +2286,9 @@ void World_GenRoom(struct room_s *room, class VT_Level *tr)
     room->content->ambient_lighting[1] = tr->rooms[room->id].light_colour.g * 2;
     room->content->ambient_lighting[2] = tr->rooms[room->id].light_colour.b * 2;
 
-    TR_GenRoomMesh(room, room->id, global_world.anim_sequences, global_world.anim_sequences_count, global_world.tex_atlas, tr);
     if(room->content->mesh)
     {
-        BaseMesh_GenFaces(room->content->mesh);
+        BaseMesh_GenVBO(room->content->mesh);
     }
     /*
      * let us load sectors
@@ -2091,14 +2640,85 @@ void World_GenRoom(struct room_s *room, class VT_Level *tr)
 }
 
 
-void World_GenRooms(class VT_Level *tr)
+static void World_GenRoomMeshJob(void *data, uint32_t index)
+{
+    room_p room = global_world.rooms + index;
+    room->id = index;
+    room->content = (room_content_p)calloc(1, sizeof(room_content_t));
+    TR_GenRoomMesh(room, index, global_world.anim_sequences, global_world.anim_sequences_count, global_world.tex_atlas, (VT_Level*)data);
+    if(room->content->mesh)
+    {
+        BaseMesh_GenFaces(room->content->mesh);
+    }
+}
+
+
+static void World_GenRoomFacesJob(void *data, uint32_t index)
+{
+    room_p room = global_world.rooms + index;
+    (void)data;
+    if(room->content->mesh)
+    {
+        BaseMesh_GenFaces(room->content->mesh);
+    }
+}
+
+
+/// Cached room meshes are restored here, job makes only their faces.
+void World_GenRoomMeshes(class VT_Level *tr, struct job_s *job, struct cache_file_s *cache)
 {
     global_world.rooms_count = tr->rooms_count;
-    room_p r = global_world.rooms = (room_p)malloc(global_world.rooms_count * sizeof(room_t));
+    global_world.rooms = (room_p)malloc(global_world.rooms_count * sizeof(room_t));
+    if(cache->mode == CACHE_FILE_READ)
+    {
+        uint32_t restored_count = 0;
+        for(; (restored_count < global_world.rooms_count) && !cache->failed; restored_count++)
+        {
+            room_p room = global_world.rooms + restored_count;
+            uint8_t has_mesh = 0;
+            room->id = restored_count;
+            room->content = (room_content_p)calloc(1, sizeof(room_content_t));
+            if(CacheFile_ReadValue(cache, has_mesh) && has_mesh)
+            {
+                room->content->mesh = (base_mesh_p)calloc(1, sizeof(base_mesh_t));
+                BaseMesh_Restore(room->content->mesh, cache, global_world.textures, global_world.tex_count);
+            }
+        }
+        if(!cache->failed)
+        {
+            Job_Init(job, World_GenRoomFacesJob, NULL, global_world.rooms_count);
+            Job_Submit(job);
+            return;
+        }
+        for(uint32_t i = 0; i < restored_count; i++)
+        {
+            room_content_p content = global_world.rooms[i].content;
+            if(content->mesh)
+            {
+                BaseMesh_Clear(content->mesh);
+                free(content->mesh);
+            }
+            free(content);
+        }
+        CacheFile_Discard(cache);
+    }
+
+    Job_Init(job, World_GenRoomMeshJob, tr, global_world.rooms_count);
+    Job_Submit(job);
+}
+
+
+/// Room meshes must be already generated by World_GenRoomMeshes() job.
+void World_GenRooms(class VT_Level *tr)
+{
+    room_p r = global_world.rooms;
     for(uint32_t i = 0; i < global_world.rooms_count; i++, r++)
     {
-        r->id = i;
         World_GenRoom(r, tr);
+        if(renderer.settings.static_batching)
+        {
+            Room_GenStaticBatch(r);
+        }
     }
 }
 
@@ -2116,22 +2736,94 @@ void World_GenRoomFlipMap()
 }
 
 
-void World_GenSkeletalModels(class VT_Level *tr)
+static void World_GenSkeletalModelJob(void *data, uint32_t index)
+{
+    VT_Level *tr = (VT_Level*)data;
+    skeletal_model_p smodel = global_world.skeletal_models + index;
+    tr_moveable_t *tr_moveable = &tr->moveables[index];
+
+    smodel->id = tr_moveable->object_id;
+    smodel->mesh_count = tr_moveable->num_meshes;
+    TR_GenSkeletalModel(smodel, index, global_world.meshes, tr);
+    SkeletalModel_PackAnims(smodel);
+    SkeletalModel_FillTransparency(smodel);
+    SkeletalModel_GenPaletteMesh(smodel);
+}
+
+
+static void World_GenSkeletalModelMeshJob(void *data, uint32_t index)
 {
-    skeletal_model_p smodel;
-    tr_moveable_t *tr_moveable;
+    skeletal_model_p smodel = global_world.skeletal_models + index;
+    (void)data;
+    SkeletalModel_FillTransparency(smodel);
+    SkeletalModel_GenPaletteMesh(smodel);
+}
 
+
+/// Models refer base meshes faces, so job starts after meshes_job. Cached models are restored here.
+void World_GenSkeletalModels(class VT_Level *tr, struct job_s *job, struct job_s *meshes_job, struct cache_file_s *cache)
+{
     global_world.skeletal_models_count = tr->moveables_count;
-    smodel = global_world.skeletal_models = (skeletal_model_p)calloc(global_world.skeletal_models_count, sizeof(skeletal_model_t));
+    global_world.skeletal_models = (skeletal_model_p)calloc(global_world.skeletal_models_count, sizeof(skeletal_model_t));
+    if(cache->mode == CACHE_FILE_READ)
+    {
+        for(uint32_t i = 0; (i < global_world.skeletal_models_count) && !cache->failed; i++)
+        {
+            SkeletalModel_Restore(global_world.skeletal_models + i, cache, global_world.meshes, global_world.meshes_count);
+        }
+        if(!cache->failed)
+        {
+            Job_Init(job, World_GenSkeletalModelMeshJob, NULL, global_world.skeletal_models_count);
+            Job_AddDependency(job, meshes_job);
+            Job_Submit(job);
+            return;
+        }
+        for(uint32_t i = 0; i < global_world.skeletal_models_count; i++)
+        {
+            SkeletalModel_Clear(global_world.skeletal_models + i);
+        }
+        memset(global_world.skeletal_models, 0, global_world.skeletal_models_count * sizeof(skeletal_model_t));
+        CacheFile_Discard(cache);
+    }
+
+    Job_Init(job, World_GenSkeletalModelJob, tr, global_world.skeletal_models_count);
+    Job_AddDependency(job, meshes_job);
+    Job_Submit(job);
+}
+
 
+void World_GenSkeletalModelsVBO()
+{
+    skeletal_model_p smodel = global_world.skeletal_models;
+    size_t frames_size = 0;
+    size_t packed_size = 0;
     for(uint32_t i = 0; i < global_world.skeletal_models_count; i++, smodel++)
     {
-        tr_moveable = &tr->moveables[i];
-        smodel->id = tr_moveable->object_id;
-        smodel->mesh_count = tr_moveable->num_meshes;
-        TR_GenSkeletalModel(smodel, i, global_world.meshes, tr);
-        SkeletalModel_FillTransparency(smodel);
+        if(smodel->palette_mesh)
+        {
+            BaseMesh_GenVBO(smodel->palette_mesh);
+        }
+        SkeletalModel_GetAnimsSize(smodel, &frames_size, &packed_size);
+    }
+    Sys_DebugLog(SYS_LOG_FILENAME, "Animation keys: %u KB packed, %u KB unpacked", (uint32_t)(packed_size / 1024), (uint32_t)(frames_size / 1024));
+}
+
+
+/// Helps job threads and keeps load screen alive until the job is done.
+void World_WaitJob(struct job_s *job, int progress_from, int progress_to)
+{
+    float next_draw_time = 0.0f;
+
+    while(!Job_WaitStep(job))
+    {
+        float time = Sys_FloatTime();
+        if(time >= next_draw_time)
+        {
+            Gui_DrawLoadScreen(progress_from + (progress_to - progress_from) * Job_GetProgress(job));
+            next_draw_time = time + 1.0f / 30.0f;
+        }
     }
+    Gui_DrawLoadScreen(progress_to);
 }
 
 
@@ -2323,7 +3015,7 @@ static room_p WorldRoom_FindRealRoomInSequence(room_p room)
 }
 
 
-void World_GenRoomProperties(class VT_Level *tr)
+void World_GenRoomProperties(class VT_Level *tr, struct cache_file_s *cache)
 {
     for(uint32_t i = 0; i < global_world.rooms_count; i++)
     {
@@ -2365,11 +3057,31 @@ void World_GenRoomProperties(class VT_Level *tr)
     for(uint32_t i = 0; i < global_world.rooms_count; i++)
     {
         room_p r = global_world.rooms + i;
-        // Fill heightmap and translate floordata.
+        // Cached sectors are taken as they were after floordata translation and sector calculations.
+        if((cache->mode == CACHE_FILE_READ) && !Room_RestoreSectors(r, cache, global_world.rooms, global_world.rooms_count))
+        {
+            CacheFile_Discard(cache);
+        }
+
+        if(cache->mode != CACHE_FILE_READ)
+        {
+            // Fill heightmap and translate floordata.
+            for(uint32_t j = 0; j < r->sectors_count; j++)
+            {
+                Res_Sector_TranslateFloorData(global_world.rooms, global_world.rooms_count, r->content->sectors + j, tr);
+            }
+
+            // Basic sector calculations.
+            Res_RoomSectorsCalculate(global_world.rooms, global_world.rooms_count, i, tr);
+            if(cache->mode == CACHE_FILE_WRITE)
+            {
+                Room_StoreSectors(r, cache, global_world.rooms);
+            }
+        }
+
         for(uint32_t j = 0; j < r->sectors_count; j++)
         {
             room_sector_p rs = r->content->sectors + j;
-            Res_Sector_TranslateFloorData(global_world.rooms, global_world.rooms_count, rs, tr);
             for(trigger_command_p cmd = (rs->trigger) ? (rs->trigger->commands) : (NULL); cmd; cmd = cmd->next)
             {
                 if(cmd->function == TR_FD_TRIGFUNC_PLAYTRACK)
@@ -2378,9 +3090,6 @@ void World_GenRoomProperties(class VT_Level *tr)
                 }
             }
         }
-
-        // Basic sector calculations.
-        Res_RoomSectorsCalculate(global_world.rooms, global_world.rooms_count, i, tr);
     }
 
     for(uint32_t i = 0; i < global_world.rooms_count; i++)
@@ -2399,6 +3108,44 @@ void World_GenRoomProperties(class VT_Level *tr)
             Room_AddToNearRoomsList(r->content->near_room_list[j], r);
         }
     }
+
+    for(uint32_t i = 0; i < global_world.rooms_count; i++)
+    {
+        // Entities are lit by the lights selected for their sector.
+        Room_GenSectorLights(global_world.rooms + i);
+    }
+}
+
+
+static void World_GenRoomPVSJob(void *data, uint32_t index)
+{
+    (void)data;
+    Room_GenPVS(global_world.rooms + index, global_world.rooms_count);
+}
+
+
+/// Every room (alternate rooms too) gets the set of rooms that may be seen through its portals.
+void World_GenRoomPVS(struct job_s *job, struct cache_file_s *cache)
+{
+    uint32_t count = global_world.rooms_count;
+    if(cache->mode == CACHE_FILE_READ)
+    {
+        for(uint32_t i = 0; (i < global_world.rooms_count) && !cache->failed; i++)
+        {
+            Room_RestorePVS(global_world.rooms + i, cache, global_world.rooms_count);
+        }
+        if(cache->failed)
+        {
+            CacheFile_Discard(cache);
+        }
+        else
+        {
+            count = 0;                                                          // job is done at once
+        }
+    }
+
+    Job_Init(job, World_GenRoomPVSJob, NULL, count);
+    Job_Submit(job);
 }
 
 
@@ -11,6 +11,7 @@
 
 void World_Prepare();
 void World_Open(const char *path, int trv);
+void World_PreloadLevel(const char *path, int trv);     // path == NULL: drop preloaded data
 void World_Clear();
 int  World_GetVersion();
 